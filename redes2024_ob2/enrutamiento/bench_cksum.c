@@ -0,0 +1,155 @@
+/*-----------------------------------------------------------------------------
+ * file:  bench_cksum.c
+ *
+ * Descripción:
+ *
+ * Microbenchmark de las implementaciones del checksum de Internet
+ * (cksum_ref, cksum_wide, cksum_avx2 y el despachador cksum) para largos
+ * de paquete entre 20 y 9000 bytes. Antes de medir verifica que todas las
+ * versiones den el mismo resultado que la de referencia.
+ *
+ * Uso: ./bench_cksum [iteraciones]
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+
+#define BENCH_DEFAULT_BYTES (256 * 1024 * 1024) /* bytes a procesar por caso */
+#define BENCH_MAX_LEN 9000
+
+struct cksum_impl
+{
+    const char* name;
+    uint16_t (*fn)(const void*, int);
+};
+
+static const int g_sizes[] = { 20, 28, 64, 128, 256, 576, 1024, 1500, 4096, 9000 };
+
+/* Evita que el compilador descarte los resultados */
+static volatile uint16_t g_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Compara cada implementacion contra cksum_ref para todos los largos y
+   desplazamientos (alineados y no alineados) hasta BENCH_MAX_LEN */
+static int verify(const struct cksum_impl* impls, int n_impls, uint8_t* buf)
+{
+    int len, off, i;
+
+    for (off = 0; off < 4; off++)
+    {
+        for (len = 0; len <= BENCH_MAX_LEN; len++)
+        {
+            uint16_t expected = cksum_ref(buf + off, len);
+            for (i = 0; i < n_impls; i++)
+            {
+                uint16_t got = impls[i].fn(buf + off, len);
+                if (got != expected)
+                {
+                    fprintf(stderr, "bench_cksum: %s differs from cksum_ref "
+                            "(len %d, offset %d): 0x%04x != 0x%04x\n",
+                            impls[i].name, len, off, got, expected);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    struct cksum_impl impls[] = {
+        { "cksum_ref",  cksum_ref },
+        { "cksum_wide", cksum_wide },
+        { "cksum_avx2", cksum_avx2 },
+        { "cksum",      cksum }
+    };
+    int n_impls = sizeof(impls) / sizeof(impls[0]);
+    long iterations = 0;
+    uint8_t* buf;
+    unsigned int s;
+    int i;
+
+    if (argc > 1)
+    {
+        iterations = atol(argv[1]);
+    }
+
+    /* Datos aleatorios, con margen para probar desplazamientos no alineados */
+    buf = malloc(BENCH_MAX_LEN + 4);
+    srand(1);
+    for (i = 0; i < BENCH_MAX_LEN + 4; i++)
+    {
+        buf[i] = rand() & 0xff;
+    }
+
+    if (!cksum_avx2_supported())
+    {
+        printf("AVX2 not supported by this CPU, cksum_avx2 falls back to cksum_wide\n");
+    }
+
+    if (verify(impls, n_impls, buf) != 0)
+    {
+        return 1;
+    }
+
+    printf("%-8s", "bytes");
+    for (i = 0; i < n_impls; i++)
+    {
+        printf("%14s", impls[i].name);
+    }
+    printf("%14s\n", "speedup");
+
+    for (s = 0; s < sizeof(g_sizes) / sizeof(g_sizes[0]); s++)
+    {
+        int len = g_sizes[s];
+        long n = iterations > 0 ? iterations : BENCH_DEFAULT_BYTES / len;
+        double ns_ref = 0, ns_best = 0;
+
+        printf("%-8d", len);
+        for (i = 0; i < n_impls; i++)
+        {
+            long k;
+            double start, ns;
+
+            /* Calentamiento */
+            for (k = 0; k < n / 10 + 1; k++)
+            {
+                g_sink = impls[i].fn(buf, len);
+            }
+
+            start = now_ns();
+            for (k = 0; k < n; k++)
+            {
+                g_sink = impls[i].fn(buf, len);
+            }
+            ns = (now_ns() - start) / n;
+
+            if (i == 0 || ns < ns_best)
+            {
+                ns_best = ns;
+            }
+            if (i == 0)
+            {
+                ns_ref = ns;
+            }
+            printf("%11.1f ns", ns);
+        }
+        printf("%13.1fx\n", ns_ref / ns_best);
+    }
+
+    free(buf);
+    return 0;
+}
@@ -1,203 +1,1560 @@
+#define SR_LOG_SUBSYS sr_sub_spf
+
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 
 #include "dijkstra.h"
 #include "pwospf_topology.h"
+#include "sr_pwospf.h"
 #include "sr_rt.h"
 
+/*
+ * Dijkstra sobre el grafo de routers de la topologia, incremental.
+ *
+ * Cada entrada (R, N, M, X) de la topologia es un prefijo N/M que anuncia
+ * el router R y, si X != 0, un enlace R -> X. Los routers se numeran con
+ * una hash de router id a indice que se mantiene entre corridas y los
+ * enlaces quedan en arreglos contiguos (off/adj/cost, los enlaces de v son
+ * adj[off[v] .. off[v + 1]), ordenados y sin repetir). El arbol se arma
+ * con un heap binario y el primer salto de cada router se hereda del
+ * padre; cada prefijo sale con el primer salto del router mas cercano que
+ * lo anuncia.
+ *
+ * La topologia no registra que cambio, asi que cada corrida vuelve a
+ * armar el grafo, que es lineal y sin heap, y lo compara con el de la
+ * corrida anterior:
+ *
+ *  - un enlace que desaparecio y era del arbol invalida el subarbol que
+ *    colgaba de el, que se vuelve a calcular sembrado desde los routers
+ *    que no cambiaron;
+ *  - un enlace nuevo se relaja y, si mejora algo, Dijkstra sigue desde ahi;
+ *  - solo se vuelven a evaluar los prefijos que cambiaron de anunciantes
+ *    o que anuncia un router cuya distancia o primer salto cambio, y en la
+ *    tabla se tocan solo esas rutas.
+ *
+ * Los empates se rompen siempre igual (distancia del padre y despues
+ * router id mas chico, tanto para el padre como para el anunciante de un
+ * prefijo), asi que el resultado no depende del orden del recorrido y el
+ * incremental da lo mismo que una corrida completa. Con "spf verify on"
+ * cada corrida incremental se compara contra una completa.
+ *
+ * La corrida es completa la primera vez, cuando se pide con "spf full",
+ * cuando cambia la instancia o el router id, y cuando cambio mucho: mas
+ * de 1/8 de los enlaces, o un subarbol a recalcular con mas de la mitad
+ * de los routers.
+ */
+
+#define SPF_NONE 0xffffffffu       /* indice invalido */
+#define SPF_INF  0xffffffffu       /* distancia de un router no alcanzable */
+#define SPF_LINK_COST 1            /* PWOSPF no anuncia costos: un salto */
+
+struct spf_graph
+{
+    uint32_t nnodes;
+    uint32_t nedges;
+    uint32_t* off;                 /* salientes, nnodes + 1 */
+    uint32_t* adj;
+    uint32_t* cost;
+    uint32_t* roff;                /* entrantes, igual */
+    uint32_t* radj;
+    uint32_t* rcost;
+};
+
+struct spf_tree
+{
+    uint32_t* dist;
+    uint32_t* parent;
+    struct sr_if** hop_if;         /* primer salto */
+    uint32_t* hop_gw;
+};
+
+struct spf_prefix
+{
+    uint32_t net;
+    uint32_t mask;
+    uint32_t aoff;                 /* anunciantes: ann[aoff .. aoff + acnt) */
+    uint32_t acnt;
+    struct sr_if* iface;           /* ruta instalada, 0 si no hay */
+    uint32_t gw;
+};
+
+struct spf_prefixes
+{
+    uint32_t n;
+    struct spf_prefix* p;
+    uint32_t* ann;                 /* indices de router, ordenados por prefijo */
+    uint32_t* hash;                /* indice+1 por net/mask, 0 libre */
+    uint32_t hmask;
+};
+
+/* Lo que queda de una corrida para la siguiente. Los arreglos por router
+   tienen lugar para cap routers; las marcas valen si son iguales al
+   numero de corrida en curso */
+struct spf_state
+{
+    int valid;
+    struct sr_instance* sr;
+    struct pwospf_lsdb* topology;
+    uint32_t me;
+    uint32_t run;
+    uint32_t cap;
+    uint32_t nnodes;
+    uint32_t* rid;
+    uint32_t* hash;                /* indice+1 por router id, 0 libre */
+    uint32_t hmask;
+    struct spf_tree t;
+    uint32_t* fstamp;              /* cerrado por Dijkstra */
+    uint32_t* tstamp;              /* tocado: odist/ohop guardan lo anterior */
+    uint32_t* astamp;              /* en el subarbol invalidado */
+    uint32_t* cstamp;              /* cambio su distancia o su primer salto */
+    uint32_t* odist;
+    struct sr_if** ohop_if;
+    uint32_t* ohop_gw;
+    struct spf_graph g;            /* grafo de la ultima corrida */
+    struct sr_if** link_if;        /* enlace propio hacia cada vecino, g.nnodes */
+    uint32_t* link_gw;
+    struct spf_prefixes px;
+};
+
+static pthread_mutex_t g_spf_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spf_state g_spf;
+static int g_spf_verify;
+static int g_spf_force_full;
+
+/* Rutas que cambio cada corrida, acumuladas (dijkstra_print_stats) */
+static unsigned long g_spf_runs;
+static unsigned long g_spf_full_runs;
+static unsigned long g_spf_verified;
+static unsigned long g_spf_mismatches;
+static int g_spf_last_full;
+static uint32_t g_spf_last_nodes[2];     /* recalculados, total */
+static uint32_t g_spf_last_prefixes[2];  /* evaluados, total */
+static struct sr_rt_diff g_spf_total;
+static struct sr_rt_diff g_spf_last;
+static uint64_t g_spf_time_last;          /* duracion de las corridas, ns */
+static uint64_t g_spf_time_max;
+static uint64_t g_spf_time_total;
+
+/* Planificador: un solo hilo corre Dijkstra, cuando vence "due". Los
+   pedidos que llegan mientras hay una corrida pendiente se suman a esa */
+struct spf_sched
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int pending;
+    uint64_t due;                  /* ns de CLOCK_MONOTONIC */
+    uint64_t first;                /* primer pedido de la corrida pendiente */
+    uint64_t last_run;             /* inicio de la ultima corrida */
+    uint32_t hold_ms;              /* espera minima entre corridas, ahora */
+    dijkstra_param_t param;        /* el ultimo pedido */
+    unsigned long triggers;
+    unsigned long coalesced;
+    unsigned long runs;
+    uint64_t wait_last;            /* del primer pedido a la corrida */
+    uint64_t wait_max;
+};
+
+static struct spf_sched g_sched = { PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t spf_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Las direcciones estan en orden de red: lo que varia queda en los bits
+   altos, asi que se mezcla todo antes de quedarse con los bajos */
+static uint32_t spf_hash(uint32_t a, uint32_t b)
+{
+    uint32_t h = a ^ (b * 0x9e3779b1u);
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    return h ^ (h >> 16);
+}
+
+static uint32_t spf_table_size(uint32_t n)
+{
+    uint32_t size = 16;
+
+    while (size < 2 * n)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+static void spf_hash_insert(struct spf_state* st, uint32_t v)
+{
+    uint32_t h = spf_hash(st->rid[v], 0) & st->hmask;
+
+    while (st->hash[h] != 0)
+    {
+        h = (h + 1) & st->hmask;
+    }
+    st->hash[h] = v + 1;
+}
+
 /*---------------------------------------------------------------------
- * Method: run_dijkstra
+ * Method: spf_grow
  *
- * Run Dijkstra algorithm
+ * Agranda los arreglos por router para que entren need routers. Los
+ * lugares nuevos quedan no alcanzables y sin marcas. La hash de router
+ * ids se arma de nuevo con el doble de lugares que routers.
  *
  *---------------------------------------------------------------------*/
 
-void* run_dijkstra(void* arg)
+static void spf_grow(struct spf_state* st, uint32_t need)
 {
-    dijkstra_param_t* dij_param = ((dijkstra_param_t*)(arg));
+    uint32_t cap = st->cap != 0 ? st->cap : 64;
+    uint32_t v;
 
-    pthread_mutex_t mutex = dij_param->mutex;
-    struct pwospf_topology_entry* topology = dij_param->topology;
-    struct in_addr router_id = dij_param->rid;
+    if (need <= st->cap)
+    {
+        return;
+    }
+    while (cap < need)
+    {
+        cap <<= 1;
+    }
+    st->rid = realloc(st->rid, cap * sizeof(uint32_t));
+    st->t.dist = realloc(st->t.dist, cap * sizeof(uint32_t));
+    st->t.parent = realloc(st->t.parent, cap * sizeof(uint32_t));
+    st->t.hop_if = realloc(st->t.hop_if, cap * sizeof(struct sr_if*));
+    st->t.hop_gw = realloc(st->t.hop_gw, cap * sizeof(uint32_t));
+    st->fstamp = realloc(st->fstamp, cap * sizeof(uint32_t));
+    st->tstamp = realloc(st->tstamp, cap * sizeof(uint32_t));
+    st->astamp = realloc(st->astamp, cap * sizeof(uint32_t));
+    st->cstamp = realloc(st->cstamp, cap * sizeof(uint32_t));
+    st->odist = realloc(st->odist, cap * sizeof(uint32_t));
+    st->ohop_if = realloc(st->ohop_if, cap * sizeof(struct sr_if*));
+    st->ohop_gw = realloc(st->ohop_gw, cap * sizeof(uint32_t));
+    for (v = st->cap; v < cap; v++)
+    {
+        st->t.dist[v] = SPF_INF;
+        st->t.parent[v] = SPF_NONE;
+        st->t.hop_if[v] = 0;
+        st->t.hop_gw[v] = 0;
+        st->fstamp[v] = st->tstamp[v] = st->astamp[v] = st->cstamp[v] = 0;
+    }
+    st->cap = cap;
+
+    free(st->hash);
+    st->hmask = 2 * cap - 1;
+    st->hash = calloc(2 * cap, sizeof(uint32_t));
+    for (v = 0; v < st->nnodes; v++)
+    {
+        spf_hash_insert(st, v);
+    }
+} /* -- spf_grow -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_reset_nodes
+ *
+ * Olvida la numeracion de routers (corrida completa). Los que estaban
+ * vuelven a quedar no alcanzables para que un indice reusado no herede
+ * nada.
+ *
+ *---------------------------------------------------------------------*/
+
+static void spf_reset_nodes(struct spf_state* st)
+{
+    uint32_t v;
 
-    pthread_mutex_lock(&mutex);
+    for (v = 0; v < st->nnodes; v++)
+    {
+        st->t.dist[v] = SPF_INF;
+        st->t.parent[v] = SPF_NONE;
+        st->t.hop_if[v] = 0;
+        st->t.hop_gw[v] = 0;
+    }
+    st->nnodes = 0;
+    if (st->hash != 0)
+    {
+        memset(st->hash, 0, (st->hmask + 1) * sizeof(uint32_t));
+    }
+} /* -- spf_reset_nodes -- */
 
-    struct in_addr zero;
-    zero.s_addr = 0;
-    struct dijkstra_item* dijkstra_stack = create_dikjstra_item(create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0), 0);
-   struct dijkstra_item*  dijkstra_heap = create_dikjstra_item(create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0), 0);
+/*---------------------------------------------------------------------
+ * Method: spf_node
+ *
+ * Indice del router rid. Si no esta y add es 1 lo agrega, si no
+ * devuelve SPF_NONE.
+ *
+ *---------------------------------------------------------------------*/
 
-    /* Limpio la tabla*/
-    clear_routes(dij_param->sr);
+static uint32_t spf_node(struct spf_state* st, uint32_t rid, int add)
+{
+    uint32_t h;
 
-    /* ejecuto Dijkstra*/
-    struct pwospf_topology_entry* topo_entry = topology->next;
-    while(topo_entry != NULL)
+    if (add && st->nnodes + 1 > st->cap)
+    {
+        spf_grow(st, st->nnodes + 1);
+    }
+    if (st->hash == 0)
+    {
+        return SPF_NONE;
+    }
+    h = spf_hash(rid, 0) & st->hmask;
+    while (st->hash[h] != 0)
     {
-        if (check_route(dij_param->sr, topo_entry->net_num) == 0)
+        if (st->rid[st->hash[h] - 1] == rid)
         {
-            struct sr_if* temp_int = dij_param->sr->if_list;
-            while (temp_int != NULL)
-            {
-                if (search_topolgy_table(topology, (temp_int->ip & temp_int->mask)) == 0)
-                {
-                    temp_int = temp_int->next;
-                    continue;
-                }
+            return st->hash[h] - 1;
+        }
+        h = (h + 1) & st->hmask;
+    }
+    if (add == 0)
+    {
+        return SPF_NONE;
+    }
+    st->rid[st->nnodes] = rid;
+    st->hash[h] = ++st->nnodes;
+    return st->nnodes - 1;
+} /* -- spf_node -- */
 
-                if (temp_int->neighbor_id != 0)
-                {
-                    struct in_addr mask;	    mask.s_addr = temp_int->mask;
-                    struct in_addr subnet;	    subnet.s_addr = temp_int->ip & mask.s_addr;
-                    struct in_addr neighbor_id;	    neighbor_id.s_addr = temp_int->neighbor_id;
-                    struct in_addr next_hop;	    next_hop.s_addr = temp_int->neighbor_ip;
+/*---------------------------------------------------------------------
+ * Method: spf_prefix_find
+ *
+ * Lugar del prefijo net/mask en la hash de prefijos: apunta al indice+1
+ * del prefijo, o a un 0 si no esta.
+ *
+ *---------------------------------------------------------------------*/
 
-                    dijkstra_stack_push(dijkstra_heap, create_dikjstra_item(create_ospfv2_topology_entry(router_id, subnet, mask, neighbor_id,
-                        next_hop, 0), 1));
-                }
-                temp_int = temp_int->next;
+static uint32_t* spf_prefix_find(const struct spf_prefixes* px, uint32_t net, uint32_t mask)
+{
+    uint32_t h = spf_hash(net, mask) & px->hmask;
+
+    while (px->hash[h] != 0)
+    {
+        struct spf_prefix* p = &px->p[px->hash[h] - 1];
+        if (p->net == net && p->mask == mask)
+        {
+            break;
+        }
+        h = (h + 1) & px->hmask;
+    }
+    return &px->hash[h];
+} /* -- spf_prefix_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_group
+ *
+ * Agrupa los m pares (key[i], val[i]) por clave, 0 <= key < n: los
+ * valores de la clave k quedan en out[off[k] .. off[k + 1]), ordenados
+ * y sin repetir. Devuelve cuantos valores quedaron. Los grupos son
+ * chicos (grado de un router, anunciantes de un prefijo), por eso el
+ * orden por insercion.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t spf_group(uint32_t n, uint32_t m, const uint32_t* key, const uint32_t* val,
+                          uint32_t* off, uint32_t* out)
+{
+    uint32_t i, j, k, s, w;
+
+    memset(off, 0, (n + 1) * sizeof(uint32_t));
+    for (i = 0; i < m; i++)
+    {
+        off[key[i] + 1]++;
+    }
+    for (k = 0; k < n; k++)
+    {
+        off[k + 1] += off[k];
+    }
+    /* off[k] avanza mientras se llena y despues se corre uno */
+    for (i = 0; i < m; i++)
+    {
+        out[off[key[i]]++] = val[i];
+    }
+    for (k = n; k > 0; k--)
+    {
+        off[k] = off[k - 1];
+    }
+    off[0] = 0;
+
+    w = 0;
+    s = 0;
+    for (k = 0; k < n; k++)
+    {
+        uint32_t e = off[k + 1];
+
+        for (i = s + 1; i < e; i++)
+        {
+            uint32_t x = out[i];
+            for (j = i; j > s && out[j - 1] > x; j--)
+            {
+                out[j] = out[j - 1];
+            }
+            out[j] = x;
+        }
+        off[k] = w;
+        for (i = s; i < e; i++)
+        {
+            if (i == s || out[i] != out[i - 1])
+            {
+                out[w++] = out[i];
             }
+        }
+        s = e;
+    }
+    off[n] = w;
+    return w;
+} /* -- spf_group -- */
 
-            struct dijkstra_item* dijkstra_popped_item;
-            uint8_t stop = 0;
-            while(1)
+static void spf_graph_free(struct spf_graph* g)
+{
+    free(g->off);
+    free(g->adj);
+    free(g->cost);
+    free(g->roff);
+    free(g->radj);
+    free(g->rcost);
+    memset(g, 0, sizeof(*g));
+}
+
+static void spf_prefixes_free(struct spf_prefixes* px)
+{
+    free(px->p);
+    free(px->ann);
+    free(px->hash);
+    memset(px, 0, sizeof(*px));
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_build
+ *
+ * Arma el grafo y la tabla de prefijos de la topologia actual, y el
+ * enlace propio hacia cada vecino (el de la primera interfaz, si hay mas
+ * de una hacia el mismo). Los enlaces propios salen de las interfaces
+ * con vecino cuya red ya esta en la topologia. Devuelve cuantos routers
+ * distintos aparecen, el resto son de corridas anteriores. Se llama con
+ * el lock de la topologia tomado.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t spf_build(struct spf_state* st, struct sr_instance* sr,
+                          struct pwospf_lsdb* topology, uint32_t seen,
+                          struct spf_graph* g, struct spf_prefixes* px,
+                          struct sr_if*** link_if, uint32_t** link_gw)
+{
+    struct pwospf_lsdb_router* r;
+    struct sr_if* iface;
+    uint32_t nentries = topology->nlinks, nraw = topology->nlinks, ne = 0, na = 0, live = 0;
+    uint32_t b, i, v;
+    uint32_t *eu, *ew, *apfx, *anode, *aoff;
+
+    for (iface = sr->if_list; iface != NULL; iface = iface->next)
+    {
+        nraw++;
+    }
+
+    eu = malloc((nraw + 1) * sizeof(uint32_t));
+    ew = malloc((nraw + 1) * sizeof(uint32_t));
+    apfx = malloc((nentries + 1) * sizeof(uint32_t));
+    anode = malloc((nentries + 1) * sizeof(uint32_t));
+
+    memset(px, 0, sizeof(*px));
+    px->hmask = spf_table_size(nentries) - 1;
+    px->hash = calloc(px->hmask + 1, sizeof(uint32_t));
+    px->p = malloc((nentries + 1) * sizeof(struct spf_prefix));
+    px->ann = malloc((nentries + 1) * sizeof(uint32_t));
+
+    st->fstamp[st->me] = seen;
+    live = 1;
+    for (b = 0; b <= topology->mask; b++)
+    {
+        for (r = topology->buckets[b]; r != NULL; r = r->next)
+        {
+            v = spf_node(st, r->router_id.s_addr, 1);
+            if (st->fstamp[v] != seen)
             {
-                while(1)
+                st->fstamp[v] = seen;
+                live++;
+            }
+            for (i = 0; i < r->lsa->nlinks; i++)
+            {
+                struct pwospf_link* e = &r->lsa->links[i];
+                uint32_t* slot;
+
+                if (e->neighbor_id.s_addr != 0)
                 {
-                    /* Pop from the heap */
-                    dijkstra_popped_item = dijkstra_stack_pop(dijkstra_heap);
-                    if (dijkstra_popped_item == NULL)
-                    {
-                        stop = 1;
-                        break;
-                    }
-                    if (dijkstra_popped_item->topology_entry->net_num.s_addr == topo_entry->net_num.s_addr)
-                    {
-                        stop = 1;
-                        break;
-                    }
-                    if (dijkstra_popped_item->topology_entry->neighbor_id.s_addr != 0)
+                    uint32_t w = spf_node(st, e->neighbor_id.s_addr, 1);
+                    if (st->fstamp[w] != seen)
                     {
-                        break;
+                        st->fstamp[w] = seen;
+                        live++;
                     }
+                    eu[ne] = v;
+                    ew[ne] = w;
+                    ne++;
                 }
-
-                /* Push popped item in stack */
-                if (dijkstra_popped_item != NULL)
-                {
-                    dijkstra_stack_push(dijkstra_stack, dijkstra_popped_item);
-                }
-                if (stop == 1)
+                slot = spf_prefix_find(px, e->net_num.s_addr, e->net_mask.s_addr);
+                if (*slot == 0)
                 {
-                    break;
+                    struct spf_prefix* p = &px->p[px->n];
+                    p->net = e->net_num.s_addr;
+                    p->mask = e->net_mask.s_addr;
+                    p->iface = 0;
+                    p->gw = 0;
+                    *slot = ++px->n;
                 }
-                struct pwospf_topology_entry* ptr = topology->next;
-                while(ptr != NULL)
-                {
-                    if ((ptr->router_id.s_addr == dijkstra_popped_item->topology_entry->neighbor_id.s_addr) &&
-                        (ptr->net_num.s_addr != dijkstra_popped_item->topology_entry->net_num.s_addr) &&
-                        (ptr->neighbor_id.s_addr != dijkstra_popped_item->topology_entry->neighbor_id.s_addr))
-                    {
-                        struct pwospf_topology_entry* clone = clone_ospfv2_topology_entry(ptr);
+                apfx[na] = *slot - 1;
+                anode[na] = v;
+                na++;
+            }
+        }
+    }
 
-                        struct dijkstra_item* to_be_pushed = create_dikjstra_item(clone, dijkstra_popped_item->cost + 1);
-                        to_be_pushed->parent = dijkstra_popped_item;
-                        dijkstra_stack_push(dijkstra_heap, to_be_pushed);
-                        dijkstra_stack_reorder(dijkstra_heap);
-                    }
+    *link_if = calloc(st->nnodes, sizeof(struct sr_if*));
+    *link_gw = calloc(st->nnodes, sizeof(uint32_t));
+    for (iface = sr->if_list; iface != NULL; iface = iface->next)
+    {
+        uint32_t w;
 
-                    ptr = ptr->next;
-                }
+        if (iface->neighbor_id == 0 ||
+            *spf_prefix_find(px, iface->ip & iface->mask, iface->mask) == 0)
+        {
+            continue;
+        }
+        w = spf_node(st, iface->neighbor_id, 0);
+        if (w == SPF_NONE || w == st->me || (*link_if)[w] != 0)
+        {
+            continue;
+        }
+        (*link_if)[w] = iface;
+        (*link_gw)[w] = iface->neighbor_ip;
+        eu[ne] = st->me;
+        ew[ne] = w;
+        ne++;
+    }
+
+    /* Enlaces salientes y entrantes, y anunciantes de cada prefijo */
+    memset(g, 0, sizeof(*g));
+    g->nnodes = st->nnodes;
+    g->off = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    g->adj = malloc((ne + 1) * sizeof(uint32_t));
+    g->roff = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    g->radj = malloc((ne + 1) * sizeof(uint32_t));
+    g->nedges = spf_group(g->nnodes, ne, eu, ew, g->off, g->adj);
+    spf_group(g->nnodes, ne, ew, eu, g->roff, g->radj);
+    g->cost = malloc((g->nedges + 1) * sizeof(uint32_t));
+    g->rcost = malloc((g->nedges + 1) * sizeof(uint32_t));
+    for (i = 0; i < g->nedges; i++)
+    {
+        g->cost[i] = g->rcost[i] = SPF_LINK_COST;
+    }
+
+    aoff = malloc((px->n + 1) * sizeof(uint32_t));
+    spf_group(px->n, na, apfx, anode, aoff, px->ann);
+    for (i = 0; i < px->n; i++)
+    {
+        px->p[i].aoff = aoff[i];
+        px->p[i].acnt = aoff[i + 1] - aoff[i];
+    }
+
+    free(aoff);
+    free(anode);
+    free(apfx);
+    free(ew);
+    free(eu);
+    return live;
+} /* -- spf_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_heap_push / spf_heap_pop
+ *
+ * Heap binario de minimos con clave distancia << 32 | nodo. No hay
+ * decrease-key: un nodo que mejora se vuelve a insertar y las copias
+ * viejas se descartan al sacarlas.
+ *
+ *---------------------------------------------------------------------*/
+
+static void spf_heap_push(uint64_t* heap, uint32_t* n, uint64_t key)
+{
+    uint32_t i = (*n)++;
+
+    while (i > 0 && heap[(i - 1) / 2] > key)
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = key;
+} /* -- spf_heap_push -- */
+
+static uint64_t spf_heap_pop(uint64_t* heap, uint32_t* n)
+{
+    uint64_t top = heap[0];
+    uint64_t last = heap[--(*n)];
+    uint32_t i = 0;
+
+    for (;;)
+    {
+        uint32_t c = 2 * i + 1;
+        if (c >= *n)
+        {
+            break;
+        }
+        if (c + 1 < *n && heap[c + 1] < heap[c])
+        {
+            c++;
+        }
+        if (heap[c] >= last)
+        {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+} /* -- spf_heap_pop -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_better
+ *
+ * 1 si llegar a w desde u con distancia d es mejor que lo que w tiene:
+ * menor distancia, o igual distancia y un padre mas cerca, o igual de
+ * cerca y con router id menor.
+ *
+ *---------------------------------------------------------------------*/
+
+static int spf_better(const struct spf_state* st, const struct spf_tree* t, uint32_t u,
+                      uint32_t d, uint32_t w)
+{
+    uint32_t p = t->parent[w];
+
+    if (d != t->dist[w])
+    {
+        return d < t->dist[w];
+    }
+    if (p == SPF_NONE || p == u)
+    {
+        return 0;
+    }
+    if (t->dist[u] != t->dist[p])
+    {
+        return t->dist[u] < t->dist[p];
+    }
+    return ntohl(st->rid[u]) < ntohl(st->rid[p]);
+} /* -- spf_better -- */
+
+/* Guarda la distancia y el primer salto de v antes del primer cambio de
+   la corrida */
+static void spf_touch(struct spf_state* st, uint32_t v, uint32_t run, uint32_t* touched,
+                      uint32_t* ntouched)
+{
+    if (touched == 0 || st->tstamp[v] == run)
+    {
+        return;
+    }
+    st->tstamp[v] = run;
+    st->odist[v] = st->t.dist[v];
+    st->ohop_if[v] = st->t.hop_if[v];
+    st->ohop_gw[v] = st->t.hop_gw[v];
+    touched[(*ntouched)++] = v;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_propagate
+ *
+ * Dijkstra desde lo que haya en el heap sobre el arbol t. Al cerrar un
+ * nodo se fija su primer salto (el del enlace propio si el padre es este
+ * router, si no el del padre); si cambio, los hijos que no mejoran por
+ * distancia se vuelven a encolar para heredarlo. Con touched != 0 se
+ * registra cada nodo que se modifica (corrida incremental).
+ *
+ *---------------------------------------------------------------------*/
+
+static void spf_propagate(struct spf_state* st, const struct spf_graph* g, struct spf_tree* t,
+                          struct sr_if** link_if, uint32_t* link_gw, uint64_t* heap,
+                          uint32_t nheap, uint32_t run, uint32_t* touched, uint32_t* ntouched)
+{
+    while (nheap > 0)
+    {
+        uint64_t key = spf_heap_pop(heap, &nheap);
+        uint32_t v = (uint32_t)key;
+        uint32_t d = (uint32_t)(key >> 32);
+        int hop_changed = 0;
+        uint32_t i;
+
+        if (st->fstamp[v] == run || d != t->dist[v])
+        {
+            continue;
+        }
+        st->fstamp[v] = run;
+        if (v != st->me)
+        {
+            uint32_t p = t->parent[v];
+            struct sr_if* hop_if = p == st->me ? link_if[v] : t->hop_if[p];
+            uint32_t hop_gw = p == st->me ? link_gw[v] : t->hop_gw[p];
+
+            hop_changed = hop_if != t->hop_if[v] || hop_gw != t->hop_gw[v];
+            t->hop_if[v] = hop_if;
+            t->hop_gw[v] = hop_gw;
+        }
+        for (i = g->off[v]; i < g->off[v + 1]; i++)
+        {
+            uint32_t w = g->adj[i];
+            uint32_t nd = d + g->cost[i];
+
+            if (st->fstamp[w] == run)
+            {
+                continue;
+            }
+            if (spf_better(st, t, v, nd, w))
+            {
+                spf_touch(st, w, run, touched, ntouched);
+                t->dist[w] = nd;
+                t->parent[w] = v;
+                spf_heap_push(heap, &nheap, ((uint64_t)nd << 32) | w);
+            }
+            else if (hop_changed && t->parent[w] == v)
+            {
+                spf_touch(st, w, run, touched, ntouched);
+                spf_heap_push(heap, &nheap, ((uint64_t)t->dist[w] << 32) | w);
             }
-            struct dijkstra_item* final_item = dijkstra_stack_pop(dijkstra_stack);
+        }
+    }
+} /* -- spf_propagate -- */
 
-            if (final_item != NULL)
+/*---------------------------------------------------------------------
+ * Method: spf_full_tree
+ *
+ * Arbol completo desde este router, sobre t.
+ *
+ *---------------------------------------------------------------------*/
+
+static void spf_full_tree(struct spf_state* st, const struct spf_graph* g, struct spf_tree* t,
+                          struct sr_if** link_if, uint32_t* link_gw, uint64_t* heap, uint32_t run)
+{
+    uint32_t v, nheap = 0;
+
+    for (v = 0; v < g->nnodes; v++)
+    {
+        t->dist[v] = SPF_INF;
+        t->parent[v] = SPF_NONE;
+        t->hop_if[v] = 0;
+        t->hop_gw[v] = 0;
+    }
+    t->dist[st->me] = 0;
+    spf_heap_push(heap, &nheap, st->me);
+    spf_propagate(st, g, t, link_if, link_gw, heap, nheap, run, 0, 0);
+} /* -- spf_full_tree -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_incremental
+ *
+ * Actualiza el arbol de la corrida anterior al grafo nuevo g. Devuelve
+ * -1, sin tocar nada, si cambio demasiado y conviene una corrida
+ * completa; si no, la cantidad de routers que se tocaron, que quedan en
+ * touched.
+ *
+ *---------------------------------------------------------------------*/
+
+static int spf_incremental(struct spf_state* st, const struct spf_graph* g,
+                           struct sr_if** link_if, uint32_t* link_gw, uint64_t* heap,
+                           uint32_t run, uint32_t* touched)
+{
+    const struct spf_graph* og = &st->g;
+    struct spf_tree* t = &st->t;
+    uint32_t* ru = malloc((og->nedges + 1) * sizeof(uint32_t));
+    uint32_t* rw = malloc((og->nedges + 1) * sizeof(uint32_t));
+    uint32_t* au = malloc((g->nedges + 1) * sizeof(uint32_t));
+    uint32_t* aw = malloc((g->nedges + 1) * sizeof(uint32_t));
+    uint32_t* stack = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    uint32_t* nsub = 0;
+    uint32_t nrem = 0, nadd = 0, nroots = 0, nsubtree = 0, nheap = 0, ntouched = 0;
+    uint32_t u, v, i;
+    int ret = -1;
+
+    /* Enlaces que ya no estan y enlaces nuevos: las dos listas de cada
+       router estan ordenadas */
+    for (u = 0; u < g->nnodes; u++)
+    {
+        uint32_t j = g->off[u], je = g->off[u + 1];
+        uint32_t ie = u < og->nnodes ? og->off[u + 1] : 0;
+
+        i = u < og->nnodes ? og->off[u] : 0;
+
+        while (i < ie || j < je)
+        {
+            if (j == je || (i < ie && og->adj[i] < g->adj[j]))
             {
-                while (final_item->parent != NULL)
-                {
-                    final_item = final_item->parent; /*dijkstra_stack_pop(dijkstra_stack);*/
+                ru[nrem] = u;
+                rw[nrem++] = og->adj[i++];
+            }
+            else if (i == ie || g->adj[j] < og->adj[i])
+            {
+                au[nadd] = u;
+                aw[nadd++] = g->adj[j++];
+            }
+            else
+            {
+                i++;
+                j++;
+            }
+        }
+    }
+    if (nrem + nadd > g->nedges / 8 + 8)
+    {
+        goto done;
+    }
 
-                }
-                struct sr_if* next_hop_int = dij_param->sr->if_list;
-                while (next_hop_int != NULL)
+    /* Raices de lo que hay que recalcular: el extremo de un enlace del
+       arbol que desaparecio y el vecino cuyo enlace propio cambio de
+       interfaz o de gateway. Cada router se marca al apilarlo, asi entra
+       una sola vez aunque sea raiz por los dos motivos y la pila no pasa
+       de nnodes */
+    for (i = 0; i < nrem; i++)
+    {
+        if (t->parent[rw[i]] == ru[i] && st->astamp[rw[i]] != run)
+        {
+            st->astamp[rw[i]] = run;
+            stack[nroots++] = rw[i];
+        }
+    }
+    for (v = 0; v < g->nnodes; v++)
+    {
+        struct sr_if* old_if = v < og->nnodes ? st->link_if[v] : 0;
+        uint32_t old_gw = v < og->nnodes ? st->link_gw[v] : 0;
+
+        if (t->parent[v] == st->me && (old_if != link_if[v] || old_gw != link_gw[v]) &&
+            st->astamp[v] != run)
+        {
+            st->astamp[v] = run;
+            stack[nroots++] = v;
+        }
+    }
+
+    if (nroots > 0)
+    {
+        /* Hijos de cada router en el arbol viejo y recorrido de los
+           subarboles; "stack" se usa como pila y los nodos del subarbol
+           se juntan en nsub */
+        uint32_t* pk = malloc((g->nnodes + 1) * sizeof(uint32_t));
+        uint32_t* pv = malloc((g->nnodes + 1) * sizeof(uint32_t));
+        uint32_t* coff = malloc((g->nnodes + 1) * sizeof(uint32_t));
+        uint32_t* child = malloc((g->nnodes + 1) * sizeof(uint32_t));
+        uint32_t m = 0;
+
+        for (v = 0; v < g->nnodes; v++)
+        {
+            if (t->parent[v] != SPF_NONE)
+            {
+                pk[m] = t->parent[v];
+                pv[m++] = v;
+            }
+        }
+        spf_group(g->nnodes, m, pk, pv, coff, child);
+
+        nsub = malloc((g->nnodes + 1) * sizeof(uint32_t));
+        while (nroots > 0)
+        {
+            v = stack[--nroots];
+            nsub[nsubtree++] = v;
+            for (i = coff[v]; i < coff[v + 1]; i++)
+            {
+                if (st->astamp[child[i]] != run)
                 {
-                    if ((next_hop_int->ip & next_hop_int->mask) == (final_item->topology_entry->next_hop.s_addr & final_item->topology_entry->net_mask.s_addr))
-                    {
-                        break;
-                    }
-                    next_hop_int = next_hop_int->next;
+                    st->astamp[child[i]] = run;
+                    stack[nroots++] = child[i];
                 }
+            }
+        }
+        free(child);
+        free(coff);
+        free(pv);
+        free(pk);
+
+        if (nsubtree > g->nnodes / 2)
+        {
+            goto done;
+        }
+    }
+
+    /* Desde aca se modifica el arbol */
+    for (i = 0; i < nsubtree; i++)
+    {
+        v = nsub[i];
+        spf_touch(st, v, run, touched, &ntouched);
+        t->dist[v] = SPF_INF;
+        t->parent[v] = SPF_NONE;
+        t->hop_if[v] = 0;
+        t->hop_gw[v] = 0;
+    }
+    /* Cada router invalidado arranca desde sus vecinos que quedaron */
+    for (i = 0; i < nsubtree; i++)
+    {
+        uint32_t k;
 
-                sr_add_rt_entry(dij_param->sr, topo_entry->net_num, final_item->topology_entry->next_hop, topo_entry->net_mask, next_hop_int->name, 110);
+        v = nsub[i];
+        for (k = g->roff[v]; k < g->roff[v + 1]; k++)
+        {
+            u = g->radj[k];
+            if (st->astamp[u] == run || t->dist[u] == SPF_INF)
+            {
+                continue;
+            }
+            if (spf_better(st, t, u, t->dist[u] + g->rcost[k], v))
+            {
+                t->dist[v] = t->dist[u] + g->rcost[k];
+                t->parent[v] = u;
+                spf_heap_push(heap, &nheap, ((uint64_t)t->dist[v] << 32) | v);
             }
         }
-        topo_entry = topo_entry->next;
     }
-    Debug("\n-> PWOSPF: Dijkstra algorithm completed\n\n");
-    Debug("\n-> PWOSPF: Printing the forwarding table\n");
-    sr_print_routing_table(dij_param->sr);
+    /* Los enlaces nuevos se relajan; los que salen de un router
+       invalidado se relajan al cerrarlo */
+    for (i = 0; i < nadd; i++)
+    {
+        u = au[i];
+        v = aw[i];
+        if (st->astamp[u] == run || t->dist[u] == SPF_INF ||
+            !spf_better(st, t, u, t->dist[u] + SPF_LINK_COST, v))
+        {
+            continue;
+        }
+        spf_touch(st, v, run, touched, &ntouched);
+        t->dist[v] = t->dist[u] + SPF_LINK_COST;
+        t->parent[v] = u;
+        spf_heap_push(heap, &nheap, ((uint64_t)t->dist[v] << 32) | v);
+    }
+    spf_propagate(st, g, t, link_if, link_gw, heap, nheap, run, touched, &ntouched);
+    ret = (int)ntouched;
 
-    pthread_mutex_unlock(&mutex);
+done:
+    free(nsub);
+    free(stack);
+    free(aw);
+    free(au);
+    free(rw);
+    free(ru);
+    return ret;
+} /* -- spf_incremental -- */
 
-    return NULL;
-} /* -- run_dijkstra -- */
+/*---------------------------------------------------------------------
+ * Method: spf_prefix_route
+ *
+ * Router alcanzable mas cercano que anuncia el prefijo p (a igual
+ * distancia, el de router id menor), y su primer salto. 0 si ninguno
+ * es alcanzable.
+ *
+ *---------------------------------------------------------------------*/
 
-void dijkstra_stack_push(struct dijkstra_item* dijkstra_first_item, struct dijkstra_item* dijkstra_new_item)
+static int spf_prefix_route(const struct spf_state* st, const struct spf_tree* t,
+                            const struct spf_prefixes* px, const struct spf_prefix* p,
+                            struct sr_if** iface, uint32_t* gw)
 {
-    if (dijkstra_first_item->next != NULL)
+    uint32_t best = SPF_NONE, i;
+
+    for (i = p->aoff; i < p->aoff + p->acnt; i++)
     {
-        dijkstra_new_item->next = dijkstra_first_item->next;
-        dijkstra_first_item->next = dijkstra_new_item;
+        uint32_t v = px->ann[i];
+
+        if (v == st->me || t->dist[v] == SPF_INF)
+        {
+            continue;
+        }
+        if (best == SPF_NONE || t->dist[v] < t->dist[best] ||
+            (t->dist[v] == t->dist[best] && ntohl(st->rid[v]) < ntohl(st->rid[best])))
+        {
+            best = v;
+        }
+    }
+    if (best == SPF_NONE || t->hop_if[best] == 0)
+    {
+        return 0;
     }
+    *iface = t->hop_if[best];
+    *gw = t->hop_gw[best];
+    return 1;
+} /* -- spf_prefix_route -- */
+
+static struct sr_rt* spf_new_route(const struct spf_prefix* p, struct sr_if* iface, uint32_t gw)
+{
+    struct sr_rt* rt = (struct sr_rt*) calloc(1, sizeof(struct sr_rt));
 
-    dijkstra_first_item->next = dijkstra_new_item;
+    rt->dest.s_addr = p->net;
+    rt->mask.s_addr = p->mask;
+    rt->gw.s_addr = gw;
+    if (iface != 0)
+    {
+        memcpy(rt->interface, iface->name, sr_IFACE_NAMELEN);
+    }
+    rt->admin_dst = 110;
+    return rt;
 }
 
-void dijkstra_stack_reorder(struct dijkstra_item* dijkstra_first_item)
+/*---------------------------------------------------------------------
+ * Method: spf_routes_full
+ *
+ * Calcula la ruta de todos los prefijos y deja las dinamicas de la
+ * tabla iguales a ese conjunto.
+ *
+ *---------------------------------------------------------------------*/
+
+static void spf_routes_full(struct spf_state* st, struct sr_instance* sr,
+                            struct spf_prefixes* px, struct sr_rt_diff* diff)
 {
-    struct dijkstra_item* ptr = dijkstra_first_item;
-    while (ptr->next != NULL)
+    /* Las rutas calculadas se juntan aca y se comparan con las instaladas
+       al final, asi la tabla solo cambia en lo que cambio la topologia */
+    struct sr_rt* pending = NULL;
+    struct sr_rt** pending_tail = &pending;
+    uint32_t i;
+
+    for (i = 0; i < px->n; i++)
     {
-        if (ptr->next->next == NULL)
+        struct spf_prefix* p = &px->p[i];
+
+        p->iface = 0;
+        p->gw = 0;
+        if (spf_prefix_route(st, &st->t, px, p, &p->iface, &p->gw))
         {
-            break;
+            *pending_tail = spf_new_route(p, p->iface, p->gw);
+            pending_tail = &(*pending_tail)->next;
         }
+    }
+    /* Instalo solo las diferencias, en un solo lote */
+    sr_rt_apply_routes(sr, pending, 110, diff);
+} /* -- spf_routes_full -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_routes_incremental
+ *
+ * Vuelve a evaluar solo los prefijos nuevos, los que cambiaron de
+ * anunciantes y los que anuncia un router marcado en cstamp; el resto
+ * conserva la ruta de la corrida anterior (opx). En la tabla se tocan
+ * solo las rutas que cambiaron. Devuelve cuantos prefijos se evaluaron.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t spf_routes_incremental(struct spf_state* st, struct sr_instance* sr,
+                                       struct spf_prefixes* px, const struct spf_prefixes* opx,
+                                       uint32_t run, struct sr_rt_diff* diff)
+{
+    struct sr_rt* updates = NULL;
+    struct sr_rt* withdrawn = NULL;
+    uint32_t i, k, nevaluated = 0, ninstalled = 0;
+
+    for (i = 0; i < px->n; i++)
+    {
+        struct spf_prefix* p = &px->p[i];
+        const struct spf_prefix* op = 0;
+        struct sr_if* iface = 0;
+        uint32_t gw = 0;
+        uint32_t slot = opx->n > 0 ? *spf_prefix_find(opx, p->net, p->mask) : 0;
+        int eval;
 
-        if (ptr->next->cost > ptr->next->next->cost)
+        if (slot != 0)
+        {
+            op = &opx->p[slot - 1];
+            p->iface = op->iface;
+            p->gw = op->gw;
+        }
+        eval = op == 0 || op->acnt != p->acnt ||
+               memcmp(&opx->ann[op->aoff], &px->ann[p->aoff], p->acnt * sizeof(uint32_t)) != 0;
+        for (k = p->aoff; !eval && k < p->aoff + p->acnt; k++)
         {
-            struct dijkstra_item* temp_1 = ptr->next->next->next;
-            struct dijkstra_item* temp_2 = ptr->next->next;
-            ptr->next->next->next = ptr->next;
-            ptr->next->next = temp_1;
-            ptr->next = temp_2;
+            eval = st->cstamp[px->ann[k]] == run;
         }
+        if (eval)
+        {
+            nevaluated++;
+            spf_prefix_route(st, &st->t, px, p, &iface, &gw);
+            if (iface != p->iface || gw != p->gw)
+            {
+                struct sr_rt* rt = spf_new_route(p, iface, gw);
+                if (iface != 0)
+                {
+                    rt->next = updates;
+                    updates = rt;
+                }
+                else
+                {
+                    rt->next = withdrawn;
+                    withdrawn = rt;
+                }
+                p->iface = iface;
+                p->gw = gw;
+            }
+        }
+        if (p->iface != 0)
+        {
+            ninstalled++;
+        }
+    }
+    /* Prefijos que ya nadie anuncia */
+    for (i = 0; i < opx->n; i++)
+    {
+        const struct spf_prefix* op = &opx->p[i];
 
-        ptr = ptr->next;
+        if (op->iface != 0 && *spf_prefix_find(px, op->net, op->mask) == 0)
+        {
+            struct sr_rt* rt = spf_new_route(op, 0, 0);
+            rt->next = withdrawn;
+            withdrawn = rt;
+        }
     }
-}
+    sr_rt_update_routes(sr, updates, withdrawn, 110, diff);
+    diff->unchanged = ninstalled - diff->added - diff->changed;
+    return nevaluated;
+} /* -- spf_routes_incremental -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_verify
+ *
+ * Modo de verificacion: compara el arbol incremental contra uno
+ * completo calculado aparte y las rutas de cada prefijo contra la
+ * tabla. Devuelve la cantidad de diferencias; si hay, st->t queda con
+ * el arbol completo.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t spf_verify_tree(struct spf_state* st, const struct spf_graph* g,
+                                struct sr_if** link_if, uint32_t* link_gw, uint64_t* heap,
+                                uint32_t run)
+{
+    struct spf_tree full;
+    uint32_t v, bad = 0;
+
+    full.dist = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    full.parent = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    full.hop_if = malloc((g->nnodes + 1) * sizeof(struct sr_if*));
+    full.hop_gw = malloc((g->nnodes + 1) * sizeof(uint32_t));
+    spf_full_tree(st, g, &full, link_if, link_gw, heap, run);
+
+    for (v = 0; v < g->nnodes; v++)
+    {
+        if (full.dist[v] != st->t.dist[v] ||
+            (full.dist[v] != SPF_INF &&
+             (full.parent[v] != st->t.parent[v] || full.hop_if[v] != st->t.hop_if[v] ||
+              full.hop_gw[v] != st->t.hop_gw[v])))
+        {
+            struct in_addr rid;
+            rid.s_addr = st->rid[v];
+            if (bad++ < 8)
+            {
+                sr_log_error(SR_LOG_SUBSYS, "-> PWOSPF: incremental SPF differs for router %s: "
+                             "distance %u, full run %u\n", inet_ntoa(rid),
+                             st->t.dist[v], full.dist[v]);
+            }
+        }
+    }
+    if (bad > 0)
+    {
+        memcpy(st->t.dist, full.dist, g->nnodes * sizeof(uint32_t));
+        memcpy(st->t.parent, full.parent, g->nnodes * sizeof(uint32_t));
+        memcpy(st->t.hop_if, full.hop_if, g->nnodes * sizeof(struct sr_if*));
+        memcpy(st->t.hop_gw, full.hop_gw, g->nnodes * sizeof(uint32_t));
+    }
+    free(full.hop_gw);
+    free(full.hop_if);
+    free(full.parent);
+    free(full.dist);
+    return bad;
+} /* -- spf_verify_tree -- */
+
+static uint32_t spf_verify_routes(struct spf_state* st, struct sr_instance* sr,
+                                  const struct spf_prefixes* px)
+{
+    uint32_t i, bad = 0;
 
-struct dijkstra_item* dijkstra_stack_pop(struct dijkstra_item* dijkstra_first_item)
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_lock(sr->ospf_subsys);
+    }
+    for (i = 0; i < px->n; i++)
+    {
+        const struct spf_prefix* p = &px->p[i];
+        struct sr_if* iface = 0;
+        uint32_t gw = 0;
+        struct in_addr dest, mask;
+        struct sr_rt* rt;
+        int ok;
+
+        dest.s_addr = p->net;
+        mask.s_addr = p->mask;
+        rt = sr_find_rt_entry(sr, dest, mask, 110);
+        if (spf_prefix_route(st, &st->t, px, p, &iface, &gw))
+        {
+            ok = p->iface == iface && p->gw == gw && rt != 0 && rt->gw.s_addr == gw &&
+                 strncmp(rt->interface, iface->name, sr_IFACE_NAMELEN) == 0;
+        }
+        else
+        {
+            ok = p->iface == 0 && rt == 0;
+        }
+        if (!ok && bad++ < 8)
+        {
+            sr_log_error(SR_LOG_SUBSYS, "-> PWOSPF: incremental SPF left a wrong route for %s\n",
+                         inet_ntoa(dest));
+        }
+    }
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_unlock(sr->ospf_subsys);
+    }
+    return bad;
+} /* -- spf_verify_routes -- */
+
+/*---------------------------------------------------------------------
+ * Method: run_dijkstra
+ *
+ * Run Dijkstra algorithm
+ *
+ * Calcula el arbol de caminos minimos desde este router, incremental si
+ * se puede, y actualiza las rutas dinamicas. Las redes con ruta estatica
+ * o conectada tambien se calculan: la ruta queda como candidata en la RIB
+ * y la eleccion la resuelve sr_rt.c.
+ *
+ *---------------------------------------------------------------------*/
+
+void* run_dijkstra(void* arg)
 {
-    if (dijkstra_first_item->next == NULL)
+    dijkstra_param_t* dij_param = ((dijkstra_param_t*)(arg));
+
+    struct pwospf_lsdb* topology = dij_param->topology;
+    struct in_addr router_id = dij_param->rid;
+    struct sr_instance* sr = dij_param->sr;
+    struct spf_state* st = &g_spf;
+    struct spf_graph g;
+    struct spf_prefixes px;
+    struct sr_if** link_if;
+    uint32_t* link_gw;
+    struct sr_rt_diff diff;
+    uint32_t live, run, nnodes, nprefixes;
+    uint64_t t0, elapsed;
+    uint64_t* heap;
+    uint32_t* touched;
+    int ntouched = 0;
+    int full;
+
+    pthread_mutex_lock(&g_spf_lock);
+    t0 = spf_now_ns();
+    full = g_spf_force_full || !st->valid || st->sr != sr || st->topology != topology ||
+           st->rid[st->me] != router_id.s_addr;
+
+    g_spf_force_full = 0;
+    if (full)
+    {
+        spf_reset_nodes(st);
+    }
+    st->me = spf_node(st, router_id.s_addr, 1);
+    pwospf_lsdb_lock(topology);
+    live = spf_build(st, sr, topology, ++st->run, &g, &px, &link_if, &link_gw);
+    pwospf_lsdb_unlock(topology);
+    run = ++st->run;
+
+    heap = malloc((3 * (uint64_t)g.nedges + g.nnodes + 16) * sizeof(uint64_t));
+    touched = malloc((g.nnodes + 1) * sizeof(uint32_t));
+
+    if (!full)
     {
-        return NULL;
+        ntouched = spf_incremental(st, &g, link_if, link_gw, heap, run, touched);
+        full = ntouched < 0;
+    }
+    if (!full && g_spf_verify)
+    {
+        g_spf_verified++;
+        if (spf_verify_tree(st, &g, link_if, link_gw, heap, ++st->run) > 0)
+        {
+            g_spf_mismatches++;
+            full = 1;
+        }
+    }
+    if (full)
+    {
+        spf_full_tree(st, &g, &st->t, link_if, link_gw, heap, ++st->run);
+        spf_routes_full(st, sr, &px, &diff);
+        nnodes = g.nnodes;
+        nprefixes = px.n;
     }
     else
     {
-        struct dijkstra_item* pResult = dijkstra_first_item->next;
+        int i;
+
+        /* Cambiados: distancia distinta, o primer salto distinto si
+           sigue alcanzable */
+        for (i = 0; i < ntouched; i++)
+        {
+            uint32_t v = touched[i];
+            if (st->t.dist[v] != st->odist[v] ||
+                (st->t.dist[v] != SPF_INF &&
+                 (st->t.hop_if[v] != st->ohop_if[v] || st->t.hop_gw[v] != st->ohop_gw[v])))
+            {
+                st->cstamp[v] = run;
+            }
+        }
+        nnodes = ntouched;
+        nprefixes = spf_routes_incremental(st, sr, &px, &st->px, run, &diff);
+        if (g_spf_verify && spf_verify_routes(st, sr, &px) > 0)
+        {
+            struct sr_rt_diff fix;
 
-        dijkstra_first_item->next = dijkstra_first_item->next->next;
+            g_spf_mismatches++;
+            spf_routes_full(st, sr, &px, &fix);
+        }
+    }
 
-        return pResult;
+    free(touched);
+    free(heap);
+    spf_graph_free(&st->g);
+    spf_prefixes_free(&st->px);
+    free(st->link_if);
+    free(st->link_gw);
+    st->g = g;
+    st->px = px;
+    st->link_if = link_if;
+    st->link_gw = link_gw;
+    st->sr = sr;
+    st->topology = topology;
+    st->valid = 1;
+    /* Los routers que ya no aparecen siguen numerados; si son la mayoria,
+       la proxima corrida es completa y los renumera */
+    if (st->nnodes > 2 * live + 64)
+    {
+        g_spf_force_full = 1;
     }
-}
 
-struct dijkstra_item* create_dikjstra_item(struct pwospf_topology_entry* new_topology_entry, uint8_t cost)
+    g_spf_runs++;
+    g_spf_full_runs += full;
+    g_spf_last_full = full;
+    g_spf_last_nodes[0] = nnodes;
+    g_spf_last_nodes[1] = g.nnodes;
+    g_spf_last_prefixes[0] = nprefixes;
+    g_spf_last_prefixes[1] = px.n;
+    g_spf_last = diff;
+    g_spf_total.added += diff.added;
+    g_spf_total.changed += diff.changed;
+    g_spf_total.withdrawn += diff.withdrawn;
+    g_spf_total.unchanged += diff.unchanged;
+
+    Debug("\n-> PWOSPF: Dijkstra algorithm completed (%s, %u routers, %u prefixes): "
+          "%lu added, %lu changed, %lu withdrawn, %lu unchanged\n\n",
+          full ? "full" : "incremental", nnodes, nprefixes,
+          diff.added, diff.changed, diff.withdrawn, diff.unchanged);
+    /* Imprimir la tabla entera en cada corrida solo tiene sentido depurando */
+    if (sr_log_enabled(sr_sub_spf, SR_LOG_DEBUG))
+    {
+        Debug("\n-> PWOSPF: Printing the forwarding table\n");
+        sr_print_routing_table(sr);
+    }
+
+    elapsed = spf_now_ns() - t0;
+    g_spf_time_last = elapsed;
+    g_spf_time_total += elapsed;
+    if (elapsed > g_spf_time_max)
+    {
+        g_spf_time_max = elapsed;
+    }
+
+    pthread_mutex_unlock(&g_spf_lock);
+
+    return NULL;
+} /* -- run_dijkstra -- */
+
+/*---------------------------------------------------------------------
+ * Method: spf_sched_thread
+ *
+ * Hilo del planificador: espera a que venza la corrida pendiente y la
+ * ejecuta. Los pedidos que llegan durante la corrida dejan otra
+ * pendiente, que respeta la espera minima.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* spf_sched_thread(void* arg)
 {
-    struct dijkstra_item* dijkstra_new_item = ((struct dijkstra_item*)(malloc(sizeof(struct dijkstra_item))));
-    dijkstra_new_item->topology_entry = new_topology_entry;
-    dijkstra_new_item->cost = cost;
-    dijkstra_new_item->parent = NULL;
-    dijkstra_new_item->next = NULL;
-    return dijkstra_new_item;
-}
+    struct spf_sched* sc = arg;
+
+    pthread_mutex_lock(&sc->lock);
+    for (;;)
+    {
+        dijkstra_param_t param;
+        uint64_t now;
+
+        if (!sc->pending)
+        {
+            pthread_cond_wait(&sc->cond, &sc->lock);
+            continue;
+        }
+        now = spf_now_ns();
+        if (now < sc->due)
+        {
+            struct timespec ts;
+            ts.tv_sec = sc->due / 1000000000ULL;
+            ts.tv_nsec = sc->due % 1000000000ULL;
+            pthread_cond_timedwait(&sc->cond, &sc->lock, &ts);
+            continue;
+        }
+        sc->pending = 0;
+        sc->last_run = now;
+        sc->runs++;
+        sc->wait_last = now - sc->first;
+        if (sc->wait_last > sc->wait_max)
+        {
+            sc->wait_max = sc->wait_last;
+        }
+        param = sc->param;
+        pthread_mutex_unlock(&sc->lock);
+
+        run_dijkstra(&param);
+
+        pthread_mutex_lock(&sc->lock);
+    }
+    return NULL;
+} /* -- spf_sched_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_schedule
+ *
+ * Pide una corrida de Dijkstra. Si ya hay una pendiente, el pedido se
+ * suma a esa. Si no, la corrida va a los SPF_INITIAL_DELAY_MS cuando la
+ * anterior fue hace mas que la espera minima, y si no cuando esa espera
+ * se cumpla, duplicandola para la proxima (hasta SPF_MAX_HOLD_MS).
+ * Despues de SPF_MAX_HOLD_MS sin corridas la espera vuelve a
+ * SPF_HOLD_MS. El hilo del planificador arranca con el primer pedido.
+ *
+ *---------------------------------------------------------------------*/
+
+void dijkstra_schedule(struct sr_instance* sr, struct pwospf_lsdb* topology,
+                       struct in_addr rid)
+{
+    struct spf_sched* sc = &g_sched;
+    uint64_t now = spf_now_ns();
+    uint64_t hold;
+
+    pthread_mutex_lock(&sc->lock);
+    if (!sc->started)
+    {
+        pthread_condattr_t attr;
+        pthread_attr_t tattr;
+        pthread_t tid;
+
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&sc->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        sc->hold_ms = SPF_HOLD_MS;
+        pthread_attr_init(&tattr);
+        pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &tattr, spf_sched_thread, sc) != 0)
+        {
+            perror("pthread_create");
+            pthread_attr_destroy(&tattr);
+            pthread_mutex_unlock(&sc->lock);
+            return;
+        }
+        pthread_attr_destroy(&tattr);
+        sc->started = 1;
+    }
+
+    sc->param.sr = sr;
+    sc->param.topology = topology;
+    sc->param.rid = rid;
+    sc->triggers++;
+    if (sc->pending)
+    {
+        sc->coalesced++;
+        pthread_mutex_unlock(&sc->lock);
+        return;
+    }
+
+    sc->pending = 1;
+    sc->first = now;
+    hold = (uint64_t)sc->hold_ms * 1000000ULL;
+    if (sc->runs == 0 || now - sc->last_run >= hold)
+    {
+        if (sc->runs > 0 && now - sc->last_run >= SPF_MAX_HOLD_MS * 1000000ULL)
+        {
+            sc->hold_ms = SPF_HOLD_MS;
+        }
+        sc->due = now + SPF_INITIAL_DELAY_MS * 1000000ULL;
+    }
+    else
+    {
+        sc->due = sc->last_run + hold;
+        if (sc->due < now + SPF_INITIAL_DELAY_MS * 1000000ULL)
+        {
+            sc->due = now + SPF_INITIAL_DELAY_MS * 1000000ULL;
+        }
+        sc->hold_ms = sc->hold_ms * 2 < SPF_MAX_HOLD_MS ? sc->hold_ms * 2 : SPF_MAX_HOLD_MS;
+    }
+    pthread_cond_signal(&sc->cond);
+    pthread_mutex_unlock(&sc->lock);
+} /* -- dijkstra_schedule -- */
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_set_verify / dijkstra_force_full
+ *
+ * Verificacion de cada corrida incremental contra una completa, y
+ * corrida completa forzada para la proxima vez.
+ *
+ *---------------------------------------------------------------------*/
+
+void dijkstra_set_verify(int on)
+{
+    pthread_mutex_lock(&g_spf_lock);
+    g_spf_verify = on;
+    pthread_mutex_unlock(&g_spf_lock);
+} /* -- dijkstra_set_verify -- */
+
+void dijkstra_force_full(void)
+{
+    pthread_mutex_lock(&g_spf_lock);
+    g_spf_force_full = 1;
+    pthread_mutex_unlock(&g_spf_lock);
+} /* -- dijkstra_force_full -- */
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_print_stats
+ *
+ * Corridas de Dijkstra y rutas que cambiaron, la ultima y acumuladas
+ *
+ *---------------------------------------------------------------------*/
+
+void dijkstra_print_stats(FILE* out)
+{
+    pthread_mutex_lock(&g_spf_lock);
+    fprintf(out, "spf runs: %lu (%lu full, %lu incremental)\n", g_spf_runs, g_spf_full_runs,
+            g_spf_runs - g_spf_full_runs);
+    if (g_spf_runs > 0)
+    {
+        fprintf(out, "last run: %s, %u of %u routers and %u of %u prefixes recomputed\n",
+                g_spf_last_full ? "full" : "incremental", g_spf_last_nodes[0],
+                g_spf_last_nodes[1], g_spf_last_prefixes[0], g_spf_last_prefixes[1]);
+    }
+    if (g_spf_runs > 0)
+    {
+        fprintf(out, "run time: last %.3f ms, avg %.3f ms, max %.3f ms\n", g_spf_time_last / 1e6,
+                g_spf_time_total / 1e6 / g_spf_runs, g_spf_time_max / 1e6);
+    }
+    fprintf(out, "verify: %s, %lu runs checked, %lu mismatches\n", g_spf_verify ? "on" : "off",
+            g_spf_verified, g_spf_mismatches);
+    fprintf(out, "%-10s%10s%10s%10s%10s\n", "routes", "added", "changed", "withdrawn", "unchanged");
+    fprintf(out, "%-10s%10lu%10lu%10lu%10lu\n", "last run",
+            g_spf_last.added, g_spf_last.changed, g_spf_last.withdrawn, g_spf_last.unchanged);
+    fprintf(out, "%-10s%10lu%10lu%10lu%10lu\n", "total",
+            g_spf_total.added, g_spf_total.changed, g_spf_total.withdrawn, g_spf_total.unchanged);
+    pthread_mutex_unlock(&g_spf_lock);
+
+    pthread_mutex_lock(&g_sched.lock);
+    fprintf(out, "scheduler: %lu triggers, %lu coalesced, %lu runs%s\n", g_sched.triggers,
+            g_sched.coalesced, g_sched.runs, g_sched.pending ? ", one pending" : "");
+    fprintf(out, "throttle: delay %d ms, hold %u ms (initial %d, max %d)\n", SPF_INITIAL_DELAY_MS,
+            g_sched.started ? g_sched.hold_ms : SPF_HOLD_MS, SPF_HOLD_MS, SPF_MAX_HOLD_MS);
+    if (g_sched.runs > 0)
+    {
+        fprintf(out, "trigger to run: last %.1f ms, max %.1f ms\n", g_sched.wait_last / 1e6,
+                g_sched.wait_max / 1e6);
+    }
+    pthread_mutex_unlock(&g_sched.lock);
+} /* -- dijkstra_print_stats -- */
@@ -1,6 +1,7 @@
 #ifndef DIJKSTRA_H
 #define DIJKSTRA_H
 
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "sr_if.h"
@@ -8,26 +9,26 @@
 
 #include "sr_protocol.h"
 
-struct dijkstra_item
-{
-    struct pwospf_topology_entry* topology_entry;
-    uint8_t cost;
-    struct dijkstra_item* parent;
-    struct dijkstra_item* next;
-} __attribute__ ((packed)) ;
+/* Planificacion de SPF: el primer cambio despues de un rato tranquilo
+   corre a los SPF_INITIAL_DELAY_MS; si los cambios siguen llegando, entre
+   una corrida y la siguiente pasan al menos SPF_HOLD_MS, que se duplica
+   con cada corrida seguida hasta SPF_MAX_HOLD_MS y vuelve al valor
+   inicial despues de SPF_MAX_HOLD_MS sin cambios */
+#define SPF_INITIAL_DELAY_MS 50
+#define SPF_HOLD_MS          200
+#define SPF_MAX_HOLD_MS      5000
 
 struct dijkstra_param
 {
     struct sr_instance* sr;
-    struct pwospf_topology_entry* topology;
+    struct pwospf_lsdb* topology;
     struct in_addr rid;
-    pthread_mutex_t mutex;
 }__attribute__ ((packed));
 typedef struct dijkstra_param dijkstra_param_t;
 
 void* run_dijkstra(void*);
-void dijkstra_stack_push(struct dijkstra_item*, struct dijkstra_item*);
-void dijkstra_stack_reorder(struct dijkstra_item*);
-struct dijkstra_item* dijkstra_stack_pop(struct dijkstra_item*);
-struct dijkstra_item* create_dikjstra_item(struct pwospf_topology_entry*, uint8_t);
+void dijkstra_schedule(struct sr_instance*, struct pwospf_lsdb*, struct in_addr);
+void dijkstra_set_verify(int);
+void dijkstra_force_full(void);
+void dijkstra_print_stats(FILE*);
 #endif	/*DIJKSTRA_H*/
@@ -1,3 +1,5 @@
+#define SR_LOG_SUBSYS sr_sub_ospf
+
 #include "pwospf_neighbors.h"
 #include "pwospf_protocol.h"
 
@@ -30,61 +32,87 @@ void delete_neighbor(struct ospfv2_neighbor* previous_neighbor)
     free(temp);
 }
 
-struct ospfv2_neighbor* check_neighbors_alive(struct ospfv2_neighbor* first_neighbor)
+/* Lo toman la actualizacion y el vencimiento, que corren en hilos
+   distintos */
+static pthread_mutex_t g_neighbors_lock = PTHREAD_MUTEX_INITIALIZER;
+static void (*g_timeout_handler)(struct in_addr, void*);
+static void* g_timeout_arg;
+
+void set_neighbor_timeout_handler(void (*handler)(struct in_addr, void*), void* arg)
+{
+    g_timeout_handler = handler;
+    g_timeout_arg = arg;
+}
+
+/* Vencio un vecino: si no llego un HELLO mientras tanto (que habria
+   rearmado el timer), se saca de la lista, que empieza en arg */
+static void neighbor_expired(struct sr_timer* t)
 {
-    struct ospfv2_neighbor* ptr = first_neighbor;
-    struct ospfv2_neighbor* result = NULL;
+    struct ospfv2_neighbor* ptr = t->arg;
+    struct in_addr neighbor_id;
 
-    while(ptr != NULL)
+    pthread_mutex_lock(&g_neighbors_lock);
+    if (sr_timer_armed(t))
     {
-        if (ptr->next == NULL)
-        {
-            break;
-        }
+        pthread_mutex_unlock(&g_neighbors_lock);
+        return;
+    }
+    while (ptr->next != NULL && &ptr->next->timer != t)
+    {
+        ptr = ptr->next;
+    }
+    if (ptr->next == NULL)
+    {
+        pthread_mutex_unlock(&g_neighbors_lock);
+        return;
+    }
 
-        if (ptr->next->alive == 0)
-        {
-            Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table\n\n", inet_ntoa(ptr->next->neighbor_id));
-            struct ospfv2_neighbor* temp = result;
-            result = create_ospfv2_neighbor(ptr->next->neighbor_id);
-            result->next = temp;
-            delete_neighbor(ptr);
-        }
-        else
-        {
-            ptr->next->alive--;
-        }
+    neighbor_id = ptr->next->neighbor_id;
+    Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table\n\n", inet_ntoa(neighbor_id));
+    delete_neighbor(ptr);
+    pthread_mutex_unlock(&g_neighbors_lock);
 
-        ptr = ptr->next;
+    if (g_timeout_handler != NULL)
+    {
+        g_timeout_handler(neighbor_id, g_timeout_arg);
     }
-    return result;
 }
 
-void refresh_neighbors_alive(struct ospfv2_neighbor* first_neighbor, struct in_addr neighbor_id)
+/* Retorna 1 si el vecino es nuevo */
+int refresh_neighbors_alive(struct ospfv2_neighbor* first_neighbor, struct in_addr neighbor_id)
 {
-    struct ospfv2_neighbor* ptr = first_neighbor;
+    uint64_t deadline = sr_timer_now() + OSPF_NEIGHBOR_TIMEOUT * SR_TIMER_SEC;
+
+    pthread_mutex_lock(&g_neighbors_lock);
+    struct ospfv2_neighbor* ptr = first_neighbor->next;
     while(ptr != NULL)
     {
         if (ptr->neighbor_id.s_addr == neighbor_id.s_addr)
         {
             Debug("-> PWOSPF: Refreshing the neighbor, [ID = %s] in the alive neighbors table\n", inet_ntoa(neighbor_id));
-            ptr->alive = OSPF_NEIGHBOR_TIMEOUT;
-            return;
+            sr_timer_arm(&ptr->timer, deadline);
+            pthread_mutex_unlock(&g_neighbors_lock);
+            return 0;
         }
 
         ptr = ptr->next;
     }
 
     Debug("-> PWOSPF: Adding the neighbor, [ID = %s] to the alive neighbors table\n", inet_ntoa(neighbor_id));
-    add_neighbor(first_neighbor, create_ospfv2_neighbor(neighbor_id));
+    ptr = create_ospfv2_neighbor(neighbor_id);
+    sr_timer_init(&ptr->timer, neighbor_expired, first_neighbor);
+    add_neighbor(first_neighbor, ptr);
+    sr_timer_arm(&ptr->timer, deadline);
+    pthread_mutex_unlock(&g_neighbors_lock);
+    return 1;
 }
 
 struct ospfv2_neighbor* create_ospfv2_neighbor(struct in_addr neighbor_id)
 {
     struct ospfv2_neighbor* new_neighbor = ((struct ospfv2_neighbor*)(malloc(sizeof(struct ospfv2_neighbor))));
 
+    sr_timer_init(&new_neighbor->timer, NULL, NULL);
     new_neighbor->neighbor_id = neighbor_id;
-    new_neighbor->alive = OSPF_NEIGHBOR_TIMEOUT;
     new_neighbor->next = NULL;
 
     return new_neighbor;
@@ -9,27 +9,31 @@
 #include <stdlib.h>
 
 #include "sr_router.h"
+#include "sr_timer.h"
 
 
 /* ----------------------------------------------------------------------------
  * struct ospfv2_neighbor
  *
- * Mantiene una tabla de los vecinos vivos
+ * Mantiene una tabla de los vecinos vivos. Cada vecino tiene un timer que
+ * vence OSPF_NEIGHBOR_TIMEOUT segundos después de su último HELLO; al
+ * vencer se saca de la tabla y se avisa con el manejador de
+ * set_neighbor_timeout_handler.
  *
  * -------------------------------------------------------------------------- */
 
 struct ospfv2_neighbor
 {
+    struct sr_timer timer;      /* -- vence si no llegan HELLOs -- */
     struct in_addr neighbor_id; /* -- the neighbor id -- */
-    uint8_t alive;        /* -- alive since [in seconds] -- */
     struct ospfv2_neighbor* next;
-}__attribute__ ((packed));
+};
 
 
 void add_neighbor(struct ospfv2_neighbor*, struct ospfv2_neighbor*);
 void delete_neighbor(struct ospfv2_neighbor*);
-struct ospfv2_neighbor* check_neighbors_alive(struct ospfv2_neighbor*);
-void refresh_neighbors_alive(struct ospfv2_neighbor*, struct in_addr);
+void set_neighbor_timeout_handler(void (*)(struct in_addr, void*), void*);
+int refresh_neighbors_alive(struct ospfv2_neighbor*, struct in_addr);
 struct ospfv2_neighbor* create_ospfv2_neighbor(struct in_addr);
 
 
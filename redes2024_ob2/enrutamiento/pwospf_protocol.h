@@ -17,8 +17,11 @@
 #define OSPF_AllSPFRouters 0xe0000005 /*"224.0.0.5"*/
 
 #define OSPF_TYPE_HELLO 1
+#define OSPF_TYPE_DBD   2
+#define OSPF_TYPE_LSR   3
 #define OSPF_TYPE_LSU   4
 #define OSPF_TYPE_LSUPDATE 4
+#define OSPF_TYPE_LSACK 5
 #define OSPF_NET_BROADCAST 1
 #define OSPF_DEFAULT_HELLOINT   5 /* seconds */
 #define OSPF_DEFAULT_LSUINT    30 /* seconds */
@@ -26,6 +29,12 @@
 
 #define OSPF_TOPO_ENTRY_TIMEOUT 35 /* seconds */ 
 
+#define OSPF_DBD_F_INIT 0x01 /* first summary of an exchange, answer with ours */
+
+/* LSU sequence numbers wrap at 16 bits: > 0 if a is newer than b, 0 if
+   equal, < 0 if older */
+#define OSPF_SEQ_CMP(a, b) ((int16_t)(uint16_t)((a) - (b)))
+
 #define OSPF_DEFAULT_AUTHKEY   0 /* ignored */
 
 #define OSPF_MAX_HELLO_SIZE  1024 /* bytes */
@@ -71,5 +80,39 @@ struct ospfv2_lsa
 }__attribute__ ((packed));
 typedef struct ospfv2_lsa ospfv2_lsa_t;
 
+/* Database description: one summary per LSA in the sender's database */
+struct ospfv2_dbd_hdr
+{
+    uint8_t  flags;    /* OSPF_DBD_F_* */
+    uint8_t  unused;
+    uint16_t padding;
+    uint32_t num_sum;  /* number of summaries */
+}__attribute__ ((packed));
+typedef struct ospfv2_dbd_hdr ospfv2_dbd_hdr_t;
+
+struct ospfv2_lsa_sum
+{
+    uint32_t rid;      /* -- originating router id -- */
+    uint16_t seq;      /* -- sequence number of its LSU -- */
+    uint16_t padding;
+}__attribute__ ((packed));
+typedef struct ospfv2_lsa_sum ospfv2_lsa_sum_t;
+
+/* Link state request: followed by num_req router ids, each answered with
+   that router's LSU */
+struct ospfv2_lsr_hdr
+{
+    uint32_t num_req;
+}__attribute__ ((packed));
+typedef struct ospfv2_lsr_hdr ospfv2_lsr_hdr_t;
+
+/* Link state acknowledgement: followed by num_ack summaries, one per LSU
+   received (router id and sequence) */
+struct ospfv2_lsack_hdr
+{
+    uint32_t num_ack;
+}__attribute__ ((packed));
+typedef struct ospfv2_lsack_hdr ospfv2_lsack_hdr_t;
+
 
 #endif  /* PWOSPF_PROTOCOL_H */
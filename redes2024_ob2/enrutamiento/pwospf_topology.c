@@ -1,218 +1,352 @@
+#define SR_LOG_SUBSYS sr_sub_ospf
+
+#include <stddef.h>
+#include <string.h>
+
 #include "pwospf_topology.h"
 #include "pwospf_protocol.h"
 
-void add_topology_entry(struct pwospf_topology_entry* first_entry, struct pwospf_topology_entry* new_entry)
+#define LSDB_INITIAL_BUCKETS 16
+
+/* Los router IDs suelen diferir en los ultimos bits; los mezclo para que
+   los buckets se repartan bien con una mascara */
+static uint32_t lsdb_hash(uint32_t rid)
+{
+    uint32_t h = rid;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static struct pwospf_lsdb_router* lsdb_find(struct pwospf_lsdb* db, uint32_t rid)
 {
-    if (first_entry->next != NULL)
+    struct pwospf_lsdb_router* r = db->buckets[lsdb_hash(rid) & db->mask];
+
+    while (r != NULL && r->router_id.s_addr != rid)
     {
-        new_entry->next = first_entry->next;
-        first_entry->next = new_entry;
+        r = r->next;
     }
-    else
+    return r;
+}
+
+/* Duplica los buckets cuando hay mas routers que buckets */
+static void lsdb_grow(struct pwospf_lsdb* db)
+{
+    uint32_t nmask = db->mask * 2 + 1;
+    struct pwospf_lsdb_router** nb = calloc(nmask + 1, sizeof(struct pwospf_lsdb_router*));
+    uint32_t i;
+
+    if (nb == NULL)
+    {
+        return;
+    }
+    for (i = 0; i <= db->mask; i++)
     {
-        first_entry->next = new_entry;
+        struct pwospf_lsdb_router* r = db->buckets[i];
+        while (r != NULL)
+        {
+            struct pwospf_lsdb_router* next = r->next;
+            uint32_t b = lsdb_hash(r->router_id.s_addr) & nmask;
+            r->next = nb[b];
+            nb[b] = r;
+            r = next;
+        }
     }
+    free(db->buckets);
+    db->buckets = nb;
+    db->mask = nmask;
 }
 
-void delete_topology_entry(struct pwospf_topology_entry* previous_entry)
+/* Vencio el LSA de un router: si no llego otro mientras tanto (que habria
+   rearmado el timer), se saca el router */
+static void lsdb_expired(struct sr_timer* t)
 {
-    struct pwospf_topology_entry* temp = previous_entry->next;
+    struct pwospf_lsdb* db = t->arg;
+    struct pwospf_lsdb_router* r =
+        (struct pwospf_lsdb_router*)((char*)t - offsetof(struct pwospf_lsdb_router, timer));
+    struct pwospf_lsdb_router** pr;
 
-    if (previous_entry->next->next != NULL)
+    pthread_mutex_lock(&db->lock);
+    if (sr_timer_armed(t))
     {
-        previous_entry->next = previous_entry->next->next;
+        pthread_mutex_unlock(&db->lock);
+        return;
     }
-    else
+
+    Debug("\n\n**** PWOSPF: Removing the LSA of a router from the topology table *****\n");
+    Debug("        [Router ID = %s]\n", inet_ntoa(r->router_id));
+    Debug("        [Sequence = %d]\n", r->lsa->sequence_num);
+    Debug("        [Links = %u]\n\n", r->lsa->nlinks);
+
+    pr = &db->buckets[lsdb_hash(r->router_id.s_addr) & db->mask];
+    while (*pr != r)
     {
-        previous_entry->next = NULL;
+        pr = &(*pr)->next;
     }
+    *pr = r->next;
+    db->nlinks -= r->lsa->nlinks;
+    db->nrouters--;
+    free(r->lsa);
+    free(r);
+    pthread_mutex_unlock(&db->lock);
 
-    free(temp);
+    if (db->expired != NULL)
+    {
+        db->expired(db, db->expired_arg);
+    }
 }
 
-uint8_t check_topology_age(struct pwospf_topology_entry* first_entry)
+/* expired se llama (sin el lock) cada vez que vence el LSA de un router */
+struct pwospf_lsdb* pwospf_lsdb_create(void (*expired)(struct pwospf_lsdb*, void*), void* arg)
 {
-    struct pwospf_topology_entry* ptr = first_entry;
+    struct pwospf_lsdb* db = ((struct pwospf_lsdb*)(calloc(1, sizeof(struct pwospf_lsdb))));
+
+    pthread_mutex_init(&db->lock, NULL);
+    db->expired = expired;
+    db->expired_arg = arg;
+    db->mask = LSDB_INITIAL_BUCKETS - 1;
+    db->buckets = calloc(LSDB_INITIAL_BUCKETS, sizeof(struct pwospf_lsdb_router*));
 
-    uint8_t deleted = 0;
-    while(ptr != NULL)
+    return db;
+}
+
+void pwospf_lsdb_destroy(struct pwospf_lsdb* db)
+{
+    uint32_t i;
+
+    for (i = 0; i <= db->mask; i++)
     {
-        if (ptr->next == NULL)
+        struct pwospf_lsdb_router* r = db->buckets[i];
+        while (r != NULL)
         {
-            break;
+            struct pwospf_lsdb_router* next = r->next;
+            sr_timer_cancel(&r->timer);
+            free(r->lsa);
+            free(r);
+            r = next;
         }
+    }
+    free(db->buckets);
+    pthread_mutex_destroy(&db->lock);
+    free(db);
+}
 
-        if (ptr->next->age == OSPF_TOPO_ENTRY_TIMEOUT)
-        {
-            Debug("\n\n**** PWOSPF: Removing a topology entry from the topology table *****\n");
-            Debug("        [Network = %s]\n", inet_ntoa(ptr->next->net_num));
-            Debug("        [Mask = %s]\n", inet_ntoa(ptr->next->net_mask));
-            Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->next->neighbor_id));
-            Debug("        [Age = %d]\n\n", ptr->next->age);
+void pwospf_lsdb_lock(struct pwospf_lsdb* db)
+{
+    pthread_mutex_lock(&db->lock);
+}
+
+void pwospf_lsdb_unlock(struct pwospf_lsdb* db)
+{
+    pthread_mutex_unlock(&db->lock);
+}
 
-            delete_topology_entry(ptr);
+/* El LSA instalado de un router, o NULL; con el lock tomado, y vale
+   hasta soltarlo */
+struct pwospf_lsa* pwospf_lsdb_lookup(struct pwospf_lsdb* db, struct in_addr router_id)
+{
+    struct pwospf_lsdb_router* r = lsdb_find(db, router_id.s_addr);
 
-            deleted = 1;
-        }
-        else
-        {
-            ptr->next->age++;
-        }
+    return r != NULL ? r->lsa : NULL;
+}
 
-        ptr = ptr->next;
+/* El LSA, sus nlinks enlaces y la copia del LSU (si lo hay) van en un
+   solo bloque; quien lo crea llena los enlaces */
+struct pwospf_lsa* pwospf_lsa_create(struct in_addr router_id, uint16_t sequence_num, uint32_t nlinks,
+                                     const uint8_t* lsu, unsigned int lsu_len)
+{
+    struct pwospf_lsa* lsa = ((struct pwospf_lsa*)(malloc(sizeof(struct pwospf_lsa) + nlinks * sizeof(struct pwospf_link) + lsu_len)));
+
+    lsa->router_id = router_id;
+    lsa->sequence_num = sequence_num;
+    lsa->nlinks = nlinks;
+    lsa->links = (struct pwospf_link*)(lsa + 1);
+    lsa->lsu = NULL;
+    lsa->lsu_len = 0;
+    if (lsu != NULL)
+    {
+        lsa->lsu = (uint8_t*)(lsa->links + nlinks);
+        lsa->lsu_len = lsu_len;
+        memcpy(lsa->lsu, lsu, lsu_len);
     }
 
-    return deleted;
+    return lsa;
 }
 
-void refresh_topology_entry(struct pwospf_topology_entry* first_entry, struct in_addr router_id, struct in_addr net_num, struct in_addr net_mask,
-    struct in_addr neighbor_id, struct in_addr next_hop, uint16_t sequence_num)
+/* Saca del LSA los enlaces a un vecino que anuncia la misma red hacia otro
+   router: el enlace no puede ser de los dos */
+static void lsdb_check_links(struct pwospf_lsdb* db, struct pwospf_lsa* lsa)
 {
-    struct pwospf_topology_entry* ptr = first_entry->next;
-    while(ptr != NULL)
+    uint32_t i, j, n = 0;
+
+    for (i = 0; i < lsa->nlinks; i++)
     {
-        if ((ptr->net_num.s_addr == net_num.s_addr) && (ptr->net_mask.s_addr == net_mask.s_addr))
+        struct pwospf_link* l = &lsa->links[i];
+        struct pwospf_lsdb_router* nb = NULL;
+        int valid = 1;
+
+        if (l->neighbor_id.s_addr != 0)
         {
-            if (ptr->router_id.s_addr == router_id.s_addr)
-            {
-                Debug("-> PWOSPF: Refreshing a topology entry in the toplogy table\n");
-                Debug("        [Network = %s]\n", inet_ntoa(ptr->net_num));
-                Debug("        [Mask = %s]\n", inet_ntoa(ptr->net_mask));
-                Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->neighbor_id));
-
-                ptr->age = 0; /*OSPF_TOPO_ENTRY_TIMEOUT*/
-                ptr->sequence_num = sequence_num;
-                ptr->neighbor_id.s_addr = neighbor_id.s_addr;
-                return;
-            }
-            /* first condition */
-            else if ((ptr->neighbor_id.s_addr != 0) && ((ptr->router_id.s_addr != neighbor_id.s_addr) || (ptr->neighbor_id.s_addr != router_id.s_addr)))
-            {
-                Debug("-> PWOSPF: Droping a topology entry: Invalid entry neighbor\n");
-                Debug("        [Network = %s]\n", inet_ntoa(net_num));
-                Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
-                Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-                return;
-            }
-            /* second condition */
-            else if ((ptr->neighbor_id.s_addr == router_id.s_addr) && (ptr->net_mask.s_addr != net_mask.s_addr))
+            nb = lsdb_find(db, l->neighbor_id.s_addr);
+        }
+        for (j = 0; nb != NULL && j < nb->lsa->nlinks; j++)
+        {
+            struct pwospf_link* o = &nb->lsa->links[j];
+            if (o->net_num.s_addr == l->net_num.s_addr && o->net_mask.s_addr == l->net_mask.s_addr &&
+                o->neighbor_id.s_addr != 0 && o->neighbor_id.s_addr != lsa->router_id.s_addr)
             {
-                Debug("-> PWOSPF: Droping a topology entry: Invalid entry subnet mask\n");
-                Debug("        [Network = %s]\n", inet_ntoa(net_num));
-                Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
-                Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-                return;
+                valid = 0;
+                break;
             }
         }
 
-        ptr = ptr->next;
+        if (!valid)
+        {
+            Debug("-> PWOSPF: Droping a topology entry: Invalid entry neighbor\n");
+            Debug("        [Network = %s]\n", inet_ntoa(l->net_num));
+            Debug("        [Mask = %s]\n", inet_ntoa(l->net_mask));
+            Debug("        [Neighbor ID = %s]\n", inet_ntoa(l->neighbor_id));
+            continue;
+        }
+        lsa->links[n++] = *l;
     }
-
-    Debug("-> PWOSPF: Adding a topology entry in the toplogy table\n");
-    Debug("        [Network = %s]\n", inet_ntoa(net_num));
-    Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
-    Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-    add_topology_entry(first_entry, create_ospfv2_topology_entry(router_id, net_num, net_mask, neighbor_id, next_hop, sequence_num));
+    lsa->nlinks = n;
 }
 
-struct pwospf_topology_entry* create_ospfv2_topology_entry(struct in_addr router_id, struct in_addr net_num, struct in_addr net_mask,
-    struct in_addr neighbor_id, struct in_addr next_hop, uint16_t sequence_num)
+/* Instala el LSA si es mas nuevo que el que hay para ese router, y se
+   queda con el en cualquier caso. Devuelve 1 si lo instalo */
+uint8_t pwospf_lsdb_install(struct pwospf_lsdb* db, struct pwospf_lsa* lsa)
 {
-    struct pwospf_topology_entry* new_entry = ((struct pwospf_topology_entry*)(malloc(sizeof(struct pwospf_topology_entry))));
-
-    new_entry->router_id = router_id;
-    new_entry->net_num = net_num;
-    new_entry->net_mask = net_mask;
-    new_entry->neighbor_id = neighbor_id;
-    new_entry->next_hop = next_hop;
-    new_entry->sequence_num = sequence_num;
-    new_entry->age = 0;
-    new_entry->next = NULL;
-
-    return new_entry;
-}
+    struct pwospf_lsdb_router* r;
+    struct pwospf_lsa* old = NULL;
 
-struct pwospf_topology_entry* clone_ospfv2_topology_entry(struct pwospf_topology_entry* entry)
-{
-    struct pwospf_topology_entry* copy_entry = ((struct pwospf_topology_entry*)(malloc(sizeof(struct pwospf_topology_entry))));
-
-    copy_entry->router_id = entry->router_id;
-    copy_entry->net_num = entry->net_num;
-    copy_entry->net_mask = entry->net_mask;
-    copy_entry->neighbor_id = entry->neighbor_id;
-    copy_entry->next_hop = entry->next_hop;
-    copy_entry->sequence_num = entry->sequence_num;
-    copy_entry->age = entry->age;
-    copy_entry->next = entry->next;
-
-    return copy_entry;
+    pthread_mutex_lock(&db->lock);
+    r = lsdb_find(db, lsa->router_id.s_addr);
+    if (r != NULL && OSPF_SEQ_CMP(r->lsa->sequence_num, lsa->sequence_num) >= 0)
+    {
+        pthread_mutex_unlock(&db->lock);
+        free(lsa);
+        return 0;
+    }
+
+    lsdb_check_links(db, lsa);
+
+    Debug("-> PWOSPF: Installing the LSA of a router in the topology table\n");
+    Debug("        [Router ID = %s]\n", inet_ntoa(lsa->router_id));
+    Debug("        [Sequence = %d]\n", lsa->sequence_num);
+    Debug("        [Links = %u]\n", lsa->nlinks);
+
+    if (r == NULL)
+    {
+        uint32_t b;
+
+        if (db->nrouters > db->mask)
+        {
+            lsdb_grow(db);
+        }
+        r = ((struct pwospf_lsdb_router*)(malloc(sizeof(struct pwospf_lsdb_router))));
+        sr_timer_init(&r->timer, lsdb_expired, db);
+        r->router_id = lsa->router_id;
+        r->lsa = NULL;
+        b = lsdb_hash(r->router_id.s_addr) & db->mask;
+        r->next = db->buckets[b];
+        db->buckets[b] = r;
+        db->nrouters++;
+    }
+    else
+    {
+        old = r->lsa;
+        db->nlinks -= old->nlinks;
+    }
+    r->lsa = lsa;
+    db->nlinks += lsa->nlinks;
+    sr_timer_arm(&r->timer, sr_timer_now() + OSPF_TOPO_ENTRY_TIMEOUT * SR_TIMER_SEC);
+    pthread_mutex_unlock(&db->lock);
+
+    free(old);
+    return 1;
 }
 
-void print_topolgy_table(struct pwospf_topology_entry* first_entry)
+void print_topolgy_table(struct pwospf_lsdb* db)
 {
+    uint64_t now = sr_timer_now();
+    uint32_t i, j;
+
     /*Debug("--------------------------------------------------------------------------------------------------------\n");*/
     Debug("========================================================================================================\n");
     Debug("%-18s%-18s%-18s%-18s%-18s%-11sAge\n", "Router ID", "Subnet", "Subnet Mask", "Neighbor ID", "Next Hop", "Sequence");
     Debug("%-18s%-18s%-18s%-18s%-18s%-11s---\n", "---------", "------", "-----------", "-----------", "--------", "--------");
 
-    struct pwospf_topology_entry* entry = first_entry->next;
-    if (entry == NULL)
+    pthread_mutex_lock(&db->lock);
+    if (db->nlinks == 0)
     {
         Debug("The topology table is empty");
     }
-    else
+    for (i = 0; i <= db->mask; i++)
     {
-        while(entry != NULL)
+        struct pwospf_lsdb_router* r;
+        for (r = db->buckets[i]; r != NULL; r = r->next)
         {
-            Debug("%-18s",inet_ntoa(entry->router_id));
-            Debug("%-18s",inet_ntoa(entry->net_num));
-            Debug("%-18s",inet_ntoa(entry->net_mask));
-            Debug("%-18s",inet_ntoa(entry->neighbor_id));
-            Debug("%-18s",inet_ntoa(entry->next_hop));
-            Debug("%-11d",entry->sequence_num);
-            Debug("%d\n",entry->age);
-
-            entry = entry->next; 
+            for (j = 0; j < r->lsa->nlinks; j++)
+            {
+                struct pwospf_link* l = &r->lsa->links[j];
+
+                Debug("%-18s",inet_ntoa(r->router_id));
+                Debug("%-18s",inet_ntoa(l->net_num));
+                Debug("%-18s",inet_ntoa(l->net_mask));
+                Debug("%-18s",inet_ntoa(l->neighbor_id));
+                Debug("%-18s",inet_ntoa(l->next_hop));
+                Debug("%-11d",r->lsa->sequence_num);
+                Debug("%d\n",(int)(OSPF_TOPO_ENTRY_TIMEOUT - (int64_t)(r->timer.deadline - now) / (int64_t)SR_TIMER_SEC));
+            }
         }
     }
+    pthread_mutex_unlock(&db->lock);
     Debug("========================================================================================================\n");
 }
 
-uint8_t search_topolgy_table(struct pwospf_topology_entry* first_entry, uint32_t subnet)
+uint8_t search_topolgy_table(struct pwospf_lsdb* db, uint32_t subnet)
 {
-    struct pwospf_topology_entry* entry = first_entry->next;
-    while(entry != NULL)
+    uint8_t found = 0;
+    uint32_t i, j;
+
+    pthread_mutex_lock(&db->lock);
+    for (i = 0; i <= db->mask && !found; i++)
     {
-        if (entry->net_num.s_addr == subnet)
+        struct pwospf_lsdb_router* r;
+        for (r = db->buckets[i]; r != NULL && !found; r = r->next)
         {
-            return 1;
+            for (j = 0; j < r->lsa->nlinks; j++)
+            {
+                if (r->lsa->links[j].net_num.s_addr == subnet)
+                {
+                    found = 1;
+                    break;
+                }
+            }
         }
-
-        entry = entry->next;
     }
+    pthread_mutex_unlock(&db->lock);
 
-    return 0;
+    return found;
 }
 
-uint8_t check_sequence_number(struct pwospf_topology_entry* first_entry, struct in_addr router_id, uint16_t sequence_num)
+uint8_t check_sequence_number(struct pwospf_lsdb* db, struct in_addr router_id, uint16_t sequence_num)
 {
-    struct pwospf_topology_entry* entry = first_entry->next;
-    while(entry != NULL)
-    {
-        if (entry->router_id.s_addr == router_id.s_addr)
-        {
-            if (entry->sequence_num < sequence_num)
-            {
-                return 1;
-            }
-            else
-            {
-                return 0;
-            }
-        }
+    struct pwospf_lsdb_router* r;
+    uint8_t newer = 1;
 
-        entry = entry->next;
+    pthread_mutex_lock(&db->lock);
+    r = lsdb_find(db, router_id.s_addr);
+    if (r != NULL && OSPF_SEQ_CMP(r->lsa->sequence_num, sequence_num) >= 0)
+    {
+        newer = 0;
     }
+    pthread_mutex_unlock(&db->lock);
 
-    return 1;
+    return newer;
 }
@@ -7,38 +7,92 @@
 
 #include <netinet/in.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "sr_router.h"
+#include "sr_timer.h"
 
 
 /* ----------------------------------------------------------------------------
- * struct pwospf_topology_entry
+ * struct pwospf_link
  *
+ * Un enlace anunciado en un LSA
  *
  * -------------------------------------------------------------------------- */
 
-struct pwospf_topology_entry
+struct pwospf_link
 {
-    struct in_addr router_id;     /* -- id del router -- */
     struct in_addr net_num;       /* -- prefijo -- */
     struct in_addr net_mask;      /* -- máscara -- */
-    struct in_addr neighbor_id;   /* -- id del vecino -- */
+    struct in_addr neighbor_id;   /* -- id del vecino, 0 si es una red stub -- */
     struct in_addr next_hop;      /* -- próximo salto -- */
-    uint16_t sequence_num;        /* -- número de secuencia del último LSU -- */
-    int age;                      /* -- edad de la entrada -- */
-    struct pwospf_topology_entry* next;
-}__attribute__ ((packed));
-
-
-void add_topology_entry(struct pwospf_topology_entry*, struct pwospf_topology_entry*);
-void delete_topology_entry(struct pwospf_topology_entry*);
-uint8_t check_topology_age(struct pwospf_topology_entry*);
-void refresh_topology_entry(struct pwospf_topology_entry*, struct in_addr, struct in_addr, struct in_addr, struct in_addr, struct in_addr, uint16_t);
-struct pwospf_topology_entry* create_ospfv2_topology_entry(struct in_addr, struct in_addr, struct in_addr, struct in_addr, struct in_addr, uint16_t);
-struct pwospf_topology_entry* clone_ospfv2_topology_entry(struct pwospf_topology_entry*);
-void print_topolgy_table(struct pwospf_topology_entry*);
-uint8_t search_topolgy_table(struct pwospf_topology_entry*, uint32_t);
-uint8_t check_sequence_number(struct pwospf_topology_entry* first_entry, struct in_addr router_id, uint16_t sequence_num);
+};
+
+/* ----------------------------------------------------------------------------
+ * struct pwospf_lsa
+ *
+ * El último LSU de un router: número de secuencia y sus enlaces, en un
+ * arreglo contiguo que va en el mismo bloque de memoria junto con una
+ * copia del paquete OSPF tal como llegó (lo que se contesta a un LSR; la
+ * base puede haber descartado enlaces). Una vez instalado no se modifica;
+ * un LSU nuevo trae un LSA nuevo que lo reemplaza.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct pwospf_lsa
+{
+    struct in_addr router_id;     /* -- id del router -- */
+    uint16_t sequence_num;        /* -- número de secuencia del LSU -- */
+    uint32_t nlinks;
+    struct pwospf_link* links;
+    uint8_t* lsu;                 /* -- el LSU recibido, NULL si no hay -- */
+    unsigned int lsu_len;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct pwospf_lsdb
+ *
+ * Base de LSAs, un hash por router ID. Cada router tiene un registro fijo
+ * que apunta a su LSA; reemplazarlo es cambiar ese puntero. Quien recorre
+ * la base (Dijkstra, la impresión) lo hace con el lock tomado, así que ve
+ * cada LSA entero, el viejo o el nuevo.
+ *
+ * Cada registro tiene un timer que vence OSPF_TOPO_ENTRY_TIMEOUT segundos
+ * después del último LSU del router; al vencer se saca el router y se
+ * llama a expired.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct pwospf_lsdb_router
+{
+    struct sr_timer timer;        /* -- vencimiento del LSA -- */
+    struct in_addr router_id;
+    struct pwospf_lsa* lsa;
+    struct pwospf_lsdb_router* next;
+};
+
+struct pwospf_lsdb
+{
+    pthread_mutex_t lock;
+    struct pwospf_lsdb_router** buckets;
+    uint32_t mask;                /* -- cantidad de buckets menos uno -- */
+    uint32_t nrouters;
+    uint32_t nlinks;              /* -- enlaces de todos los LSAs -- */
+    void (*expired)(struct pwospf_lsdb*, void*);
+    void* expired_arg;
+};
+
+
+struct pwospf_lsdb* pwospf_lsdb_create(void (*)(struct pwospf_lsdb*, void*), void*);
+void pwospf_lsdb_destroy(struct pwospf_lsdb*);
+void pwospf_lsdb_lock(struct pwospf_lsdb*);
+void pwospf_lsdb_unlock(struct pwospf_lsdb*);
+struct pwospf_lsa* pwospf_lsdb_lookup(struct pwospf_lsdb*, struct in_addr);
+struct pwospf_lsa* pwospf_lsa_create(struct in_addr, uint16_t, uint32_t, const uint8_t*, unsigned int);
+uint8_t pwospf_lsdb_install(struct pwospf_lsdb*, struct pwospf_lsa*);
+void print_topolgy_table(struct pwospf_lsdb*);
+uint8_t search_topolgy_table(struct pwospf_lsdb*, uint32_t);
+uint8_t check_sequence_number(struct pwospf_lsdb*, struct in_addr, uint16_t);
 
 
 #endif  /* --  PWOSPF_TOPOLOGY -- */
@@ -15,7 +15,7 @@
 /* Envía una solicitud ARP */
 void sr_arp_request_send(struct sr_instance *sr, uint32_t ip) {
 
-  printf("$$$ -> Send ARP request.\n");
+  sr_log_debug(sr_sub_arp, "$$$ -> Send ARP request.\n");
 
   /* Obtengo memoria para el paquete */
   int arpPacketLen = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
@@ -29,7 +29,7 @@ void sr_arp_request_send(struct sr_instance *sr, uint32_t ip) {
   struct sr_if *currIf = sr->if_list;
   uint8_t *copyPacket;
   while (currIf != NULL) {
-      printf("$$$$ -> Send ARP request from interface %s.\n", currIf->name);
+      sr_log_debug(sr_sub_arp, "$$$$ -> Send ARP request from interface %s.\n", currIf->name);
 
       /* Agrero la dirección de origen y el tipo de paquete */
       memcpy(ethHdr->ether_shost, (uint8_t *) currIf->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
@@ -50,12 +50,12 @@ void sr_arp_request_send(struct sr_instance *sr, uint32_t ip) {
       copyPacket = malloc(arpPacketLen);
       memcpy(copyPacket, ethHdr, arpPacketLen);
 
-      print_hdrs(copyPacket, arpPacketLen);
+      DebugHdrs(copyPacket, arpPacketLen);
       sr_send_packet(sr, copyPacket, arpPacketLen, currIf->name);
 
       currIf = currIf->next;
   }
-  printf("$$$ -> Send ARP request processing complete.\n");
+  sr_log_debug(sr_sub_arp, "$$$ -> Send ARP request processing complete.\n");
 }
 
 /* 
@@ -176,7 +176,8 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
 		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
+        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN - 1);
+        new_pkt->iface[sr_IFACE_NAMELEN - 1] = '\0';
         new_pkt->next = req->packets;
         req->packets = new_pkt;
     }
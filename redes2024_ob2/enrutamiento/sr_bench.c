@@ -0,0 +1,1025 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Descripción:
+ *
+ * Microbenchmarks de las primitivas del camino caliente, para comparar
+ * entre commits (make bench):
+ *
+ *   lpm               tablas de 10 a 1M rutas
+ *   arpcache_lookup   acierto y fallo con la cache llena al 0-100%
+ *   arpcache_insert   con la cache llena al 0-100%
+ *   cksum             largos de 20 a 9000 bytes
+ *   is_packet_valid   ICMP, ARP y un IP con checksum invalido
+ *   sr_get_interface  3 y 16 interfaces, acierto y fallo
+ *   run_dijkstra      anillos de 4 a 1024 routers, grillas de 3x3 a 64x64 y
+ *                     una estrella de 4,
+ *                     corrida completa e incremental (/stub, /link, /down)
+ *
+ * Cada caso se calibra para que una muestra dure al menos -s microsegundos,
+ * se descartan -w muestras de calentamiento y se toman -r muestras. Se
+ * informan min, mediana, p90, p99, max, media y desvio del tiempo por
+ * operacion en una tabla y en JSON (-o), un resultado por linea para que
+ * sea facil de procesar. Con -c se compara contra un JSON anterior y se
+ * marca como regresion toda mediana que empeore mas de -T por ciento; el
+ * programa termina con 1 si hubo alguna.
+ *
+ * Uso: ./sr_bench [-f filtro] [-r muestras] [-w muestras] [-s us] [-q]
+ *                 [-l etiqueta] [-o salida.json] [-c base.json] [-T %]
+ *
+ * Enlaza el router sin sr_main.o ni sr_vns_comm.o, como sr_replay.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_protocol.h"
+#include "sr_arpcache.h"
+#include "sr_parse.h"
+#include "sr_pwospf.h"
+#include "sr_utils.h"
+#include "sr_log.h"
+#include "pwospf_topology.h"
+#include "dijkstra.h"
+
+#define BENCH_DEFAULT_SAMPLES   30
+#define BENCH_DEFAULT_WARMUP    3
+#define BENCH_DEFAULT_SAMPLE_US 2000
+#define BENCH_DEFAULT_THRESHOLD 10.0
+#define BENCH_MAX_SAMPLES       1000
+#define BENCH_MAX_RESULTS       128
+#define BENCH_ADDRS             4096   /* direcciones de consulta para lpm */
+#define BENCH_MAX_IFACES        16
+
+/* Definida en sr_router.c, sin prototipo en un header */
+struct sr_rt* lpm(struct sr_instance* sr, uint32_t dest_ip);
+
+struct bench_result
+{
+    char name[64];
+    long iters;
+    double min, median, p90, p99, max, mean, stddev;
+};
+
+static struct bench_result g_results[BENCH_MAX_RESULTS];
+static int g_nresults;
+
+static const char* g_filter;
+static int g_samples = BENCH_DEFAULT_SAMPLES;
+static int g_warmup = BENCH_DEFAULT_WARMUP;
+static double g_sample_ns = BENCH_DEFAULT_SAMPLE_US * 1e3;
+static int g_quick;
+
+/* Evita que el compilador descarte los resultados */
+static volatile uintptr_t g_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+ * Stub: los benchmarks no envian tramas
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len, const char* iface)
+{
+    return 0;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Format: %s [-f filter] [-r samples] [-w warmup samples] [-s sample us] [-q]\n"
+                    "          [-l label] [-o out.json] [-c baseline.json] [-T threshold %%]\n",
+            argv0);
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double* sorted, int n, double p)
+{
+    int i = (int) ceil(p * n) - 1;
+
+    return sorted[i < 0 ? 0 : (i >= n ? n - 1 : i)];
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: bench_run
+ *
+ * Mide fn(ctx, iters): calibra iters para que una muestra dure al menos
+ * g_sample_ns, descarta g_warmup muestras y guarda las estadisticas de
+ * g_samples muestras en ns por operacion.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void bench_run(const char* name, void (*fn)(void*, long), void* ctx)
+{
+    static double samples[BENCH_MAX_SAMPLES];
+    struct bench_result* r;
+    long iters = 1;
+    double t, sum = 0, sq = 0;
+    int i;
+
+    if ((g_filter != 0 && strstr(name, g_filter) == 0) || g_nresults == BENCH_MAX_RESULTS)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        t = now_ns();
+        fn(ctx, iters);
+        t = now_ns() - t;
+        if (t >= g_sample_ns || iters >= (1L << 30))
+        {
+            break;
+        }
+        iters = t < g_sample_ns / 64 ? iters * 8 : iters * 2;
+    }
+
+    for (i = 0; i < g_warmup; i++)
+    {
+        fn(ctx, iters);
+    }
+    for (i = 0; i < g_samples; i++)
+    {
+        t = now_ns();
+        fn(ctx, iters);
+        samples[i] = (now_ns() - t) / iters;
+        sum += samples[i];
+    }
+    qsort(samples, g_samples, sizeof(double), cmp_double);
+
+    r = &g_results[g_nresults++];
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->iters = iters;
+    r->mean = sum / g_samples;
+    for (i = 0; i < g_samples; i++)
+    {
+        sq += (samples[i] - r->mean) * (samples[i] - r->mean);
+    }
+    r->stddev = g_samples > 1 ? sqrt(sq / (g_samples - 1)) : 0;
+    r->min = samples[0];
+    r->median = percentile(samples, g_samples, 0.50);
+    r->p90 = percentile(samples, g_samples, 0.90);
+    r->p99 = percentile(samples, g_samples, 0.99);
+    r->max = samples[g_samples - 1];
+
+    printf("%-36s %10.1f %10.1f %10.1f %10.1f %10.1f %8.1f%%\n", r->name, r->min, r->median,
+           r->p90, r->p99, r->max, r->mean > 0 ? 100 * r->stddev / r->mean : 0.0);
+    fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+ * Instancia del router para los benchmarks
+ *---------------------------------------------------------------------------*/
+
+static void bench_init_sr(struct sr_instance* sr)
+{
+    memset(sr, 0, sizeof(*sr));
+    sr->sockfd = -1;
+    sr->validation_tier = sr_validate_local;
+    sr_arpcache_init(&sr->cache);
+    /* Solo el lock que usa lpm, sin los hilos de PWOSPF */
+    sr->ospf_subsys = malloc(sizeof(struct pwospf_subsys));
+    pthread_mutex_init(&sr->ospf_subsys->lock, 0);
+}
+
+/* Agrega n interfaces eth1..ethn, la i-esima en 10.i.0.1/24 */
+static void bench_add_ifaces(struct sr_instance* sr, int n)
+{
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x0a, 0, 0, 0, 0, 0 };
+    char name[sr_IFACE_NAMELEN];
+    int i;
+
+    for (i = 1; i <= n; i++)
+    {
+        snprintf(name, sizeof(name), "eth%d", i);
+        mac[5] = i;
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, htonl(0x0a000001 | (i << 16)));
+        sr_set_ether_mask(sr, htonl(0xffffff00));
+    }
+}
+
+static void bench_free_routes(struct sr_instance* sr)
+{
+    sr_clear_rt_source(sr, SR_RT_STATIC);
+    sr_clear_rt_source(sr, SR_RT_CONNECTED);
+    sr_clear_rt_source(sr, SR_RT_DYNAMIC);
+}
+
+/*-----------------------------------------------------------------------------
+ * lpm
+ *---------------------------------------------------------------------------*/
+
+struct lpm_ctx
+{
+    struct sr_instance* sr;
+    uint32_t addrs[BENCH_ADDRS];
+};
+
+static void bench_lpm_fn(void* arg, long iters)
+{
+    struct lpm_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        g_sink += (uintptr_t) lpm(ctx->sr, ctx->addrs[i & (BENCH_ADDRS - 1)]);
+    }
+}
+
+/* Tabla de n rutas al azar (/8 a /32) mas la ruta por defecto. La mitad
+   de las consultas caen dentro de algun prefijo de la tabla. */
+static void bench_lpm(void)
+{
+    static const int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+    struct sr_instance sr;
+    struct lpm_ctx* ctx = malloc(sizeof(*ctx));
+    unsigned int s;
+    char name[64];
+
+    bench_init_sr(&sr);
+    bench_add_ifaces(&sr, 3);
+    ctx->sr = &sr;
+    srand(1);
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int n = sizes[s], i;
+        uint32_t* prefixes;
+        struct in_addr gw, zero;
+
+        if (g_quick && n > 100000)
+        {
+            break;
+        }
+        snprintf(name, sizeof(name), "lpm/routes=%d", n);
+        if (g_filter != 0 && strstr(name, g_filter) == 0)
+        {
+            continue;
+        }
+
+        prefixes = malloc(n * sizeof(uint32_t));
+        gw.s_addr = htonl(0x0a010002);
+        for (i = 0; i < n; i++)
+        {
+            int len = 8 + rand() % 25;
+            uint32_t mask = len == 32 ? 0xffffffff : ~(0xffffffffU >> len);
+            uint32_t dest = ((uint32_t) rand() << 16 ^ rand()) & mask;
+            struct in_addr d, m;
+
+            d.s_addr = htonl(dest);
+            m.s_addr = htonl(mask);
+            sr_add_rt_entry(&sr, d, gw, m, "eth1", 1);
+            prefixes[i] = dest;
+        }
+        zero.s_addr = 0;
+        sr_add_rt_entry(&sr, zero, gw, zero, "eth1", 0);
+        sr_fib_update(&sr);
+        for (i = 0; i < BENCH_ADDRS; i++)
+        {
+            uint32_t a = (uint32_t) rand() << 16 ^ rand();
+
+            ctx->addrs[i] = htonl(i & 1 ? prefixes[rand() % n] | (a & 0xff) : a);
+        }
+        free(prefixes);
+
+        bench_run(name, bench_lpm_fn, ctx);
+        bench_free_routes(&sr);
+    }
+    free(ctx);
+}
+
+/*-----------------------------------------------------------------------------
+ * Cache ARP
+ *---------------------------------------------------------------------------*/
+
+struct arp_ctx
+{
+    struct sr_arpcache* cache;
+    uint32_t ip;
+    int slot;                          /* entrada que ocupa el alta */
+};
+
+static void bench_arp_lookup_fn(void* arg, long iters)
+{
+    struct arp_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        struct sr_arpentry* e = sr_arpcache_lookup(ctx->cache, ctx->ip);
+
+        g_sink += (uintptr_t) e;
+        free(e);
+    }
+}
+
+static void bench_arp_insert_fn(void* arg, long iters)
+{
+    struct arp_ctx* ctx = arg;
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x0a, 0, 0, 0, 0, 1 };
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        g_sink += (uintptr_t) sr_arpcache_insert(ctx->cache, mac, ctx->ip);
+        /* liberar la entrada para que la proxima alta haga el mismo trabajo */
+        if (ctx->slot < SR_ARPCACHE_SZ)
+        {
+            ctx->cache->entries[ctx->slot].valid = 0;
+        }
+    }
+}
+
+static void bench_arpcache(void)
+{
+    static const int fills[] = { 0, 25, 50, 75, 100 };
+    struct sr_instance sr;
+    struct arp_ctx ctx;
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x0a, 0, 0, 0, 0, 0 };
+    unsigned int f;
+    char name[64];
+    int i;
+
+    bench_init_sr(&sr);
+    ctx.cache = &sr.cache;
+
+    for (f = 0; f < sizeof(fills) / sizeof(fills[0]); f++)
+    {
+        int n = SR_ARPCACHE_SZ * fills[f] / 100;
+
+        memset(sr.cache.entries, 0, sizeof(sr.cache.entries));
+        for (i = 0; i < n; i++)
+        {
+            mac[5] = i;
+            sr_arpcache_insert(&sr.cache, mac, htonl(0x0a000000 + i + 1));
+        }
+
+        if (n > 0)
+        {
+            ctx.ip = htonl(0x0a000000 + n);  /* la ultima que se agrego */
+            snprintf(name, sizeof(name), "arpcache_lookup/hit/fill=%d%%", fills[f]);
+            bench_run(name, bench_arp_lookup_fn, &ctx);
+        }
+        ctx.ip = htonl(0xc0a80001);
+        snprintf(name, sizeof(name), "arpcache_lookup/miss/fill=%d%%", fills[f]);
+        bench_run(name, bench_arp_lookup_fn, &ctx);
+
+        ctx.ip = htonl(0xc0a80002);
+        ctx.slot = n;
+        snprintf(name, sizeof(name), "arpcache_insert/fill=%d%%", fills[f]);
+        bench_run(name, bench_arp_insert_fn, &ctx);
+    }
+    sr_arpcache_destroy(&sr.cache);
+}
+
+/*-----------------------------------------------------------------------------
+ * cksum
+ *---------------------------------------------------------------------------*/
+
+struct cksum_ctx
+{
+    uint8_t* buf;
+    int len;
+};
+
+static void bench_cksum_fn(void* arg, long iters)
+{
+    struct cksum_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        g_sink += cksum(ctx->buf, ctx->len);
+    }
+}
+
+static void bench_cksum(void)
+{
+    static const int sizes[] = { 20, 64, 576, 1500, 9000 };
+    struct cksum_ctx ctx;
+    unsigned int s;
+    char name[64];
+    int i;
+
+    ctx.buf = malloc(9000);
+    for (i = 0; i < 9000; i++)
+    {
+        ctx.buf[i] = rand();
+    }
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        ctx.len = sizes[s];
+        snprintf(name, sizeof(name), "cksum/bytes=%d", sizes[s]);
+        bench_run(name, bench_cksum_fn, &ctx);
+    }
+    free(ctx.buf);
+}
+
+/*-----------------------------------------------------------------------------
+ * is_packet_valid
+ *---------------------------------------------------------------------------*/
+
+struct valid_ctx
+{
+    uint8_t frame[128];
+    unsigned int len;
+};
+
+static void bench_valid_fn(void* arg, long iters)
+{
+    struct valid_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        g_sink += is_packet_valid(ctx->frame, ctx->len);
+    }
+}
+
+/* Echo request de 98 bytes, como el de ping */
+static void build_icmp(struct valid_ctx* ctx)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*) ctx->frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*) (eth + 1);
+    sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*) (ip + 1);
+
+    memset(ctx->frame, 0, sizeof(ctx->frame));
+    ctx->len = 98;
+    eth->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(ctx->len - sizeof(*eth));
+    ip->ip_ttl = 64;
+    ip->ip_p = ip_protocol_icmp;
+    ip->ip_src = htonl(0x64000001);
+    ip->ip_dst = htonl(0xc800000a);
+    ip->ip_sum = cksum(ip, sizeof(*ip));
+    icmp->icmp_type = 8;
+    icmp->icmp_sum = cksum(icmp, ctx->len - sizeof(*eth) - sizeof(*ip));
+}
+
+static void bench_is_packet_valid(void)
+{
+    struct valid_ctx ctx;
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*) ctx.frame;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*) (eth + 1);
+
+    build_icmp(&ctx);
+    bench_run("is_packet_valid/icmp", bench_valid_fn, &ctx);
+
+    ((sr_ip_hdr_t*) (eth + 1))->ip_sum ^= 0x1234;
+    bench_run("is_packet_valid/bad_ip_cksum", bench_valid_fn, &ctx);
+
+    memset(ctx.frame, 0, sizeof(ctx.frame));
+    ctx.len = sizeof(*eth) + sizeof(*arp);
+    eth->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(arp_op_request);
+    bench_run("is_packet_valid/arp", bench_valid_fn, &ctx);
+}
+
+/*-----------------------------------------------------------------------------
+ * sr_get_interface
+ *---------------------------------------------------------------------------*/
+
+struct iface_ctx
+{
+    struct sr_instance* sr;
+    const char* name;
+};
+
+static void bench_iface_fn(void* arg, long iters)
+{
+    struct iface_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        g_sink += (uintptr_t) sr_get_interface(ctx->sr, ctx->name);
+    }
+}
+
+static void bench_get_interface(void)
+{
+    static const int counts[] = { 3, BENCH_MAX_IFACES };
+    struct sr_instance sr;
+    struct iface_ctx ctx;
+    char last[sr_IFACE_NAMELEN];
+    char name[64];
+    unsigned int c;
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        bench_init_sr(&sr);
+        bench_add_ifaces(&sr, counts[c]);
+        ctx.sr = &sr;
+
+        snprintf(last, sizeof(last), "eth%d", counts[c]);
+        ctx.name = last;
+        snprintf(name, sizeof(name), "sr_get_interface/ifaces=%d/last", counts[c]);
+        bench_run(name, bench_iface_fn, &ctx);
+
+        ctx.name = "eth99";
+        snprintf(name, sizeof(name), "sr_get_interface/ifaces=%d/miss", counts[c]);
+        bench_run(name, bench_iface_fn, &ctx);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * run_dijkstra
+ *---------------------------------------------------------------------------*/
+
+/* Que cambia entre corridas: nada pero forzando una corrida completa,
+   una red stub que aparece y desaparece, un enlace que se cae y vuelve,
+   o los enlaces del router que corre el algoritmo */
+enum bench_spf_mode
+{
+    BENCH_SPF_FULL,
+    BENCH_SPF_STUB,
+    BENCH_SPF_LINK,
+    BENCH_SPF_DOWN
+};
+
+/* Forma de la topologia */
+enum bench_spf_shape
+{
+    BENCH_SPF_RING,
+    BENCH_SPF_GRID,
+    BENCH_SPF_STAR
+};
+
+/* Enlaces de cada router mientras se arma la topologia; el que cambia va
+   ultimo, asi el LSA sin el es el mismo arreglo con uno menos */
+#define BENCH_MAX_LINKS 6
+
+struct bench_router
+{
+    struct pwospf_link links[BENCH_MAX_LINKS];
+    uint32_t n;
+};
+
+struct dijkstra_ctx
+{
+    dijkstra_param_t param;
+    enum bench_spf_mode mode;
+    struct bench_router* routers;  /* indexados por id, 1..n */
+    int flap[2];                   /* routers cuyo LSA cambia */
+    int nflap;
+    uint32_t nbr[BENCH_MAX_LINKS]; /* vecinos del router 1 en /down */
+    uint16_t seq;
+    int present;
+};
+
+static struct in_addr addr(uint32_t host_order)
+{
+    struct in_addr a;
+
+    a.s_addr = htonl(host_order);
+    return a;
+}
+
+/* Instala el LSA del router id, sin su ultimo enlace si !last */
+static void bench_install(struct dijkstra_ctx* ctx, int id, int last)
+{
+    struct bench_router* r = &ctx->routers[id];
+    struct pwospf_lsa* lsa = pwospf_lsa_create(addr(0x01010100 + id), ctx->seq, r->n - !last, NULL, 0);
+
+    memcpy(lsa->links, r->links, lsa->nlinks * sizeof(struct pwospf_link));
+    pwospf_lsdb_install(ctx->param.topology, lsa);
+}
+
+/* Cada cambio es un LSU nuevo de los routers afectados, que reemplaza al
+   anterior como en sr_handle_pwospf_lsu_packet */
+static void bench_flap(struct dijkstra_ctx* ctx)
+{
+    int i;
+
+    ctx->present = !ctx->present;
+    ctx->seq++;
+    for (i = 0; i < ctx->nflap; i++)
+    {
+        bench_install(ctx, ctx->flap[i], ctx->present);
+    }
+}
+
+/* Se caen todos los vecinos del router 1 y despues vuelven: se borran
+   los neighbor_id de sus interfaces y su LSA queda solo con la red stub,
+   como cuando pwospf los da por muertos */
+static void bench_down(struct dijkstra_ctx* ctx)
+{
+    struct bench_router* r = &ctx->routers[1];
+    struct pwospf_lsa* lsa;
+    struct sr_if* iface;
+    int i = 0;
+
+    ctx->present = !ctx->present;
+    ctx->seq++;
+    for (iface = ctx->param.sr->if_list; iface != 0; iface = iface->next)
+    {
+        iface->neighbor_id = ctx->present ? ctx->nbr[i] : 0;
+        i++;
+    }
+    lsa = pwospf_lsa_create(addr(0x01010101), ctx->seq, ctx->present ? r->n : 1, NULL, 0);
+    memcpy(lsa->links, r->links + (ctx->present ? 0 : r->n - 1),
+           lsa->nlinks * sizeof(struct pwospf_link));
+    pwospf_lsdb_install(ctx->param.topology, lsa);
+}
+
+static void bench_dijkstra_fn(void* arg, long iters)
+{
+    struct dijkstra_ctx* ctx = arg;
+    long i;
+
+    for (i = 0; i < iters; i++)
+    {
+        if (ctx->mode == BENCH_SPF_FULL)
+        {
+            dijkstra_force_full();
+        }
+        else if (ctx->mode == BENCH_SPF_DOWN)
+        {
+            bench_down(ctx);
+        }
+        else
+        {
+            bench_flap(ctx);
+        }
+        run_dijkstra(&ctx->param);
+    }
+}
+
+static void bench_add_link(struct bench_router* r, uint32_t net, uint32_t mask, uint32_t nb,
+                           uint32_t next_hop)
+{
+    struct pwospf_link* l = &r->links[r->n++];
+
+    l->net_num = addr(net);
+    l->net_mask = addr(mask);
+    l->neighbor_id = addr(nb);
+    l->next_hop = addr(next_hop);
+}
+
+/* Enlace entre los routers a y b (ids 1..n, router id 1.1.1.0 + id). La
+   red es el /30 numero link de 10.0.0.0/8, con a en .1 y b en .2. */
+static void bench_link(struct sr_instance* sr, struct bench_router* routers, int a, int b,
+                       int link)
+{
+    uint32_t net = 0x0a000000 + (link << 2);
+    struct in_addr mask = addr(0xfffffffc);
+
+    bench_add_link(&routers[a], net, 0xfffffffc, 0x01010100 + b, net + 2);
+    bench_add_link(&routers[b], net, 0xfffffffc, 0x01010100 + a, net + 1);
+
+    /* el router 1 es el que corre el algoritmo */
+    if (a == 1 || b == 1)
+    {
+        char name[sr_IFACE_NAMELEN];
+        unsigned char mac[ETHER_ADDR_LEN] = { 0x0a, 0, 0, 0, 1, 0 };
+        struct sr_if* iface;
+        int other = a == 1 ? b : a;
+
+        snprintf(name, sizeof(name), "eth%d", other);
+        mac[5] = other;
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, htonl(net + (a == 1 ? 1 : 2)));
+        sr_set_ether_mask(sr, mask.s_addr);
+        for (iface = sr->if_list; iface->next != 0; iface = iface->next)
+            ;
+        iface->neighbor_id = htonl(0x01010100 + other);
+        iface->neighbor_ip = htonl(net + (a == 1 ? 2 : 1));
+        sr_add_rt_entry(sr, addr(net), addr(0), mask, name, 0);
+    }
+}
+
+/* Deja ultimo el enlace del router r hacia nb */
+static void bench_link_last(struct bench_router* r, int nb)
+{
+    uint32_t i;
+
+    for (i = 0; i + 1 < r->n; i++)
+    {
+        if (r->links[i].neighbor_id.s_addr == htonl(0x01010100 + nb))
+        {
+            struct pwospf_link t = r->links[i];
+            r->links[i] = r->links[r->n - 1];
+            r->links[r->n - 1] = t;
+            break;
+        }
+    }
+}
+
+/* Anillo de n routers, grilla de lado n, o estrella de n routers con el
+   router 1 en el centro, cada router con una red stub /24, la numero id
+   de 172.16.0.0/12. En /stub y /link lo que cambia esta a mitad de
+   camino: una red stub nueva del router del medio, o el enlace entre ese
+   router y el siguiente. En /down se caen los enlaces del router 1 y
+   cada corrida se verifica contra una completa */
+static void bench_dijkstra_topo(int n, enum bench_spf_shape shape, enum bench_spf_mode mode)
+{
+    static const char* shapes[] = { "ring", "grid", "star" };
+    static const char* suffix[] = { "", "/stub", "/link", "/down" };
+    int grid = shape == BENCH_SPF_GRID;
+    struct sr_instance sr;
+    struct dijkstra_ctx ctx;
+    char name[64];
+    int routers = grid ? n * n : n;
+    int mid = grid ? routers / 2 + 1 : n / 2;
+    int link = 1, i;
+
+    snprintf(name, sizeof(name), "run_dijkstra/%s=%d%s", shapes[shape], routers, suffix[mode]);
+    if (g_filter != 0 && strstr(name, g_filter) == 0)
+    {
+        return;
+    }
+
+    bench_init_sr(&sr);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mode = mode;
+    ctx.routers = calloc(routers + 1, sizeof(struct bench_router));
+
+    for (i = 1; i <= routers; i++)
+    {
+        if (shape == BENCH_SPF_STAR)
+        {
+            if (i > 1)
+            {
+                bench_link(&sr, ctx.routers, 1, i, link++);
+            }
+        }
+        else if (!grid)
+        {
+            bench_link(&sr, ctx.routers, i, i % n + 1, link++);
+        }
+        else
+        {
+            if (i % n != 0)
+            {
+                bench_link(&sr, ctx.routers, i, i + 1, link++);
+            }
+            if (i + n <= routers)
+            {
+                bench_link(&sr, ctx.routers, i, i + n, link++);
+            }
+        }
+    }
+    for (i = 1; i <= routers; i++)
+    {
+        bench_add_link(&ctx.routers[i], 0xac100000 + (i << 8), 0xffffff00, 0, 0);
+    }
+
+    if (mode == BENCH_SPF_STUB)
+    {
+        bench_add_link(&ctx.routers[mid], 0xc0a80000, 0xffffff00, 0, 0);
+        ctx.flap[ctx.nflap++] = mid;
+    }
+    else if (mode == BENCH_SPF_LINK)
+    {
+        /* el enlace mid <-> mid + 1, en los LSAs de los dos */
+        bench_link_last(&ctx.routers[mid], mid + 1);
+        bench_link_last(&ctx.routers[mid + 1], mid);
+        ctx.flap[ctx.nflap++] = mid;
+        ctx.flap[ctx.nflap++] = mid + 1;
+    }
+
+    ctx.param.topology = pwospf_lsdb_create(NULL, NULL);
+    for (i = 1; i <= routers; i++)
+    {
+        bench_install(&ctx, i, 1);
+    }
+    ctx.present = 1;
+
+    ctx.param.sr = &sr;
+    ctx.param.rid = addr(0x01010101);
+    if (mode == BENCH_SPF_DOWN)
+    {
+        struct sr_if* iface;
+
+        i = 0;
+        for (iface = sr.if_list; iface != 0; iface = iface->next)
+        {
+            ctx.nbr[i++] = iface->neighbor_id;
+        }
+        dijkstra_set_verify(1);
+    }
+    dijkstra_force_full();
+    bench_run(name, bench_dijkstra_fn, &ctx);
+    dijkstra_set_verify(0);
+
+    pwospf_lsdb_destroy(ctx.param.topology);
+    free(ctx.routers);
+}
+
+static void bench_dijkstra(void)
+{
+    /* Sin sufijo cada corrida es completa, O((V + E) log V); /stub, /link
+       y /down miden la incremental. Las grillas de 64x64 (4096 routers) son el
+       caso grande */
+    bench_dijkstra_topo(4, BENCH_SPF_RING, BENCH_SPF_FULL);
+    bench_dijkstra_topo(16, BENCH_SPF_RING, BENCH_SPF_FULL);
+    bench_dijkstra_topo(3, BENCH_SPF_GRID, BENCH_SPF_FULL);
+    bench_dijkstra_topo(4, BENCH_SPF_GRID, BENCH_SPF_FULL);
+    bench_dijkstra_topo(16, BENCH_SPF_GRID, BENCH_SPF_FULL);
+    bench_dijkstra_topo(16, BENCH_SPF_GRID, BENCH_SPF_STUB);
+    bench_dijkstra_topo(16, BENCH_SPF_GRID, BENCH_SPF_LINK);
+    bench_dijkstra_topo(4, BENCH_SPF_STAR, BENCH_SPF_DOWN);
+    bench_dijkstra_topo(16, BENCH_SPF_RING, BENCH_SPF_DOWN);
+    bench_dijkstra_topo(16, BENCH_SPF_GRID, BENCH_SPF_DOWN);
+    if (!g_quick)
+    {
+        bench_dijkstra_topo(64, BENCH_SPF_RING, BENCH_SPF_FULL);
+        bench_dijkstra_topo(1024, BENCH_SPF_RING, BENCH_SPF_FULL);
+        bench_dijkstra_topo(64, BENCH_SPF_GRID, BENCH_SPF_FULL);
+        bench_dijkstra_topo(64, BENCH_SPF_GRID, BENCH_SPF_STUB);
+        bench_dijkstra_topo(64, BENCH_SPF_GRID, BENCH_SPF_LINK);
+        bench_dijkstra_topo(64, BENCH_SPF_GRID, BENCH_SPF_DOWN);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Salida
+ *---------------------------------------------------------------------------*/
+
+static int write_json(const char* path, const char* label)
+{
+    FILE* fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    char host[64] = "";
+    time_t now = time(0);
+    char stamp[32];
+    int i;
+
+    if (fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(fp, "{\n  \"label\": \"%s\",\n  \"timestamp\": \"%s\",\n  \"host\": \"%s\",\n",
+            label, stamp, host);
+    fprintf(fp, "  \"samples\": %d,\n  \"warmup\": %d,\n  \"sample_us\": %.0f,\n  \"unit\": \"ns/op\",\n",
+            g_samples, g_warmup, g_sample_ns / 1e3);
+    fprintf(fp, "  \"results\": [\n");
+    for (i = 0; i < g_nresults; i++)
+    {
+        struct bench_result* r = &g_results[i];
+
+        fprintf(fp, "    {\"name\": \"%s\", \"iters\": %ld, \"min\": %.2f, \"median\": %.2f, "
+                    "\"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f, \"mean\": %.2f, \"stddev\": %.2f}%s\n",
+                r->name, r->iters, r->min, r->median, r->p90, r->p99, r->max, r->mean, r->stddev,
+                i + 1 < g_nresults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: compare
+ *
+ * Compara las medianas contra las de un JSON escrito por este programa
+ * (un resultado por linea). Retorna la cantidad de regresiones.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int compare(const char* path, double threshold)
+{
+    FILE* fp = fopen(path, "r");
+    char line[512];
+    int regressions = 0, i;
+
+    if (fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    printf("\n%-36s %12s %12s %9s\n", "compared to", "base ns/op", "ns/op", "change");
+    while (fgets(line, sizeof(line), fp) != 0)
+    {
+        char name[64];
+        double base;
+        char* p = strstr(line, "\"median\": ");
+
+        if (sscanf(line, " {\"name\": \"%63[^\"]\"", name) != 1 || p == 0 ||
+            sscanf(p + 10, "%lf", &base) != 1)
+        {
+            continue;
+        }
+        for (i = 0; i < g_nresults; i++)
+        {
+            if (strcmp(g_results[i].name, name) == 0 && base > 0)
+            {
+                double change = 100 * (g_results[i].median - base) / base;
+                int bad = change > threshold;
+
+                printf("%-36s %12.1f %12.1f %+8.1f%%%s\n", name, base, g_results[i].median, change,
+                       bad ? "  REGRESSION" : "");
+                regressions += bad;
+            }
+        }
+    }
+    fclose(fp);
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    const char* out = 0;
+    const char* baseline = 0;
+    const char* label = "";
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int c, regressions = 0;
+
+    while ((c = getopt(argc, argv, "hf:r:w:s:ql:o:c:T:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'f':
+                g_filter = optarg;
+                break;
+            case 'r':
+                g_samples = atoi(optarg);
+                break;
+            case 'w':
+                g_warmup = atoi(optarg);
+                break;
+            case 's':
+                g_sample_ns = atof(optarg) * 1e3;
+                break;
+            case 'q':
+                g_quick = 1;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'c':
+                baseline = optarg;
+                break;
+            case 'T':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc || g_samples <= 0 || g_samples > BENCH_MAX_SAMPLES || g_warmup < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* run_dijkstra informa por el log; que no ensucie la tabla */
+    sr_log_parse_levels("error");
+
+    printf("%-36s %10s %10s %10s %10s %10s %9s\n", "ns/op", "min", "median", "p90", "p99", "max",
+           "stddev");
+    bench_lpm();
+    bench_arpcache();
+    bench_cksum();
+    bench_is_packet_valid();
+    bench_get_interface();
+    bench_dijkstra();
+
+    if (out != 0 && write_json(out, label) != 0)
+    {
+        return 1;
+    }
+    if (baseline != 0)
+    {
+        regressions = compare(baseline, threshold);
+    }
+    return regressions != 0;
+}
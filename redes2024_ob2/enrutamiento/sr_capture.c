@@ -0,0 +1,706 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Descripción:
+ *
+ * Escritor asincrono de capturas en formato pcap o pcapng. Reemplaza el
+ * sr_dump + fflush por trama que hacia sr_log_packet.
+ *
+ * Los productores (hilo que lee del servidor, hilos de PWOSPF, ...) solo
+ * reservan un slot de la cola, copian hasta snaplen bytes y lo publican.
+ * El escritor arma los cabezales en un buffer de SR_CAPTURE_BUF_SIZE
+ * bytes y lo escribe cuando se llena, cuando la cola queda vacia por
+ * SR_CAPTURE_FLUSH_MS o antes de rotar.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_LOG_SUBSYS sr_sub_cap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "sr_capture.h"
+#include "sr_if.h"
+#include "sr_dumper.h"
+#include "sr_ring.h"
+#include "sr_log.h"
+#include "sr_filter.h"
+
+/* Lo que el productor deja en cada slot, seguido de los datos */
+struct cap_rec
+{
+  uint64_t ts_ns;     /* CLOCK_MONOTONIC */
+  uint32_t len;       /* largo original de la trama */
+  uint32_t caplen;    /* bytes copiados */
+  uint8_t ifindex;
+  uint8_t dir;        /* enum sr_capture_dir */
+};
+
+/* Datos de una interfaz para su bloque IDB */
+struct cap_if
+{
+  char name[sr_IFACE_NAMELEN + 1];
+  unsigned char mac[ETHER_ADDR_LEN];
+  uint32_t ip;
+  uint32_t mask;
+};
+
+/* Filtro reemplazado, pendiente de liberar */
+struct cap_retired
+{
+  struct sr_filter* filter;
+  struct cap_retired* next;
+};
+
+struct sr_capture
+{
+  struct sr_capture_opts opts;
+  char* path;
+  struct sr_ring ring;
+  struct sr_filter* filter;         /* se lee sin lock en el camino de datos */
+  pthread_mutex_t filter_lock;      /* solo para los cambios de filtro */
+  struct cap_retired* retired;
+  uint64_t filtered;                /* tramas que no pasaron el filtro */
+  pthread_t thread;
+  int stopping;
+  int64_t epoch_offset_ns;   /* CLOCK_REALTIME - CLOCK_MONOTONIC al abrir */
+
+  struct cap_if ifs[SR_CAPTURE_MAX_IFS];
+  int n_ifs;                 /* se publica despues de completar ifs */
+
+  /* -- estado del escritor -- */
+  int fd;
+  unsigned int file_no;      /* rotaciones hechas */
+  uint64_t file_bytes;       /* bytes ya escritos en el archivo actual */
+  time_t file_opened;
+  int idbs_written;          /* pcapng: IDBs ya escritos en este archivo */
+  uint64_t file_frames;      /* tramas en el archivo actual */
+  uint8_t* buf;
+  size_t buf_used;
+  uint64_t reported_drops;
+
+  /* -- estadisticas (solo las escribe el escritor) -- */
+  uint64_t frames;
+  uint64_t bytes;
+  uint64_t writes;
+  uint64_t write_errors;
+  uint64_t open_errors;
+  uint64_t files;
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_ms(void)
+{
+  return clock_ns(CLOCK_MONOTONIC) / 1000000;
+}
+
+int sr_capture_format_from_path(const char* path)
+{
+  size_t len = strlen(path);
+
+  if (len >= 7 && strcmp(path + len - 7, ".pcapng") == 0) {
+    return sr_capture_pcapng;
+  }
+  return sr_capture_pcap;
+}
+
+uint64_t sr_capture_parse_size(const char* str)
+{
+  char* end;
+  unsigned long long v = strtoull(str, &end, 10);
+
+  switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+  }
+  return *end == 0 && end != str ? v : 0;
+}
+
+/* Escribe todo el buffer. Un error (disco lleno, ...) pierde el bloque
+   pero no detiene la captura. */
+static void cap_flush(struct sr_capture* cap)
+{
+  size_t off = 0;
+
+  if (cap->buf_used == 0) {
+    return;
+  }
+  if (cap->fd < 0) {
+    /* la captura se detuvo: sin archivo donde escribir */
+    cap->buf_used = 0;
+    return;
+  }
+
+  while (off < cap->buf_used) {
+    ssize_t w = write(cap->fd, cap->buf + off, cap->buf_used - off);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (cap->write_errors++ == 0) {
+        sr_log_error(sr_sub_cap, "capture: write to %s failed: %s\n", cap->path, strerror(errno));
+      }
+      break;
+    }
+    off += w;
+  }
+
+  cap->file_bytes += off;
+  cap->writes++;
+  cap->buf_used = 0;
+}
+
+static void cap_put(struct sr_capture* cap, const void* data, size_t len)
+{
+  memcpy(cap->buf + cap->buf_used, data, len);
+  cap->buf_used += len;
+}
+
+#define PAD4(n) (((n) + 3) & ~3u)
+
+/* Agrega una opcion pcapng con su relleno */
+static void cap_put_opt(struct sr_capture* cap, uint16_t code, const void* data, uint16_t len)
+{
+  static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+  struct pcapng_opt opt;
+
+  opt.code = code;
+  opt.len = len;
+  cap_put(cap, &opt, sizeof(opt));
+  cap_put(cap, data, len);
+  cap_put(cap, zeros, PAD4(len) - len);
+}
+
+static void cap_put_endofopt(struct sr_capture* cap, uint32_t total_len)
+{
+  struct pcapng_opt opt;
+
+  opt.code = PCAPNG_OPT_ENDOFOPT;
+  opt.len = 0;
+  cap_put(cap, &opt, sizeof(opt));
+  cap_put(cap, &total_len, sizeof(total_len));
+}
+
+static void cap_put_shb(struct sr_capture* cap)
+{
+  static const char appl[] = "sr (redes2024)";
+  struct pcapng_shb shb;
+
+  shb.h.type = PCAPNG_BT_SHB;
+  shb.h.total_len = sizeof(shb) + sizeof(struct pcapng_opt) + PAD4(sizeof(appl) - 1) +
+                    sizeof(struct pcapng_opt) + sizeof(uint32_t);
+  shb.byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC;
+  shb.version_major = 1;
+  shb.version_minor = 0;
+  shb.section_len = -1;
+
+  cap_put(cap, &shb, sizeof(shb));
+  cap_put_opt(cap, PCAPNG_SHB_USERAPPL, appl, sizeof(appl) - 1);
+  cap_put_endofopt(cap, shb.h.total_len);
+}
+
+/* Nombre de la interfaz id en su IDB; retorna si se conocen sus datos */
+static int cap_idb_name(struct sr_capture* cap, int id, char* name, size_t size)
+{
+  int known = id < __atomic_load_n(&cap->n_ifs, __ATOMIC_ACQUIRE);
+
+  if (known) {
+    snprintf(name, size, "%s", cap->ifs[id].name);
+  }
+  else {
+    snprintf(name, size, "if%d", id);
+  }
+  return known;
+}
+
+/* Bytes que ocupa el IDB de la interfaz id */
+static size_t cap_idb_size(struct sr_capture* cap, int id)
+{
+  char name[sr_IFACE_NAMELEN + 1];
+  int known = cap_idb_name(cap, id, name, sizeof(name));
+
+  return sizeof(struct pcapng_idb) +
+         sizeof(struct pcapng_opt) + PAD4(strlen(name)) +
+         (known ? sizeof(struct pcapng_opt) + PAD4(ETHER_ADDR_LEN) : 0) +
+         (known ? sizeof(struct pcapng_opt) + 2 * sizeof(uint32_t) : 0) +
+         sizeof(struct pcapng_opt) + PAD4(1) +
+         sizeof(struct pcapng_opt) + sizeof(uint32_t);
+}
+
+/* IDB con nombre, MAC, IPv4 y resolucion de nanosegundos */
+static void cap_put_idb(struct sr_capture* cap, int id)
+{
+  struct pcapng_idb idb;
+  char name[sr_IFACE_NAMELEN + 1];
+  uint32_t ipv4[2];
+  uint8_t tsresol = 9;   /* 10^-9 s */
+  int known = cap_idb_name(cap, id, name, sizeof(name));
+  uint16_t name_len = strlen(name);
+
+  idb.h.type = PCAPNG_BT_IDB;
+  idb.h.total_len = cap_idb_size(cap, id);
+  idb.linktype = LINKTYPE_ETHERNET;
+  idb.reserved = 0;
+  idb.snaplen = cap->opts.snaplen;
+
+  cap_put(cap, &idb, sizeof(idb));
+  cap_put_opt(cap, PCAPNG_IF_NAME, name, name_len);
+  if (known) {
+    ipv4[0] = cap->ifs[id].ip;
+    ipv4[1] = cap->ifs[id].mask;
+    cap_put_opt(cap, PCAPNG_IF_MACADDR, cap->ifs[id].mac, ETHER_ADDR_LEN);
+    cap_put_opt(cap, PCAPNG_IF_IPV4ADDR, ipv4, sizeof(ipv4));
+  }
+  cap_put_opt(cap, PCAPNG_IF_TSRESOL, &tsresol, 1);
+  cap_put_endofopt(cap, idb.h.total_len);
+}
+
+/* Bytes que ocupa una trama de caplen bytes en el archivo */
+static size_t cap_rec_size(struct sr_capture* cap, uint32_t caplen)
+{
+  if (cap->opts.format == sr_capture_pcapng) {
+    return sizeof(struct pcapng_epb) + PAD4(caplen) +
+           sizeof(struct pcapng_opt) + sizeof(uint32_t) +   /* epb_flags */
+           sizeof(struct pcapng_opt) + sizeof(uint32_t);    /* fin y largo */
+  }
+  return sizeof(struct pcap_sf_pkthdr) + caplen;
+}
+
+static int cap_rec_if(struct cap_rec* rec)
+{
+  return rec->ifindex == SR_CAPTURE_IF_UNKNOWN ? 0 : rec->ifindex;
+}
+
+/* Lo que cap_put_rec agrega al buffer: la trama y, en pcapng, los IDB que
+   todavia no se escribieron y tienen que ir antes */
+static size_t cap_rec_need(struct sr_capture* cap, struct cap_rec* rec)
+{
+  size_t need = cap_rec_size(cap, rec->caplen);
+  int id;
+
+  if (cap->opts.format == sr_capture_pcapng) {
+    for (id = cap->idbs_written; id <= cap_rec_if(rec); id++) {
+      need += cap_idb_size(cap, id);
+    }
+  }
+  return need;
+}
+
+static void cap_put_rec(struct sr_capture* cap, struct cap_rec* rec)
+{
+  static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+  uint64_t ts = rec->ts_ns + cap->epoch_offset_ns;
+
+  if (cap->opts.format == sr_capture_pcapng) {
+    struct pcapng_epb epb;
+    uint32_t flags = rec->dir;
+    int id = cap_rec_if(rec);
+
+    /* Los IDB van antes del primer EPB que los referencia */
+    while (cap->idbs_written <= id) {
+      cap_put_idb(cap, cap->idbs_written++);
+    }
+
+    epb.h.type = PCAPNG_BT_EPB;
+    epb.h.total_len = cap_rec_size(cap, rec->caplen);
+    epb.if_id = id;
+    epb.ts_high = ts >> 32;
+    epb.ts_low = ts & 0xffffffff;
+    epb.caplen = rec->caplen;
+    epb.len = rec->len;
+    cap_put(cap, &epb, sizeof(epb));
+    cap_put(cap, rec + 1, rec->caplen);
+    cap_put(cap, zeros, PAD4(rec->caplen) - rec->caplen);
+    cap_put_opt(cap, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+    cap_put_endofopt(cap, epb.h.total_len);
+  }
+  else {
+    struct pcap_sf_pkthdr hdr;
+
+    hdr.ts.tv_sec = ts / 1000000000ULL;
+    hdr.ts.tv_usec = (ts % 1000000000ULL) / 1000;
+    hdr.caplen = rec->caplen;
+    hdr.len = rec->len;
+    cap_put(cap, &hdr, sizeof(hdr));
+    cap_put(cap, rec + 1, rec->caplen);
+  }
+}
+
+/* Abre el archivo numero cap->file_no y escribe el cabezal */
+static int cap_open_file(struct sr_capture* cap)
+{
+  char name[1024];
+
+  if (strcmp(cap->path, "-") == 0) {
+    cap->fd = STDOUT_FILENO;
+  }
+  else {
+    if (cap->file_no == 0) {
+      snprintf(name, sizeof(name), "%s", cap->path);
+    }
+    else {
+      snprintf(name, sizeof(name), "%s.%u", cap->path, cap->file_no);
+    }
+    cap->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (cap->fd < 0) {
+      fprintf(stderr, "sr_capture: can't open %s: %s\n", name, strerror(errno));
+      return -1;
+    }
+  }
+
+  cap->file_bytes = 0;
+  cap->file_opened = time(0);
+  cap->idbs_written = 0;
+  cap->file_frames = 0;
+  cap->files++;
+
+  if (cap->opts.format == sr_capture_pcapng) {
+    cap_put_shb(cap);
+  }
+  else {
+    struct pcap_file_header hdr;
+
+    hdr.magic = TCPDUMP_MAGIC;
+    hdr.version_major = PCAP_VERSION_MAJOR;
+    hdr.version_minor = PCAP_VERSION_MINOR;
+    hdr.thiszone = 0;
+    hdr.sigfigs = 0;
+    hdr.snaplen = cap->opts.snaplen;
+    hdr.linktype = LINKTYPE_ETHERNET;
+    cap_put(cap, &hdr, sizeof(hdr));
+  }
+  return 0;
+}
+
+static void cap_rotate(struct sr_capture* cap)
+{
+  cap_flush(cap);
+  close(cap->fd);
+  cap->file_no++;
+  if (cap_open_file(cap) != 0) {
+    /* Sin archivo nuevo la captura se detiene; escribir en stdout
+       mezclaria las tramas con el log y sin cabezal */
+    cap->fd = -1;
+    cap->open_errors++;
+    sr_log_error(sr_sub_cap, "capture: can't open the next file of %s, capture stopped\n", cap->path);
+  }
+}
+
+static int cap_must_rotate(struct sr_capture* cap, size_t need)
+{
+  if (cap->fd == STDOUT_FILENO || cap->fd < 0) {
+    return 0;
+  }
+  if (cap->opts.rotate_bytes != 0 &&
+      cap->file_bytes + cap->buf_used + need > cap->opts.rotate_bytes &&
+      cap->file_frames > 0) {
+    return 1;
+  }
+  if (cap->opts.rotate_secs != 0 &&
+      time(0) - cap->file_opened >= (time_t) cap->opts.rotate_secs) {
+    return 1;
+  }
+  return 0;
+}
+
+static void cap_report_drops(struct sr_capture* cap)
+{
+  uint64_t dropped = sr_ring_dropped(&cap->ring);
+
+  if (dropped != cap->reported_drops) {
+    sr_log_warn(sr_sub_cap, "capture: %llu frames dropped, writer is behind\n",
+                (unsigned long long) (dropped - cap->reported_drops));
+    cap->reported_drops = dropped;
+  }
+}
+
+static void* cap_writer(void* arg)
+{
+  struct sr_capture* cap = (struct sr_capture*) arg;
+  struct timespec idle;
+  uint64_t last_flush = now_ms();
+  uint64_t last_report = last_flush;
+
+  idle.tv_sec = 0;
+  idle.tv_nsec = 1000000;
+
+  for (;;) {
+    struct cap_rec* rec;
+    uint64_t now;
+    int n = 0;
+
+    while ((rec = sr_ring_peek(&cap->ring, 0)) != 0) {
+      size_t need;
+
+      if (cap->fd < 0) {
+        /* captura detenida: se vacia la cola sin escribir */
+        sr_ring_release(&cap->ring);
+        n++;
+        continue;
+      }
+
+      need = cap_rec_need(cap, rec);
+
+      if (cap_must_rotate(cap, need)) {
+        cap_rotate(cap);
+        /* el archivo nuevo empieza sin IDB */
+        need = cap_rec_need(cap, rec);
+      }
+      if (cap->buf_used + need > SR_CAPTURE_BUF_SIZE) {
+        cap_flush(cap);
+        last_flush = now_ms();
+      }
+
+      cap->bytes += rec->caplen;
+      cap_put_rec(cap, rec);
+      sr_ring_release(&cap->ring);
+
+      cap->frames++;
+      cap->file_frames++;
+      n++;
+    }
+
+    now = now_ms();
+    if (cap->buf_used > 0 && (n == 0 || now - last_flush >= SR_CAPTURE_FLUSH_MS)) {
+      cap_flush(cap);
+      last_flush = now;
+    }
+    if (now - last_report >= 1000) {
+      cap_report_drops(cap);
+      last_report = now;
+    }
+
+    if (n == 0) {
+      if (__atomic_load_n(&cap->stopping, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      nanosleep(&idle, 0);
+    }
+  }
+
+  cap_report_drops(cap);
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_open
+ *
+ * Reserva la cola y el buffer, abre el primer archivo y lanza el hilo
+ * escritor.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(const struct sr_capture_opts* opts)
+{
+  struct sr_capture* cap = calloc(1, sizeof(*cap));
+
+  if (cap == 0) {
+    return 0;
+  }
+  cap->opts = *opts;
+  pthread_mutex_init(&cap->filter_lock, 0);
+  cap->epoch_offset_ns = (int64_t) (clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC));
+  cap->path = strdup(opts->path);
+  cap->opts.path = cap->path;
+  cap->buf = malloc(SR_CAPTURE_BUF_SIZE);
+
+  if (cap->path == 0 || cap->buf == 0 ||
+      sr_ring_init(&cap->ring, SR_CAPTURE_RING_SLOTS, sizeof(struct cap_rec) + opts->snaplen) != 0) {
+    free(cap->buf);
+    free(cap->path);
+    free(cap);
+    return 0;
+  }
+
+  if (cap_open_file(cap) != 0) {
+    sr_ring_destroy(&cap->ring);
+    free(cap->buf);
+    free(cap->path);
+    free(cap);
+    return 0;
+  }
+
+  if (pthread_create(&cap->thread, 0, cap_writer, cap) != 0) {
+    close(cap->fd);
+    sr_ring_destroy(&cap->ring);
+    free(cap->buf);
+    free(cap->path);
+    free(cap);
+    return 0;
+  }
+  return cap;
+} /* -- sr_capture_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_packet
+ *
+ * Camino rapido: timestamp, una copia y publicar. Si la cola esta llena
+ * la trama se descarta (sr_ring la cuenta).
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                       unsigned int ifindex, int dir)
+{
+  struct cap_rec* rec;
+  uint64_t pos;
+
+  rec = sr_ring_reserve(&cap->ring, &pos);
+  if (rec == 0) {
+    return;
+  }
+
+  rec->ts_ns = clock_ns(CLOCK_MONOTONIC);
+  rec->ifindex = ifindex;
+  rec->dir = dir;
+  rec->len = len;
+  rec->caplen = len < cap->opts.snaplen ? len : cap->opts.snaplen;
+  memcpy(rec + 1, buf, rec->caplen);
+
+  sr_ring_commit(&cap->ring, pos, sizeof(*rec) + rec->caplen);
+} /* -- sr_capture_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_set_filter
+ *
+ * Publica el filtro nuevo con un intercambio atomico. El viejo no se
+ * libera: un productor puede haberlo leido justo antes del cambio. Los
+ * filtros cambian a mano y ocupan poco, asi que se guardan hasta el
+ * cierre.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_set_filter(struct sr_capture* cap, struct sr_filter* filter)
+{
+  struct sr_filter* old;
+
+  pthread_mutex_lock(&cap->filter_lock);
+  old = __atomic_exchange_n(&cap->filter, filter, __ATOMIC_ACQ_REL);
+  if (old != 0) {
+    struct cap_retired* r = malloc(sizeof(*r));
+    if (r != 0) {
+      r->filter = old;
+      r->next = cap->retired;
+      cap->retired = r;
+    }
+    /* sin memoria se pierde el filtro viejo antes que arriesgar un
+       acceso a memoria liberada */
+  }
+  pthread_mutex_unlock(&cap->filter_lock);
+} /* -- sr_capture_set_filter -- */
+
+int sr_capture_match(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                     const char* iface, int dir)
+{
+  struct sr_filter* f = __atomic_load_n(&cap->filter, __ATOMIC_ACQUIRE);
+
+  if (f == 0 || sr_filter_match(f, buf, len, iface, dir)) {
+    return 1;
+  }
+  __atomic_fetch_add(&cap->filtered, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+void sr_capture_print_filter(struct sr_capture* cap, FILE* out, int program)
+{
+  struct sr_filter* f;
+
+  pthread_mutex_lock(&cap->filter_lock);
+  f = cap->filter;
+  if (f == 0) {
+    fprintf(out, "no filter, capturing everything\n");
+  }
+  else {
+    fprintf(out, "filter: %s\n", sr_filter_expr(f));
+    if (program) {
+      sr_filter_print(f, out);
+    }
+  }
+  pthread_mutex_unlock(&cap->filter_lock);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_set_interfaces
+ *
+ * Guarda los datos de los IDB. El escritor solo lee las entradas por
+ * debajo de n_ifs, que se publica al final.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_set_interfaces(struct sr_capture* cap, struct sr_if* if_list)
+{
+  struct sr_if* iface;
+  int n = 0;
+
+  if (__atomic_load_n(&cap->n_ifs, __ATOMIC_ACQUIRE) != 0) {
+    return;
+  }
+  for (iface = if_list; iface != 0 && n < SR_CAPTURE_MAX_IFS; iface = iface->next) {
+    if (iface->index >= SR_CAPTURE_MAX_IFS) {
+      continue;
+    }
+    snprintf(cap->ifs[iface->index].name, sizeof(cap->ifs[0].name), "%s", iface->name);
+    memcpy(cap->ifs[iface->index].mac, iface->addr, ETHER_ADDR_LEN);
+    cap->ifs[iface->index].ip = iface->ip;
+    cap->ifs[iface->index].mask = iface->mask;
+    n++;
+  }
+  __atomic_store_n(&cap->n_ifs, n, __ATOMIC_RELEASE);
+} /* -- sr_capture_set_interfaces -- */
+
+void sr_capture_close(struct sr_capture* cap)
+{
+  if (cap == 0) {
+    return;
+  }
+
+  __atomic_store_n(&cap->stopping, 1, __ATOMIC_RELEASE);
+  pthread_join(cap->thread, 0);
+  cap_flush(cap);
+  if (cap->fd != STDOUT_FILENO && cap->fd >= 0) {
+    close(cap->fd);
+  }
+
+  sr_ring_destroy(&cap->ring);
+  while (cap->retired != 0) {
+    struct cap_retired* r = cap->retired;
+    cap->retired = r->next;
+    sr_filter_free(r->filter);
+    free(r);
+  }
+  sr_filter_free(cap->filter);
+  pthread_mutex_destroy(&cap->filter_lock);
+  free(cap->buf);
+  free(cap->path);
+  free(cap);
+}
+
+void sr_capture_print_stats(struct sr_capture* cap, FILE* out)
+{
+  fprintf(out, "Capture %s (%s):\n", cap->path,
+          cap->opts.format == sr_capture_pcapng ? "pcapng" : "pcap");
+  fprintf(out, "  %-28s%llu\n", "frames written", (unsigned long long) cap->frames);
+  fprintf(out, "  %-28s%llu\n", "frames dropped", (unsigned long long) sr_ring_dropped(&cap->ring));
+  pthread_mutex_lock(&cap->filter_lock);
+  fprintf(out, "  %-28s%s\n", "filter", cap->filter != 0 ? sr_filter_expr(cap->filter) : "none");
+  pthread_mutex_unlock(&cap->filter_lock);
+  fprintf(out, "  %-28s%llu\n", "frames filtered out",
+          (unsigned long long) __atomic_load_n(&cap->filtered, __ATOMIC_RELAXED));
+  fprintf(out, "  %-28s%llu\n", "frame bytes", (unsigned long long) cap->bytes);
+  fprintf(out, "  %-28s%llu\n", "write() calls", (unsigned long long) cap->writes);
+  fprintf(out, "  %-28s%llu\n", "write errors", (unsigned long long) cap->write_errors);
+  fprintf(out, "  %-28s%llu\n", "open errors", (unsigned long long) cap->open_errors);
+  fprintf(out, "  %-28s%llu\n", "files", (unsigned long long) cap->files);
+}
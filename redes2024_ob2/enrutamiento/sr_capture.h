@@ -0,0 +1,106 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Descripción:
+ *
+ * Captura de tramas (opcion -l) sin escribir a disco en el camino de
+ * datos. sr_capture_packet copia la trama a una sr_ring y retorna; un
+ * hilo escritor junta las tramas en un buffer grande, lo escribe con un
+ * solo write() y rota el archivo por tamaño (-S) o por tiempo (-G).
+ *
+ * Si el disco no da abasto la cola se llena y las tramas que no entran se
+ * descartan: se cuentan y se informan por el log (subsistema cap).
+ *
+ * Si el archivo termina en ".pcapng" se escribe pcapng: un bloque de
+ * interfaz por cada sr_if (id == sr_if.index), la direccion de cada trama
+ * en epb_flags y timestamps en nanosegundos tomados de CLOCK_MONOTONIC
+ * (corridos a la epoca una sola vez al abrir), de modo que la latencia
+ * de un salto por el router se mide restando timestamps de una captura.
+ *
+ * Un filtro (opcion -f o comando "filter" del canal de control, ver
+ * sr_filter.h) decide que tramas se copian; se evalua antes de la copia.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_CAPTURE_RING_SLOTS 4096
+#define SR_CAPTURE_BUF_SIZE   (256 * 1024)   /* bytes por write() */
+#define SR_CAPTURE_FLUSH_MS   200            /* maximo tiempo en el buffer */
+
+#define SR_CAPTURE_MAX_IFS    32
+#define SR_CAPTURE_IF_UNKNOWN 0xff
+
+struct sr_capture;
+struct sr_if;
+struct sr_filter;
+
+enum sr_capture_format {
+  sr_capture_pcap = 0,
+  sr_capture_pcapng
+};
+
+/* Mismos valores que la direccion de epb_flags */
+enum sr_capture_dir {
+  sr_capture_in = 1,
+  sr_capture_out = 2
+};
+
+struct sr_capture_opts
+{
+  const char* path;          /* "-" es stdout (sin rotacion) */
+  int format;                /* enum sr_capture_format */
+  unsigned int snaplen;      /* bytes guardados de cada trama */
+  uint64_t rotate_bytes;     /* 0: no rotar por tamaño */
+  unsigned int rotate_secs;  /* 0: no rotar por tiempo */
+};
+
+/* Abre el primer archivo y arranca el escritor. Retorna 0 si falla. */
+struct sr_capture* sr_capture_open(const struct sr_capture_opts* opts);
+
+/* Formato segun la extension del archivo */
+int sr_capture_format_from_path(const char* path);
+
+/* Copia nombre, MAC e IP de las interfaces para los bloques de interfaz
+   de pcapng. Se llama una vez, cuando llega el HWINFO. */
+void sr_capture_set_interfaces(struct sr_capture* cap, struct sr_if* if_list);
+
+/* Encola una copia de la trama. ifindex es sr_if.index (o
+   SR_CAPTURE_IF_UNKNOWN) y dir un enum sr_capture_dir. Seguro desde
+   cualquier hilo. */
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                       unsigned int ifindex, int dir);
+
+/* Cambia el filtro (0: capturar todo). Se puede llamar con la captura
+   andando: el filtro anterior puede estar evaluandose en otro hilo, asi
+   que se retira y se libera recien en sr_capture_close. */
+void sr_capture_set_filter(struct sr_capture* cap, struct sr_filter* filter);
+
+/* 1 si la trama pasa el filtro actual (o no hay filtro). Cuenta las que
+   no pasan. */
+int sr_capture_match(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                     const char* iface, int dir);
+
+/* Imprime la expresion del filtro y, si program != 0, el programa */
+void sr_capture_print_filter(struct sr_capture* cap, FILE* out, int program);
+
+/* Vacia la cola, cierra el archivo y libera todo */
+void sr_capture_close(struct sr_capture* cap);
+
+void sr_capture_print_stats(struct sr_capture* cap, FILE* out);
+
+/* "100000", "64k", "100M", "2G" -> bytes; 0 si no es valido */
+uint64_t sr_capture_parse_size(const char* str);
+
+#endif /* -- SR_CAPTURE_H -- */
@@ -0,0 +1,217 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Descripción:
+ *
+ * Servidor del canal de control. Un unico hilo atiende las conexiones de
+ * a una: lee lineas, las separa en palabras y llama al manejador del
+ * comando. Los comandos se registran al inicio, por eso la tabla no se
+ * protege con locks.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sr_ctl.h"
+#include "sr_log.h"
+
+struct sr_ctl_cmd
+{
+  const char* name;
+  const char* help;
+  sr_ctl_handler_t handler;
+};
+
+static struct
+{
+  struct sr_ctl_cmd cmds[SR_CTL_MAX_CMDS];
+  int n_cmds;
+  int fd;
+  char path[108];
+  struct sr_instance* sr;
+  pthread_t thread;
+} g_ctl = { .fd = -1 };
+
+int sr_ctl_register(const char* name, const char* help, sr_ctl_handler_t handler)
+{
+  if (g_ctl.n_cmds == SR_CTL_MAX_CMDS) {
+    return -1;
+  }
+  g_ctl.cmds[g_ctl.n_cmds].name = name;
+  g_ctl.cmds[g_ctl.n_cmds].help = help;
+  g_ctl.cmds[g_ctl.n_cmds].handler = handler;
+  g_ctl.n_cmds++;
+  return 0;
+}
+
+static int ctl_help(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+  int i;
+
+  for (i = 0; i < g_ctl.n_cmds; i++) {
+    fprintf(out, "%-10s%s\n", g_ctl.cmds[i].name, g_ctl.cmds[i].help);
+  }
+  return 0;
+}
+
+/* log                      muestra los niveles
+   log <nivel>              cambia todos los subsistemas
+   log <subsistema> <nivel> cambia uno */
+static int ctl_log(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+  int sub = -1;
+  int level;
+
+  if (argc == 2 || argc == 3) {
+    if (argc == 3 && (sub = sr_log_subsys_from_str(argv[1])) < 0 && strcmp(argv[1], "all") != 0) {
+      fprintf(out, "unknown subsystem %s\n", argv[1]);
+      return -1;
+    }
+    if ((level = sr_log_level_from_str(argv[argc - 1])) < 0) {
+      fprintf(out, "unknown level %s\n", argv[argc - 1]);
+      return -1;
+    }
+    sr_log_set_level(sub, level);
+    if (level > SR_LOG_COMPILE_LEVEL) {
+      fprintf(out, "warning: messages above %s are not compiled in\n",
+              sr_log_level_str(SR_LOG_COMPILE_LEVEL));
+    }
+  }
+  else if (argc != 1) {
+    fprintf(out, "usage: log [subsystem] [level]\n");
+    return -1;
+  }
+
+  sr_log_print_levels(out);
+  return 0;
+}
+
+static void ctl_dispatch(char* line, FILE* out)
+{
+  char* argv[SR_CTL_MAX_ARGS];
+  char* save = 0;
+  char* tok;
+  int argc = 0;
+  int i;
+
+  for (tok = strtok_r(line, " \t\r\n", &save); tok != 0 && argc < SR_CTL_MAX_ARGS;
+       tok = strtok_r(0, " \t\r\n", &save)) {
+    argv[argc++] = tok;
+  }
+  if (argc == 0) {
+    return;
+  }
+
+  for (i = 0; i < g_ctl.n_cmds; i++) {
+    if (strcmp(argv[0], g_ctl.cmds[i].name) == 0) {
+      g_ctl.cmds[i].handler(g_ctl.sr, argc, argv, out);
+      return;
+    }
+  }
+  fprintf(out, "unknown command %s, try help\n", argv[0]);
+}
+
+static void* ctl_thread(void* arg)
+{
+  char line[512];
+
+  for (;;) {
+    int cfd = accept(g_ctl.fd, 0, 0);
+    FILE* in;
+    FILE* out;
+
+    if (cfd < 0) {
+      if (g_ctl.fd < 0) {
+        break;
+      }
+      continue;
+    }
+    /* Un FILE por sentido: en un socket no se puede alternar lectura y
+       escritura sobre el mismo stream */
+    in = fdopen(cfd, "r");
+    out = in != 0 ? fdopen(dup(cfd), "w") : 0;
+    if (out == 0) {
+      if (in != 0) {
+        fclose(in);
+      }
+      else {
+        close(cfd);
+      }
+      continue;
+    }
+    while (fgets(line, sizeof(line), in) != 0) {
+      ctl_dispatch(line, out);
+      fflush(out);
+    }
+    fclose(out);
+    fclose(in);
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_start
+ *
+ * Registra los comandos propios, crea el socket Unix en path (borrando
+ * uno viejo si existe) y lanza el hilo que lo atiende.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_start(struct sr_instance* sr, const char* path)
+{
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Control socket path too long: %s\n", path);
+    return -1;
+  }
+
+  sr_ctl_register("help", "list commands", ctl_help);
+  sr_ctl_register("log", "[subsystem] [level]: show or set log levels", ctl_log);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((g_ctl.fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    perror("socket(AF_UNIX)");
+    return -1;
+  }
+  unlink(path);
+  if (bind(g_ctl.fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(g_ctl.fd, 4) < 0) {
+    perror("bind/listen control socket");
+    close(g_ctl.fd);
+    g_ctl.fd = -1;
+    return -1;
+  }
+
+  strcpy(g_ctl.path, path);
+  g_ctl.sr = sr;
+  if (pthread_create(&g_ctl.thread, 0, ctl_thread, 0) != 0) {
+    close(g_ctl.fd);
+    g_ctl.fd = -1;
+    return -1;
+  }
+  pthread_detach(g_ctl.thread);
+  return 0;
+} /* -- sr_ctl_start -- */
+
+void sr_ctl_stop(void)
+{
+  int fd = g_ctl.fd;
+
+  if (fd < 0) {
+    return;
+  }
+  g_ctl.fd = -1;
+  shutdown(fd, SHUT_RDWR);
+  close(fd);
+  unlink(g_ctl.path);
+}
@@ -0,0 +1,34 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Descripción:
+ *
+ * Canal de control del router: un socket Unix (opcion -C) donde se envian
+ * comandos de una linea, por ejemplo
+ *
+ *   echo "log ospf debug" | nc -U /tmp/sr.ctl
+ *
+ * Cada subsistema registra sus comandos con sr_ctl_register antes de
+ * sr_ctl_start. El manejador escribe la respuesta en out.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#include <stdio.h>
+
+struct sr_instance;
+
+#define SR_CTL_MAX_CMDS 32
+#define SR_CTL_MAX_ARGS 64   /* alcanza para una expresion de filtro */
+
+typedef int (*sr_ctl_handler_t)(struct sr_instance* sr, int argc, char** argv, FILE* out);
+
+int sr_ctl_register(const char* name, const char* help, sr_ctl_handler_t handler);
+
+/* Crea el socket en path y un hilo que atiende las conexiones */
+int sr_ctl_start(struct sr_instance* sr, const char* path);
+void sr_ctl_stop(void);
+
+#endif /* -- SR_CTL_H -- */
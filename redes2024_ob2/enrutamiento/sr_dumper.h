@@ -77,3 +77,60 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+/*
+ * pcapng (https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html).
+ * Todos los bloques empiezan con tipo y largo total, y terminan repitiendo
+ * el largo. Los campos van en el orden de bytes del que escribe.
+ */
+#define PCAPNG_BT_SHB 0x0A0D0D0A     /* Section Header Block */
+#define PCAPNG_BT_IDB 0x00000001     /* Interface Description Block */
+#define PCAPNG_BT_EPB 0x00000006     /* Enhanced Packet Block */
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_ENDOFOPT   0
+#define PCAPNG_OPT_COMMENT    1
+#define PCAPNG_SHB_USERAPPL   4
+#define PCAPNG_IF_NAME        2
+#define PCAPNG_IF_IPV4ADDR    4
+#define PCAPNG_IF_MACADDR     6
+#define PCAPNG_IF_TSRESOL     9
+#define PCAPNG_EPB_FLAGS      2
+
+/* epb_flags, bits 0-1: direccion */
+#define PCAPNG_EPB_DIR_IN     0x1
+#define PCAPNG_EPB_DIR_OUT    0x2
+
+struct pcapng_block_hdr {
+  uint32_t type;
+  uint32_t total_len;
+};
+
+struct pcapng_shb {
+  struct pcapng_block_hdr h;
+  uint32_t byte_order_magic;
+  uint16_t version_major;     /* 1 */
+  uint16_t version_minor;     /* 0 */
+  int64_t  section_len;       /* -1: no se conoce */
+};
+
+struct pcapng_idb {
+  struct pcapng_block_hdr h;
+  uint16_t linktype;
+  uint16_t reserved;
+  uint32_t snaplen;
+};
+
+struct pcapng_epb {
+  struct pcapng_block_hdr h;
+  uint32_t if_id;
+  uint32_t ts_high;           /* timestamp en unidades de if_tsresol */
+  uint32_t ts_low;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+struct pcapng_opt {
+  uint16_t code;
+  uint16_t len;               /* sin el relleno a 4 bytes */
+};
@@ -0,0 +1,678 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * FIB plana para lpm() y snapshot binario de la tabla de enrutamiento.
+ * El formato esta descrito en sr_fib.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_pwospf.h"
+
+#define FIB_ROUTES(h) ((struct sr_fib_route*) ((h) + 1))
+#define FIB_SLOTS(h)  ((uint32_t*) (FIB_ROUTES(h) + (h)->nroutes))
+
+/* Mascara de un prefijo /p, en orden de red */
+static uint32_t fib_mask(int plen)
+{
+    return plen == 0 ? 0 : htonl(0xffffffffU << (32 - plen));
+}
+
+/* Largo del prefijo de una mascara, -1 si no es contigua */
+static int fib_plen(uint32_t mask)
+{
+    uint32_t m = ntohl(mask);
+    int plen = 0;
+
+    while (plen < 32 && (m & (0x80000000U >> plen)))
+    {
+        plen++;
+    }
+    return fib_mask(plen) == mask ? plen : -1;
+}
+
+/* Hash multiplicativo, se queda con los bits altos del producto */
+static uint32_t fib_hash(uint32_t key, uint32_t bits)
+{
+    return (key * 2654435761U) >> (32 - bits);
+}
+
+/* Checksum de la imagen: FNV-1a de a palabras de 64 bits. Cualquier
+   cambio en una sola palabra cambia el resultado. */
+static uint64_t fib_checksum(const void* buf, size_t len)
+{
+    const uint64_t* w = buf;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len / 8; i++)
+    {
+        h ^= w[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+/*---------------------------------------------------------------------
+ * Method: fib_image
+ *
+ * Arma la imagen plana con las n rutas de rts, en ese orden. Con
+ * prefijos repetidos la hash apunta al primero, igual que el recorrido
+ * lineal de lpm().
+ *
+ * Devuelve 0 si alguna mascara no es contigua: esas rutas no entran en
+ * una hash por largo de prefijo y la capa se recorre entera.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_fib_hdr* fib_image(struct sr_rt** rts, uint32_t n)
+{
+    uint32_t count[33];
+    struct sr_fib_level level[33];
+    uint64_t plen_map = 0;
+    uint32_t nroutes = 0, nslots = 0;
+    struct sr_fib_hdr* h;
+    struct sr_fib_route* routes;
+    uint32_t* slots;
+    uint32_t k;
+    size_t size;
+    int p;
+
+    memset(count, 0, sizeof(count));
+    for (k = 0; k < n; k++)
+    {
+        p = fib_plen(rts[k]->mask.s_addr);
+        if (p < 0)
+        {
+            return 0;
+        }
+        count[p]++;
+        nroutes++;
+    }
+
+    /* -- a lo sumo media tabla ocupada, siempre queda un slot libre -- */
+    memset(level, 0, sizeof(level));
+    for (p = 0; p <= 32; p++)
+    {
+        uint32_t bits = 1;
+
+        if (count[p] == 0)
+        {
+            continue;
+        }
+        while ((1U << bits) < 2 * count[p])
+        {
+            bits++;
+        }
+        level[p].off = nslots;
+        level[p].bits = bits;
+        plen_map |= 1ULL << p;
+        nslots += 1U << bits;
+    }
+
+    size = sizeof(struct sr_fib_hdr) + nroutes * sizeof(struct sr_fib_route)
+           + nslots * sizeof(uint32_t);
+    size = (size + 7) & ~(size_t) 7;
+    h = calloc(1, size);
+    if (h == 0)
+    {
+        return 0;
+    }
+
+    memcpy(h->magic, SR_FIB_MAGIC, sizeof(h->magic));
+    h->version = SR_FIB_VERSION;
+    h->byteorder = SR_FIB_BYTEORDER;
+    h->nroutes = nroutes;
+    h->nslots = nslots;
+    h->size = size;
+    h->plen_map = plen_map;
+    memcpy(h->level, level, sizeof(level));
+
+    routes = FIB_ROUTES(h);
+    slots = FIB_SLOTS(h);
+    nroutes = 0;
+    for (k = 0; k < n; k++)
+    {
+        struct sr_rt* rt = rts[k];
+        struct sr_fib_route* r = &routes[nroutes];
+        struct sr_fib_level* l;
+        uint32_t i;
+
+        r->dest = rt->dest.s_addr;
+        r->gw = rt->gw.s_addr;
+        r->mask = rt->mask.s_addr;
+        r->plen = fib_plen(r->mask);
+        r->admin_dst = rt->admin_dst;
+        memcpy(r->interface, rt->interface, sr_IFACE_NAMELEN);
+        r->interface[sr_IFACE_NAMELEN - 1] = 0;
+        nroutes++;
+
+        l = &h->level[r->plen];
+        i = fib_hash(r->dest, l->bits);
+        while (slots[l->off + i] != 0 && routes[slots[l->off + i] - 1].dest != r->dest)
+        {
+            i = (i + 1) & ((1U << l->bits) - 1);
+        }
+        if (slots[l->off + i] == 0)
+        {
+            slots[l->off + i] = nroutes;
+        }
+    }
+    return h;
+} /* -- fib_image -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_collect
+ *
+ * Rutas de una capa: las estaticas, en el orden de routing_table, o las
+ * conectadas y dinamicas que estan elegidas. Estas se sacan de las
+ * listas de su fuente en la RIB, sin recorrer las estaticas, asi que
+ * rearmar la capa de PWOSPF no depende del tamano de la tabla.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt** fib_collect(struct sr_instance* sr, int dyn, uint32_t* n)
+{
+    static const int dyn_sources[] = { SR_RT_CONNECTED, SR_RT_DYNAMIC };
+    struct sr_rt** rts;
+    struct sr_rt* rt;
+    uint32_t cap = 0;
+    unsigned int s;
+
+    *n = 0;
+    if (sr->rib == 0)
+    {
+        return 0;
+    }
+    if (!dyn)
+    {
+        cap = sr->rib->ncand[SR_RT_STATIC];
+    }
+    for (s = 0; dyn && s < sizeof(dyn_sources) / sizeof(dyn_sources[0]); s++)
+    {
+        cap += sr->rib->ncand[dyn_sources[s]];
+    }
+    if (cap == 0 || (rts = malloc(cap * sizeof(struct sr_rt*))) == 0)
+    {
+        return 0;
+    }
+
+    if (!dyn)
+    {
+        for (rt = sr->routing_table; rt != 0 && *n < cap; rt = rt->next)
+        {
+            if (SR_RT_SOURCE(rt->admin_dst) == SR_RT_STATIC)
+            {
+                rts[(*n)++] = rt;
+            }
+        }
+        return rts;
+    }
+    for (s = 0; s < sizeof(dyn_sources) / sizeof(dyn_sources[0]); s++)
+    {
+        for (rt = sr->rib->source[dyn_sources[s]]; rt != 0; rt = rt->snext)
+        {
+            if (rt->pprev != 0)
+            {
+                rts[(*n)++] = rt;
+            }
+        }
+    }
+    return rts;
+} /* -- fib_collect -- */
+
+/* Arma una capa; con pocas rutas o mascaras no contiguas va sin imagen */
+static struct sr_fib* fib_layer(struct sr_instance* sr, int dyn)
+{
+    struct sr_fib* fib;
+    uint32_t n;
+    struct sr_rt** rts = fib_collect(sr, dyn, &n);
+
+    if (n == 0 || (fib = calloc(1, sizeof(struct sr_fib))) == 0)
+    {
+        free(rts);
+        return 0;
+    }
+    fib->node = rts;
+    fib->nroutes = n;
+    if (n >= SR_FIB_MIN_ROUTES)
+    {
+        fib->img = fib_image(rts, n);
+    }
+    return fib;
+} /* -- fib_layer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_update
+ *
+ * Rearma las capas que quedaron viejas: la estatica solo si cambiaron
+ * rutas estaticas (si vino del snapshot sigue mapeada mientras tanto) y
+ * la de conectadas y dinamicas, que es chica, con cualquier cambio. La
+ * llama quien cambia la tabla, con el lock de pwospf tomado si hay
+ * hilos, cuando termina un lote de cambios: lpm() solo consulta y exige
+ * las capas al dia.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_update(struct sr_instance* sr)
+{
+    if (sr->fib_version == sr->rt_version)
+    {
+        return;
+    }
+    if (sr->fib_static_version != sr->rt_static_version)
+    {
+        sr_fib_free(sr->fib);
+        sr->fib = fib_layer(sr, 0);
+        sr->fib_static_version = sr->rt_static_version;
+    }
+    sr_fib_free(sr->fib_dyn);
+    sr->fib_dyn = fib_layer(sr, 1);
+    sr->fib_version = sr->rt_version;
+} /* -- sr_fib_update -- */
+
+void sr_fib_free(struct sr_fib* fib)
+{
+    if (fib == 0)
+    {
+        return;
+    }
+    if (fib->map_len > 0)
+    {
+        munmap(fib->img, fib->map_len);
+    }
+    else
+    {
+        free(fib->img);
+    }
+    free(fib->node);
+    free(fib);
+} /* -- sr_fib_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_layer_lookup
+ *
+ * Prefijo mas largo de la capa que contiene dest_ip: una consulta a la
+ * hash por cada largo presente, de /32 hacia /0, o el recorrido de la
+ * capa si no tiene imagen.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* fib_layer_lookup(const struct sr_fib* fib, uint32_t dest_ip)
+{
+    const struct sr_fib_hdr* h = fib->img;
+    const struct sr_fib_route* routes;
+    const uint32_t* slots;
+    uint64_t map;
+
+    if (h == 0)
+    {
+        struct sr_rt* bpm = 0;
+        uint32_t i;
+
+        for (i = 0; i < fib->nroutes; i++)
+        {
+            struct sr_rt* rt = fib->node[i];
+
+            if ((dest_ip & rt->mask.s_addr) == rt->dest.s_addr &&
+                (bpm == 0 || ntohl(rt->mask.s_addr) > ntohl(bpm->mask.s_addr)))
+            {
+                bpm = rt;
+            }
+        }
+        return bpm;
+    }
+
+    routes = FIB_ROUTES(h);
+    slots = FIB_SLOTS(h);
+    map = h->plen_map;
+    while (map != 0)
+    {
+        int p = 63 - __builtin_clzll(map);
+        const struct sr_fib_level* l = &h->level[p];
+        uint32_t key = dest_ip & fib_mask(p);
+        uint32_t i = fib_hash(key, l->bits);
+        uint32_t s;
+
+        while ((s = slots[l->off + i]) != 0)
+        {
+            if (routes[s - 1].dest == key)
+            {
+                return fib->node[s - 1];
+            }
+            i = (i + 1) & ((1U << l->bits) - 1);
+        }
+        map &= ~(1ULL << p);
+    }
+    return 0;
+} /* -- fib_layer_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup
+ *
+ * Prefijo mas largo entre las dos capas. Una ruta estatica siempre es
+ * la elegida de su prefijo, asi que las capas no repiten prefijos y
+ * alcanza con quedarse con la mascara mas larga. Solo vale con las capas
+ * al dia (fib_version == rt_version).
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(struct sr_instance* sr, uint32_t dest_ip)
+{
+    struct sr_rt* st = sr->fib != 0 ? fib_layer_lookup(sr->fib, dest_ip) : 0;
+    struct sr_rt* dyn = sr->fib_dyn != 0 ? fib_layer_lookup(sr->fib_dyn, dest_ip) : 0;
+
+    if (st == 0 || (dyn != 0 && ntohl(dyn->mask.s_addr) > ntohl(st->mask.s_addr)))
+    {
+        return dyn;
+    }
+    return st;
+} /* -- sr_fib_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_save_snapshot
+ *
+ * Escribe el snapshot de las rutas estaticas en path. Se escribe a un
+ * temporal y se renombra, un router que arranca nunca ve un snapshot a
+ * medias. Devuelve la cantidad de rutas escritas, o -1 con errno.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_save_snapshot(struct sr_instance* sr, const char* path)
+{
+    struct sr_fib_hdr* h;
+    struct sr_rt** rts;
+    uint32_t nrts;
+    char tmp[512];
+    FILE* fp;
+    int ok, n;
+
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_lock(sr->ospf_subsys);
+    }
+    rts = fib_collect(sr, 0, &nrts);
+    h = fib_image(rts, nrts);
+    free(rts);
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_unlock(sr->ospf_subsys);
+    }
+    if (h == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    h->src_mtime = sr->rt_mtime;
+    h->src_size = sr->rt_size;
+    h->checksum = fib_checksum(h + 1, h->size - sizeof(struct sr_fib_hdr));
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if (fp == 0)
+    {
+        free(h);
+        return -1;
+    }
+    ok = fwrite(h, h->size, 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        int err = errno;
+
+        unlink(tmp);
+        free(h);
+        errno = err;
+        return -1;
+    }
+    n = h->nroutes;
+    free(h);
+    return n;
+} /* -- sr_fib_save_snapshot -- */
+
+/* Valida la imagen mapeada: tamanos, rangos de cada hash y que en cada
+   una quede algun slot libre (si no, una consulta no termina) */
+static const char* fib_check_image(const struct sr_fib_hdr* h, size_t len)
+{
+    const uint32_t* slots;
+    int p;
+
+    if (len < sizeof(struct sr_fib_hdr) || memcmp(h->magic, SR_FIB_MAGIC, sizeof(h->magic)) != 0)
+    {
+        return "not a routing table snapshot";
+    }
+    if (h->version != SR_FIB_VERSION || h->byteorder != SR_FIB_BYTEORDER)
+    {
+        return "unsupported version or byte order";
+    }
+    if (h->size != len
+        || h->nroutes > len / sizeof(struct sr_fib_route)
+        || h->nslots > len / sizeof(uint32_t)
+        || sizeof(struct sr_fib_hdr) + (uint64_t) h->nroutes * sizeof(struct sr_fib_route)
+           + (uint64_t) h->nslots * sizeof(uint32_t) > len)
+    {
+        return "truncated";
+    }
+    if (fib_checksum(h + 1, len - sizeof(struct sr_fib_hdr)) != h->checksum)
+    {
+        return "bad checksum";
+    }
+
+    slots = FIB_SLOTS(h);
+    for (p = 0; p <= 32; p++)
+    {
+        const struct sr_fib_level* l = &h->level[p];
+        uint32_t i, used = 0;
+
+        if (!(h->plen_map & (1ULL << p)))
+        {
+            continue;
+        }
+        if (l->bits == 0 || l->bits > 31 || l->off > h->nslots
+            || (1U << l->bits) > h->nslots - l->off)
+        {
+            return "bad index";
+        }
+        for (i = 0; i < (1U << l->bits); i++)
+        {
+            uint32_t s = slots[l->off + i];
+
+            if (s > h->nroutes)
+            {
+                return "bad index";
+            }
+            used += s != 0;
+        }
+        if (used == 1U << l->bits)
+        {
+            return "bad index";
+        }
+    }
+    if (h->plen_map >> 33)
+    {
+        return "bad index";
+    }
+    return 0;
+} /* -- fib_check_image -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_load_snapshot
+ *
+ * Mapea el snapshot path y, si es valido y no es mas viejo que el
+ * archivo de texto rtable, lo instala como tabla de enrutamiento: la
+ * FIB se usa directo desde el mapeo y solo se arma la lista de rutas
+ * (sin parsear nada). Devuelve -1 si hay que leer el archivo de texto.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_load_snapshot(struct sr_instance* sr, const char* path, const char* rtable)
+{
+    struct sr_fib_hdr* h;
+    struct sr_fib* fib;
+    struct sr_fib_route* routes;
+    struct timespec t0, t1;
+    struct stat st, src;
+    const char* error;
+    uint32_t i;
+    int fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            perror(path);
+        }
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct sr_fib_hdr))
+    {
+        fprintf(stderr, "%s: not a routing table snapshot, loading %s\n", path, rtable);
+        close(fd);
+        return -1;
+    }
+    h = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED)
+    {
+        perror(path);
+        return -1;
+    }
+
+    error = fib_check_image(h, st.st_size);
+    if (error == 0 && stat(rtable, &src) == 0
+        && (src.st_mtime != h->src_mtime || (uint64_t) src.st_size != h->src_size))
+    {
+        error = "stale";
+    }
+    if (error != 0)
+    {
+        fprintf(stderr, "%s: %s, loading %s\n", path, error, rtable);
+        munmap(h, st.st_size);
+        return -1;
+    }
+
+    fib = calloc(1, sizeof(struct sr_fib));
+    if (fib == 0 || (fib->node = malloc((h->nroutes ? h->nroutes : 1) * sizeof(struct sr_rt*))) == 0)
+    {
+        free(fib);
+        munmap(h, st.st_size);
+        return -1;
+    }
+    fib->img = h;
+    fib->map_len = st.st_size;
+    fib->nroutes = h->nroutes;
+
+    /* -- el resto del router recorre la RIB y la lista de rutas elegidas:
+          se cargan las rutas sin parsear nada -- */
+    if (sr->routing_table != 0)
+    {
+        printf("Loading routing table from server, clear local routing table.\n");
+    }
+    sr_clear_rt_source(sr, SR_RT_STATIC);
+    sr_clear_rt_source(sr, SR_RT_CONNECTED);
+    sr_clear_rt_source(sr, SR_RT_DYNAMIC);
+    sr_reserve_rt(sr, h->nroutes);
+    routes = FIB_ROUTES(h);
+    for (i = 0; i < h->nroutes; i++)
+    {
+        struct in_addr dest, gw, mask;
+        char iface[sr_IFACE_NAMELEN];
+
+        dest.s_addr = routes[i].dest;
+        gw.s_addr = routes[i].gw;
+        mask.s_addr = routes[i].mask;
+        memcpy(iface, routes[i].interface, sr_IFACE_NAMELEN);
+        iface[sr_IFACE_NAMELEN - 1] = 0;
+        fib->node[i] = sr_add_rt_entry(sr, dest, gw, mask, iface, routes[i].admin_dst);
+    }
+    /* -- la capa estatica es el mapeo; la otra quedo vacia -- */
+    sr_fib_free(sr->fib);
+    sr->fib = fib;
+    sr->fib_static_version = sr->rt_static_version;
+    sr_fib_update(sr);
+    snprintf(sr->rt_path, sizeof(sr->rt_path), "%s", rtable);
+    sr->rt_mtime = h->src_mtime;
+    sr->rt_size = h->src_size;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Loaded %u routes from snapshot %s in %.1f ms (%.1f KiB mapped)\n",
+           h->nroutes, path,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+           st.st_size / 1024.0);
+    return 0;
+} /* -- sr_fib_load_snapshot -- */
+
+/* Una linea por capa */
+static void fib_print_layer(const char* name, const struct sr_fib* fib, FILE* out)
+{
+    const struct sr_fib_hdr* h;
+    int plens = 0, p;
+
+    if (fib == 0)
+    {
+        fprintf(out, "fib %s: empty\n", name);
+        return;
+    }
+    if ((h = fib->img) == 0)
+    {
+        fprintf(out, "fib %s: %u routes, linear lookup (small layer or non-contiguous mask)\n",
+                name, fib->nroutes);
+        return;
+    }
+    for (p = 0; p <= 32; p++)
+    {
+        plens += (h->plen_map >> p) & 1;
+    }
+    fprintf(out, "fib %s: %s, %u routes, %d prefix lengths, %u slots, %.1f KiB\n", name,
+            fib->map_len > 0 ? "mapped from snapshot" : "built",
+            h->nroutes, plens, h->nslots, h->size / 1024.0);
+} /* -- fib_print_layer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_print
+ *
+ * Resumen de la tabla y de las capas de la FIB, para el canal de control
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_print(struct sr_instance* sr, FILE* out)
+{
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_lock(sr->ospf_subsys);
+    }
+    fprintf(out, "routing table from %s\n", sr->rt_path[0] ? sr->rt_path : "-");
+    sr_print_rib_stats(sr, out);
+
+    if (sr->fib_version != sr->rt_version)
+    {
+        fprintf(out, "fib: out of date, sr_fib_update missing after the last change\n");
+    }
+    else
+    {
+        fib_print_layer("static", sr->fib, out);
+        fib_print_layer("connected/dynamic", sr->fib_dyn, out);
+    }
+    if (sr->ospf_subsys != 0)
+    {
+        pwospf_unlock(sr->ospf_subsys);
+    }
+} /* -- sr_fib_print -- */
@@ -0,0 +1,105 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Estructura de busqueda de la tabla de enrutamiento (FIB) y su snapshot
+ * binario.
+ *
+ * La FIB es una imagen plana, sin punteros: un cabezal, el arreglo de
+ * rutas y una tabla hash por largo de prefijo. lpm() recorre solo los
+ * largos presentes, del mas largo al mas corto, con una consulta a la
+ * hash en cada uno. Como la imagen no tiene punteros se puede escribir
+ * tal cual a disco y, al arrancar, mapearla con mmap y usarla sin
+ * reconstruir nada (ver sr_fib_load_snapshot).
+ *
+ * La busqueda tiene dos capas: las rutas estaticas (la tabla grande, que
+ * casi no cambia y puede venir del snapshot) y encima las conectadas y
+ * dinamicas elegidas. Un cambio de PWOSPF rearma solo la segunda. Las
+ * capas las rearma sr_fib_update, que llama quien cambia la tabla al
+ * terminar; lpm() nunca arma nada.
+ *
+ * Formato del snapshot (version SR_FIB_VERSION, orden de bytes del host
+ * que lo escribio, marcado en byteorder):
+ *
+ *   struct sr_fib_hdr                    cabezal, checksum del resto
+ *   struct sr_fib_route  [nroutes]       rutas, en el orden de la tabla
+ *   uint32_t             [nslots]        hash de cada largo: indice+1, 0 libre
+ *
+ * El snapshot guarda las rutas estaticas (admin_dst 0), las mismas que
+ * salen del archivo de texto, junto con el mtime y el tamano de ese
+ * archivo al momento de cargarlo. Si el archivo cambio, el snapshot esta
+ * viejo y se vuelve a leer el texto.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sr_if.h"
+
+#define SR_FIB_MAGIC     "SRFIB\r\n\032"
+#define SR_FIB_VERSION   1
+#define SR_FIB_BYTEORDER 0x01020304
+#define SR_FIB_SUFFIX    ".snap"   /* snapshot por defecto: <rtable>.snap */
+#define SR_FIB_MIN_ROUTES 384     /* con menos rutas una capa se recorre entera */
+
+struct sr_instance;
+struct sr_rt;
+
+struct sr_fib_route
+{
+    uint32_t dest;                      /* orden de red */
+    uint32_t gw;
+    uint32_t mask;
+    uint8_t  plen;
+    uint8_t  admin_dst;
+    uint8_t  pad[2];
+    char     interface[sr_IFACE_NAMELEN];
+};
+
+struct sr_fib_level
+{
+    uint32_t off;                       /* primer slot de este largo */
+    uint32_t bits;                      /* 1 << bits slots, 0 si no hay rutas */
+};
+
+struct sr_fib_hdr
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    uint64_t size;                      /* bytes de la imagen, cabezal incluido */
+    uint64_t checksum;                  /* de todo lo que sigue al cabezal */
+    int64_t  src_mtime;                 /* archivo de texto de origen */
+    uint64_t src_size;
+    uint64_t plen_map;                  /* bit p: hay rutas /p */
+    uint32_t nroutes;
+    uint32_t nslots;
+    struct sr_fib_level level[33];
+};
+
+/* Una capa de la FIB: la imagen (en el heap o mapeada) y el nodo de la
+   lista sr->routing_table que corresponde a cada ruta, que es lo que
+   devuelve lpm(). Sin imagen (pocas rutas o mascaras no contiguas) se
+   recorren los nroutes nodos. */
+struct sr_fib
+{
+    struct sr_fib_hdr* img;
+    size_t map_len;                     /* > 0 si img es un mmap del snapshot */
+    struct sr_rt** node;
+    uint32_t nroutes;
+};
+
+void sr_fib_update(struct sr_instance* sr);
+void sr_fib_free(struct sr_fib* fib);
+struct sr_rt* sr_fib_lookup(struct sr_instance* sr, uint32_t dest_ip);
+
+int sr_fib_save_snapshot(struct sr_instance* sr, const char* path);
+int sr_fib_load_snapshot(struct sr_instance* sr, const char* path, const char* rtable);
+void sr_fib_print(struct sr_instance* sr, FILE* out);
+
+#endif /* SR_FIB_H */
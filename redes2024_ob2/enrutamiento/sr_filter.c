@@ -0,0 +1,597 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.c
+ *
+ * Descripción:
+ *
+ * Compilador y evaluador de filtros de captura.
+ *
+ * La expresion se parsea a un arbol y el arbol se traduce a instrucciones
+ * de comparacion con dos destinos (jt si la comparacion es verdadera, jf
+ * si es falsa), resolviendo "and", "or" y "not" con saltos: la evaluacion
+ * corta en cuanto se conoce el resultado. Los saltos van siempre hacia
+ * adelante, asi que un programa termina en a lo sumo n_insns pasos.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include "sr_filter.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_capture.h"
+
+#define FLT_MAX_IFACES 8
+#define FLT_MAX_NODES  (2 * SR_FILTER_MAX_INSNS)
+#define FLT_MAX_TOKENS 256
+
+/* Destinos especiales de un salto */
+#define FLT_ACCEPT (-1)
+#define FLT_REJECT (-2)
+
+/* Calificadores de direccion de host, net y port */
+#define FLT_SRC 0x1
+#define FLT_DST 0x2
+
+enum flt_op {
+  flt_ethertype = 0,   /* a: ethertype */
+  flt_ipproto,         /* a: ip_p */
+  flt_host,            /* a: direccion */
+  flt_net,             /* a: red, b: mascara */
+  flt_port,            /* a: puerto */
+  flt_iface,           /* a: indice en names */
+  flt_dir              /* a: enum sr_capture_dir */
+};
+
+static const char* g_op_str[] = { "ethertype", "ipproto", "host", "net", "port", "iface", "dir" };
+
+struct flt_insn
+{
+  uint8_t op;          /* enum flt_op */
+  uint8_t sel;         /* FLT_SRC | FLT_DST */
+  int16_t jt;          /* instruccion siguiente si la comparacion da verdadero */
+  int16_t jf;          /* ... y si da falso */
+  uint32_t a;
+  uint32_t b;
+};
+
+struct sr_filter
+{
+  char* expr;
+  int need_hdrs;       /* 0 si solo mira interfaz y direccion */
+  int n_insns;
+  struct flt_insn insns[SR_FILTER_MAX_INSNS];
+  int n_names;
+  char names[FLT_MAX_IFACES][sr_IFACE_NAMELEN];
+};
+
+/* Campos de la trama que usan las comparaciones */
+struct flt_pkt
+{
+  uint16_t ethertype;
+  uint8_t proto;
+  uint8_t has_addr;    /* src y dst validos (IP, o sender/target de ARP) */
+  uint8_t has_ports;
+  uint16_t sport;      /* en host byte order */
+  uint16_t dport;
+  uint32_t src;        /* en network byte order */
+  uint32_t dst;
+};
+
+/* -- evaluacion -- */
+
+static void flt_extract(const uint8_t* buf, unsigned int len, struct flt_pkt* p)
+{
+  const unsigned int eth_len = sizeof(sr_ethernet_hdr_t);
+
+  memset(p, 0, sizeof(*p));
+  if (len < eth_len) {
+    return;
+  }
+  p->ethertype = ntohs(((const sr_ethernet_hdr_t*) buf)->ether_type);
+
+  if (p->ethertype == ethertype_ip && len >= eth_len + sizeof(sr_ip_hdr_t)) {
+    const sr_ip_hdr_t* ip = (const sr_ip_hdr_t*) (buf + eth_len);
+    unsigned int hl = ip->ip_hl * 4;
+
+    p->proto = ip->ip_p;
+    p->src = ip->ip_src;
+    p->dst = ip->ip_dst;
+    p->has_addr = 1;
+    /* Los puertos solo estan en el primer fragmento */
+    if ((p->proto == ip_protocol_tcp || p->proto == ip_protocol_udp) &&
+        (ntohs(ip->ip_off) & IP_OFFMASK) == 0 && len >= eth_len + hl + 4) {
+      const uint8_t* l4 = buf + eth_len + hl;
+      p->sport = (l4[0] << 8) | l4[1];
+      p->dport = (l4[2] << 8) | l4[3];
+      p->has_ports = 1;
+    }
+  }
+  else if (p->ethertype == ethertype_arp && len >= eth_len + sizeof(sr_arp_hdr_t)) {
+    const sr_arp_hdr_t* arp = (const sr_arp_hdr_t*) (buf + eth_len);
+    p->src = arp->ar_sip;
+    p->dst = arp->ar_tip;
+    p->has_addr = 1;
+  }
+}
+
+int sr_filter_match(const struct sr_filter* f, const uint8_t* buf, unsigned int len,
+                    const char* iface, int dir)
+{
+  struct flt_pkt p;
+  int pc = 0;
+
+  if (f->need_hdrs) {
+    flt_extract(buf, len, &p);
+  }
+  else {
+    memset(&p, 0, sizeof(p));   /* solo interfaz y direccion */
+  }
+
+  for (;;) {
+    const struct flt_insn* i = &f->insns[pc];
+    int r;
+
+    switch (i->op) {
+      case flt_ethertype:
+        r = p.ethertype == i->a;
+        break;
+      case flt_ipproto:
+        r = p.ethertype == ethertype_ip && p.proto == i->a;
+        break;
+      case flt_host:
+        r = p.has_addr && (((i->sel & FLT_SRC) && p.src == i->a) ||
+                           ((i->sel & FLT_DST) && p.dst == i->a));
+        break;
+      case flt_net:
+        r = p.has_addr && (((i->sel & FLT_SRC) && (p.src & i->b) == i->a) ||
+                           ((i->sel & FLT_DST) && (p.dst & i->b) == i->a));
+        break;
+      case flt_port:
+        r = p.has_ports && (((i->sel & FLT_SRC) && p.sport == i->a) ||
+                            ((i->sel & FLT_DST) && p.dport == i->a));
+        break;
+      case flt_iface:
+        r = iface != 0 && strncmp(iface, f->names[i->a], sr_IFACE_NAMELEN) == 0;
+        break;
+      case flt_dir:
+        r = dir == (int) i->a;
+        break;
+      default:
+        r = 0;
+    }
+
+    pc = r ? i->jt : i->jf;
+    if (pc < 0) {
+      return pc == FLT_ACCEPT;
+    }
+  }
+}
+
+/* -- parser -- */
+
+enum flt_node_type { n_and, n_or, n_not, n_prim };
+
+struct flt_node
+{
+  int type;
+  int left, right;           /* indices en nodes */
+  struct flt_insn prim;      /* solo n_prim; jt/jf se completan al generar */
+};
+
+struct flt_compiler
+{
+  struct sr_filter* f;
+  char* tok[FLT_MAX_TOKENS];
+  int n_tok;
+  int cur;
+  struct flt_node nodes[FLT_MAX_NODES];
+  int n_nodes;
+  int labels[SR_FILTER_MAX_INSNS * 2];   /* posicion de cada etiqueta */
+  int n_labels;
+  int insn_label_t[SR_FILTER_MAX_INSNS];
+  int insn_label_f[SR_FILTER_MAX_INSNS];
+  char* err;
+  size_t err_size;
+  int failed;
+};
+
+static void flt_error(struct flt_compiler* c, const char* what)
+{
+  if (c->failed) {
+    return;
+  }
+  c->failed = 1;
+  if (c->cur < c->n_tok) {
+    snprintf(c->err, c->err_size, "%s near '%s'", what, c->tok[c->cur]);
+  }
+  else {
+    snprintf(c->err, c->err_size, "%s at end of expression", what);
+  }
+}
+
+#define FLT_IS_OP(s) ((s)[0] == '(' || (s)[0] == ')' || (s)[0] == '!' || \
+                      ((s)[0] == '&' && (s)[1] == '&') || ((s)[0] == '|' && (s)[1] == '|'))
+
+/* Separa en palabras; "(", ")", "!", "&&" y "||" son palabras aunque esten
+   pegados a otras */
+static int flt_tokenize(struct flt_compiler* c, char* s)
+{
+  while (*s) {
+    if (isspace((unsigned char) *s)) {
+      *s++ = 0;
+      continue;
+    }
+    if (c->n_tok == FLT_MAX_TOKENS) {
+      return -1;
+    }
+    if (FLT_IS_OP(s)) {
+      /* un string propio, para poder cortar la palabra anterior con un 0 */
+      switch (*s) {
+        case '(': c->tok[c->n_tok++] = "("; break;
+        case ')': c->tok[c->n_tok++] = ")"; break;
+        case '!': c->tok[c->n_tok++] = "!"; break;
+        case '&': c->tok[c->n_tok++] = "&&"; *s++ = 0; break;
+        case '|': c->tok[c->n_tok++] = "||"; *s++ = 0; break;
+      }
+      *s++ = 0;
+      continue;
+    }
+    c->tok[c->n_tok++] = s;
+    while (*s && !isspace((unsigned char) *s) && !FLT_IS_OP(s)) {
+      s++;
+    }
+  }
+  return 0;
+}
+
+static const char* flt_peek(struct flt_compiler* c)
+{
+  return c->cur < c->n_tok ? c->tok[c->cur] : "";
+}
+
+static int flt_accept(struct flt_compiler* c, const char* word)
+{
+  if (strcmp(flt_peek(c), word) == 0) {
+    c->cur++;
+    return 1;
+  }
+  return 0;
+}
+
+static int flt_new_node(struct flt_compiler* c, int type, int left, int right)
+{
+  struct flt_node* n;
+
+  if (c->n_nodes == FLT_MAX_NODES) {
+    flt_error(c, "expression too long");
+    return 0;
+  }
+  n = &c->nodes[c->n_nodes];
+  memset(n, 0, sizeof(*n));
+  n->type = type;
+  n->left = left;
+  n->right = right;
+  return c->n_nodes++;
+}
+
+static int flt_prim(struct flt_compiler* c, int op, int sel, uint32_t a, uint32_t b)
+{
+  int n = flt_new_node(c, n_prim, -1, -1);
+
+  c->nodes[n].prim.op = op;
+  c->nodes[n].prim.sel = sel;
+  c->nodes[n].prim.a = a;
+  c->nodes[n].prim.b = b;
+  if (op != flt_iface && op != flt_dir) {
+    c->f->need_hdrs = 1;
+  }
+  return n;
+}
+
+static int flt_parse_expr(struct flt_compiler* c);
+
+static int flt_parse_primitive(struct flt_compiler* c)
+{
+  const char* w = flt_peek(c);
+  int sel = FLT_SRC | FLT_DST;
+  struct in_addr addr;
+
+  if (flt_accept(c, "arp"))  return flt_prim(c, flt_ethertype, 0, ethertype_arp, 0);
+  if (flt_accept(c, "ip"))   return flt_prim(c, flt_ethertype, 0, ethertype_ip, 0);
+  if (flt_accept(c, "icmp")) return flt_prim(c, flt_ipproto, 0, ip_protocol_icmp, 0);
+  if (flt_accept(c, "tcp"))  return flt_prim(c, flt_ipproto, 0, ip_protocol_tcp, 0);
+  if (flt_accept(c, "udp"))  return flt_prim(c, flt_ipproto, 0, ip_protocol_udp, 0);
+  if (flt_accept(c, "ospf")) return flt_prim(c, flt_ipproto, 0, ip_protocol_ospfv2, 0);
+  if (flt_accept(c, "in"))   return flt_prim(c, flt_dir, 0, sr_capture_in, 0);
+  if (flt_accept(c, "out"))  return flt_prim(c, flt_dir, 0, sr_capture_out, 0);
+
+  if (flt_accept(c, "iface")) {
+    struct sr_filter* f = c->f;
+    w = flt_peek(c);
+    if (*w == 0) {
+      flt_error(c, "expected interface name");
+      return 0;
+    }
+    if (f->n_names == FLT_MAX_IFACES) {
+      flt_error(c, "too many interfaces");
+      return 0;
+    }
+    strncpy(f->names[f->n_names], w, sr_IFACE_NAMELEN);
+    c->cur++;
+    return flt_prim(c, flt_iface, 0, f->n_names++, 0);
+  }
+
+  if (flt_accept(c, "src")) {
+    sel = FLT_SRC;
+  }
+  else if (flt_accept(c, "dst")) {
+    sel = FLT_DST;
+  }
+
+  if (flt_accept(c, "host")) {
+    if (inet_aton(flt_peek(c), &addr) == 0) {
+      flt_error(c, "expected IPv4 address");
+      return 0;
+    }
+    c->cur++;
+    return flt_prim(c, flt_host, sel, addr.s_addr, 0);
+  }
+  if (flt_accept(c, "net")) {
+    char buf[32];
+    char* slash;
+    char* end;
+    unsigned long plen = 32;
+    uint32_t mask;
+
+    snprintf(buf, sizeof(buf), "%s", flt_peek(c));
+    if ((slash = strchr(buf, '/')) != 0) {
+      *slash = 0;
+      plen = strtoul(slash + 1, &end, 10);
+      if (end == slash + 1 || *end != 0 || plen > 32) {
+        flt_error(c, "bad prefix length");
+        return 0;
+      }
+    }
+    if (inet_aton(buf, &addr) == 0) {
+      flt_error(c, "expected network A.B.C.D/len");
+      return 0;
+    }
+    c->cur++;
+    mask = plen == 0 ? 0 : htonl(0xffffffffu << (32 - plen));
+    return flt_prim(c, flt_net, sel, addr.s_addr & mask, mask);
+  }
+  if (flt_accept(c, "port")) {
+    char* end;
+    unsigned long port = strtoul(flt_peek(c), &end, 10);
+
+    if (end == flt_peek(c) || *end != 0 || port > 65535) {
+      flt_error(c, "expected port number");
+      return 0;
+    }
+    c->cur++;
+    return flt_prim(c, flt_port, sel, port, 0);
+  }
+
+  flt_error(c, sel != (FLT_SRC | FLT_DST) ? "expected host, net or port" : "unknown primitive");
+  return 0;
+}
+
+static int flt_parse_factor(struct flt_compiler* c)
+{
+  int n;
+
+  if (flt_accept(c, "not") || flt_accept(c, "!")) {
+    n = flt_parse_factor(c);
+    return flt_new_node(c, n_not, n, -1);
+  }
+  if (flt_accept(c, "(")) {
+    n = flt_parse_expr(c);
+    if (!flt_accept(c, ")")) {
+      flt_error(c, "expected ')'");
+    }
+    return n;
+  }
+  return flt_parse_primitive(c);
+}
+
+static int flt_parse_term(struct flt_compiler* c)
+{
+  int n = flt_parse_factor(c);
+
+  while (!c->failed && (flt_accept(c, "and") || flt_accept(c, "&&"))) {
+    n = flt_new_node(c, n_and, n, flt_parse_factor(c));
+  }
+  return n;
+}
+
+static int flt_parse_expr(struct flt_compiler* c)
+{
+  int n = flt_parse_term(c);
+
+  while (!c->failed && (flt_accept(c, "or") || flt_accept(c, "||"))) {
+    n = flt_new_node(c, n_or, n, flt_parse_term(c));
+  }
+  return n;
+}
+
+/* -- generacion de codigo -- */
+
+static int flt_new_label(struct flt_compiler* c)
+{
+  c->labels[c->n_labels] = -1;
+  return c->n_labels++;
+}
+
+/* Genera el nodo n saltando a la etiqueta t si es verdadero y a f si no */
+static void flt_gen(struct flt_compiler* c, int n, int t, int f)
+{
+  struct flt_node* node = &c->nodes[n];
+  int mid;
+
+  if (c->failed) {
+    return;
+  }
+  switch (node->type) {
+    case n_and:
+      mid = flt_new_label(c);
+      flt_gen(c, node->left, mid, f);
+      c->labels[mid] = c->f->n_insns;
+      flt_gen(c, node->right, t, f);
+      break;
+    case n_or:
+      mid = flt_new_label(c);
+      flt_gen(c, node->left, t, mid);
+      c->labels[mid] = c->f->n_insns;
+      flt_gen(c, node->right, t, f);
+      break;
+    case n_not:
+      flt_gen(c, node->left, f, t);
+      break;
+    case n_prim:
+      if (c->f->n_insns == SR_FILTER_MAX_INSNS) {
+        flt_error(c, "expression too long");
+        return;
+      }
+      c->insn_label_t[c->f->n_insns] = t;
+      c->insn_label_f[c->f->n_insns] = f;
+      c->f->insns[c->f->n_insns++] = node->prim;
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_compile
+ *
+ * Parsea la expresion, genera el programa y resuelve las etiquetas de
+ * los saltos. Las etiquetas 0 y 1 son aceptar y rechazar.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_filter* sr_filter_compile(const char* expr, char* err, size_t err_size)
+{
+  struct flt_compiler* c = calloc(1, sizeof(*c));
+  struct sr_filter* f = calloc(1, sizeof(*f));
+  char* copy = strdup(expr);
+  int root;
+  int i;
+
+  if (c == 0 || f == 0 || copy == 0) {
+    snprintf(err, err_size, "out of memory");
+    free(c);
+    free(f);
+    free(copy);
+    return 0;
+  }
+  c->f = f;
+  c->err = err;
+  c->err_size = err_size;
+
+  if (flt_tokenize(c, copy) != 0) {
+    flt_error(c, "expression too long");
+  }
+  else if (c->n_tok == 0) {
+    c->failed = 1;
+    snprintf(err, err_size, "empty expression");
+  }
+  else {
+    root = flt_parse_expr(c);
+    if (c->cur < c->n_tok) {
+      flt_error(c, "unexpected word");
+    }
+    flt_new_label(c);   /* 0: aceptar */
+    flt_new_label(c);   /* 1: rechazar */
+    flt_gen(c, root, 0, 1);
+  }
+
+  for (i = 0; !c->failed && i < f->n_insns; i++) {
+    int t = c->insn_label_t[i];
+    int fl = c->insn_label_f[i];
+    f->insns[i].jt = t == 0 ? FLT_ACCEPT : t == 1 ? FLT_REJECT : c->labels[t];
+    f->insns[i].jf = fl == 0 ? FLT_ACCEPT : fl == 1 ? FLT_REJECT : c->labels[fl];
+  }
+
+  free(copy);
+  if (c->failed) {
+    free(c);
+    free(f);
+    return 0;
+  }
+  free(c);
+
+  f->expr = strdup(expr);
+  if (f->expr == 0) {
+    snprintf(err, err_size, "out of memory");
+    free(f);
+    return 0;
+  }
+  return f;
+} /* -- sr_filter_compile -- */
+
+const char* sr_filter_expr(const struct sr_filter* f)
+{
+  return f->expr;
+}
+
+static void flt_print_target(FILE* out, int target)
+{
+  if (target == FLT_ACCEPT) {
+    fprintf(out, "accept");
+  }
+  else if (target == FLT_REJECT) {
+    fprintf(out, "reject");
+  }
+  else {
+    fprintf(out, "%d", target);
+  }
+}
+
+void sr_filter_print(const struct sr_filter* f, FILE* out)
+{
+  int i;
+
+  for (i = 0; i < f->n_insns; i++) {
+    const struct flt_insn* insn = &f->insns[i];
+    const char* sel = insn->sel == FLT_SRC ? "src " : insn->sel == FLT_DST ? "dst " : "";
+    struct in_addr a;
+    char arg[64];
+
+    switch (insn->op) {
+      case flt_host:
+        a.s_addr = insn->a;
+        snprintf(arg, sizeof(arg), "%s%s", sel, inet_ntoa(a));
+        break;
+      case flt_net:
+        a.s_addr = insn->a;
+        snprintf(arg, sizeof(arg), "%s%s/%d", sel, inet_ntoa(a), __builtin_popcount(insn->b));
+        break;
+      case flt_port:
+        snprintf(arg, sizeof(arg), "%s%u", sel, insn->a);
+        break;
+      case flt_iface:
+        snprintf(arg, sizeof(arg), "%.*s", sr_IFACE_NAMELEN, f->names[insn->a]);
+        break;
+      case flt_dir:
+        snprintf(arg, sizeof(arg), "%s", insn->a == sr_capture_in ? "in" : "out");
+        break;
+      default:
+        snprintf(arg, sizeof(arg), "0x%x", insn->a);
+    }
+    fprintf(out, "(%03d) %-10s%-24sjt ", i, g_op_str[insn->op], arg);
+    flt_print_target(out, insn->jt);
+    fprintf(out, " jf ");
+    flt_print_target(out, insn->jf);
+    fprintf(out, "\n");
+  }
+}
+
+void sr_filter_free(struct sr_filter* f)
+{
+  if (f == 0) {
+    return;
+  }
+  free(f->expr);
+  free(f);
+}
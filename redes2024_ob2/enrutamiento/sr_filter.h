@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.h
+ *
+ * Descripción:
+ *
+ * Filtros de captura. Una expresion al estilo tcpdump se compila a un
+ * programa corto de comparaciones con saltos (como BPF): evaluarlo es
+ * leer unos pocos campos de los cabezales y recorrer el programa, sin
+ * reservar memoria ni tomar locks.
+ *
+ * Gramatica:
+ *
+ *   expr      := term { ("or" | "||") term }
+ *   term      := factor { ("and" | "&&") factor }
+ *   factor    := ("not" | "!") factor | "(" expr ")" | primitiva
+ *   primitiva := arp | ip | icmp | tcp | udp | ospf
+ *              | [src | dst] host A.B.C.D
+ *              | [src | dst] net A.B.C.D/len
+ *              | [src | dst] port N          (tcp o udp)
+ *              | iface NOMBRE
+ *              | in | out
+ *
+ * Por ejemplo "ospf", "icmp and host 10.0.1.1" o
+ * "iface eth1 and in and not (arp or ospf)".
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FILTER_H
+#define SR_FILTER_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_FILTER_MAX_INSNS 128
+
+struct sr_filter;
+
+/* Compila expr. Retorna 0 si no es valida y deja el motivo en err. */
+struct sr_filter* sr_filter_compile(const char* expr, char* err, size_t err_size);
+
+/* 1 si la trama pasa el filtro. iface es el nombre de la interfaz y dir
+   un enum sr_capture_dir. */
+int sr_filter_match(const struct sr_filter* f, const uint8_t* buf, unsigned int len,
+                    const char* iface, int dir);
+
+/* Expresion con la que se compilo */
+const char* sr_filter_expr(const struct sr_filter* f);
+
+/* Imprime el programa compilado, una instruccion por linea */
+void sr_filter_print(const struct sr_filter* f, FILE* out);
+
+void sr_filter_free(struct sr_filter* f);
+
+#endif /* -- SR_FILTER_H -- */
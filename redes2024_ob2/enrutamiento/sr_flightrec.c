@@ -0,0 +1,452 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flightrec.c
+ *
+ * Descripción:
+ *
+ * Anillo que se sobreescribe: cada productor toma la siguiente posicion
+ * con un fetch_add y escribe su slot sin esperar a nadie. Como no hay
+ * consumidor que libere slots, nunca se descarta nada: lo viejo se pisa.
+ *
+ * Cada slot tiene un numero de secuencia al estilo seqlock (2*pos+1
+ * mientras se escribe, 2*pos+2 cuando esta completo). El volcado copia el
+ * slot y vuelve a leer la secuencia: si cambio, el slot se piso mientras
+ * se copiaba y se omite.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_LOG_SUBSYS sr_sub_cap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "sr_flightrec.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_parse.h"
+#include "sr_dumper.h"
+#include "sr_capture.h"
+#include "sr_log.h"
+
+struct fr_slot
+{
+  uint64_t seq;       /* 2*pos+1 escribiendo, 2*pos+2 completo */
+  uint64_t ts_ns;     /* CLOCK_MONOTONIC */
+  uint32_t len;       /* largo original de la trama */
+  uint16_t caplen;    /* bytes guardados */
+  uint8_t ifindex;
+  uint8_t dir;        /* enum sr_capture_dir */
+  uint8_t action;     /* enum sr_pkt_action */
+  uint8_t verdict;    /* enum sr_pkt_verdict */
+};
+
+struct sr_flightrec
+{
+  struct sr_instance* sr;
+  uint8_t* slots;
+  size_t stride;              /* bytes por slot, cabezal + snaplen */
+  uint64_t mask;
+  unsigned int snaplen;
+  uint64_t head;              /* proxima posicion a escribir */
+  int64_t epoch_offset_ns;    /* CLOCK_REALTIME - CLOCK_MONOTONIC al abrir */
+
+  pthread_t thread;           /* espera SIGUSR1 */
+  int stopping;
+
+  pthread_mutex_t dump_lock;  /* un volcado a la vez (señal y canal de control) */
+  unsigned int dumps;
+  char last_dump[256];
+};
+
+#define FR_SLOT(fr, pos) ((struct fr_slot*) ((fr)->slots + ((pos) & (fr)->mask) * (fr)->stride))
+
+static uint64_t clock_ns(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int sr_flightrec_parse_opt(const char* str, unsigned int* frames, unsigned int* snaplen)
+{
+  char* end;
+  unsigned long v = strtoul(str, &end, 10);
+
+  if (end == str) {
+    return -1;
+  }
+  *frames = v;
+  if (*end == '/') {
+    const char* s = end + 1;
+    v = strtoul(s, &end, 10);
+    if (end == s || v == 0 || v > SR_FLIGHTREC_MAX_SNAPLEN) {
+      return -1;
+    }
+    *snaplen = v;
+  }
+  return *end == 0 ? 0 : -1;
+}
+
+/* Toma la siguiente posicion y copia la trama. Retorna la posicion. */
+static uint64_t fr_record(struct sr_flightrec* fr, const uint8_t* buf, unsigned int len,
+                          unsigned int ifindex, int dir, int action, int verdict)
+{
+  uint64_t pos = __atomic_fetch_add(&fr->head, 1, __ATOMIC_RELAXED);
+  struct fr_slot* slot = FR_SLOT(fr, pos);
+
+  __atomic_store_n(&slot->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->ts_ns = clock_ns(CLOCK_MONOTONIC);
+  slot->len = len;
+  slot->caplen = len < fr->snaplen ? len : fr->snaplen;
+  slot->ifindex = ifindex;
+  slot->dir = dir;
+  slot->action = action;
+  slot->verdict = verdict;
+  memcpy(slot + 1, buf, slot->caplen);
+
+  __atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+  return pos;
+}
+
+uint64_t sr_flightrec_rx(struct sr_flightrec* fr, const uint8_t* buf, unsigned int len,
+                         const struct sr_pkt_desc* desc)
+{
+  return fr_record(fr, buf, len, desc->in_if != 0 ? desc->ifindex : SR_CAPTURE_IF_UNKNOWN,
+                   sr_capture_in, sr_pkt_act_none, desc->verdict);
+}
+
+void sr_flightrec_set_action(struct sr_flightrec* fr, uint64_t pos, int action)
+{
+  struct fr_slot* slot = FR_SLOT(fr, pos);
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == 2 * pos + 2) {
+    __atomic_store_n(&slot->action, action, __ATOMIC_RELAXED);
+  }
+}
+
+void sr_flightrec_tx(struct sr_flightrec* fr, const uint8_t* buf, unsigned int len,
+                     unsigned int ifindex)
+{
+  fr_record(fr, buf, len, ifindex, sr_capture_out, sr_pkt_act_sent, sr_pkt_ok);
+}
+
+/* -- escritura del pcapng (fuera del camino de datos, con stdio) -- */
+
+#define PAD4(n) (((n) + 3) & ~3u)
+
+static void fr_put_opt(FILE* f, uint16_t code, const void* data, uint16_t len)
+{
+  static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+  struct pcapng_opt opt;
+
+  opt.code = code;
+  opt.len = len;
+  fwrite(&opt, sizeof(opt), 1, f);
+  fwrite(data, 1, len, f);
+  fwrite(zeros, 1, PAD4(len) - len, f);
+}
+
+static void fr_put_endofopt(FILE* f, uint32_t total_len)
+{
+  struct pcapng_opt opt;
+
+  opt.code = PCAPNG_OPT_ENDOFOPT;
+  opt.len = 0;
+  fwrite(&opt, sizeof(opt), 1, f);
+  fwrite(&total_len, sizeof(total_len), 1, f);
+}
+
+static void fr_put_shb(FILE* f)
+{
+  static const char appl[] = "sr (redes2024) flight recorder";
+  struct pcapng_shb shb;
+
+  shb.h.type = PCAPNG_BT_SHB;
+  shb.h.total_len = sizeof(shb) + sizeof(struct pcapng_opt) + PAD4(sizeof(appl) - 1) +
+                    sizeof(struct pcapng_opt) + sizeof(uint32_t);
+  shb.byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC;
+  shb.version_major = 1;
+  shb.version_minor = 0;
+  shb.section_len = -1;
+
+  fwrite(&shb, sizeof(shb), 1, f);
+  fr_put_opt(f, PCAPNG_SHB_USERAPPL, appl, sizeof(appl) - 1);
+  fr_put_endofopt(f, shb.h.total_len);
+}
+
+/* IDB de una interfaz; iface 0 para las tramas de interfaz desconocida */
+static void fr_put_idb(FILE* f, struct sr_if* iface, unsigned int snaplen)
+{
+  struct pcapng_idb idb;
+  const char* name = iface != 0 ? iface->name : "unknown";
+  uint16_t name_len = strlen(name);
+  uint32_t ipv4[2];
+  uint8_t tsresol = 9;   /* 10^-9 s */
+
+  idb.h.type = PCAPNG_BT_IDB;
+  idb.h.total_len = sizeof(idb) +
+                    sizeof(struct pcapng_opt) + PAD4(name_len) +
+                    (iface ? sizeof(struct pcapng_opt) + PAD4(ETHER_ADDR_LEN) : 0) +
+                    (iface ? sizeof(struct pcapng_opt) + sizeof(ipv4) : 0) +
+                    sizeof(struct pcapng_opt) + PAD4(1) +
+                    sizeof(struct pcapng_opt) + sizeof(uint32_t);
+  idb.linktype = LINKTYPE_ETHERNET;
+  idb.reserved = 0;
+  idb.snaplen = snaplen;
+
+  fwrite(&idb, sizeof(idb), 1, f);
+  fr_put_opt(f, PCAPNG_IF_NAME, name, name_len);
+  if (iface != 0) {
+    ipv4[0] = iface->ip;
+    ipv4[1] = iface->mask;
+    fr_put_opt(f, PCAPNG_IF_MACADDR, iface->addr, ETHER_ADDR_LEN);
+    fr_put_opt(f, PCAPNG_IF_IPV4ADDR, ipv4, sizeof(ipv4));
+  }
+  fr_put_opt(f, PCAPNG_IF_TSRESOL, &tsresol, 1);
+  fr_put_endofopt(f, idb.h.total_len);
+}
+
+/* EPB con la direccion en epb_flags y la decision como comentario */
+static void fr_put_epb(FILE* f, struct sr_flightrec* fr, struct fr_slot* slot, uint32_t if_id,
+                       const char* if_name)
+{
+  static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+  struct pcapng_epb epb;
+  uint64_t ts = slot->ts_ns + fr->epoch_offset_ns;
+  uint32_t flags = slot->dir;
+  char comment[128];
+  uint16_t comment_len;
+
+  if (slot->action == sr_pkt_act_drop_invalid) {
+    snprintf(comment, sizeof(comment), "%s %s: dropped: %s", slot->dir == sr_capture_in ? "in" : "out",
+             if_name, sr_pkt_verdict_str(slot->verdict));
+  }
+  else {
+    snprintf(comment, sizeof(comment), "%s %s: %s", slot->dir == sr_capture_in ? "in" : "out",
+             if_name, sr_pkt_action_str(slot->action));
+  }
+  comment_len = strlen(comment);
+
+  epb.h.type = PCAPNG_BT_EPB;
+  epb.h.total_len = sizeof(epb) + PAD4(slot->caplen) +
+                    sizeof(struct pcapng_opt) + sizeof(uint32_t) +     /* epb_flags */
+                    sizeof(struct pcapng_opt) + PAD4(comment_len) +    /* opt_comment */
+                    sizeof(struct pcapng_opt) + sizeof(uint32_t);      /* fin y largo */
+  epb.if_id = if_id;
+  epb.ts_high = ts >> 32;
+  epb.ts_low = ts & 0xffffffff;
+  epb.caplen = slot->caplen;
+  epb.len = slot->len;
+
+  fwrite(&epb, sizeof(epb), 1, f);
+  fwrite(slot + 1, 1, slot->caplen, f);
+  fwrite(zeros, 1, PAD4(slot->caplen) - slot->caplen, f);
+  fr_put_opt(f, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+  fr_put_opt(f, PCAPNG_OPT_COMMENT, comment, comment_len);
+  fr_put_endofopt(f, epb.h.total_len);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_flightrec_dump
+ *
+ * Escribe las tramas del anillo, de la mas vieja a la mas nueva. Los
+ * productores siguen grabando mientras tanto: los slots que se pisan
+ * durante la copia se omiten.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_flightrec_dump(struct sr_flightrec* fr, const char* path, char* name_out,
+                      size_t name_size)
+{
+  struct sr_if* ifs[SR_CAPTURE_MAX_IFS];
+  struct sr_if* iface;
+  struct fr_slot* copy;
+  char name[256];
+  uint64_t head, pos;
+  uint32_t n_ifs = 0, i;
+  int written = 0;
+  FILE* f;
+
+  copy = malloc(fr->stride);
+  if (copy == 0) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&fr->dump_lock);
+
+  if (path != 0) {
+    snprintf(name, sizeof(name), "%s", path);
+  }
+  else {
+    snprintf(name, sizeof(name), "flightrec-%d-%u.pcapng", (int) getpid(), fr->dumps);
+  }
+  if ((f = fopen(name, "wb")) == 0) {
+    sr_log_error(sr_sub_cap, "flight recorder: can't open %s: %s\n", name, strerror(errno));
+    pthread_mutex_unlock(&fr->dump_lock);
+    free(copy);
+    return -1;
+  }
+
+  /* Un IDB por sr_if (id == index) y uno mas para las desconocidas */
+  memset(ifs, 0, sizeof(ifs));
+  for (iface = fr->sr->if_list; iface != 0; iface = iface->next) {
+    if (iface->index < SR_CAPTURE_MAX_IFS) {
+      ifs[iface->index] = iface;
+      if (iface->index + 1u > n_ifs) {
+        n_ifs = iface->index + 1;
+      }
+    }
+  }
+  fr_put_shb(f);
+  for (i = 0; i <= n_ifs; i++) {
+    fr_put_idb(f, i < n_ifs ? ifs[i] : 0, fr->snaplen);
+  }
+
+  head = __atomic_load_n(&fr->head, __ATOMIC_ACQUIRE);
+  for (pos = head > fr->mask + 1 ? head - (fr->mask + 1) : 0; pos < head; pos++) {
+    struct fr_slot* slot = FR_SLOT(fr, pos);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    uint32_t if_id;
+
+    if (seq != 2 * pos + 2) {
+      continue;   /* pisado o todavia escribiendose */
+    }
+    memcpy(copy, slot, fr->stride);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+      continue;
+    }
+
+    if_id = copy->ifindex < n_ifs && ifs[copy->ifindex] != 0 ? copy->ifindex : n_ifs;
+    fr_put_epb(f, fr, copy, if_id, if_id < n_ifs ? ifs[if_id]->name : "unknown");
+    written++;
+  }
+
+  if (fclose(f) != 0) {
+    sr_log_error(sr_sub_cap, "flight recorder: error writing %s\n", name);
+    written = -1;
+  }
+  else {
+    fr->dumps++;
+    snprintf(fr->last_dump, sizeof(fr->last_dump), "%s", name);
+  }
+  if (name_out != 0) {
+    snprintf(name_out, name_size, "%s", name);
+  }
+
+  pthread_mutex_unlock(&fr->dump_lock);
+  free(copy);
+  return written;
+} /* -- sr_flightrec_dump -- */
+
+/* Hilo que espera SIGUSR1 y vuelca el anillo */
+static void* fr_signal_thread(void* arg)
+{
+  struct sr_flightrec* fr = (struct sr_flightrec*) arg;
+  sigset_t set;
+  char name[256];
+  int sig;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+
+  for (;;) {
+    int n;
+
+    if (sigwait(&set, &sig) != 0) {
+      continue;
+    }
+    if (__atomic_load_n(&fr->stopping, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    n = sr_flightrec_dump(fr, 0, name, sizeof(name));
+    if (n >= 0) {
+      sr_log_info(sr_sub_cap, "flight recorder: %d frames written to %s\n", n, name);
+    }
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_flightrec_open
+ *
+ * Reserva el anillo, bloquea SIGUSR1 y lanza el hilo que lo atiende.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_flightrec* sr_flightrec_open(struct sr_instance* sr, unsigned int frames,
+                                       unsigned int snaplen)
+{
+  struct sr_flightrec* fr;
+  sigset_t set;
+  uint64_t n = 1;
+
+  while (n < frames) {
+    n <<= 1;
+  }
+
+  fr = calloc(1, sizeof(*fr));
+  if (fr == 0) {
+    return 0;
+  }
+  fr->sr = sr;
+  fr->snaplen = snaplen;
+  fr->stride = (sizeof(struct fr_slot) + snaplen + 7) & ~(size_t) 7;
+  fr->mask = n - 1;
+  fr->epoch_offset_ns = (int64_t) (clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC));
+  pthread_mutex_init(&fr->dump_lock, 0);
+
+  /* calloc: seq == 0 no coincide con ninguna posicion completa */
+  fr->slots = calloc(n, fr->stride);
+  if (fr->slots == 0) {
+    free(fr);
+    return 0;
+  }
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, 0);
+
+  if (pthread_create(&fr->thread, 0, fr_signal_thread, fr) != 0) {
+    free(fr->slots);
+    free(fr);
+    return 0;
+  }
+  return fr;
+} /* -- sr_flightrec_open -- */
+
+void sr_flightrec_close(struct sr_flightrec* fr)
+{
+  if (fr == 0) {
+    return;
+  }
+
+  __atomic_store_n(&fr->stopping, 1, __ATOMIC_RELEASE);
+  pthread_kill(fr->thread, SIGUSR1);
+  pthread_join(fr->thread, 0);
+
+  pthread_mutex_destroy(&fr->dump_lock);
+  free(fr->slots);
+  free(fr);
+}
+
+void sr_flightrec_print_stats(struct sr_flightrec* fr, FILE* out)
+{
+  uint64_t head = __atomic_load_n(&fr->head, __ATOMIC_RELAXED);
+
+  fprintf(out, "Flight recorder (%llu frames x %u bytes):\n",
+          (unsigned long long) (fr->mask + 1), fr->snaplen);
+  fprintf(out, "  %-28s%llu\n", "frames recorded", (unsigned long long) head);
+  fprintf(out, "  %-28s%llu\n", "frames held",
+          (unsigned long long) (head < fr->mask + 1 ? head : fr->mask + 1));
+  fprintf(out, "  %-28s%u\n", "dumps", fr->dumps);
+  if (fr->dumps > 0) {
+    fprintf(out, "  %-28s%s\n", "last dump", fr->last_dump);
+  }
+}
@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flightrec.h
+ *
+ * Descripción:
+ *
+ * Flight recorder: anillo en memoria con las ultimas tramas recibidas y
+ * enviadas (los primeros snaplen bytes de cada una) y la decision que tomo
+ * el router con cada una (enum sr_pkt_action). No escribe a disco: cuando
+ * algo sale mal se vuelca a un archivo pcapng, con la decision como
+ * comentario de cada trama, al recibir SIGUSR1 o con el comando
+ * "flightrec dump" del canal de control.
+ *
+ * Grabar una trama cuesta un incremento atomico, una lectura del reloj y
+ * una copia de snaplen bytes: esta prendido por defecto (opcion -F).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FLIGHTREC_H
+#define SR_FLIGHTREC_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_FLIGHTREC_DEFAULT_FRAMES  1024
+#define SR_FLIGHTREC_DEFAULT_SNAPLEN 128
+#define SR_FLIGHTREC_MAX_SNAPLEN     1514
+
+struct sr_flightrec;
+struct sr_instance;
+struct sr_pkt_desc;
+
+/* Reserva el anillo (frames se redondea a potencia de 2) y lanza el hilo
+   que espera SIGUSR1. Hay que llamarla antes de crear cualquier otro hilo:
+   bloquea SIGUSR1 en el hilo que llama y los hilos nuevos heredan la
+   mascara. Retorna 0 si falla. */
+struct sr_flightrec* sr_flightrec_open(struct sr_instance* sr, unsigned int frames,
+                                       unsigned int snaplen);
+
+/* Graba una trama recibida antes de que el manejador la modifique.
+   Retorna la posicion para sr_flightrec_set_action. */
+uint64_t sr_flightrec_rx(struct sr_flightrec* fr, const uint8_t* buf, unsigned int len,
+                         const struct sr_pkt_desc* desc);
+
+/* Completa la decision de la trama grabada en pos (si no fue pisada) */
+void sr_flightrec_set_action(struct sr_flightrec* fr, uint64_t pos, int action);
+
+/* Graba una trama enviada */
+void sr_flightrec_tx(struct sr_flightrec* fr, const uint8_t* buf, unsigned int len,
+                     unsigned int ifindex);
+
+/* Escribe el contenido actual en path (o en flightrec-<pid>-<n>.pcapng si
+   path es 0). Retorna la cantidad de tramas escritas o -1. El nombre del
+   archivo queda en name_out si no es 0. */
+int sr_flightrec_dump(struct sr_flightrec* fr, const char* path, char* name_out,
+                      size_t name_size);
+
+void sr_flightrec_close(struct sr_flightrec* fr);
+
+void sr_flightrec_print_stats(struct sr_flightrec* fr, FILE* out);
+
+/* "1024" o "1024/96" (tramas/bytes de cada una). Retorna 0 si es valido. */
+int sr_flightrec_parse_opt(const char* str, unsigned int* frames, unsigned int* snaplen);
+
+#endif /* -- SR_FLIGHTREC_H -- */
@@ -108,7 +108,9 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         sr->if_list->neighbor_id = 0;
         sr->if_list->neighbor_ip = 0;
         sr->if_list->helloint = 0;
-        strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
+        sr->if_list->index = 0;
+        strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN - 1);
+        sr->if_list->name[sr_IFACE_NAMELEN - 1] = '\0';
         return;
     }
 
@@ -119,10 +121,12 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
 
     if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
     assert(if_walker->next);
+    if_walker->next->index = if_walker->index + 1;
     if_walker = if_walker->next;
     if_walker->neighbor_id = 0;
     if_walker->neighbor_ip = 0;
-    strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+    strncpy(if_walker->name,name,sr_IFACE_NAMELEN - 1);
+    if_walker->name[sr_IFACE_NAMELEN - 1] = '\0';
     if_walker->next = 0;
     if_walker->helloint = 0;
 } /* -- sr_add_interface -- */ 
@@ -48,6 +48,7 @@ struct sr_if
   uint8_t helloint;
   uint32_t neighbor_id;
   uint32_t neighbor_ip;
+  uint8_t index;        /* posicion en if_list, usada en los descriptores */
   /********************/  
 };
 
@@ -0,0 +1,613 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Descripción:
+ *
+ * Backend del log. sr_log_emit recorre el formato para saber el tipo de
+ * cada argumento, los guarda en un registro de tamaño fijo (copiando los
+ * strings, porque por ejemplo inet_ntoa reutiliza su buffer) y lo encola
+ * en una sr_ring. El hilo escritor vuelve a recorrer el formato, formatea
+ * cada conversion con snprintf y escribe los registros pendientes de una
+ * vez.
+ *
+ * Si el formato tiene una conversion que no se reconoce o demasiados
+ * argumentos, el registro se formatea en el momento (camino lento).
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "sr_log.h"
+#include "sr_ring.h"
+
+#define SR_LOG_RING_SLOTS 8192
+#define SR_LOG_SLOT_SIZE  512
+#define SR_LOG_MAX_ARGS   16
+#define SR_LOG_LINE_MAX   4096
+#define SR_LOG_IDLE_NS    2000000   /* espera del escritor con la cola vacia */
+
+unsigned char sr_log_levels[sr_sub_max] = {
+  SR_LOG_DEFAULT_LEVEL, SR_LOG_DEFAULT_LEVEL, SR_LOG_DEFAULT_LEVEL,
+  SR_LOG_DEFAULT_LEVEL, SR_LOG_DEFAULT_LEVEL, SR_LOG_DEFAULT_LEVEL,
+  SR_LOG_DEFAULT_LEVEL
+};
+
+static const char* g_level_str[] = { "error", "warn", "info", "debug", "trace" };
+static const char  g_level_chr[] = { 'E', 'W', 'I', 'D', 'T' };
+static const char* g_subsys_str[sr_sub_max] = { "core", "fwd", "arp", "ospf", "spf", "vns", "cap" };
+
+/* Tipos de argumento, segun la conversion */
+enum log_arg_kind {
+  arg_none = 0,   /* %% */
+  arg_int,
+  arg_long,
+  arg_llong,
+  arg_size,
+  arg_double,
+  arg_ptr,
+  arg_str,
+  arg_bad
+};
+
+union log_arg
+{
+  int i;
+  long l;
+  long long ll;
+  size_t z;
+  double d;
+  void* p;
+  unsigned int s_off;   /* offset del string copiado en el registro */
+};
+
+struct log_rec
+{
+  uint64_t ts_ns;                        /* CLOCK_REALTIME */
+  const char* fmt;                       /* 0: texto ya formateado */
+  uint8_t sub;
+  uint8_t level;
+  uint8_t nargs;
+  union log_arg args[SR_LOG_MAX_ARGS];
+  /* a continuacion, los strings copiados */
+};
+
+#define REC_STR_SPACE (SR_LOG_SLOT_SIZE - sizeof(struct log_rec))
+#define rec_strs(rec) ((char*) ((rec) + 1))
+
+struct fmt_spec
+{
+  int len;     /* largo de la conversion, desde el '%' */
+  int kind;    /* enum log_arg_kind */
+  int stars;   /* '*' en ancho y/o precision: argumentos int extra */
+};
+
+static struct
+{
+  struct sr_ring ring;
+  FILE* out;
+  pthread_t thread;
+  int running;
+  int stopping;
+  int emitters;            /* productores usando la cola ahora */
+  int at_bol;              /* el escritor esta al inicio de una linea */
+  uint64_t reported;       /* descartes ya informados */
+} g_log;
+
+/* p apunta a un '%'. Completa s y retorna el puntero al final de la
+   conversion. */
+static const char* parse_spec(const char* p, struct fmt_spec* s)
+{
+  const char* q = p + 1;
+  int lmod = 0;   /* 1 l, 2 ll, 3 z/t, 4 L */
+
+  s->kind = arg_bad;
+  s->stars = 0;
+
+  if (*q == '%') {
+    s->kind = arg_none;
+    s->len = 2;
+    return q + 1;
+  }
+
+  while (*q != 0 && strchr("-+ #0'", *q) != 0) {
+    q++;
+  }
+  if (*q == '*') {
+    s->stars++;
+    q++;
+  }
+  else {
+    while (isdigit((unsigned char) *q)) q++;
+  }
+  if (*q == '.') {
+    q++;
+    if (*q == '*') {
+      s->stars++;
+      q++;
+    }
+    else {
+      while (isdigit((unsigned char) *q)) q++;
+    }
+  }
+
+  switch (*q) {
+    case 'h':
+      q++;
+      if (*q == 'h') q++;
+      break;
+    case 'l':
+      q++;
+      lmod = 1;
+      if (*q == 'l') {
+        q++;
+        lmod = 2;
+      }
+      break;
+    case 'q': case 'j':
+      q++;
+      lmod = 2;
+      break;
+    case 'z': case 't':
+      q++;
+      lmod = 3;
+      break;
+    case 'L':
+      q++;
+      lmod = 4;
+      break;
+  }
+
+  switch (*q) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+      s->kind = lmod == 0 ? arg_int : lmod == 1 ? arg_long :
+                lmod == 2 ? arg_llong : lmod == 3 ? arg_size : arg_bad;
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      s->kind = lmod == 4 ? arg_bad : arg_double;
+      break;
+    case 's':
+      s->kind = lmod == 0 ? arg_str : arg_bad;
+      break;
+    case 'p':
+      s->kind = arg_ptr;
+      break;
+  }
+  if (*q != 0) {
+    q++;
+  }
+
+  s->len = q - p;
+  return q;
+}
+
+/* Guarda los argumentos en el registro. Retorna -1 si hay que formatear
+   en el momento. */
+static int capture_args(struct log_rec* rec, const char* fmt, va_list ap)
+{
+  char* strs = rec_strs(rec);
+  unsigned int used = 0;
+  int n = 0;
+  int k;
+  const char* p = fmt;
+  struct fmt_spec s;
+
+  while ((p = strchr(p, '%')) != 0) {
+    p = parse_spec(p, &s);
+    if (s.kind == arg_none) {
+      continue;
+    }
+    if (s.kind == arg_bad || n + s.stars + 1 > SR_LOG_MAX_ARGS) {
+      return -1;
+    }
+
+    for (k = 0; k < s.stars; k++) {
+      rec->args[n++].i = va_arg(ap, int);
+    }
+
+    switch (s.kind) {
+      case arg_int:    rec->args[n++].i = va_arg(ap, int); break;
+      case arg_long:   rec->args[n++].l = va_arg(ap, long); break;
+      case arg_llong:  rec->args[n++].ll = va_arg(ap, long long); break;
+      case arg_size:   rec->args[n++].z = va_arg(ap, size_t); break;
+      case arg_double: rec->args[n++].d = va_arg(ap, double); break;
+      case arg_ptr:    rec->args[n++].p = va_arg(ap, void*); break;
+      case arg_str:
+        {
+          const char* str = va_arg(ap, const char*);
+          size_t len;
+
+          if (str == 0) {
+            str = "(null)";
+          }
+          if (used >= REC_STR_SPACE) {
+            return -1;
+          }
+          /* Los strings que no entran se truncan */
+          len = strlen(str);
+          if (len > REC_STR_SPACE - used - 1) {
+            len = REC_STR_SPACE - used - 1;
+          }
+          memcpy(strs + used, str, len);
+          strs[used + len] = 0;
+          rec->args[n++].s_off = used;
+          used += len + 1;
+        }
+        break;
+    }
+  }
+
+  rec->nargs = n;
+  return 0;
+}
+
+#define CALL_SNPRINTF(out, cap, spec, s, a, v) \
+  ((s)->stars == 0 ? snprintf(out, cap, spec, v) : \
+   (s)->stars == 1 ? snprintf(out, cap, spec, (a)[0].i, v) : \
+                     snprintf(out, cap, spec, (a)[0].i, (a)[1].i, v))
+
+/* Formatea una conversion con sus argumentos (a apunta al primero) */
+static int format_one(char* out, size_t cap, const char* spec, struct fmt_spec* s,
+                      union log_arg* a, const char* strs)
+{
+  union log_arg* v = a + s->stars;
+
+  switch (s->kind) {
+    case arg_int:    return CALL_SNPRINTF(out, cap, spec, s, a, v->i);
+    case arg_long:   return CALL_SNPRINTF(out, cap, spec, s, a, v->l);
+    case arg_llong:  return CALL_SNPRINTF(out, cap, spec, s, a, v->ll);
+    case arg_size:   return CALL_SNPRINTF(out, cap, spec, s, a, v->z);
+    case arg_double: return CALL_SNPRINTF(out, cap, spec, s, a, v->d);
+    case arg_ptr:    return CALL_SNPRINTF(out, cap, spec, s, a, v->p);
+    case arg_str:    return CALL_SNPRINTF(out, cap, spec, s, a, strs + v->s_off);
+  }
+  return 0;
+}
+
+/* Agrega n bytes de src a out si entran */
+static size_t append(char* out, size_t o, size_t cap, const char* src, size_t n)
+{
+  if (o + n > cap) {
+    n = cap - o;
+  }
+  memcpy(out + o, src, n);
+  return o + n;
+}
+
+/* Formatea el texto del registro en out (sin terminar en 0) */
+static size_t format_rec(struct log_rec* rec, char* out, size_t cap)
+{
+  const char* strs = rec_strs(rec);
+  const char* p = rec->fmt;
+  const char* pct;
+  char spec[32];
+  struct fmt_spec s;
+  size_t o = 0;
+  int n = 0;
+
+  if (rec->fmt == 0) {
+    return append(out, 0, cap, strs, strlen(strs));
+  }
+
+  while ((pct = strchr(p, '%')) != 0) {
+    o = append(out, o, cap, p, pct - p);
+    p = parse_spec(pct, &s);
+
+    if (s.kind == arg_none) {
+      o = append(out, o, cap, "%", 1);
+      continue;
+    }
+    if (s.len >= (int) sizeof(spec) || n + s.stars + 1 > rec->nargs) {
+      o = append(out, o, cap, pct, s.len);
+      continue;
+    }
+
+    memcpy(spec, pct, s.len);
+    spec[s.len] = 0;
+    if (o < cap) {
+      int w = format_one(out + o, cap - o + 1, spec, &s, rec->args + n, strs);
+      if (w > 0) {
+        o += (size_t) w > cap - o ? cap - o : (size_t) w;
+      }
+    }
+    n += s.stars + 1;
+  }
+
+  return append(out, o, cap, p, strlen(p));
+}
+
+/* "[hh:mm:ss.mmm sub L] " */
+static size_t format_prefix(struct log_rec* rec, char* out, size_t cap)
+{
+  time_t sec = rec->ts_ns / 1000000000ULL;
+  unsigned int msec = (rec->ts_ns % 1000000000ULL) / 1000000;
+  struct tm tm;
+  int w;
+
+  localtime_r(&sec, &tm);
+  w = snprintf(out, cap, "[%02d:%02d:%02d.%03u %-4s %c] ", tm.tm_hour, tm.tm_min,
+               tm.tm_sec, msec, g_subsys_str[rec->sub], g_level_chr[rec->level]);
+  return w > 0 && (size_t) w < cap ? (size_t) w : 0;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_emit
+ *
+ * Productor. No toma locks ni formatea: reserva un slot, copia los
+ * argumentos y lo publica. Si la cola esta llena el registro se descarta.
+ * Mientras usa la cola se cuenta en emitters, para que sr_log_stop no la
+ * libere debajo suyo.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_emit(int sub, int level, const char* fmt, ...)
+{
+  struct log_rec* rec;
+  uint64_t pos;
+  va_list ap;
+
+  /* Primero me anoto y despues miro running; sr_log_stop hace lo mismo
+     al reves, asi que o yo veo running en 0 o el me ve anotado */
+  __atomic_add_fetch(&g_log.emitters, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&g_log.running, __ATOMIC_SEQ_CST)) {
+    __atomic_sub_fetch(&g_log.emitters, 1, __ATOMIC_RELEASE);
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    return;
+  }
+
+  rec = sr_ring_reserve(&g_log.ring, &pos);
+  if (rec == 0) {
+    __atomic_sub_fetch(&g_log.emitters, 1, __ATOMIC_RELEASE);
+    return;
+  }
+
+  rec->ts_ns = now_ns();
+  rec->sub = sub;
+  rec->level = level;
+  rec->fmt = fmt;
+
+  va_start(ap, fmt);
+  if (capture_args(rec, fmt, ap) != 0) {
+    va_end(ap);
+    va_start(ap, fmt);
+    rec->fmt = 0;
+    rec->nargs = 0;
+    vsnprintf(rec_strs(rec), REC_STR_SPACE, fmt, ap);
+  }
+  va_end(ap);
+
+  sr_ring_commit(&g_log.ring, pos, sizeof(*rec));
+  __atomic_sub_fetch(&g_log.emitters, 1, __ATOMIC_RELEASE);
+} /* -- sr_log_emit -- */
+
+/* Escribe los registros pendientes. Retorna cuantos escribio. */
+static int log_drain(void)
+{
+  char line[SR_LOG_LINE_MAX];
+  struct log_rec* rec;
+  uint64_t dropped;
+  int n = 0;
+
+  while ((rec = sr_ring_peek(&g_log.ring, 0)) != 0) {
+    size_t o = 0;
+
+    if (g_log.at_bol) {
+      o = format_prefix(rec, line, sizeof(line));
+    }
+    o += format_rec(rec, line + o, sizeof(line) - o - 1);
+    sr_ring_release(&g_log.ring);
+
+    if (o > 0) {
+      fwrite(line, 1, o, g_log.out);
+      g_log.at_bol = line[o - 1] == '\n';
+    }
+    n++;
+  }
+
+  dropped = sr_ring_dropped(&g_log.ring);
+  if (dropped != g_log.reported) {
+    fprintf(g_log.out, "%s[log] %llu records dropped, ring full\n", g_log.at_bol ? "" : "\n",
+            (unsigned long long) (dropped - g_log.reported));
+    g_log.reported = dropped;
+    g_log.at_bol = 1;
+    n++;
+  }
+
+  if (n > 0) {
+    fflush(g_log.out);
+  }
+  return n;
+}
+
+static void* log_writer(void* arg)
+{
+  struct timespec idle;
+
+  idle.tv_sec = 0;
+  idle.tv_nsec = SR_LOG_IDLE_NS;
+
+  for (;;) {
+    if (log_drain() == 0) {
+      if (__atomic_load_n(&g_log.stopping, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      nanosleep(&idle, 0);
+    }
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_start
+ *
+ * Crea la cola y el hilo escritor. A partir de aca sr_log_emit encola.
+ * sr_log_stop queda registrada con atexit.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_log_start(FILE* out)
+{
+  static int atexit_done = 0;
+
+  if (g_log.running) {
+    return 0;
+  }
+  /* Para no perder lo encolado si el programa termina con exit() */
+  if (!atexit_done) {
+    atexit(sr_log_stop);
+    atexit_done = 1;
+  }
+  if (sr_ring_init(&g_log.ring, SR_LOG_RING_SLOTS, SR_LOG_SLOT_SIZE) != 0) {
+    return -1;
+  }
+
+  g_log.out = out;
+  g_log.at_bol = 1;
+  g_log.stopping = 0;
+  g_log.reported = 0;
+
+  fflush(out);
+  if (pthread_create(&g_log.thread, 0, log_writer, 0) != 0) {
+    sr_ring_destroy(&g_log.ring);
+    return -1;
+  }
+  __atomic_store_n(&g_log.running, 1, __ATOMIC_RELEASE);
+  return 0;
+} /* -- sr_log_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_stop
+ *
+ * Vuelve a la escritura directa, espera a que los productores que ya
+ * estaban usando la cola terminen y a que el escritor la vacie, y la
+ * libera.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_stop(void)
+{
+  if (!g_log.running) {
+    return;
+  }
+  __atomic_store_n(&g_log.running, 0, __ATOMIC_SEQ_CST);
+  /* Los que pasaron el chequeo de running antes solo copian un registro */
+  while (__atomic_load_n(&g_log.emitters, __ATOMIC_SEQ_CST) != 0) {
+    sched_yield();
+  }
+  __atomic_store_n(&g_log.stopping, 1, __ATOMIC_RELEASE);
+  pthread_join(g_log.thread, 0);
+  log_drain();
+  sr_ring_destroy(&g_log.ring);
+} /* -- sr_log_stop -- */
+
+int sr_log_level_from_str(const char* name)
+{
+  int i;
+  for (i = SR_LOG_ERROR; i <= SR_LOG_TRACE; i++) {
+    if (strcmp(name, g_level_str[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int sr_log_subsys_from_str(const char* name)
+{
+  int i;
+  for (i = 0; i < sr_sub_max; i++) {
+    if (strcmp(name, g_subsys_str[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char* sr_log_level_str(int level)
+{
+  return level >= SR_LOG_ERROR && level <= SR_LOG_TRACE ? g_level_str[level] : "?";
+}
+
+const char* sr_log_subsys_str(int sub)
+{
+  return sub >= 0 && sub < sr_sub_max ? g_subsys_str[sub] : "?";
+}
+
+int sr_log_set_level(int sub, int level)
+{
+  int i;
+
+  if (level < SR_LOG_ERROR || level > SR_LOG_TRACE || sub >= sr_sub_max) {
+    return -1;
+  }
+  for (i = 0; i < sr_sub_max; i++) {
+    if (sub < 0 || sub == i) {
+      __atomic_store_n(&sr_log_levels[i], level, __ATOMIC_RELAXED);
+    }
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_parse_levels
+ *
+ * Acepta "nivel" (todos los subsistemas) o una lista separada por comas
+ * de "subsistema=nivel", donde subsistema puede ser "all".
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_log_parse_levels(const char* spec)
+{
+  char buf[256];
+  char* save = 0;
+  char* tok;
+
+  strncpy(buf, spec, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+
+  for (tok = strtok_r(buf, ",", &save); tok != 0; tok = strtok_r(0, ",", &save)) {
+    char* eq = strchr(tok, '=');
+    int sub = -1;
+    int level;
+
+    if (eq != 0) {
+      *eq = 0;
+      if (strcmp(tok, "all") != 0 && (sub = sr_log_subsys_from_str(tok)) < 0) {
+        return -1;
+      }
+      tok = eq + 1;
+    }
+    if ((level = sr_log_level_from_str(tok)) < 0) {
+      return -1;
+    }
+    sr_log_set_level(sub, level);
+  }
+  return 0;
+} /* -- sr_log_parse_levels -- */
+
+void sr_log_print_levels(FILE* out)
+{
+  int i;
+
+  for (i = 0; i < sr_sub_max; i++) {
+    fprintf(out, "%-6s%s\n", g_subsys_str[i], sr_log_level_str(sr_log_levels[i]));
+  }
+  fprintf(out, "compiled up to %s, %llu records dropped\n",
+          sr_log_level_str(SR_LOG_COMPILE_LEVEL),
+          (unsigned long long) (g_log.running ? sr_ring_dropped(&g_log.ring) : g_log.reported));
+}
@@ -0,0 +1,100 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Descripción:
+ *
+ * Log por niveles y por subsistema.
+ *
+ * - Los mensajes de nivel mayor a SR_LOG_COMPILE_LEVEL no se compilan (ni
+ *   se evaluan sus argumentos). Se elige al compilar, por ejemplo
+ *   CFLAGS += -DSR_LOG_COMPILE_LEVEL=SR_LOG_WARN.
+ * - El resto se filtra con el nivel de cada subsistema, que se cambia en
+ *   tiempo de ejecucion (opcion -L o comando "log" del canal de control).
+ * - Los mensajes que pasan el filtro no se formatean en el hilo que los
+ *   emite: se guarda un registro binario (formato, argumentos y copia de
+ *   los strings) en una cola sin locks, y un hilo escritor los formatea y
+ *   escribe en bloque.
+ *
+ * El formato debe ser un literal: el registro guarda solo el puntero.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#include <stdio.h>
+
+/* Niveles (macros para poder usarlos en #if) */
+#define SR_LOG_ERROR 0
+#define SR_LOG_WARN  1
+#define SR_LOG_INFO  2
+#define SR_LOG_DEBUG 3
+#define SR_LOG_TRACE 4
+
+#ifndef SR_LOG_COMPILE_LEVEL
+#ifdef _DEBUG_
+#define SR_LOG_COMPILE_LEVEL SR_LOG_TRACE
+#else
+#define SR_LOG_COMPILE_LEVEL SR_LOG_INFO
+#endif
+#endif
+
+/* Nivel inicial de todos los subsistemas */
+#define SR_LOG_DEFAULT_LEVEL SR_LOG_INFO
+
+enum sr_log_subsys {
+  sr_sub_core = 0,   /* arranque, interfaces, tabla de rutas */
+  sr_sub_fwd,        /* camino de datos: IP, ICMP, reenvio */
+  sr_sub_arp,        /* ARP y cache ARP */
+  sr_sub_ospf,       /* PWOSPF: HELLO, LSU, vecinos, topologia */
+  sr_sub_spf,        /* calculo de rutas (Dijkstra) */
+  sr_sub_vns,        /* conexion con el servidor VNS */
+  sr_sub_cap,        /* captura de tramas */
+  sr_sub_max
+};
+
+/* Subsistema que usa Debug() en cada archivo. Definirlo antes de incluir
+   sr_router.h o sr_log.h para cambiarlo. */
+#ifndef SR_LOG_SUBSYS
+#define SR_LOG_SUBSYS sr_sub_core
+#endif
+
+extern unsigned char sr_log_levels[sr_sub_max];
+
+#define sr_log_enabled(sub, lvl) \
+  ((lvl) <= SR_LOG_COMPILE_LEVEL && \
+   (lvl) <= __atomic_load_n(&sr_log_levels[(sub)], __ATOMIC_RELAXED))
+
+#define sr_log(sub, lvl, fmt, args...) \
+  do { if (sr_log_enabled(sub, lvl)) sr_log_emit((sub), (lvl), fmt, ## args); } while (0)
+
+#define sr_log_error(sub, fmt, args...) sr_log(sub, SR_LOG_ERROR, fmt, ## args)
+#define sr_log_warn(sub, fmt, args...)  sr_log(sub, SR_LOG_WARN, fmt, ## args)
+#define sr_log_info(sub, fmt, args...)  sr_log(sub, SR_LOG_INFO, fmt, ## args)
+#define sr_log_debug(sub, fmt, args...) sr_log(sub, SR_LOG_DEBUG, fmt, ## args)
+#define sr_log_trace(sub, fmt, args...) sr_log(sub, SR_LOG_TRACE, fmt, ## args)
+
+/* Encola un registro. Antes de sr_log_start (o despues de sr_log_stop)
+   escribe directamente en stdout. */
+void sr_log_emit(int sub, int level, const char* fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+/* Arranca y detiene el hilo escritor. sr_log_stop vacia la cola. */
+int sr_log_start(FILE* out);
+void sr_log_stop(void);
+
+/* Niveles: "error".."trace"; subsistemas: "core", "fwd", ... o "all".
+   Retornan -1 si el nombre no existe. */
+int sr_log_level_from_str(const char* name);
+int sr_log_subsys_from_str(const char* name);
+const char* sr_log_level_str(int level);
+const char* sr_log_subsys_str(int sub);
+int sr_log_set_level(int sub, int level);   /* sub == -1: todos */
+
+/* Aplica una lista "nivel" o "subsistema=nivel,..." (opcion -L) */
+int sr_log_parse_levels(const char* spec);
+
+/* Imprime el nivel de cada subsistema y los registros descartados */
+void sr_log_print_levels(FILE* out);
+
+#endif /* -- SR_LOG_H -- */
@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <sys/types.h>
+#include <errno.h>
 
 #ifdef _LINUX_
 #include <getopt.h>
@@ -32,6 +33,14 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_log.h"
+#include "sr_ctl.h"
+#include "sr_capture.h"
+#include "sr_flightrec.h"
+#include "sr_filter.h"
+#include "sr_fib.h"
+#include "dijkstra.h"
+#include "sr_pwospf.h"
 
 extern char* optarg;
 
@@ -44,12 +53,20 @@ extern char* optarg;
 #define DEFAULT_SERVER "localhost"
 #define DEFAULT_RTABLE "rtable"
 #define DEFAULT_TOPO 0
+#define SR_RT_PRINT_MAX 64 /* larger tables are not printed at startup */
 
 static void usage(char* );
 static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static int sr_ctl_stats(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_capture(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_rtable(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_spf(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_ospf(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_flightrec(struct sr_instance* sr, int argc, char** argv, FILE* out);
+static int sr_ctl_filter(struct sr_instance* sr, int argc, char** argv, FILE* out);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -65,11 +82,20 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    char *filter_expr = 0;
+    int tier = sr_validate_local;
+    char *ctl_path = 0;
+    struct sr_capture_opts cap_opts;
+    unsigned int fr_frames = SR_FLIGHTREC_DEFAULT_FRAMES;
+    unsigned int fr_snaplen = SR_FLIGHTREC_DEFAULT_SNAPLEN;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    memset(&cap_opts, 0, sizeof(cap_opts));
+    cap_opts.snaplen = PACKET_DUMP_SIZE;
+
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:V:L:C:S:G:F:f:")) != EOF)
     {
         switch (c)
         {
@@ -95,17 +121,99 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg;
                 break;
+            case 'f':
+                filter_expr = optarg;
+                break;
             case 'r':
                 rtable = optarg;
                 break;
             case 'T':
                 template = optarg;
                 break;
+            case 'V':
+                tier = sr_parse_tier(optarg);
+                if (tier < 0)
+                {
+                    fprintf(stderr, "Unknown validation tier %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'L':
+                if (sr_log_parse_levels(optarg) != 0)
+                {
+                    fprintf(stderr, "Invalid log levels %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'C':
+                ctl_path = optarg;
+                break;
+            case 'S':
+                cap_opts.rotate_bytes = sr_capture_parse_size(optarg);
+                if (cap_opts.rotate_bytes == 0)
+                {
+                    fprintf(stderr, "Invalid capture file size %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'G':
+                cap_opts.rotate_secs = atoi(optarg);
+                break;
+            case 'F':
+                if (sr_flightrec_parse_opt(optarg, &fr_frames, &fr_snaplen) != 0)
+                {
+                    fprintf(stderr, "Invalid flight recorder size %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
         } /* switch */
     } /* -- while -- */
 
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.validation_tier = tier;
+
+    /* -- flight recorder, before any other thread so that all of them
+          inherit the blocked SIGUSR1 -- */
+    if (fr_frames > 0)
+    {
+        sr.flightrec = sr_flightrec_open(&sr, fr_frames, fr_snaplen);
+        if (sr.flightrec == 0)
+        {
+            fprintf(stderr, "Error allocating the flight recorder\n");
+            exit(1);
+        }
+    }
+
+    /* -- from here on log messages go through the writer thread -- */
+    if (sr_log_start(stdout) != 0)
+    {
+        fprintf(stderr, "Error starting the log writer\n");
+        exit(1);
+    }
+
+    if (ctl_path != 0)
+    {
+        sr_ctl_register("stats", "packet validation counters", sr_ctl_stats);
+        sr_ctl_register("capture", "packet capture counters", sr_ctl_capture);
+        sr_ctl_register("filter", "[-d] [expression|none]: show or set the capture filter",
+                sr_ctl_filter);
+        sr_ctl_register("flightrec", "[dump [file]]: flight recorder counters or dump to pcapng",
+                sr_ctl_flightrec);
+        sr_ctl_register("rtable", "[save [file]]: routing table summary or write its snapshot",
+                sr_ctl_rtable);
+        sr_ctl_register("spf", "[full | verify on|off]: shortest path runs and route changes",
+                sr_ctl_spf);
+        sr_ctl_register("ospf", "PWOSPF origination and database exchange counters", sr_ctl_ospf);
+        if (sr_ctl_start(&sr, ctl_path) != 0)
+        {
+            exit(1);
+        }
+    }
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -113,7 +221,10 @@ int main(int argc, char **argv)
         sr_load_rt_wrap(&sr, rtable);
     }
     else
-        strncpy(sr.template, template, 30);
+    {
+        strncpy(sr.template, template, sizeof(sr.template) - 1);
+        sr.template[sizeof(sr.template) - 1] = '\0';
+    }
 
     sr.topo_id = topo;
     strncpy(sr.host,host,32);
@@ -121,18 +232,40 @@ int main(int argc, char **argv)
     if(! user )
     { sr_set_user(&sr); }
     else
-    { strncpy(sr.user, user, 32); }
+    {
+        strncpy(sr.user, user, sizeof(sr.user) - 1);
+        sr.user[sizeof(sr.user) - 1] = '\0';
+    }
 
-    /* -- set up file pointer for logging of raw packets -- */
+    /* -- set up the capture of raw packets, written by its own thread -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        cap_opts.path = logfile;
+        cap_opts.format = sr_capture_format_from_path(logfile);
+        sr.capture = sr_capture_open(&cap_opts);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
             exit(1);
         }
+        if(filter_expr != 0)
+        {
+            char err[128];
+            struct sr_filter* filter = sr_filter_compile(filter_expr, err, sizeof(err));
+
+            if(filter == 0)
+            {
+                fprintf(stderr, "Invalid capture filter: %s\n", err);
+                exit(1);
+            }
+            sr_capture_set_filter(sr.capture, filter);
+        }
+    }
+    else if(filter_expr != 0)
+    {
+        fprintf(stderr, "A capture filter needs a capture file (-l)\n");
+        exit(1);
     }
 
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
@@ -178,9 +311,13 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file (.pcap or .pcapng)] [-V transit|local|full] \n");
+    printf("           [-L [subsystem=]level,...] [-C control socket] \n");
+    printf("           [-S rotate size[k|M|G]] [-G rotate seconds] [-f filter] \n");
+    printf("           [-F flight recorder frames[/bytes], 0 disables] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("   a server containing '/' is a unix socket (sr_vnsd -u) \n");
 } /* -- usage -- */
 
 /*-----------------------------------------------------------------------------
@@ -199,11 +336,13 @@ void sr_set_user(struct sr_instance* sr)
     if(( pw = getpwuid(uid) ) == 0)
     {
         fprintf (stderr, "Error getting username, using something silly\n");
-        strncpy(sr->user, "something_silly", 32);
+        strncpy(sr->user, "something_silly", sizeof(sr->user) - 1);
+        sr->user[sizeof(sr->user) - 1] = '\0';
     }
     else
     {
-        strncpy(sr->user, pw->pw_name, 32);
+        strncpy(sr->user, pw->pw_name, sizeof(sr->user) - 1);
+        sr->user[sizeof(sr->user) - 1] = '\0';
     }
 
 } /* -- sr_set_user -- */
@@ -220,16 +359,267 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    /* -- the PWOSPF, ARP and timer threads keep running; once they can no
+          longer send, nothing touches the capture or the flight recorder -- */
+    sr_stop_senders(sr);
+
+    if(sr->capture)
     {
-        sr_dump_close(sr->logfile);
+        struct sr_capture* cap = sr->capture;
+
+        sr->capture = 0;
+        sr_capture_print_stats(cap, stdout);
+        sr_capture_close(cap);
     }
 
+    sr_print_pkt_stats(sr, stdout);
+
+    sr_ctl_stop();
+
+    if(sr->flightrec)
+    {
+        struct sr_flightrec* fr = sr->flightrec;
+
+        sr->flightrec = 0;
+        sr_flightrec_close(fr);
+    }
+    sr_log_stop();
+
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
     */
 } /* -- sr_destroy_instance -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_stats(..)
+ * Scope: Local
+ *
+ * Comando "stats" del canal de control
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_stats(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    sr_print_pkt_stats(sr, out);
+    return 0;
+} /* -- sr_ctl_stats -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_capture(..)
+ * Scope: Local
+ *
+ * Comando "capture" del canal de control
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_capture(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    if (sr->capture == 0)
+    {
+        fprintf(out, "capture disabled, start with -l file\n");
+        return -1;
+    }
+    sr_capture_print_stats(sr->capture, out);
+    return 0;
+} /* -- sr_ctl_capture -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_flightrec(..)
+ * Scope: Local
+ *
+ * Comando "flightrec" del canal de control: sin argumentos muestra los
+ * contadores, "dump [archivo]" vuelca el anillo a pcapng.
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_flightrec(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    char name[256];
+    int n;
+
+    if (sr->flightrec == 0)
+    {
+        fprintf(out, "flight recorder disabled (-F 0)\n");
+        return -1;
+    }
+    if (argc == 1)
+    {
+        sr_flightrec_print_stats(sr->flightrec, out);
+        return 0;
+    }
+    if (strcmp(argv[1], "dump") != 0 || argc > 3)
+    {
+        fprintf(out, "usage: flightrec [dump [file]]\n");
+        return -1;
+    }
+    n = sr_flightrec_dump(sr->flightrec, argc == 3 ? argv[2] : 0, name, sizeof(name));
+    if (n < 0)
+    {
+        fprintf(out, "error writing %s\n", name);
+        return -1;
+    }
+    fprintf(out, "%d frames written to %s\n", n, name);
+    return 0;
+} /* -- sr_ctl_flightrec -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_rtable(..)
+ * Scope: Local
+ *
+ * Comando "rtable" del canal de control: sin argumentos resume la tabla
+ * y la FIB, "save [archivo]" escribe el snapshot binario (por defecto
+ * junto al archivo de texto, donde lo busca el proximo arranque).
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_rtable(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    char name[256];
+    int n;
+
+    if (argc == 1)
+    {
+        sr_fib_print(sr, out);
+        return 0;
+    }
+    if (strcmp(argv[1], "save") != 0 || argc > 3)
+    {
+        fprintf(out, "usage: rtable [save [file]]\n");
+        return -1;
+    }
+    if (argc == 3)
+    {
+        snprintf(name, sizeof(name), "%s", argv[2]);
+    }
+    else if (sr->rt_path[0] != 0)
+    {
+        snprintf(name, sizeof(name), "%s%s", sr->rt_path, SR_FIB_SUFFIX);
+    }
+    else
+    {
+        fprintf(out, "no routing table file, give the snapshot name\n");
+        return -1;
+    }
+    n = sr_fib_save_snapshot(sr, name);
+    if (n < 0)
+    {
+        fprintf(out, "error writing %s: %s\n", name,
+                errno == EINVAL ? "non-contiguous mask in the table" : strerror(errno));
+        return -1;
+    }
+    fprintf(out, "%d static routes written to %s\n", n, name);
+    return 0;
+} /* -- sr_ctl_rtable -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_spf(..)
+ * Scope: Local
+ *
+ * Comando "spf" del canal de control
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_spf(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    if (argc == 1)
+    {
+        dijkstra_print_stats(out);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "full") == 0)
+    {
+        dijkstra_force_full();
+        fprintf(out, "next spf run will be a full one\n");
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "verify") == 0 &&
+        (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0))
+    {
+        dijkstra_set_verify(strcmp(argv[2], "on") == 0);
+        fprintf(out, "spf verify %s\n", argv[2]);
+        return 0;
+    }
+    fprintf(out, "usage: spf [full | verify on|off]\n");
+    return -1;
+} /* -- sr_ctl_spf -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_ospf(..)
+ * Scope: Local
+ *
+ * Comando "ospf" del canal de control
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_ospf(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    pwospf_print_stats(out);
+    return 0;
+} /* -- sr_ctl_ospf -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_filter(..)
+ * Scope: Local
+ *
+ * Comando "filter" del canal de control: sin argumentos muestra el filtro
+ * (con -d tambien el programa compilado), "none" lo quita y cualquier otra
+ * cosa se compila como expresion nueva.
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_ctl_filter(struct sr_instance* sr, int argc, char** argv, FILE* out)
+{
+    char expr[512];
+    char err[128];
+    struct sr_filter* filter;
+    int program = 0;
+    size_t used = 0;
+    int i;
+
+    if (sr->capture == 0)
+    {
+        fprintf(out, "capture disabled, start with -l file\n");
+        return -1;
+    }
+    if (argc > 1 && strcmp(argv[1], "-d") == 0)
+    {
+        program = 1;
+        argc--;
+        argv++;
+    }
+    if (argc == 1)
+    {
+        sr_capture_print_filter(sr->capture, out, program);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "none") == 0)
+    {
+        sr_capture_set_filter(sr->capture, 0);
+        sr_capture_print_filter(sr->capture, out, 0);
+        return 0;
+    }
+
+    /* El canal de control separo la expresion en palabras */
+    expr[0] = 0;
+    for (i = 1; i < argc; i++)
+    {
+        used += snprintf(expr + used, sizeof(expr) - used, "%s%s", i > 1 ? " " : "", argv[i]);
+        if (used >= sizeof(expr))
+        {
+            fprintf(out, "expression too long\n");
+            return -1;
+        }
+    }
+    if ((filter = sr_filter_compile(expr, err, sizeof(err))) == 0)
+    {
+        fprintf(out, "invalid filter: %s\n", err);
+        return -1;
+    }
+    sr_capture_set_filter(sr->capture, filter);
+    sr_capture_print_filter(sr->capture, out, program);
+    return 0;
+} /* -- sr_ctl_filter -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_init_instance(..)
  * Scope: Local
@@ -248,7 +638,20 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->rib = 0;
+    sr->fib = 0;
+    sr->fib_dyn = 0;
+    sr->rt_version = 0;
+    sr->rt_static_version = 0;
+    sr->fib_version = 0;
+    sr->fib_static_version = 0;
+    sr->rt_path[0] = 0;
+    sr->capture = 0;
+    sr->flightrec = 0;
+    sr->stopping = 0;
+    sr->senders = 0;
+    sr->validation_tier = sr_validate_local;
+    memset(&sr->pkt_stats, 0, sizeof(sr->pkt_stats));
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -303,13 +706,24 @@ int sr_verify_routing_table(struct sr_instance* sr)
 } /* -- sr_verify_routing_table -- */
 
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
-    if(sr_load_rt(sr, rtable) != 0) {
+    char snapshot[256];
+
+    /* -- a binary snapshot next to the text file skips the parsing -- */
+    snprintf(snapshot, sizeof(snapshot), "%s%s", rtable, SR_FIB_SUFFIX);
+    if(sr_fib_load_snapshot(sr, snapshot, rtable) != 0 &&
+       sr_load_rt(sr, rtable) != 0) {
         fprintf(stderr,"Error setting up routing table from file %s\n",
                 rtable);
         exit(1);
     }
 
 
+    /* -- a full table would take longer to print than to load -- */
+    if (count_routes(sr) > SR_RT_PRINT_MAX)
+    {
+        return;
+    }
+
     printf("Loading routing table\n");
     printf("---------------------------------------------\n");
     sr_print_routing_table(sr);
@@ -0,0 +1,345 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_parse.c
+ *
+ * Descripción:
+ *
+ * Parser de una sola pasada. Reemplaza las validaciones y casteos repetidos
+ * que hacian sr_arp_req_not_for_us, is_packet_valid, sr_handlepacket,
+ * sr_handle_ip_packet y los manejadores de PWOSPF.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sr_parse.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "pwospf_protocol.h"
+#include "sr_utils.h"
+
+static const char* g_verdict_str[sr_pkt_verdict_max] = {
+  "ok",
+  "truncated",
+  "bad IP version",
+  "bad IP header length",
+  "bad IP total length",
+  "bad IP checksum",
+  "bad ICMP checksum",
+  "bad PWOSPF length",
+  "bad PWOSPF checksum",
+  "ARP request not for us",
+  "unknown ethertype"
+};
+
+static const char* g_action_str[sr_pkt_act_max] = {
+  "no action",
+  "forwarded",
+  "queued for ARP",
+  "to PWOSPF",
+  "answered by router",
+  "dropped",
+  "dropped: no route",
+  "dropped: TTL expired",
+  "dropped: not an echo request",
+  "sent"
+};
+
+static const char* g_tier_str[] = { "transit", "local", "full" };
+
+const char* sr_pkt_verdict_str(int verdict)
+{
+  if (verdict < 0 || verdict >= sr_pkt_verdict_max) {
+    return "?";
+  }
+  return g_verdict_str[verdict];
+}
+
+const char* sr_pkt_action_str(int action)
+{
+  if (action < 0 || action >= sr_pkt_act_max) {
+    return "?";
+  }
+  return g_action_str[action];
+}
+
+int sr_parse_tier(const char* name)
+{
+  int i;
+  for (i = sr_validate_transit; i <= sr_validate_full; i++) {
+    if (strcmp(name, g_tier_str[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char* sr_tier_str(int tier)
+{
+  if (tier < sr_validate_transit || tier > sr_validate_full) {
+    return "?";
+  }
+  return g_tier_str[tier];
+}
+
+/* Decide si hay que verificar el checksum ICMP/PWOSPF segun el nivel.
+   Un router no esta obligado a verificar lo que solo reenvia, y hacerlo
+   duplica el costo por byte de los pings grandes que lo atraviesan. */
+static int must_verify_l4(struct sr_instance* sr, struct sr_pkt_desc* desc)
+{
+  int tier = sr != 0 ? sr->validation_tier : sr_validate_full;
+
+  switch (tier) {
+    case sr_validate_full:
+      return 1;
+    case sr_validate_local:
+      return (desc->flags & (SR_PKT_F_LOCAL | SR_PKT_F_OSPF_MCAST)) ||
+             desc->l4_proto == ip_protocol_ospfv2;
+    default:
+      return 0;
+  }
+}
+
+static void count_l4(struct sr_instance* sr, int checked)
+{
+  if (sr == 0) {
+    return;
+  }
+  if (checked) {
+    sr->pkt_stats.l4_cksum_checked++;
+  }
+  else {
+    sr->pkt_stats.l4_cksum_skipped++;
+  }
+}
+
+/* Un bloque con su checksum incluido suma 0xffff en complemento a uno, por
+   lo que cksum() sobre todo el bloque retorna 0xffff si es correcto. Asi no
+   hace falta poner el campo en cero y restaurarlo como en ip_cksum().
+   Pero cksum() tambien retorna 0xffff si la suma plegada es 0, y eso solo
+   pasa si todos los bytes son cero: ese bloque no es valido. En un bloque
+   correcto el primer byte distinto de cero aparece enseguida. */
+static int cksum_ok(const void* data, int len)
+{
+  const uint8_t* p = data;
+  int i;
+
+  if (cksum(data, len) != 0xffff) {
+    return 0;
+  }
+  for (i = 0; i < len; i++) {
+    if (p[i] != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int parse_arp(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                     struct sr_pkt_desc* desc)
+{
+  sr_arp_hdr_t* arp_hdr;
+
+  if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)) {
+    return sr_pkt_truncated;
+  }
+
+  arp_hdr = (sr_arp_hdr_t*) (packet + desc->l3_off);
+  desc->src = arp_hdr->ar_sip;
+  desc->dst = arp_hdr->ar_tip;
+
+  /* Antes lo hacia sr_arp_req_not_for_us en sr_vns_comm.c */
+  if (desc->in_if != 0 && arp_hdr->ar_op == htons(arp_op_request) &&
+      arp_hdr->ar_tip != desc->in_if->ip) {
+    return sr_pkt_arp_not_for_us;
+  }
+
+  if (sr != 0 && desc->dst != 0) {
+    desc->local_if = sr_get_interface_given_ip(sr, desc->dst);
+    if (desc->local_if != 0) {
+      desc->flags |= SR_PKT_F_LOCAL;
+    }
+  }
+
+  return sr_pkt_ok;
+}
+
+static int parse_ip(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    struct sr_pkt_desc* desc)
+{
+  sr_ip_hdr_t* ip_hdr;
+  unsigned int hlen, ip_len;
+  int verify;
+
+  if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)) {
+    return sr_pkt_truncated;
+  }
+
+  ip_hdr = (sr_ip_hdr_t*) (packet + desc->l3_off);
+  if (ip_hdr->ip_v != 4) {
+    return sr_pkt_bad_ip_version;
+  }
+
+  hlen = ip_hdr->ip_hl * 4;
+  if (hlen < sizeof(sr_ip_hdr_t) || desc->l3_off + hlen > len) {
+    return sr_pkt_bad_ip_hlen;
+  }
+
+  /* ip_len puede ser menor que la trama (relleno Ethernet) pero no mayor */
+  ip_len = ntohs(ip_hdr->ip_len);
+  if (ip_len < hlen || desc->l3_off + ip_len > len) {
+    return sr_pkt_bad_ip_len;
+  }
+
+  if (!cksum_ok(ip_hdr, hlen)) {
+    return sr_pkt_bad_ip_cksum;
+  }
+
+  desc->l4_off = desc->l3_off + hlen;
+  desc->l4_len = ip_len - hlen;
+  desc->l4_proto = ip_hdr->ip_p;
+  desc->src = ip_hdr->ip_src;
+  desc->dst = ip_hdr->ip_dst;
+
+  if (desc->dst == htonl(OSPF_AllSPFRouters)) {
+    desc->flags |= SR_PKT_F_OSPF_MCAST;
+  }
+  else if (sr != 0 && desc->dst != 0) {
+    desc->local_if = sr_get_interface_given_ip(sr, desc->dst);
+    if (desc->local_if != 0) {
+      desc->flags |= SR_PKT_F_LOCAL;
+    }
+  }
+
+  verify = must_verify_l4(sr, desc);
+
+  if (desc->l4_proto == ip_protocol_icmp) {
+    /* El largo solo importa si el router va a leer el cabezal ICMP */
+    if ((verify || (desc->flags & SR_PKT_F_LOCAL)) &&
+        desc->l4_len < sizeof(sr_icmp_hdr_t)) {
+      return sr_pkt_truncated;
+    }
+    /* El checksum ICMP cubre todo el mensaje, sin el relleno Ethernet */
+    count_l4(sr, verify);
+    if (verify && !cksum_ok(packet + desc->l4_off, desc->l4_len)) {
+      return sr_pkt_bad_icmp_cksum;
+    }
+  }
+  else if (desc->l4_proto == ip_protocol_ospfv2) {
+    ospfv2_hdr_t* ospf_hdr;
+    unsigned int ospf_len;
+
+    /* PWOSPF siempre lo procesa el router, los largos se validan siempre */
+    if (desc->l4_len < sizeof(ospfv2_hdr_t)) {
+      return sr_pkt_truncated;
+    }
+    ospf_hdr = (ospfv2_hdr_t*) (packet + desc->l4_off);
+    ospf_len = ntohs(ospf_hdr->len);
+    if (ospf_len < sizeof(ospfv2_hdr_t) || ospf_len > desc->l4_len) {
+      return sr_pkt_bad_ospf_len;
+    }
+    count_l4(sr, verify);
+    if (verify && !cksum_ok(ospf_hdr, ospf_len)) {
+      return sr_pkt_bad_ospf_cksum;
+    }
+  }
+
+  return sr_pkt_ok;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_parse_packet
+ *
+ * Recorre la trama una sola vez, valida largos y checksums y completa
+ * el descriptor. Retorna el veredicto (sr_pkt_ok si la trama es valida).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_parse_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    const char* interface, struct sr_pkt_desc* desc)
+{
+  sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet;
+
+  memset(desc, 0, sizeof(*desc));
+
+  if (sr != 0 && interface != 0) {
+    desc->in_if = sr_get_interface(sr, interface);
+    if (desc->in_if != 0) {
+      desc->ifindex = desc->in_if->index;
+    }
+  }
+
+  if (len < sizeof(sr_ethernet_hdr_t)) {
+    desc->verdict = sr_pkt_truncated;
+    return desc->verdict;
+  }
+
+  desc->ethertype = ntohs(eth_hdr->ether_type);
+  desc->l3_off = sizeof(sr_ethernet_hdr_t);
+
+  if (desc->ethertype == ethertype_arp) {
+    desc->verdict = parse_arp(sr, packet, len, desc);
+  }
+  else if (desc->ethertype == ethertype_ip) {
+    desc->verdict = parse_ip(sr, packet, len, desc);
+  }
+  else {
+    desc->verdict = sr_pkt_unknown_ethertype;
+  }
+
+  if (sr != 0) {
+    sr->pkt_stats.rx++;
+    sr->pkt_stats.verdicts[desc->verdict]++;
+  }
+
+  return desc->verdict;
+} /* -- sr_parse_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_print_pkt_stats
+ *
+ * Imprime los contadores del parser: tramas recibidas, checksums de
+ * capa 4 verificados u omitidos y descartes por motivo.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_print_pkt_stats(struct sr_instance* sr, FILE* out)
+{
+  struct sr_pkt_stats* st = &sr->pkt_stats;
+  int i, w = 28;
+
+  /* La primera columna alcanza para el motivo de descarte mas largo */
+  for (i = sr_pkt_ok + 1; i < sr_pkt_verdict_max; i++) {
+    int n = (int) strlen("dropped: ") + (int) strlen(sr_pkt_verdict_str(i)) + 1;
+    if (n > w) {
+      w = n;
+    }
+  }
+
+  fprintf(out, "Packet validation (tier %s):\n", sr_tier_str(sr->validation_tier));
+  fprintf(out, "  %-*s%llu\n", w, "received", (unsigned long long) st->rx);
+  fprintf(out, "  %-*s%llu\n", w, "L4 checksums verified", (unsigned long long) st->l4_cksum_checked);
+  fprintf(out, "  %-*s%llu\n", w, "L4 checksums skipped", (unsigned long long) st->l4_cksum_skipped);
+  for (i = sr_pkt_ok + 1; i < sr_pkt_verdict_max; i++) {
+    if (st->verdicts[i] != 0) {
+      fprintf(out, "  dropped: %-*s%llu\n", w - (int) strlen("dropped: "), sr_pkt_verdict_str(i),
+              (unsigned long long) st->verdicts[i]);
+    }
+  }
+} /* -- sr_print_pkt_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: is_packet_valid
+ *
+ * Se mantiene por compatibilidad. Valida la trama sin resolver
+ * interfaces.
+ *
+ *---------------------------------------------------------------------*/
+
+int is_packet_valid(uint8_t *packet /* lent */,
+    unsigned int len) {
+  struct sr_pkt_desc desc;
+
+  return sr_parse_packet(0, packet, len, 0, &desc) == sr_pkt_ok;
+}
@@ -0,0 +1,133 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_parse.h
+ *
+ * Descripción:
+ *
+ * Parser de una sola pasada para las tramas recibidas. Valida largos y
+ * checksums una unica vez y deja el resultado en un descriptor compacto
+ * (struct sr_pkt_desc) que consumen los manejadores de ARP, IP y PWOSPF,
+ * de modo que ninguno vuelva a castear ni a verificar los cabezales.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PARSE_H
+#define SR_PARSE_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* forward declare */
+struct sr_instance;
+struct sr_if;
+
+/* Resultado de la validacion de una trama */
+enum sr_pkt_verdict {
+  sr_pkt_ok = 0,
+  sr_pkt_truncated,          /* la trama es mas corta que sus cabezales */
+  sr_pkt_bad_ip_version,     /* version IP distinta de 4 */
+  sr_pkt_bad_ip_hlen,        /* ip_hl menor a 5 o mayor que la trama */
+  sr_pkt_bad_ip_len,         /* ip_len inconsistente con la trama */
+  sr_pkt_bad_ip_cksum,
+  sr_pkt_bad_icmp_cksum,
+  sr_pkt_bad_ospf_len,       /* len de PWOSPF inconsistente con ip_len */
+  sr_pkt_bad_ospf_cksum,
+  sr_pkt_arp_not_for_us,     /* ARP request dirigido a otra IP */
+  sr_pkt_unknown_ethertype,
+  sr_pkt_verdict_max
+};
+
+/* Decision que tomo el router con una trama (la completan los manejadores;
+   la usa el flight recorder) */
+enum sr_pkt_action {
+  sr_pkt_act_none = 0,
+  sr_pkt_act_forwarded,      /* reenviada con la MAC de la cache ARP */
+  sr_pkt_act_arp_queued,     /* encolada esperando respuesta ARP */
+  sr_pkt_act_ospf,           /* entregada a PWOSPF */
+  sr_pkt_act_local,          /* contestada por el router (echo, ARP) */
+  sr_pkt_act_drop_invalid,   /* descartada por el parser, motivo en verdict */
+  sr_pkt_act_drop_no_route,  /* sin ruta, se envio ICMP net unreachable */
+  sr_pkt_act_drop_ttl,       /* TTL vencido, se envio ICMP time exceeded */
+  sr_pkt_act_drop_unreach,   /* para el router pero no es echo request */
+  sr_pkt_act_sent,           /* trama enviada por sr_send_packet */
+  sr_pkt_act_max
+};
+
+/* Niveles de validacion, seleccionables al inicio con -V */
+enum sr_validation_tier {
+  sr_validate_transit = 0,   /* solo largos de Ethernet e IP y checksum IP */
+  sr_validate_local,         /* ademas checksums ICMP/PWOSPF de lo que es para
+                                el router o es PWOSPF (por defecto) */
+  sr_validate_full           /* checksums ICMP/PWOSPF de todo, incluso lo que
+                                solo se reenvia */
+};
+
+/* Contadores del parser. Solo los actualiza el hilo que lee del servidor. */
+struct sr_pkt_stats
+{
+  uint64_t rx;                               /* tramas parseadas */
+  uint64_t l4_cksum_checked;                 /* checksums ICMP/PWOSPF verificados */
+  uint64_t l4_cksum_skipped;                 /* omitidos por el nivel de validacion */
+  uint64_t verdicts[sr_pkt_verdict_max];     /* tramas por veredicto (descartes por motivo) */
+};
+
+/* Flags del descriptor */
+#define SR_PKT_F_LOCAL      0x01  /* destino es una de las IPs del router */
+#define SR_PKT_F_OSPF_MCAST 0x02  /* destino es OSPF_AllSPFRouters */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pkt_desc
+ *
+ * Metadatos de una trama, completados por sr_parse_packet. Los offsets son
+ * relativos al inicio de la trama y las direcciones quedan en network byte
+ * order, igual que en los cabezales.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pkt_desc
+{
+  uint16_t ethertype;       /* en host byte order */
+  uint16_t l3_off;          /* inicio del cabezal ARP o IP */
+  uint16_t l4_off;          /* inicio del cabezal ICMP/PWOSPF/... (solo IP) */
+  uint16_t l4_len;          /* largo desde l4_off segun ip_len (solo IP) */
+  uint8_t  l4_proto;        /* ip_p (solo IP) */
+  uint8_t  verdict;         /* enum sr_pkt_verdict */
+  uint8_t  flags;           /* SR_PKT_F_* */
+  uint8_t  ifindex;         /* indice de la interfaz de entrada */
+  uint8_t  action;          /* enum sr_pkt_action, la completa el manejador */
+  uint32_t src;             /* IP origen, o sender IP si es ARP */
+  uint32_t dst;             /* IP destino, o target IP si es ARP */
+  struct sr_if* in_if;      /* interfaz de entrada (0 si no se conoce) */
+  struct sr_if* local_if;   /* interfaz del router con IP == dst, o 0 */
+};
+
+/* Recorre la trama una sola vez y completa desc. sr e interface pueden ser
+   NULL: en ese caso no se resuelven las interfaces ni se filtran los ARP
+   que no son para el router. Retorna desc->verdict. */
+int sr_parse_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    const char* interface, struct sr_pkt_desc* desc);
+
+/* Nombre legible de un veredicto */
+const char* sr_pkt_verdict_str(int verdict);
+
+/* Nombre legible de una decision */
+const char* sr_pkt_action_str(int action);
+
+/* Traduce "transit", "local" o "full" a enum sr_validation_tier; -1 si no
+   es valido */
+int sr_parse_tier(const char* name);
+const char* sr_tier_str(int tier);
+
+/* Imprime los contadores de validacion por motivo de descarte */
+void sr_print_pkt_stats(struct sr_instance* sr, FILE* out);
+
+/* Compatibilidad: 1 si la trama es valida, 0 si no */
+int is_packet_valid(uint8_t *, unsigned int);
+
+#endif /* -- SR_PARSE_H -- */
@@ -156,6 +156,8 @@ typedef struct sr_ethernet_hdr sr_ethernet_hdr_t;
 
 enum sr_ip_protocol {
   ip_protocol_icmp = 0x0001,
+  ip_protocol_tcp = 6,
+  ip_protocol_udp = 17,
   ip_protocol_ospfv2 = 89,
 };
 
@@ -7,6 +7,8 @@
  *
  *---------------------------------------------------------------------------*/
 
+#define SR_LOG_SUBSYS sr_sub_ospf
+
 #include "sr_pwospf.h"
 #include "sr_router.h"
 
@@ -20,9 +22,11 @@
 #include <stdlib.h>
 
 #include "sr_utils.h"
+#include "sr_parse.h"
 #include "sr_protocol.h"
 #include "pwospf_protocol.h"
 #include "sr_rt.h"
+#include "sr_fib.h"
 #include "pwospf_neighbors.h"
 #include "pwospf_topology.h"
 #include "dijkstra.h"
@@ -33,18 +37,12 @@ variables globales. Pueden ser accedidas desde todos los hilos */
 /*pthread_t hello_thread;*/
 pthread_t g_hello_packet_thread;
 pthread_t g_all_lsu_thread;
-pthread_t g_lsu_thread;
-pthread_t g_neighbors_thread;
-pthread_t g_topology_entries_thread;
 pthread_t g_rx_lsu_thread;
-pthread_t g_dijkstra_thread;
-
-pthread_mutex_t g_dijkstra_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct in_addr g_router_id;
 uint8_t g_ospf_multicast_mac[ETHER_ADDR_LEN];
 struct ospfv2_neighbor* g_neighbors;
-struct pwospf_topology_entry* g_topology;
+struct pwospf_lsdb* g_topology;
 uint16_t g_sequence_num;
 
 /* ID de IP*/
@@ -54,6 +52,96 @@ static uint16_t count_ip_id = 0;
     lo agrego no la puedo llamar en init --- */
 static void* pwospf_run_thread(void* arg);
 
+/* -- Manejadores de los timers de vecinos y de LSAs, se registran en init -- */
+static void neighbor_timeout(struct in_addr neighbor_id, void* arg);
+static void topology_timeout(struct pwospf_lsdb* topology, void* arg);
+static void send_ospf(struct sr_instance* sr, struct sr_if* iface, const uint8_t* ospf, unsigned int ospf_len);
+static void send_dbd(struct sr_instance* sr, struct sr_if* iface, uint8_t flags);
+static void flood_init(struct sr_instance* sr);
+static void flood_send(struct sr_instance* sr, struct sr_if* iface, const uint8_t* ospf, unsigned int ospf_len);
+static void flood_ack(struct sr_if* iface, uint32_t rid, uint16_t seq);
+static void flood_clear(struct sr_if* iface);
+
+/* LSU propio: el cuerpo OSPF que se envía por todas las interfaces, armado
+   la última vez que cambiaron los enlaces */
+struct lsu_cache
+{
+    pthread_mutex_t lock;
+    uint8_t* ospf;                /* cabezal OSPF, cabezal LSU y LSAs */
+    unsigned int ospf_len;
+    unsigned long originated;     /* LSUs originados */
+    unsigned long changed;        /* de esos, cuantos con LSAs nuevos */
+};
+static struct lsu_cache g_lsu = { PTHREAD_MUTEX_INITIALIZER };
+
+/* Intercambio de bases con un vecino nuevo (DBD y LSR). Los contadores
+   solo los actualiza el hilo que procesa los paquetes */
+struct dbx_stats
+{
+    unsigned long dbd_sent;
+    unsigned long dbd_rcvd;
+    unsigned long lsr_sent;
+    unsigned long lsr_rcvd;
+    unsigned long lsa_requested;  /* LSAs pedidos en LSRs enviados */
+    unsigned long lsa_sent;       /* LSUs enviados por LSRs recibidos */
+};
+static struct dbx_stats g_dbx;
+
+/* Lo que entra de un DBD o LSR en un paquete: el que lo recibe lo copia
+   en powspf_rx_lsu_param */
+#define OSPF_MAX_BODY (sizeof(((powspf_rx_lsu_param_t*)0)->packet) - sizeof(sr_ethernet_hdr_t) - \
+                       sizeof(sr_ip_hdr_t) - sizeof(ospfv2_hdr_t))
+#define DBD_MAX_SUM ((OSPF_MAX_BODY - sizeof(ospfv2_dbd_hdr_t)) / sizeof(ospfv2_lsa_sum_t))
+#define LSR_MAX_REQ ((OSPF_MAX_BODY - sizeof(ospfv2_lsr_hdr_t)) / sizeof(uint32_t))
+#define LSACK_MAX ((OSPF_MAX_BODY - sizeof(ospfv2_lsack_hdr_t)) / sizeof(ospfv2_lsa_sum_t))
+
+/* Flooding confiable: un LSU enviado a un vecino se reenvía cada
+   LSU_RXMT_MS hasta que lo confirme. Los acks se demoran hasta
+   LSACK_DELAY_MS para juntar en un solo paquete los de una ráfaga */
+#define LSU_RXMT_MS     1000
+#define LSACK_DELAY_MS  200
+
+/* Un LSU enviado que el vecino todavía no confirmó */
+struct rxmt_entry
+{
+    uint32_t rid;                 /* router que originó el LSU */
+    uint16_t seq;
+    uint8_t* ospf;                /* cuerpo OSPF tal como se envió */
+    unsigned int ospf_len;
+    struct rxmt_entry* next;
+};
+
+/* Estado de flooding de una interfaz (y su vecino) */
+struct flood_iface
+{
+    struct sr_timer rxmt_timer;
+    struct sr_timer ack_timer;
+    struct sr_timer dbd_timer;    /* espera del DBD del vecino */
+    struct sr_instance* sr;
+    struct sr_if* iface;
+    struct rxmt_entry* rxmt;      /* LSUs sin confirmar */
+    uint32_t nrxmt;
+    ospfv2_lsa_sum_t* acks;       /* acks demorados, hasta LSACK_MAX */
+    uint32_t nacks;
+};
+
+struct flood_stats
+{
+    unsigned long retransmitted;  /* LSUs reenviados por falta de ack */
+    unsigned long acked;          /* confirmados con un LSAck */
+    unsigned long implied;        /* confirmados porque el vecino lo reenvió */
+    unsigned long ack_sent;       /* paquetes LSAck enviados */
+    unsigned long ack_lsas;       /* LSUs confirmados en ellos */
+    unsigned long ack_rcvd;       /* paquetes LSAck recibidos */
+};
+
+/* Un lock para las listas de todas las interfaces: las tocan los hilos de
+   LSU recibidos, el de los timers y el que procesa los paquetes */
+static pthread_mutex_t g_flood_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct flood_iface* g_flood;
+static uint32_t g_nflood;
+static struct flood_stats g_flood_stats;
+
 /*---------------------------------------------------------------------
  * Method: pwospf_init(..)
  *
@@ -85,7 +173,7 @@ int pwospf_init(struct sr_instance* sr)
     /* Inicializa el id del router como 0 (Luego sera modificado) */
     g_router_id.s_addr = 0;
 
-    /* Define la MAC de multicast a usar para los paquetes HELLO */
+    /* Define la MAC de multicast a usar para los paquetes HELLO y LSU */
     g_ospf_multicast_mac[0] = 0x01;
     g_ospf_multicast_mac[1] = 0x00;
     g_ospf_multicast_mac[2] = 0x5e;
@@ -107,10 +195,13 @@ int pwospf_init(struct sr_instance* sr)
     struct in_addr zero;
     zero.s_addr = 0;
     g_neighbors = create_ospfv2_neighbor(zero);
-    /* Agrega zero a la representacion de la topologia que guarda el router */
-    /* Topology guarda el registro de todos los routers en la topologia de red,
-    en una lista de topology entries */
-    g_topology = create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0);
+    /* Los vecinos vencen con un timer cada uno; al vencer se ajusta el
+    neighbor id en las interfaces */
+    set_neighbor_timeout_handler(neighbor_timeout, sr);
+    /* Topology guarda el ultimo LSA de cada router de la topologia de red,
+    en un hash por router ID. Cuando vence el de un router se corre
+    Dijkstra */
+    g_topology = pwospf_lsdb_create(topology_timeout, sr);
 
     /* Inicializa el hilo principal */
     if( pthread_create(&sr->ospf_subsys->thread, 0, pwospf_run_thread, sr)) { 
@@ -164,6 +255,10 @@ void* pwospf_run_thread(void* arg)
 
     struct sr_instance* sr = (struct sr_instance*)arg;
 
+    /* Listas de retransmisión y acks de cada interfaz. Van antes del
+    Router ID: hasta tenerlo no se procesan paquetes PWOSPF */
+    flood_init(sr);
+
     /* Set the ID of the router */
     while(g_router_id.s_addr == 0)
     {
@@ -184,6 +279,7 @@ void* pwospf_run_thread(void* arg)
 
     Debug("\nPWOSPF: Detecting the router interfaces and adding their networks to the routing table\n");
     struct sr_if* int_temp = sr->if_list;
+    pwospf_lock(sr->ospf_subsys);
     while(int_temp != NULL)
     {
         struct in_addr ip;
@@ -195,7 +291,7 @@ void* pwospf_run_thread(void* arg)
         struct in_addr network;
         network.s_addr = ip.s_addr & mask.s_addr;
 
-        if (check_route(sr, network) == 0)
+        if (sr_find_rt_entry(sr, network, mask, 1) == NULL)
         {
             Debug("-> PWOSPF: Adding the directly connected network [%s, ", inet_ntoa(network));
             Debug("%s] to the routing table\n", inet_ntoa(mask));
@@ -203,15 +299,19 @@ void* pwospf_run_thread(void* arg)
         }
         int_temp = int_temp->next;
     }
+    /* Solo cambia la capa de conectadas y dinámicas de la FIB */
+    sr_fib_update(sr);
+    pwospf_unlock(sr->ospf_subsys);
     
     Debug("\n-> PWOSPF: Printing the forwarding table\n");
     sr_print_routing_table(sr);
 
 
+    /* Primer LSU, para los vecinos que ya mandaron HELLOs */
+    pwospf_originate_lsu(sr, 1);
+
     pthread_create(&g_hello_packet_thread, NULL, send_hellos, sr);
     pthread_create(&g_all_lsu_thread, NULL, send_all_lsu, sr);
-    pthread_create(&g_neighbors_thread, NULL, check_neighbors_life, sr);
-    pthread_create(&g_topology_entries_thread, NULL, check_topology_entries_age, sr);
 
     return NULL;
 } /* -- run_ospf_thread -- */
@@ -234,7 +334,8 @@ void print_neighbors(struct sr_instance* sr)
     int i = 0;
     while (ngbr != NULL) {
         Debug("      [Neighbor ID = %s]\n", inet_ntoa(ngbr->neighbor_id));
-        Debug("         [State = %d]\n", ngbr->alive);    
+        Debug("         [Expires in = %d s]\n", ngbr->neighbor_id.s_addr == 0 ? 0 :
+              (int)((int64_t)(ngbr->timer.deadline - sr_timer_now()) / (int64_t)SR_TIMER_SEC));
         struct sr_if* iface = sr->if_list;
             while (iface != NULL) {
                 if (iface->neighbor_id == ngbr->neighbor_id.s_addr){
@@ -250,107 +351,52 @@ void print_neighbors(struct sr_instance* sr)
 }
 
 /*---------------------------------------------------------------------
- * Method: check_neighbors_life
+ * Method: neighbor_timeout
  *
- * Chequea si los vecinos están vivos
+ * Se llama cuando vence el timer de un vecino (no mandó HELLOs en
+ * OSPF_NEIGHBOR_TIMEOUT segundos), ya sacado de la lista de vecinos
  *
  *---------------------------------------------------------------------*/
 
-void* check_neighbors_life(void* arg)
+static void neighbor_timeout(struct in_addr neighbor_id, void* arg)
 {
     struct sr_instance* sr = (struct sr_instance*)arg;
 
-    /* Loop constante */
-    while (1){
-        /* Cada 1 segundo */
-        usleep(1000000);
-
-        /* Debug("Checking neighbors lives...\n"); */
-        /* Chequeo lista de vecinos */
-        /* Check Neighbors Alive recorre la lista de vecinos y elimina aquellos
-        vecinos que tienen tiempo de vida (restante) igual a 0. Si el tiempo de
-        vida no es igual a cero entonces lo decrementa en uno. */
-        /* Ahora retorna vecinos eliminados */
-        /* Tengan en cuenta que la lista es una copia y deben gestionar ustedes la memoria. */
-        struct ospfv2_neighbor* deleted_ngbrs = check_neighbors_alive(g_neighbors);
-
-        /* Si hay un cambio, se debe ajustar el neighbor id en la interfaz. */
-        while (deleted_ngbrs != NULL) {
-            /* Tomo el id del vecino */
-            uint32_t deleted_id = deleted_ngbrs->neighbor_id.s_addr;
-            /* Busco que interfaces tienen ese vecino y las actualizo */
-            struct sr_if* iface = sr->if_list;
-            while (iface != NULL) {
-                if (iface->neighbor_id == deleted_id){
-                    /* Seteo en 0 IP e Id */
-                    iface->neighbor_id = 0;
-                    iface->neighbor_ip = 0;
-
-                    /* Veo los vecinos */
-                    /* print_neighbors(sr); */
-                }         
-                /* Paso a la siguiente interfaz */
-                iface = iface->next;       
-            }
-            /* Paso al siguiente vecino eliminado */
-            deleted_ngbrs = deleted_ngbrs->next;
+    /* Busco que interfaces tienen ese vecino y las actualizo */
+    struct sr_if* iface = sr->if_list;
+    while (iface != NULL) {
+        if (iface->neighbor_id == neighbor_id.s_addr){
+            /* Seteo en 0 IP e Id */
+            iface->neighbor_id = 0;
+            iface->neighbor_ip = 0;
+            /* Lo que no confirmó ya no lo va a confirmar */
+            flood_clear(iface);
         }
-
-        /* Libero la memoria de la lista de vecinos eliminados */
-        free(deleted_ngbrs);
+        /* Paso a la siguiente interfaz */
+        iface = iface->next;
     }
-    return NULL;
-} /* -- check_neighbors_life -- */
+
+    /* El enlace quedó sin vecino: mi LSA cambió */
+    pwospf_originate_lsu(sr, 0);
+} /* -- neighbor_timeout -- */
 
 
 /*---------------------------------------------------------------------
- * Method: check_topology_entries_age
+ * Method: topology_timeout
  *
- * Check if the topology entries are alive 
- * and if they are not, remove them from the topology table
+ * Se llama cuando vence el LSA de un router (no llegaron LSUs suyos en
+ * OSPF_TOPO_ENTRY_TIMEOUT segundos), ya sacado de la topología
  *
  *---------------------------------------------------------------------*/
 
-void* check_topology_entries_age(void* arg)
+static void topology_timeout(struct pwospf_lsdb* topology, void* arg)
 {
     struct sr_instance* sr = (struct sr_instance*)arg;
-    /* Loop constante */
-    while (1){
-        /* Cada 1 segundo */
-        usleep(1000000);
 
-        /* Debug("Checking topology entries ages...\n"); */
-        /* Chequea el tiempo de vida de cada entrada de la topologia. */
-        /* Check Topology Age recorre la lista de topology entries y elimina 
-        aquellas entradas que tienen tiempo de vida igual al tiempo maximo. Si 
-        el tiempo de vida no es igual al maximo entonces lo aumenta en uno.
-        Retorna 1 si hubo alguna eliminacion */
-        u_int8_t change = check_topology_age(g_topology);
-        /* Si hay un cambio en la topología, se llama a la función de Dijkstra
-        en un nuevo hilo. */
-        if (change) {
-            dijkstra_param_t* dij = malloc(sizeof(dijkstra_param_t));
-            /* Almaceno las variables en la estructura para dijkstra */
-            dij->sr = sr;
-            dij->topology = g_topology;
-            dij->rid = g_router_id;
-            dij->mutex = g_dijkstra_mutex;
-            /* Llamo a la funcion en un nuevo hilo */
-            /* pthread_create crea un hilo nuevo para ejecutar la funcion que
-            se pasa como parametro (3er param). En el primer parametro se guarda
-            un puntero al identificador del proceso. El segundo parametro son arugumentos
-            que se pasan para crear el hilo (NULL pasa args por default). El ultimo parametro
-            son los parametros que recibe la funcion que se ejecuta en el hilo. */
-            pthread_create(&g_dijkstra_thread, NULL, run_dijkstra, dij);
-            
-            /* Se imprime la topología resultado del chequeo */
-            /* Debug("Printing the resulting topology table: \n");
-            print_topolgy_table(g_topology);
-            Debug("\n"); */
-        }
-    }
-    return NULL;
-} /* -- check_topology_entries_age -- */
+    /* El planificador junta este cambio con los que lleguen cerca
+    y corre Dijkstra una sola vez, en su propio hilo */
+    dijkstra_schedule(sr, topology, g_router_id);
+} /* -- topology_timeout -- */
 
 
 /*---------------------------------------------------------------------
@@ -501,7 +547,8 @@ void* send_hello_packet(void* arg)
 /*---------------------------------------------------------------------
  * Method: send_all_lsu
  *
- * Construye y envía LSUs cada 30 segundos
+ * Refresca el LSU propio cada OSPF_DEFAULT_LSUINT segundos, para que
+ * no venza en los demás routers aunque nada haya cambiado
  *
  *---------------------------------------------------------------------*/
 
@@ -514,171 +561,552 @@ void* send_all_lsu(void* arg)
         /* Se ejecuta cada OSPF_DEFAULT_LSUINT segundos */
         usleep(OSPF_DEFAULT_LSUINT * 1000000);
 
-        /* Bloqueo para evitar mezclar el envío de HELLOs y LSUs */
-        pwospf_lock(sr->ospf_subsys);
-        
-        /* Recorro las interfaces del router */
-        struct sr_if* iface = sr->if_list;  
-        while (iface != NULL) {
-        /* Si la interfaz tiene un vecino */
-            if (iface->neighbor_id != 0) {
-                    /* Envio un LSU */
-                    powspf_hello_lsu_param_t* lsu_param = malloc(sizeof(powspf_hello_lsu_param_t));
-                    lsu_param->sr = sr;
-                    lsu_param->interface = iface;
-                    /* Creo un hilo de ejecución para enviar el LSU */
-                    pthread_create(&g_lsu_thread, NULL, send_lsu, lsu_param);
-                    
-            }
-            /* Paso a la siguiente interfaz */
-            iface = iface->next;
-        }
-
-        /* Desbloqueo para poder seguir enviando HELLOs*/
-        pwospf_unlock(sr->ospf_subsys);
+        pwospf_originate_lsu(sr, 1);
     }
 
     return NULL;
 } /* -- send_all_lsu -- */
 
 /*---------------------------------------------------------------------
- * Method: send_lsu
+ * Method: build_local_lsas
  *
- * Construye y envía paquetes LSU a través de una interfaz específica
+ * Arma los LSAs de este router: uno por cada ruta estática o conectada
+ * de la tabla, con el id del vecino de su interfaz. Deja la cantidad en
+ * count; el arreglo lo libera quien llama.
  *
  *---------------------------------------------------------------------*/
 
-void* send_lsu(void* arg)
+static ospfv2_lsa_t* build_local_lsas(struct sr_instance* sr, uint32_t* count)
 {
-    /* La interfaz por la que se va a enviar el mensaje LSU viene por parametro */
-    powspf_hello_lsu_param_t* lsu_param = ((powspf_hello_lsu_param_t*)(arg));
-    struct sr_instance * sr = lsu_param->sr;
-    struct sr_if * iface = lsu_param->interface;
+    pwospf_lock(sr->ospf_subsys);
 
-    /* Solo envío LSUs si del otro lado hay un router*/
-    
-    /* Construyo el LSU */
-    /* Debug("\n\nPWOSPF: Constructing LSU packet\n"); */
-    
-    /* Cuento cantidad vecinos para poder calcular el tamanio de los paquetes */
     /* Count routes cuenta los nodos directamente conectados (los vecinos) y los estaticos */
-    int routes = count_routes(sr);
-    
-    uint8_t* lsu_packet = malloc(sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + routes*sizeof(ospfv2_lsa_t));
-    int packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + routes*sizeof(ospfv2_lsa_t);
-    int ospf_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + routes*sizeof(ospfv2_lsa_t);
+    uint32_t routes = count_routes(sr);
+    ospfv2_lsa_t* lsas = malloc((routes + 1) * sizeof(ospfv2_lsa_t));
+    uint32_t i = 0;
+
+    /* Creo cada LSA iterando en las entradas de la tabla */
+    struct sr_rt* rt_entry = sr->routing_table;
+    while (rt_entry != NULL && i < routes){
+        /* Solo envío entradas directamente conectadas y agregadas a mano*/
+        /* Creo LSA con subnet, mask y routerID (id del vecino de la interfaz)*/
+        if (rt_entry->admin_dst <= 1){ /*Si están estáticas o conectadas*/
+            struct sr_if* iface = sr_get_interface(sr, rt_entry->interface);
+            lsas[i].subnet = rt_entry->dest.s_addr;
+            lsas[i].mask = rt_entry->mask.s_addr;
+            lsas[i].rid = iface != NULL ? iface->neighbor_id : 0;
+            i++;
+        }
+        rt_entry = rt_entry->next;
+    }
+
+    pwospf_unlock(sr->ospf_subsys);
+
+    *count = i;
+    return lsas;
+} /* -- build_local_lsas -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_originate_lsu
+ *
+ * Origina el LSU de este router y lo envía por cada interfaz con vecino.
+ * El cuerpo OSPF (cabezal OSPF, cabezal LSU y LSAs) queda guardado en
+ * g_lsu: si los LSAs no cambiaron solo se le pone un número de secuencia
+ * nuevo, y por cada interfaz solo se arman los cabezales Ethernet e IP.
+ * Si los LSAs no cambiaron solo se envía con force (el refresco
+ * periódico o un vecino nuevo).
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_originate_lsu(struct sr_instance* sr, int force)
+{
+    /* Hasta que pwospf_run_thread elige el Router ID no hay LSU; ahí se
+    origina el primero */
+    if (g_router_id.s_addr == 0) {
+        return;
+    }
+
+    uint32_t nlsa;
+    ospfv2_lsa_t* lsas = build_local_lsas(sr, &nlsa);
+    unsigned int ospf_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + nlsa * sizeof(ospfv2_lsa_t);
+
+    pthread_mutex_lock(&g_lsu.lock);
+    int same = g_lsu.ospf != NULL && g_lsu.ospf_len == ospf_len &&
+               memcmp(g_lsu.ospf + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t), lsas,
+                      nlsa * sizeof(ospfv2_lsa_t)) == 0;
+    if (same && !force) {
+        /* Nada cambió en mis enlaces */
+        pthread_mutex_unlock(&g_lsu.lock);
+        free(lsas);
+        return;
+    }
+
+    if (!same) {
+        /* Cambiaron los enlaces: armo el cuerpo de nuevo */
+        free(g_lsu.ospf);
+        g_lsu.ospf = malloc(ospf_len);
+        g_lsu.ospf_len = ospf_len;
+
+        /* Inicializo cabezal de OSPF*/
+        ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)g_lsu.ospf;
+        ospf_hdr->version = OSPF_V2;
+        ospf_hdr->type = OSPF_TYPE_LSU;
+        ospf_hdr->len = htons(ospf_len);
+        ospf_hdr->aid = 0;
+        ospf_hdr->autype = 0;
+        ospf_hdr->audata = 0;
+
+        /* Seteo el TTL en 64 y el resto de los campos del cabezal de LSU */
+        ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(g_lsu.ospf + sizeof(ospfv2_hdr_t));
+        lsu_hdr->unused = 0;
+        lsu_hdr->ttl = 64;
+        /* Seteo el número de anuncios con la cantidad de LSAs */
+        lsu_hdr->num_adv = htonl(nlsa);
+        memcpy(g_lsu.ospf + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t), lsas, nlsa * sizeof(ospfv2_lsa_t));
+        g_lsu.changed++;
+
+        /* Mis enlaces también entran en Dijkstra: un vecino que aparece
+        o se va cambia los caminos aunque no llegue ningún LSU */
+        dijkstra_schedule(sr, g_topology, g_router_id);
+    }
+    free(lsas);
+
+    /* Seteo mi Router ID y el número de secuencia y avanzo; uno por LSU
+    originado, el mismo en todas las interfaces */
+    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)g_lsu.ospf;
+    ospf_hdr->rid = g_router_id.s_addr;
+    ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(g_lsu.ospf + sizeof(ospfv2_hdr_t));
+    lsu_hdr->seq = htons(g_sequence_num);
+    g_sequence_num++;
+    /* Calculo el checksum del paquete LSU */
+    ospf_hdr->csum = 0;
+    ospf_hdr->csum = ospfv2_cksum(ospf_hdr, ospf_len);
+    g_lsu.originated++;
+
+    Debug("-> PWOSPF: Originating LSU [Sequence = %d, LSAs = %u%s]\n", ntohs(lsu_hdr->seq), nlsa,
+          same ? ", refresh" : "");
+
+    /* Recorro las interfaces del router */
+    struct sr_if* iface = sr->if_list;
+    while (iface != NULL) {
+        /* Si la interfaz tiene un vecino */
+        if (iface->neighbor_id != 0) {
+            flood_send(sr, iface, g_lsu.ospf, g_lsu.ospf_len);
+        }
+        /* Paso a la siguiente interfaz */
+        iface = iface->next;
+    }
+    pthread_mutex_unlock(&g_lsu.lock);
+} /* -- pwospf_originate_lsu -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_print_stats
+ *
+ * Imprime los contadores del LSU propio (comando "ospf" del canal de
+ * control)
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_print_stats(FILE* out)
+{
+    pthread_mutex_lock(&g_lsu.lock);
+    fprintf(out, "router id: %s\n", inet_ntoa(g_router_id));
+    fprintf(out, "lsu: %lu originated, %lu with new LSAs, %lu refreshes\n", g_lsu.originated,
+            g_lsu.changed, g_lsu.originated - g_lsu.changed);
+    if (g_lsu.ospf != NULL)
+    {
+        ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(g_lsu.ospf + sizeof(ospfv2_hdr_t));
+        fprintf(out, "last lsu: sequence %u, %u LSAs, %u bytes\n", ntohs(lsu_hdr->seq),
+                (unsigned int)ntohl(lsu_hdr->num_adv), g_lsu.ospf_len);
+    }
+    pthread_mutex_unlock(&g_lsu.lock);
+    fprintf(out, "dbd: %lu sent, %lu received\n", g_dbx.dbd_sent, g_dbx.dbd_rcvd);
+    fprintf(out, "lsr: %lu sent for %lu LSAs, %lu received, %lu LSAs sent\n", g_dbx.lsr_sent,
+            g_dbx.lsa_requested, g_dbx.lsr_rcvd, g_dbx.lsa_sent);
+
+    pthread_mutex_lock(&g_flood_lock);
+    uint32_t i, pending = 0;
+    for (i = 0; i < g_nflood; i++) {
+        pending += g_flood[i].nrxmt;
+    }
+    fprintf(out, "flood: %u unacknowledged, %lu retransmitted, %lu acked, %lu implied acks\n", pending,
+            g_flood_stats.retransmitted, g_flood_stats.acked, g_flood_stats.implied);
+    fprintf(out, "lsack: %lu sent for %lu LSUs, %lu received\n", g_flood_stats.ack_sent,
+            g_flood_stats.ack_lsas, g_flood_stats.ack_rcvd);
+    pthread_mutex_unlock(&g_flood_lock);
+} /* -- pwospf_print_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: send_ospf
+ *
+ * Envía un cuerpo OSPF ya armado (LSU, DBD o LSR) a través de una
+ * interfaz específica, agregando los cabezales Ethernet e IP de esa
+ * interfaz. Como los HELLO,
+ * va a OSPF_AllSPFRouters con la MAC de multicast, así que no depende
+ * de ARP
+ *
+ *---------------------------------------------------------------------*/
+
+static void send_ospf(struct sr_instance* sr, struct sr_if* iface, const uint8_t* ospf, unsigned int ospf_len)
+{
+    unsigned int packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + ospf_len;
+    uint8_t* lsu_packet = malloc(packet_len);
 
     /* Inicializo cabezal Ethernet */
-    /* Dirección MAC destino la dejo para el final ya que hay que hacer ARP */
+    /* Dirección MAC destino: la de multicast de OSPF */
     sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) lsu_packet;
+    memcpy(eth_hdr->ether_dhost, g_ospf_multicast_mac, ETHER_ADDR_LEN);
     memcpy(eth_hdr->ether_shost, (uint8_t*) iface->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
     eth_hdr->ether_type = htons(ethertype_ip);
     /* Inicializo cabezal IP*/
-    /* La IP destino es la del vecino contectado a mi interfaz*/
+    /* La IP destino es la de multicast OSPF_AllSPFRouters */
     sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t*)((uint8_t*) eth_hdr + sizeof(sr_ethernet_hdr_t));
     ip_hdr->ip_tos = 0;
     ip_hdr->ip_ttl = 16;
     ip_hdr->ip_hl = 5;
     ip_hdr->ip_v = 4;
     ip_hdr->ip_off = 0;
-    ip_hdr->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + routes*sizeof(ospfv2_lsa_t));
+    ip_hdr->ip_len = htons(sizeof(sr_ip_hdr_t) + ospf_len);
     ip_hdr->ip_p = ip_protocol_ospfv2;
     ip_hdr->ip_src = iface->ip;
-    ip_hdr->ip_dst = iface->neighbor_ip;
+    ip_hdr->ip_dst = htonl(OSPF_AllSPFRouters);
     ip_hdr->ip_id = htons(count_ip_id++); /* REVISAR */
+    ip_hdr->ip_sum = 0;
     ip_hdr->ip_sum = ip_cksum(ip_hdr, ip_hdr->ip_hl*4);
-   
-    /* Inicializo cabezal de OSPF*/
-    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)((uint8_t*) ip_hdr + sizeof(sr_ip_hdr_t));
+
+    /* El cuerpo OSPF ya viene armado, con su checksum */
+    memcpy(lsu_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t), ospf, ospf_len);
+
+    /* Envía el paquete Ethernet */
+    sr_send_packet(sr, lsu_packet, packet_len, iface->name);
+
+    free(lsu_packet);
+} /* -- send_ospf -- */
+
+
+/* Cabezal OSPF de un paquete de len bytes originado por este router; el
+   checksum se calcula cuando está el resto */
+static void ospf_fill_hdr(uint8_t* ospf, uint8_t type, uint32_t rid, unsigned int len)
+{
+    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)ospf;
+
     ospf_hdr->version = OSPF_V2;
-    ospf_hdr->type = OSPF_TYPE_LSU;
-    ospf_hdr->len = htons(ospf_len);
-    ospf_hdr->rid = g_router_id.s_addr;
+    ospf_hdr->type = type;
+    ospf_hdr->len = htons(len);
+    ospf_hdr->rid = rid;
     ospf_hdr->aid = 0;
+    ospf_hdr->csum = 0;
     ospf_hdr->autype = 0;
     ospf_hdr->audata = 0;
-    ospf_hdr->csum = 0;
+}
 
-    /* Seteo el número de secuencia y avanzo*/
-    ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)((uint8_t*) ospf_hdr + sizeof(ospfv2_hdr_t));
-    lsu_hdr->seq = htons(g_sequence_num);
-    g_sequence_num++;
+/*---------------------------------------------------------------------
+ * Method: flood_init
+ *
+ * Crea el estado de flooding de cada interfaz, con sus timers
+ * desarmados
+ *
+ *---------------------------------------------------------------------*/
 
-    /* Seteo el TTL en 64 y el resto de los campos del cabezal de LSU */
-    lsu_hdr->unused = 0;
-    lsu_hdr->ttl = 64;
+static void rxmt_expired(struct sr_timer* t);
+static void ack_expired(struct sr_timer* t);
+static void dbd_expired(struct sr_timer* t);
 
-    /* Seteo el número de anuncios con la cantidad de rutas a enviar. Uso función count_routes */
-    lsu_hdr->num_adv = htonl(routes);
+static void flood_init(struct sr_instance* sr)
+{
+    struct sr_if* iface;
+    uint32_t n = 0;
 
-    /* Creo cada LSA iterando en las entradas de la tabla */
-    struct sr_rt* rt_entry = sr->routing_table;
-    int i = 0;
-    while (rt_entry != NULL){
-        /* Solo envío entradas directamente conectadas y agregadas a mano*/
-        /* Creo LSA con subnet, mask y routerID (id del vecino de la interfaz)*/
-        if (rt_entry->admin_dst <= 1){ /*Si están estáticas o conectadas*/
-            ospfv2_lsa_t* lsa_hdr = (ospfv2_lsa_t*)((uint8_t*)lsu_hdr + sizeof(ospfv2_lsu_hdr_t) + sizeof(ospfv2_lsa_t)*i);   
-            lsa_hdr->subnet = rt_entry->dest.s_addr;
-            lsa_hdr->mask = rt_entry->mask.s_addr;
-            lsa_hdr->rid = sr_get_interface(sr, rt_entry->interface)->neighbor_id;
-            i++;
+    for (iface = sr->if_list; iface != NULL; iface = iface->next) {
+        n++;
+    }
+    g_flood = calloc(n, sizeof(struct flood_iface));
+    g_nflood = n;
+
+    n = 0;
+    for (iface = sr->if_list; iface != NULL; iface = iface->next, n++) {
+        struct flood_iface* f = &g_flood[n];
+
+        sr_timer_init(&f->rxmt_timer, rxmt_expired, f);
+        sr_timer_init(&f->ack_timer, ack_expired, f);
+        sr_timer_init(&f->dbd_timer, dbd_expired, f);
+        f->sr = sr;
+        f->iface = iface;
+        f->acks = malloc(LSACK_MAX * sizeof(ospfv2_lsa_sum_t));
+    }
+} /* -- flood_init -- */
+
+static struct flood_iface* flood_find(struct sr_if* iface)
+{
+    uint32_t i;
+
+    for (i = 0; i < g_nflood; i++) {
+        if (g_flood[i].iface == iface) {
+            return &g_flood[i];
         }
-        rt_entry = rt_entry->next;
     }
+    return NULL;
+}
 
-    /* Calculo el checksum del paquete LSU */
-    ospf_hdr->csum = ospfv2_cksum(ospf_hdr, ospf_len);
+/* Saca de la lista los LSUs de rid con secuencia hasta seq; con el lock.
+   Devuelve cuántos sacó */
+static uint32_t rxmt_remove(struct flood_iface* f, uint32_t rid, uint16_t seq)
+{
+    struct rxmt_entry** pe = &f->rxmt;
+    uint32_t n = 0;
+
+    while (*pe != NULL) {
+        struct rxmt_entry* e = *pe;
+        if (e->rid == rid && OSPF_SEQ_CMP(seq, e->seq) >= 0) {
+            *pe = e->next;
+            free(e->ospf);
+            free(e);
+            f->nrxmt--;
+            n++;
+            continue;
+        }
+        pe = &e->next;
+    }
+    if (f->rxmt == NULL) {
+        sr_timer_cancel(&f->rxmt_timer);
+    }
+    return n;
+}
 
-    /* Verificar ARP y reenviar si corresponde (puede necesitar una solicitud ARP y esperar la respuesta) */
-    /* struct sr_arpentry *sr_arp_entry = sr_arpcache_lookup(&(sr->cache), next_hop_ip);
-    if (sr_arp_entry != NULL && sr_arp_entry->valid) {
-        sr_ethernet_hdr_t *eth_hdr = (sr_ethernet_hdr_t *)packet;
-        memcpy(eth_hdr->ether_dhost, sr_arp_entry->mac, ETHER_ADDR_LEN);
-        sr_send_packet(sr, packet, len, iface_name);
-        free(sr_arp_entry);
-    } else {
-        printf("No se encontró entrada ARP, enviando solicitud ARP\n");
-        sr_arpcache_queuereq(&(sr->cache), next_hop_ip, packet, len, iface_name);
-    } */
-
-    /* Verificar ARP y reenviar si corresponde (puede necesitar una solicitud ARP y esperar la respuesta) */
-    /* Obtengo la IP del proximo salto de la IP del vecino en la interfaz */
-    struct in_addr next_hop_ip; 
-    next_hop_ip.s_addr = iface->neighbor_ip;
-    Debug("NEXT HOP IP DE LA QUE QUIERO ARP: %s\n", inet_ntoa(next_hop_ip));
-
-    /* Busca en la ARP cache si ya hay una direccion MAC para la IP del proximo salto */
-    struct sr_arpentry *arp_entry = sr_arpcache_lookup(&(sr->cache), next_hop_ip.s_addr);
-
-    /* Si la entrada no es nula y es valida, reenvio el paquete */
-    if (arp_entry != NULL && arp_entry->valid)
-    {
-    printf("OSPF -> Next hop IP is in ARP cache.\n");
-    /* Seteo ahora si la MAC de destino */
-    memcpy(eth_hdr->ether_dhost, arp_entry->mac, ETHER_ADDR_LEN);
-    /* Envia el paquete Ethernet */
-    printf("OSPF -> Ethernet packet is ready to send.\n");
-    sr_send_packet(sr, lsu_packet, packet_len, iface->name);
-    printf("OSPF -> Ethernet packet sent.\n");
-    /* Libera la memoria del paquete (Es el mismo que se recibio en un principio) */
-    free(arp_entry);
+/*---------------------------------------------------------------------
+ * Method: flood_send
+ *
+ * Envía un LSU por la interfaz y, si tiene vecino, lo deja en su lista
+ * de retransmisión hasta que lo confirme. Un LSU nuevo del mismo router
+ * reemplaza al que estaba esperando.
+ *
+ *---------------------------------------------------------------------*/
+
+static void flood_send(struct sr_instance* sr, struct sr_if* iface, const uint8_t* ospf, unsigned int ospf_len)
+{
+    struct flood_iface* f = flood_find(iface);
+    ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(ospf + sizeof(ospfv2_hdr_t));
+
+    send_ospf(sr, iface, ospf, ospf_len);
+
+    if (f == NULL || iface->neighbor_id == 0) {
+        return;
     }
-    /* Si no se encontro una entrada para la IP del proximo salto en la cache ARP */
-    else
-    {
-    printf("***** -> Next hop IP is not in ARP cache.\n");
-    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip.s_addr, lsu_packet, packet_len, iface->name);
-    printf("***** -> Handle ARP request.\n");
-    handle_arpreq(sr, req);
+
+    struct rxmt_entry* e = malloc(sizeof(struct rxmt_entry));
+    e->rid = ((ospfv2_hdr_t*)ospf)->rid;
+    e->seq = ntohs(lsu_hdr->seq);
+    e->ospf = malloc(ospf_len);
+    memcpy(e->ospf, ospf, ospf_len);
+    e->ospf_len = ospf_len;
+
+    pthread_mutex_lock(&g_flood_lock);
+    rxmt_remove(f, e->rid, e->seq);
+    e->next = f->rxmt;
+    f->rxmt = e;
+    f->nrxmt++;
+    if (!sr_timer_armed(&f->rxmt_timer)) {
+        sr_timer_arm(&f->rxmt_timer, sr_timer_now() + LSU_RXMT_MS * 1000000ULL);
     }
+    pthread_mutex_unlock(&g_flood_lock);
+} /* -- flood_send -- */
 
-    free(lsu_packet);
-    free(lsu_param);
+/* Vence el timer de retransmisión: reenvío lo que sigue sin confirmar */
+static void rxmt_expired(struct sr_timer* t)
+{
+    struct flood_iface* f = t->arg;
+    struct rxmt_entry* e;
 
-    return NULL;
-} /* -- send_lsu -- */
+    pthread_mutex_lock(&g_flood_lock);
+    if (sr_timer_armed(t)) {
+        pthread_mutex_unlock(&g_flood_lock);
+        return;
+    }
+    for (e = f->rxmt; e != NULL; e = e->next) {
+        send_ospf(f->sr, f->iface, e->ospf, e->ospf_len);
+        g_flood_stats.retransmitted++;
+    }
+    if (f->rxmt != NULL) {
+        Debug("-> PWOSPF: Retransmitting %u LSUs on interface %s\n", f->nrxmt, f->iface->name);
+        sr_timer_arm(t, sr_timer_now() + LSU_RXMT_MS * 1000000ULL);
+    }
+    pthread_mutex_unlock(&g_flood_lock);
+}
 
+/* Envía en un LSAck los acks demorados de la interfaz; con el lock */
+static void ack_flush(struct flood_iface* f)
+{
+    unsigned int ospf_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsack_hdr_t) + f->nacks * sizeof(ospfv2_lsa_sum_t);
+    uint8_t* ospf = malloc(ospf_len);
+
+    ospf_fill_hdr(ospf, OSPF_TYPE_LSACK, g_router_id.s_addr, ospf_len);
+    ospfv2_lsack_hdr_t* ack_hdr = (ospfv2_lsack_hdr_t*)(ospf + sizeof(ospfv2_hdr_t));
+    ack_hdr->num_ack = htonl(f->nacks);
+    memcpy(ospf + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsack_hdr_t), f->acks, f->nacks * sizeof(ospfv2_lsa_sum_t));
+    ((ospfv2_hdr_t*)ospf)->csum = ospfv2_cksum((ospfv2_hdr_t*)ospf, ospf_len);
+
+    send_ospf(f->sr, f->iface, ospf, ospf_len);
+    free(ospf);
+
+    g_flood_stats.ack_sent++;
+    g_flood_stats.ack_lsas += f->nacks;
+    f->nacks = 0;
+    sr_timer_cancel(&f->ack_timer);
+}
+
+static void ack_expired(struct sr_timer* t)
+{
+    struct flood_iface* f = t->arg;
+
+    pthread_mutex_lock(&g_flood_lock);
+    if (!sr_timer_armed(t) && f->nacks > 0) {
+        ack_flush(f);
+    }
+    pthread_mutex_unlock(&g_flood_lock);
+}
+
+/*---------------------------------------------------------------------
+ * Method: flood_ack
+ *
+ * Llegó por la interfaz un LSU de rid con secuencia seq. Si yo le había
+ * enviado ese LSU (o uno más viejo) al vecino, que me lo mande vale como
+ * confirmación. Además se lo confirmo, nuevo o repetido, en el próximo
+ * LSAck de la interfaz.
+ *
+ *---------------------------------------------------------------------*/
+
+static void flood_ack(struct sr_if* iface, uint32_t rid, uint16_t seq)
+{
+    struct flood_iface* f = flood_find(iface);
+
+    if (f == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_flood_lock);
+    g_flood_stats.implied += rxmt_remove(f, rid, seq);
+
+    f->acks[f->nacks].rid = rid;
+    f->acks[f->nacks].seq = htons(seq);
+    f->acks[f->nacks].padding = 0;
+    f->nacks++;
+    if (f->nacks == LSACK_MAX) {
+        ack_flush(f);
+    }
+    else if (!sr_timer_armed(&f->ack_timer)) {
+        sr_timer_arm(&f->ack_timer, sr_timer_now() + LSACK_DELAY_MS * 1000000ULL);
+    }
+    pthread_mutex_unlock(&g_flood_lock);
+} /* -- flood_ack -- */
+
+/* El vecino de la interfaz se fue: descarto lo pendiente */
+static void flood_clear(struct sr_if* iface)
+{
+    struct flood_iface* f = flood_find(iface);
+
+    if (f == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_flood_lock);
+    while (f->rxmt != NULL) {
+        struct rxmt_entry* e = f->rxmt;
+        f->rxmt = e->next;
+        free(e->ospf);
+        free(e);
+    }
+    f->nrxmt = 0;
+    f->nacks = 0;
+    sr_timer_cancel(&f->rxmt_timer);
+    sr_timer_cancel(&f->ack_timer);
+    sr_timer_cancel(&f->dbd_timer);
+    pthread_mutex_unlock(&g_flood_lock);
+}
+
+/*---------------------------------------------------------------------
+ * Method: dbd_start
+ *
+ * Vecino nuevo en la interfaz: el intercambio de bases lo empieza el de
+ * Router ID más alto con un DBD con OSPF_DBD_F_INIT y el otro solo
+ * contesta. El de ID más bajo espera el DBD un HELLOINT y, si no llega
+ * (el vecino no se enteró de que me reinicié, o se perdió), lo empieza
+ * él.
+ *
+ *---------------------------------------------------------------------*/
+
+static void dbd_start(struct sr_instance* sr, struct sr_if* iface, uint32_t neighbor_id)
+{
+    struct flood_iface* f = flood_find(iface);
+
+    if (f == NULL || ntohl(g_router_id.s_addr) > ntohl(neighbor_id)) {
+        send_dbd(sr, iface, OSPF_DBD_F_INIT);
+        return;
+    }
+
+    pthread_mutex_lock(&g_flood_lock);
+    sr_timer_arm(&f->dbd_timer, sr_timer_now() + OSPF_DEFAULT_HELLOINT * SR_TIMER_SEC);
+    pthread_mutex_unlock(&g_flood_lock);
+} /* -- dbd_start -- */
+
+/* Llegó un DBD por la interfaz: ya no lo espero */
+static void dbd_received(struct sr_if* iface)
+{
+    struct flood_iface* f = flood_find(iface);
+
+    if (f == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_flood_lock);
+    sr_timer_cancel(&f->dbd_timer);
+    pthread_mutex_unlock(&g_flood_lock);
+}
+
+static void dbd_expired(struct sr_timer* t)
+{
+    struct flood_iface* f = t->arg;
+    int start;
+
+    pthread_mutex_lock(&g_flood_lock);
+    start = !sr_timer_armed(t) && f->iface->neighbor_id != 0;
+    pthread_mutex_unlock(&g_flood_lock);
+
+    if (start) {
+        Debug("-> PWOSPF: No database description on %s, starting the exchange\n", f->iface->name);
+        send_dbd(f->sr, f->iface, OSPF_DBD_F_INIT);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_pwospf_lsack_packet
+ *
+ * Saca de la lista de retransmisión de la interfaz los LSUs que el
+ * vecino confirma
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_handle_pwospf_lsack_packet(struct sr_instance* sr, uint8_t* packet, struct sr_pkt_desc* desc)
+{
+    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)(packet + desc->l4_off);
+    ospfv2_lsack_hdr_t* ack_hdr = (ospfv2_lsack_hdr_t*)(packet + desc->l4_off + sizeof(ospfv2_hdr_t));
+    unsigned int ospf_len = ntohs(ospf_hdr->len);
+    struct flood_iface* f = flood_find(desc->in_if);
+
+    if (f == NULL || ospf_len < sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsack_hdr_t) ||
+        ntohl(ack_hdr->num_ack) > (ospf_len - sizeof(ospfv2_hdr_t) - sizeof(ospfv2_lsack_hdr_t)) / sizeof(ospfv2_lsa_sum_t)) {
+        return;
+    }
+
+    uint32_t n = ntohl(ack_hdr->num_ack), i;
+    ospfv2_lsa_sum_t* acks = (ospfv2_lsa_sum_t*)((uint8_t*)ack_hdr + sizeof(ospfv2_lsack_hdr_t));
+
+    pthread_mutex_lock(&g_flood_lock);
+    g_flood_stats.ack_rcvd++;
+    for (i = 0; i < n; i++) {
+        g_flood_stats.acked += rxmt_remove(f, acks[i].rid, ntohs(acks[i].seq));
+    }
+    pthread_mutex_unlock(&g_flood_lock);
+} /* -- sr_handle_pwospf_lsack_packet -- */
 
 /*---------------------------------------------------------------------
  * Method: sr_handle_pwospf_hello_packet
@@ -687,20 +1115,20 @@ void* send_lsu(void* arg)
  *
  *---------------------------------------------------------------------*/
 
-void sr_handle_pwospf_hello_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_if* rx_if)
+void sr_handle_pwospf_hello_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_pkt_desc* desc)
 {
     /* Obtengo información del paquete recibido */
-    /* Tomo el cabezal IP */
-    sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+    /* La interfaz de entrada y los offsets vienen en el descriptor */
+    struct sr_if* rx_if = desc->in_if;
     /* Tomo el cabezal PWOSPF */
-    ospfv2_hdr_t* pwospf_hdr = (ospfv2_hdr_t*) (packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+    ospfv2_hdr_t* pwospf_hdr = (ospfv2_hdr_t*) (packet + desc->l4_off);
     /* Y el cabezal HELLO */
-    ospfv2_hello_hdr_t* hello_hdr = (ospfv2_hello_hdr_t*) (packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t));
+    ospfv2_hello_hdr_t* hello_hdr = (ospfv2_hello_hdr_t*) (packet + desc->l4_off + sizeof(ospfv2_hdr_t));
 
     struct in_addr neighbor_id;
     neighbor_id.s_addr = pwospf_hdr->rid;
     struct in_addr neighbor_ip;
-    neighbor_ip.s_addr = ip_hdr->ip_src;
+    neighbor_ip.s_addr = desc->src;
     struct in_addr net_mask;
     net_mask.s_addr = hello_hdr->nmask;
     /* Imprimo info del paquete recibido*/
@@ -709,9 +1137,9 @@ void sr_handle_pwospf_hello_packet(struct sr_instance* sr, uint8_t* packet, unsi
     Debug("      [Neighbor IP = %s]\n", inet_ntoa(neighbor_ip));
     Debug("      [Network Mask = %s]\n", inet_ntoa(net_mask));
  */
-    /* Chequeo checksum */
-    if (ospfv2_cksum(pwospf_hdr, sizeof(ospfv2_hdr_t)) == pwospf_hdr->csum) {
-        /* Debug("-> PWOSPF: HELLO Packet dropped, invalid checksum\n"); */
+    /* El checksum ya lo verifico el parser; solo falta el largo del HELLO */
+    if (desc->l4_len < sizeof(ospfv2_hdr_t) + sizeof(ospfv2_hello_hdr_t)) {
+        /* Debug("-> PWOSPF: HELLO Packet dropped, too short\n"); */
         return;
     }
     /* Chequeo de la máscara de red */
@@ -730,30 +1158,29 @@ void sr_handle_pwospf_hello_packet(struct sr_instance* sr, uint8_t* packet, unsi
     }
     /* Debug("-> PWOSPF: Valid HELLO Packet.\n"); */
     /* Si es un nuevo vecino */
+    int changed = 0;
     if (rx_if->neighbor_id != neighbor_id.s_addr || rx_if->neighbor_ip != neighbor_ip.s_addr) {
     /* Seteo el vecino en la interfaz por donde llegó */
     rx_if->neighbor_id = neighbor_id.s_addr;
     rx_if->neighbor_ip = neighbor_ip.s_addr;
+    changed = 1;
     }
     /* Actualizo la lista de vecinos */
     /* Refresh neighbors alive recorre la lista de vecinos buscando el vecino que se 
     indica por id. Si lo encuentra actualiza el tiempo de vida, si no lo agrega a la
-    lista de vecinos */
-    refresh_neighbors_alive(g_neighbors, neighbor_id);
-    /* Debo enviar LSUs por todas mis interfaces */
-    struct sr_if* iface = sr->if_list;
-    /* Recorro todas las interfaces para enviar el paquete LSU */
-    while (iface != NULL) {
-        /* Si la interfaz tiene un vecino, envío un LSU */
-        if (iface->neighbor_id != 0) {
-            powspf_hello_lsu_param_t* lsu_param = malloc(sizeof(powspf_hello_lsu_param_t));;
-            lsu_param->interface = iface;
-            lsu_param->sr = sr;
-            pthread_create(&g_lsu_thread, NULL, send_lsu, lsu_param);
-        }
-        /* Paso a la siguiente interfaz */
-        iface = iface->next;
-    } 
+    lista de vecinos (y retorna 1) */
+    int new_neighbor = refresh_neighbors_alive(g_neighbors, neighbor_id);
+    /* Solo si cambió el estado de mis enlaces origino un LSU nuevo y lo
+    envío por todas mis interfaces. A un vecino nuevo se lo envío aunque
+    no haya cambiado, todavía no lo tiene */
+    if (changed || new_neighbor) {
+        pwospf_originate_lsu(sr, new_neighbor);
+    }
+    /* Y nos pasamos los resúmenes de las bases, para pedir lo que falta
+    sin esperar los refrescos de cada router */
+    if (new_neighbor) {
+        dbd_start(sr, rx_if, neighbor_id.s_addr);
+    }
 
    /* Veo los vecinos */
     /* print_neighbors(sr); */
@@ -776,7 +1203,6 @@ void* sr_handle_pwospf_lsu_packet(void* arg)
     struct sr_instance* sr = rx_lsu_param->sr;
     uint8_t* packet = rx_lsu_param->packet;
     struct sr_if* rx_if = rx_lsu_param->rx_if;
-    unsigned int length = rx_lsu_param->length;
     sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
     struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
     /* struct in_addr addr_ip;
@@ -787,32 +1213,43 @@ void* sr_handle_pwospf_lsu_packet(void* arg)
     /* Imprimo info del paquete recibido*/
     /* Debug("-> PWOSPF: Detecting LSU Packet from [Neighbor ID = %s, IP = %s]\n", inet_ntoa(addr_id), inet_ntoa(addr_ip)); */
     
-    /* Chequeo checksum */
+    /* El checksum ya lo verifico el parser antes de copiar el paquete;
+       solo chequeo que entren los LSA anunciados */
     uint16_t ospf_len = ntohs(ospf_hdr->len);
-    uint16_t new_cksum = ospfv2_cksum(ospf_hdr, ospf_len);
-    if (new_cksum != ospf_hdr->csum){
-        /* Debug("-> PWOSPF: LSU Packet dropped, invalid checksum\n"); */
+    ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t));
+    if (ospf_len < sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) ||
+        ntohl(lsu_hdr->num_adv) > (ospf_len - sizeof(ospfv2_hdr_t) - sizeof(ospfv2_lsu_hdr_t)) / sizeof(ospfv2_lsa_t)) {
+        /* Debug("-> PWOSPF: LSU Packet dropped, invalid length\n"); */
+        free(rx_lsu_param);
         return NULL;
     }
 
+    /* Confirmo el LSU al vecino aunque después lo descarte (mío o
+    repetido); si no, lo seguiría reenviando */
+    flood_ack(rx_if, ospf_hdr->rid, ntohs(lsu_hdr->seq));
+
     /* Obtengo el Router ID del router originario del LSU y chequeo si no es mío*/
     struct in_addr origin_router_id;
     origin_router_id.s_addr = ospf_hdr->rid;
     if (origin_router_id.s_addr == g_router_id.s_addr){
         /* Debug("-> PWOSPF: LSU Packet dropped, originated by this router\n"); */
+        free(rx_lsu_param);
         return NULL;
     }
 
     /* Chequeo numero de secuencia */
-    ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t));
     uint16_t sequence_num = ntohs(lsu_hdr->seq);
     if(check_sequence_number(g_topology, origin_router_id, sequence_num) == 0){
         /* Debug("-> PWOSPF: LSU Packet dropped, repeated sequence number\n"); */
+        free(rx_lsu_param);
         return NULL;
     }
     
-    /* Itero en los LSA que forman parte del LSU. Para cada uno, actualizo la topología.*/
+    /* Itero en los LSA que forman parte del LSU y armo con ellos el nuevo LSA
+    del router, que reemplaza entero al anterior.*/
     /* Debug("-> PWOSPF: Processing LSAs and updating topology table\n"); */
+    struct pwospf_lsa* new_lsa = pwospf_lsa_create(origin_router_id, sequence_num, ntohl(lsu_hdr->num_adv),
+                                                   (uint8_t*)ospf_hdr, ospf_len);
 
     /* Puntero inicial para el primer LSA después de las cabeceras */
     uint8_t* lsa_ptr = packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t);
@@ -839,51 +1276,49 @@ void* sr_handle_pwospf_lsu_packet(void* arg)
         Debug("     [Next HOP IP = %s]\n", inet_ntoa(next_hop));
         Debug("     [Sequence number = %d]\n", sequence_num);
         Debug("\n"); */
-        /* LLamo a refresh_topology_entry*/
-        refresh_topology_entry(g_topology, origin_router_id, net_num, net_mask, neighbor_id, next_hop, sequence_num);
+        /* Agrego el enlace al nuevo LSA */
+        new_lsa->links[i].net_num = net_num;
+        new_lsa->links[i].net_mask = net_mask;
+        new_lsa->links[i].neighbor_id = neighbor_id;
+        new_lsa->links[i].next_hop = next_hop;
     
         /* Aumento en 1 */
         i++;
     }
+
+    /* Reemplazo el LSA del router. Si mientras tanto se instalo uno igual
+    o mas nuevo (otro hilo con el mismo LSU), lo descarto y no lo reenvio */
+    if (pwospf_lsdb_install(g_topology, new_lsa) == 0) {
+        free(rx_lsu_param);
+        return NULL;
+    }
     
     /* Imprimo la topología */
-    Debug("\n-> PWOSPF: Printing the topology table\n");
-    print_topolgy_table(g_topology);
+    if (sr_log_enabled(sr_sub_ospf, SR_LOG_DEBUG))
+    {
+        Debug("\n-> PWOSPF: Printing the topology table\n");
+        print_topolgy_table(g_topology);
+    }
 
-    /* Ejecuto Dijkstra en un nuevo hilo (run_dijkstra)*/
-    dijkstra_param_t* dij_param = (dijkstra_param_t*)(malloc(sizeof(dijkstra_param_t)));
-    dij_param->sr = sr;
-    dij_param->topology = g_topology;
-    pthread_create(&g_dijkstra_thread, NULL, run_dijkstra, dij_param);
+    /* Pido una corrida de Dijkstra; una rafaga de LSUs termina en una sola */
+    dijkstra_schedule(sr, g_topology, g_router_id);
 
     /* Chequeo TTL y me fijo si corresponde reenvio */
     lsu_hdr->ttl--;
     if (lsu_hdr->ttl <= 0) {
+        free(rx_lsu_param);
         return NULL;
     }
 
-    /* Flooding del LSU por todas las interfaces menos por donde me llegó */
+    /* El TTL cambió: checksum OSPF de nuevo */
+    ospf_hdr->csum = ospfv2_cksum(ospf_hdr, ospf_len);
+
+    /* Flooding del LSU por todas las interfaces menos por donde me llegó,
+    cada vecino hasta que lo confirme */
     struct sr_if* iface = sr->if_list;
     while (iface) {
-        if (strcmp(iface->name, rx_if->name) != 0 && iface->neighbor_id != 0) {
-            
-            /* Seteo MAC de origen */
-            i = 0;
-            while (i < ETHER_ADDR_LEN) {
-                ((sr_ethernet_hdr_t*)(packet))->ether_shost[i] = iface->addr[i];
-                i++;
-            }
-
-            /* Ajusto paquete IP, origen y checksum*/
-            ip_hdr->ip_src = iface->ip;
-            ip_hdr->ip_sum = ip_cksum(ip_hdr, sizeof(sr_ip_hdr_t));
-
-            /* checksum OSPF */
-            ospf_hdr->csum = ospfv2_cksum(ospf_hdr, htons(ospf_hdr->len));
-            
-
-            /* Envío el paquete*/
-            sr_send_packet(sr, packet, length, iface->name);
+        if (iface != rx_if && iface->neighbor_id != 0) {
+            flood_send(sr, iface, (uint8_t*)ospf_hdr, ospf_len);
         }
         iface = iface->next;
     }
@@ -893,6 +1328,228 @@ void* sr_handle_pwospf_lsu_packet(void* arg)
     return NULL;
 } /* -- sr_handle_pwospf_lsu_packet -- */
 
+/*---------------------------------------------------------------------
+ * Method: send_dbd
+ *
+ * Envía por la interfaz un resumen de la base (Router ID y número de
+ * secuencia de cada LSA, incluido el mío), en tantos DBD como haga
+ * falta. Con OSPF_DBD_F_INIT en el primero el vecino contesta con el
+ * suyo.
+ *
+ *---------------------------------------------------------------------*/
+
+static void send_dbd(struct sr_instance* sr, struct sr_if* iface, uint8_t flags)
+{
+    ospfv2_lsa_sum_t* sums;
+    uint32_t n = 0, i;
+
+    /* Junto los resúmenes con la base tomada y la suelto antes de enviar */
+    pwospf_lsdb_lock(g_topology);
+    sums = malloc((g_topology->nrouters + 1) * sizeof(ospfv2_lsa_sum_t));
+    for (i = 0; i <= g_topology->mask; i++) {
+        struct pwospf_lsdb_router* r;
+        for (r = g_topology->buckets[i]; r != NULL; r = r->next) {
+            sums[n].rid = r->router_id.s_addr;
+            sums[n].seq = htons(r->lsa->sequence_num);
+            sums[n].padding = 0;
+            n++;
+        }
+    }
+    pwospf_lsdb_unlock(g_topology);
+
+    /* Y el mío, el último que originé */
+    pthread_mutex_lock(&g_lsu.lock);
+    if (g_lsu.ospf != NULL) {
+        ospfv2_lsu_hdr_t* lsu_hdr = (ospfv2_lsu_hdr_t*)(g_lsu.ospf + sizeof(ospfv2_hdr_t));
+        sums[n].rid = g_router_id.s_addr;
+        sums[n].seq = lsu_hdr->seq;
+        sums[n].padding = 0;
+        n++;
+    }
+    pthread_mutex_unlock(&g_lsu.lock);
+
+    /* Aunque la base esté vacía va un DBD, el vecino puede tener que
+    contestar. Solo el primero lleva INIT */
+    i = 0;
+    do {
+        uint32_t cnt = n - i < DBD_MAX_SUM ? n - i : DBD_MAX_SUM;
+        unsigned int ospf_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_dbd_hdr_t) + cnt * sizeof(ospfv2_lsa_sum_t);
+        uint8_t* ospf = malloc(ospf_len);
+
+        ospf_fill_hdr(ospf, OSPF_TYPE_DBD, g_router_id.s_addr, ospf_len);
+        ospfv2_dbd_hdr_t* dbd_hdr = (ospfv2_dbd_hdr_t*)(ospf + sizeof(ospfv2_hdr_t));
+        dbd_hdr->flags = flags;
+        dbd_hdr->unused = 0;
+        dbd_hdr->padding = 0;
+        dbd_hdr->num_sum = htonl(cnt);
+        memcpy(ospf + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_dbd_hdr_t), sums + i, cnt * sizeof(ospfv2_lsa_sum_t));
+        ((ospfv2_hdr_t*)ospf)->csum = ospfv2_cksum((ospfv2_hdr_t*)ospf, ospf_len);
+
+        send_ospf(sr, iface, ospf, ospf_len);
+        free(ospf);
+        g_dbx.dbd_sent++;
+
+        flags &= ~OSPF_DBD_F_INIT;
+        i += cnt;
+    } while (i < n);
+
+    Debug("-> PWOSPF: Sending database description [Interface = %s, LSAs = %u]\n", iface->name, n);
+    free(sums);
+} /* -- send_dbd -- */
+
+/*---------------------------------------------------------------------
+ * Method: send_lsr
+ *
+ * Pide por la interfaz los LSAs de los routers de req
+ *
+ *---------------------------------------------------------------------*/
+
+static void send_lsr(struct sr_instance* sr, struct sr_if* iface, const uint32_t* req, uint32_t n)
+{
+    uint32_t i = 0;
+
+    while (i < n) {
+        uint32_t cnt = n - i < LSR_MAX_REQ ? n - i : LSR_MAX_REQ;
+        unsigned int ospf_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsr_hdr_t) + cnt * sizeof(uint32_t);
+        uint8_t* ospf = malloc(ospf_len);
+
+        ospf_fill_hdr(ospf, OSPF_TYPE_LSR, g_router_id.s_addr, ospf_len);
+        ospfv2_lsr_hdr_t* lsr_hdr = (ospfv2_lsr_hdr_t*)(ospf + sizeof(ospfv2_hdr_t));
+        lsr_hdr->num_req = htonl(cnt);
+        memcpy(ospf + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsr_hdr_t), req + i, cnt * sizeof(uint32_t));
+        ((ospfv2_hdr_t*)ospf)->csum = ospfv2_cksum((ospfv2_hdr_t*)ospf, ospf_len);
+
+        send_ospf(sr, iface, ospf, ospf_len);
+        free(ospf);
+        g_dbx.lsr_sent++;
+        g_dbx.lsa_requested += cnt;
+        i += cnt;
+    }
+} /* -- send_lsr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_pwospf_dbd_packet
+ *
+ * Compara el resumen del vecino con la base y le pide los LSAs que no
+ * tengo o que tengo más viejos. Si trae un LSA mío más nuevo que el
+ * último que originé (de antes de reiniciar), sigo la secuencia desde
+ * ahí; si no, los demás descartarían mis LSUs hasta que ese venza.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_handle_pwospf_dbd_packet(struct sr_instance* sr, uint8_t* packet, struct sr_pkt_desc* desc)
+{
+    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)(packet + desc->l4_off);
+    ospfv2_dbd_hdr_t* dbd_hdr = (ospfv2_dbd_hdr_t*)(packet + desc->l4_off + sizeof(ospfv2_hdr_t));
+    unsigned int ospf_len = ntohs(ospf_hdr->len);
+
+    /* El parser ya verificó el largo OSPF; falta que entren los resúmenes */
+    if (ospf_len < sizeof(ospfv2_hdr_t) + sizeof(ospfv2_dbd_hdr_t) ||
+        ntohl(dbd_hdr->num_sum) > (ospf_len - sizeof(ospfv2_hdr_t) - sizeof(ospfv2_dbd_hdr_t)) / sizeof(ospfv2_lsa_sum_t)) {
+        return;
+    }
+    g_dbx.dbd_rcvd++;
+    dbd_received(desc->in_if);
+
+    uint32_t n = ntohl(dbd_hdr->num_sum);
+    ospfv2_lsa_sum_t* sums = (ospfv2_lsa_sum_t*)((uint8_t*)dbd_hdr + sizeof(ospfv2_dbd_hdr_t));
+    uint32_t* req = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t nreq = 0, i;
+    int reoriginate = 0;
+
+    for (i = 0; i < n; i++) {
+        struct in_addr rid;
+        uint16_t seq = ntohs(sums[i].seq);
+
+        rid.s_addr = sums[i].rid;
+        if (rid.s_addr == g_router_id.s_addr) {
+            pthread_mutex_lock(&g_lsu.lock);
+            if (OSPF_SEQ_CMP(seq, g_sequence_num) >= 0) {
+                g_sequence_num = seq + 1;
+                reoriginate = 1;
+            }
+            pthread_mutex_unlock(&g_lsu.lock);
+        }
+        else if (check_sequence_number(g_topology, rid, seq)) {
+            req[nreq++] = rid.s_addr;
+        }
+    }
+
+    Debug("-> PWOSPF: Database description from %s [LSAs = %u, requesting %u%s]\n",
+          desc->in_if->name, n, nreq, reoriginate ? ", own LSA is stale" : "");
+
+    if (nreq > 0) {
+        send_lsr(sr, desc->in_if, req, nreq);
+    }
+    free(req);
+
+    if (dbd_hdr->flags & OSPF_DBD_F_INIT) {
+        send_dbd(sr, desc->in_if, 0);
+    }
+    if (reoriginate) {
+        pwospf_originate_lsu(sr, 1);
+    }
+} /* -- sr_handle_pwospf_dbd_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_pwospf_lsr_packet
+ *
+ * Contesta un LSR con un LSU por cada router pedido que esté en la base
+ * (o el mío): el paquete tal como lo recibí cuando instalé su LSA, no lo
+ * que quedó de él en la base
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_handle_pwospf_lsr_packet(struct sr_instance* sr, uint8_t* packet, struct sr_pkt_desc* desc)
+{
+    ospfv2_hdr_t* ospf_hdr = (ospfv2_hdr_t*)(packet + desc->l4_off);
+    ospfv2_lsr_hdr_t* lsr_hdr = (ospfv2_lsr_hdr_t*)(packet + desc->l4_off + sizeof(ospfv2_hdr_t));
+    unsigned int ospf_len = ntohs(ospf_hdr->len);
+
+    if (ospf_len < sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsr_hdr_t) ||
+        ntohl(lsr_hdr->num_req) > (ospf_len - sizeof(ospfv2_hdr_t) - sizeof(ospfv2_lsr_hdr_t)) / sizeof(uint32_t)) {
+        return;
+    }
+    g_dbx.lsr_rcvd++;
+
+    uint32_t n = ntohl(lsr_hdr->num_req), i;
+    uint32_t* req = (uint32_t*)((uint8_t*)lsr_hdr + sizeof(ospfv2_lsr_hdr_t));
+
+    for (i = 0; i < n; i++) {
+        struct in_addr rid;
+        uint8_t* lsu = NULL;
+        unsigned int lsu_len = 0;
+
+        rid.s_addr = req[i];
+        if (rid.s_addr == g_router_id.s_addr) {
+            pthread_mutex_lock(&g_lsu.lock);
+            if (g_lsu.ospf != NULL) {
+                flood_send(sr, desc->in_if, g_lsu.ospf, g_lsu.ospf_len);
+                g_dbx.lsa_sent++;
+            }
+            pthread_mutex_unlock(&g_lsu.lock);
+            continue;
+        }
+
+        /* Copio el LSU con la base tomada y lo envío sin ella; ya tiene
+        su checksum */
+        pwospf_lsdb_lock(g_topology);
+        struct pwospf_lsa* lsa = pwospf_lsdb_lookup(g_topology, rid);
+        if (lsa != NULL && lsa->lsu != NULL) {
+            lsu_len = lsa->lsu_len;
+            lsu = malloc(lsu_len);
+            memcpy(lsu, lsa->lsu, lsu_len);
+        }
+        pwospf_lsdb_unlock(g_topology);
+
+        if (lsu != NULL) {
+            flood_send(sr, desc->in_if, lsu, lsu_len);
+            free(lsu);
+            g_dbx.lsa_sent++;
+        }
+    }
+} /* -- sr_handle_pwospf_lsr_packet -- */
+
 /**********************************************************************************
  * SU CÓDIGO DEBERÍA TERMINAR AQUÍ
  * *********************************************************************************/
@@ -904,15 +1561,20 @@ void* sr_handle_pwospf_lsu_packet(void* arg)
  *
  *---------------------------------------------------------------------*/
 
-void sr_handle_pwospf_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_if* rx_if)
+void sr_handle_pwospf_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_pkt_desc* desc)
 {
     /*Nuevo. Si aún no terminó la inicialización, se descarta el paquete recibido */
     if (g_router_id.s_addr == 0) {
        return;
     }
 
-    ospfv2_hdr_t* rx_ospfv2_hdr = ((ospfv2_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)));
-    powspf_rx_lsu_param_t* rx_lsu_param = ((powspf_rx_lsu_param_t*)(malloc(sizeof(powspf_rx_lsu_param_t))));
+    /* sr_handle_pwospf_lsu_packet asume cabezal IP sin opciones y entra en el buffer de la copia */
+    if (desc->l4_off != sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) || length > sizeof(((powspf_rx_lsu_param_t*)0)->packet)) {
+       return;
+    }
+
+    ospfv2_hdr_t* rx_ospfv2_hdr = ((ospfv2_hdr_t*)(packet + desc->l4_off));
+    powspf_rx_lsu_param_t* rx_lsu_param;
 
     /* Debug("-> PWOSPF: Detecting PWOSPF Packet\n");
     Debug("      [Type = %d]\n", rx_ospfv2_hdr->type); */
@@ -920,17 +1582,23 @@ void sr_handle_pwospf_packet(struct sr_instance* sr, uint8_t* packet, unsigned i
     switch(rx_ospfv2_hdr->type)
     {
         case OSPF_TYPE_HELLO:
-            sr_handle_pwospf_hello_packet(sr, packet, length, rx_if);
+            sr_handle_pwospf_hello_packet(sr, packet, length, desc);
+            break;
+        case OSPF_TYPE_DBD:
+            sr_handle_pwospf_dbd_packet(sr, packet, desc);
+            break;
+        case OSPF_TYPE_LSR:
+            sr_handle_pwospf_lsr_packet(sr, packet, desc);
+            break;
+        case OSPF_TYPE_LSACK:
+            sr_handle_pwospf_lsack_packet(sr, packet, desc);
             break;
         case OSPF_TYPE_LSU:
+            rx_lsu_param = ((powspf_rx_lsu_param_t*)(malloc(sizeof(powspf_rx_lsu_param_t))));
             rx_lsu_param->sr = sr;
-            unsigned int i;
-            for (i = 0; i < length; i++)
-            {
-                rx_lsu_param->packet[i] = packet[i];
-            }
+            memcpy(rx_lsu_param->packet, packet, length);
             rx_lsu_param->length = length;
-            rx_lsu_param->rx_if = rx_if;
+            rx_lsu_param->rx_if = desc->in_if;
             /* Nuevo */
             pthread_attr_t attr;
             pthread_attr_init(&attr);
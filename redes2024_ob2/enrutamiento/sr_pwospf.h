@@ -11,12 +11,14 @@
 #ifndef SR_PWOSPF_H
 #define SR_PWOSPF_H
 
+#include <stdio.h>
 #include <pthread.h>
 #include "sr_protocol.h"
 
 
 /* forward declare */
 struct sr_instance;
+struct sr_pkt_desc;
 
 struct pwospf_subsys
 {   /* -- hilo y lock del pwospf subsystem -- */
@@ -42,15 +44,14 @@ typedef struct powspf_rx_lsu_param powspf_rx_lsu_param_t;
 
 int pwospf_init(struct sr_instance* sr);
 
-void* check_neighbors_life(void*);
-void* check_topology_entries_age(void*);
 void* send_hellos(void*);
 void* send_hello_packet(void*);
 void* send_all_lsu(void*);
-void* send_lsu(void*);
-void sr_handle_pwospf_hello_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_if*);
+void pwospf_originate_lsu(struct sr_instance*, int);
+void pwospf_print_stats(FILE*);
+void sr_handle_pwospf_hello_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_pkt_desc*);
 void* sr_handle_pwospf_lsu_packet(void*);
-void sr_handle_pwospf_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_if*);
+void sr_handle_pwospf_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_pkt_desc*);
 
 void pwospf_lock(struct pwospf_subsys* subsys);
 void pwospf_unlock(struct pwospf_subsys* subsys);
@@ -0,0 +1,576 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.c
+ *
+ * Descripción:
+ *
+ * Banco de prueba del camino de datos sin VNS ni Mininet. Mapea una
+ * captura pcap en memoria, arma las interfaces, la tabla de rutas y la
+ * cache ARP a partir de un archivo de configuracion y pasa las tramas por
+ * sr_parse_packet + sr_handle_parsed_packet (lo mismo que sr_handlepacket)
+ * tan rapido como puede. sr_send_packet esta reemplazado por un stub que
+ * solo cuenta, asi que se enlaza todo el router salvo sr_main.o y
+ * sr_vns_comm.o.
+ *
+ * Informa paquetes por segundo, ns por paquete, un histograma de latencia
+ * (potencias de 2) y la decision tomada con cada trama.
+ *
+ * Uso: ./sr_replay [-n vueltas] [-w vueltas] [-V nivel] [-L niveles] [-a]
+ *                  config captura.pcap
+ *
+ * Configuracion, una directiva por linea ('#' comenta):
+ *
+ *   iface  NOMBRE MAC IP MASCARA    interfaz del router
+ *   route  DESTINO GW MASCARA IFACE entrada de la tabla de rutas
+ *   rtable ARCHIVO                  tabla de rutas en el formato de -r
+ *   arp    IP MAC                   entrada estatica de la cache ARP
+ *   ingress IFACE                   interfaz de entrada por defecto
+ *   ospf   on|off                   pasar (on) u omitir (off, por defecto)
+ *                                   las tramas PWOSPF
+ *
+ * La interfaz de entrada de cada trama es la que tiene su MAC destino; las
+ * tramas de broadcast o multicast entran por la interfaz cuya red contiene
+ * la IP origen y si no por la de "ingress". Las tramas unicast a una MAC
+ * ajena (las que envio el propio router en la captura) se omiten salvo con
+ * -a. Con PWOSPF omitido la tabla de rutas no cambia durante la corrida y
+ * el resultado es reproducible; con "ospf on" se arranca el subsistema
+ * PWOSPF y sus hilos como en el router.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_protocol.h"
+#include "sr_arpcache.h"
+#include "sr_parse.h"
+#include "sr_pwospf.h"
+#include "sr_dumper.h"
+
+#define REPLAY_DEFAULT_LOOPS  1000
+#define REPLAY_DEFAULT_WARMUP 10
+#define REPLAY_HIST_BUCKETS   40      /* hasta 2^40 ns */
+#define REPLAY_BUF_SIZE       65536
+
+#define PCAP_NSEC_MAGIC 0xa1b23c4d   /* pcap con timestamps en ns */
+
+/* Una trama de la captura lista para pasar al router */
+struct replay_frame
+{
+    const uint8_t* data;
+    unsigned int len;
+    const char* iface;
+};
+
+/* Contadores del stub de sr_send_packet */
+static uint64_t g_tx_frames;
+static uint64_t g_tx_bytes;
+static uint64_t g_tx_bad_src;   /* MAC origen distinta de la de la interfaz */
+
+static int g_ospf;
+static const char* g_ingress;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet
+ *
+ * Stub: cuenta la trama y verifica la MAC origen como lo haria
+ * sr_vns_comm.c, sin copiar ni escribir.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len, const char* iface)
+{
+    struct sr_if* if_rec = sr_get_interface(sr, iface);
+
+    g_tx_frames++;
+    g_tx_bytes += len;
+    if (if_rec == 0 || len < sizeof(sr_ethernet_hdr_t) ||
+        memcmp(((sr_ethernet_hdr_t*) buf)->ether_shost, if_rec->addr, ETHER_ADDR_LEN) != 0)
+    {
+        g_tx_bad_src++;
+    }
+    return 0;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Format: %s [-n loops] [-w warmup loops] [-V transit|local|full]\n"
+                    "          [-L [subsystem=]level,...] [-a] config capture.pcap\n", argv0);
+}
+
+static int parse_mac(const char* s, unsigned char* mac)
+{
+    unsigned int b[ETHER_ADDR_LEN];
+    int i;
+
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+    {
+        return -1;
+    }
+    for (i = 0; i < ETHER_ADDR_LEN; i++)
+    {
+        mac[i] = b[i];
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: load_config
+ *
+ * Lee las directivas del archivo de configuracion. Retorna 0 si todas
+ * son validas.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int load_config(struct sr_instance* sr, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    char line[512];
+    int lineno = 0;
+
+    if (fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != 0)
+    {
+        char w[5][64];
+        int n;
+        char* hash = strchr(line, '#');
+
+        lineno++;
+        if (hash != 0)
+        {
+            *hash = 0;
+        }
+        n = sscanf(line, "%63s %63s %63s %63s %63s", w[0], w[1], w[2], w[3], w[4]);
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        if (strcmp(w[0], "iface") == 0 && n == 5)
+        {
+            unsigned char mac[ETHER_ADDR_LEN];
+            struct in_addr ip, mask;
+
+            if (parse_mac(w[2], mac) != 0 || inet_aton(w[3], &ip) == 0 || inet_aton(w[4], &mask) == 0)
+            {
+                goto bad;
+            }
+            sr_add_interface(sr, w[1]);
+            sr_set_ether_addr(sr, mac);
+            sr_set_ether_ip(sr, ip.s_addr);
+            sr_set_ether_mask(sr, mask.s_addr);
+        }
+        else if (strcmp(w[0], "route") == 0 && n == 5)
+        {
+            struct in_addr dest, gw, mask;
+
+            if (inet_aton(w[1], &dest) == 0 || inet_aton(w[2], &gw) == 0 || inet_aton(w[3], &mask) == 0)
+            {
+                goto bad;
+            }
+            sr_add_rt_entry(sr, dest, gw, mask, w[4], 0);
+        }
+        else if (strcmp(w[0], "rtable") == 0 && n == 2)
+        {
+            if (sr_load_rt(sr, w[1]) != 0)
+            {
+                goto bad;
+            }
+        }
+        else if (strcmp(w[0], "arp") == 0 && n == 3)
+        {
+            unsigned char mac[ETHER_ADDR_LEN];
+            struct in_addr ip;
+
+            if (inet_aton(w[1], &ip) == 0 || parse_mac(w[2], mac) != 0)
+            {
+                goto bad;
+            }
+            sr_arpcache_insert(&sr->cache, mac, ip.s_addr);
+        }
+        else if (strcmp(w[0], "ingress") == 0 && n == 2)
+        {
+            g_ingress = strdup(w[1]);
+        }
+        else if (strcmp(w[0], "ospf") == 0 && n == 2)
+        {
+            g_ospf = strcmp(w[1], "on") == 0;
+        }
+        else
+        {
+            goto bad;
+        }
+        continue;
+
+bad:
+        fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    if (sr->if_list == 0)
+    {
+        fprintf(stderr, "%s: no interfaces\n", path);
+        return -1;
+    }
+    return 0;
+} /* -- load_config -- */
+
+/* Interfaz por la que entra la trama, o 0 si hay que omitirla */
+static const char* pick_ingress(struct sr_instance* sr, const uint8_t* f, unsigned int len,
+                                int all)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*) f;
+    struct sr_if* iface;
+    uint32_t src = 0;
+
+    for (iface = sr->if_list; iface != 0; iface = iface->next)
+    {
+        if (memcmp(eth->ether_dhost, iface->addr, ETHER_ADDR_LEN) == 0)
+        {
+            return iface->name;
+        }
+    }
+
+    /* Unicast a otra MAC: la envio el router que hizo la captura */
+    if ((eth->ether_dhost[0] & 1) == 0 && !all)
+    {
+        return 0;
+    }
+
+    if (ntohs(eth->ether_type) == ethertype_ip && len >= sizeof(*eth) + sizeof(sr_ip_hdr_t))
+    {
+        src = ((const sr_ip_hdr_t*) (f + sizeof(*eth)))->ip_src;
+    }
+    else if (ntohs(eth->ether_type) == ethertype_arp && len >= sizeof(*eth) + sizeof(sr_arp_hdr_t))
+    {
+        src = ((const sr_arp_hdr_t*) (f + sizeof(*eth)))->ar_sip;
+    }
+    for (iface = sr->if_list; iface != 0; iface = iface->next)
+    {
+        if (src != 0 && (src & iface->mask) == (iface->ip & iface->mask))
+        {
+            return iface->name;
+        }
+    }
+    return g_ingress != 0 ? g_ingress : sr->if_list->name;
+}
+
+static int is_ospf(const uint8_t* f, unsigned int len)
+{
+    return len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+           ntohs(((const sr_ethernet_hdr_t*) f)->ether_type) == ethertype_ip &&
+           ((const sr_ip_hdr_t*) (f + sizeof(sr_ethernet_hdr_t)))->ip_p == ip_protocol_ospfv2;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: load_pcap
+ *
+ * Mapea la captura y arma el arreglo de tramas a pasar. Las tramas
+ * truncadas (caplen < len) se omiten.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct replay_frame* load_pcap(struct sr_instance* sr, const char* path, int all,
+                                      int* n_frames, int* n_skipped)
+{
+    struct pcap_file_header* hdr;
+    struct replay_frame* frames;
+    struct stat st;
+    const uint8_t* base;
+    size_t off;
+    int fd, n = 0, max;
+
+    *n_skipped = 0;
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        return 0;
+    }
+    base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || (size_t) st.st_size < sizeof(*hdr))
+    {
+        fprintf(stderr, "%s: can't map or too short\n", path);
+        return 0;
+    }
+
+    hdr = (struct pcap_file_header*) base;
+    if ((hdr->magic != TCPDUMP_MAGIC && hdr->magic != PCAP_NSEC_MAGIC) ||
+        hdr->linktype != LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "%s: not a little-endian Ethernet pcap\n", path);
+        return 0;
+    }
+
+    max = st.st_size / (sizeof(struct pcap_sf_pkthdr) + sizeof(sr_ethernet_hdr_t)) + 1;
+    frames = calloc(max, sizeof(*frames));
+    if (frames == 0)
+    {
+        return 0;
+    }
+
+    for (off = sizeof(*hdr); off + sizeof(struct pcap_sf_pkthdr) <= (size_t) st.st_size; )
+    {
+        const struct pcap_sf_pkthdr* ph = (const struct pcap_sf_pkthdr*) (base + off);
+        const uint8_t* data = base + off + sizeof(*ph);
+
+        off += sizeof(*ph) + ph->caplen;
+        if (off > (size_t) st.st_size)
+        {
+            break;
+        }
+        if (ph->caplen < ph->len || ph->caplen < sizeof(sr_ethernet_hdr_t) ||
+            ph->caplen > REPLAY_BUF_SIZE || (!g_ospf && is_ospf(data, ph->caplen)))
+        {
+            (*n_skipped)++;
+            continue;
+        }
+        frames[n].data = data;
+        frames[n].len = ph->caplen;
+        frames[n].iface = pick_ingress(sr, data, ph->caplen, all);
+        if (frames[n].iface == 0)
+        {
+            (*n_skipped)++;
+            continue;
+        }
+        n++;
+    }
+
+    *n_frames = n;
+    return frames;
+} /* -- load_pcap -- */
+
+static void print_hist(const uint64_t* hist, uint64_t total)
+{
+    int i, first = -1, last = -1;
+
+    for (i = 0; i < REPLAY_HIST_BUCKETS; i++)
+    {
+        if (hist[i] != 0)
+        {
+            if (first < 0)
+            {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    printf("Latency histogram (ns per packet):\n");
+    for (i = first; i >= 0 && i <= last; i++)
+    {
+        double pct = 100.0 * hist[i] / total;
+        int bar = (int) (pct / 2);
+
+        printf("  [%9llu, %9llu)  %12llu  %5.1f%%  ",
+               i == 0 ? 0ULL : 1ULL << i, 1ULL << (i + 1), (unsigned long long) hist[i], pct);
+        while (bar-- > 0)
+        {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+/* Cota superior del bucket donde cae el percentil p */
+static uint64_t hist_percentile(const uint64_t* hist, uint64_t total, double p)
+{
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < REPLAY_HIST_BUCKETS; i++)
+    {
+        seen += hist[i];
+        if (seen >= total * p)
+        {
+            return 1ULL << (i + 1);
+        }
+    }
+    return 1ULL << REPLAY_HIST_BUCKETS;
+}
+
+int main(int argc, char** argv)
+{
+    struct sr_instance sr;
+    struct replay_frame* frames;
+    uint8_t* buf;
+    uint64_t hist[REPLAY_HIST_BUCKETS];
+    uint64_t actions[sr_pkt_act_max];
+    uint64_t handled = 0, busy_ns = 0, wall_ns, t_start;
+    int loops = REPLAY_DEFAULT_LOOPS, warmup = REPLAY_DEFAULT_WARMUP;
+    int all = 0, tier = sr_validate_local;
+    int n_frames, n_skipped, loop, i, c;
+
+    while ((c = getopt(argc, argv, "hn:w:V:L:a")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'V':
+                if ((tier = sr_parse_tier(optarg)) < 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                if (sr_log_parse_levels(optarg) != 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'a':
+                all = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2 || loops <= 0 || warmup < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.validation_tier = tier;
+    sr_arpcache_init(&sr.cache);
+    if (load_config(&sr, argv[optind]) != 0)
+    {
+        return 1;
+    }
+    sr_fib_update(&sr);
+
+    if (g_ospf)
+    {
+        pwospf_init(&sr);
+    }
+    else
+    {
+        /* Solo el lock que usa lpm, sin los hilos de PWOSPF */
+        sr.ospf_subsys = malloc(sizeof(struct pwospf_subsys));
+        pthread_mutex_init(&sr.ospf_subsys->lock, 0);
+    }
+
+    frames = load_pcap(&sr, argv[optind + 1], all, &n_frames, &n_skipped);
+    if (frames == 0)
+    {
+        return 1;
+    }
+    if (n_frames == 0)
+    {
+        fprintf(stderr, "%s: no frames to replay (%d skipped)\n", argv[optind + 1], n_skipped);
+        return 1;
+    }
+    printf("Replaying %d frames (%d skipped) x %d loops, %d warmup, validation %s\n",
+           n_frames, n_skipped, loops, warmup, sr_tier_str(tier));
+
+    /* El manejador modifica la trama (TTL, MACs): cada pasada trabaja
+       sobre una copia, como el buffer de recepcion de sr_vns_comm.c */
+    buf = malloc(REPLAY_BUF_SIZE);
+    memset(hist, 0, sizeof(hist));
+    memset(actions, 0, sizeof(actions));
+
+    for (loop = 0; loop < warmup; loop++)
+    {
+        for (i = 0; i < n_frames; i++)
+        {
+            struct sr_pkt_desc desc;
+
+            memcpy(buf, frames[i].data, frames[i].len);
+            sr_parse_packet(&sr, buf, frames[i].len, (char*) frames[i].iface, &desc);
+            sr_handle_parsed_packet(&sr, buf, frames[i].len, &desc);
+        }
+    }
+    memset(&sr.pkt_stats, 0, sizeof(sr.pkt_stats));
+    g_tx_frames = g_tx_bytes = g_tx_bad_src = 0;
+
+    t_start = now_ns();
+    for (loop = 0; loop < loops; loop++)
+    {
+        for (i = 0; i < n_frames; i++)
+        {
+            struct sr_pkt_desc desc;
+            uint64_t t0, dt;
+            int b = 0;
+
+            memcpy(buf, frames[i].data, frames[i].len);
+            t0 = now_ns();
+            sr_parse_packet(&sr, buf, frames[i].len, (char*) frames[i].iface, &desc);
+            sr_handle_parsed_packet(&sr, buf, frames[i].len, &desc);
+            dt = now_ns() - t0;
+
+            busy_ns += dt;
+            while (b < REPLAY_HIST_BUCKETS - 1 && (dt >> (b + 1)) != 0)
+            {
+                b++;
+            }
+            hist[b]++;
+            actions[desc.action < sr_pkt_act_max ? desc.action : sr_pkt_act_none]++;
+        }
+    }
+    wall_ns = now_ns() - t_start;
+    handled = (uint64_t) loops * n_frames;
+
+    printf("\n%-28s%llu\n", "packets", (unsigned long long) handled);
+    printf("%-28s%.3f s\n", "wall time", wall_ns / 1e9);
+    printf("%-28s%.0f\n", "packets/s", handled / (wall_ns / 1e9));
+    printf("%-28s%.1f\n", "ns/packet (handler)", (double) busy_ns / handled);
+    printf("%-28s%.1f\n", "ns/packet (wall)", (double) wall_ns / handled);
+    printf("%-28s<%llu ns\n", "p50", (unsigned long long) hist_percentile(hist, handled, 0.50));
+    printf("%-28s<%llu ns\n", "p99", (unsigned long long) hist_percentile(hist, handled, 0.99));
+    printf("%-28s<%llu ns\n", "p99.9", (unsigned long long) hist_percentile(hist, handled, 0.999));
+    printf("%-28s%llu frames, %llu bytes", "transmitted",
+           (unsigned long long) g_tx_frames, (unsigned long long) g_tx_bytes);
+    if (g_tx_bad_src != 0)
+    {
+        printf(" (%llu with a wrong source MAC)", (unsigned long long) g_tx_bad_src);
+    }
+    printf("\n\nDecisions:\n");
+    for (i = 0; i < sr_pkt_act_max; i++)
+    {
+        if (actions[i] != 0)
+        {
+            printf("  %-26s%llu\n", sr_pkt_action_str(i), (unsigned long long) actions[i]);
+        }
+    }
+    putchar('\n');
+    print_hist(hist, handled);
+    putchar('\n');
+    sr_print_pkt_stats(&sr, stdout);
+
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,123 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.c
+ *
+ * Descripción:
+ *
+ * Cola circular MPSC sin locks. El numero de secuencia de cada slot vale
+ * pos cuando el slot esta libre para la posicion pos, pos + 1 cuando el
+ * productor termino de escribirlo, y pos + nslots cuando el consumidor lo
+ * libera para la vuelta siguiente.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr_ring.h"
+
+struct sr_ring_slot
+{
+    uint64_t seq;
+    uint32_t len;
+};
+
+#define SLOT_HDR_SIZE ((sizeof(struct sr_ring_slot) + 15) & ~15u)
+
+static struct sr_ring_slot* slot_at(struct sr_ring* ring, uint64_t pos)
+{
+    return (struct sr_ring_slot*) (ring->slots + (pos & ring->mask) * ring->stride);
+}
+
+int sr_ring_init(struct sr_ring* ring, unsigned int nslots, unsigned int slot_size)
+{
+    unsigned int n = 1;
+    unsigned int i;
+
+    while (n < nslots) {
+        n <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->mask = n - 1;
+    ring->slot_size = slot_size;
+    ring->stride = (SLOT_HDR_SIZE + slot_size + SR_RING_CACHELINE - 1) & ~(SR_RING_CACHELINE - 1);
+
+    if (posix_memalign((void**) &ring->slots, SR_RING_CACHELINE, (size_t) n * ring->stride) != 0) {
+        ring->slots = 0;
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        slot_at(ring, i)->seq = i;
+        slot_at(ring, i)->len = 0;
+    }
+    return 0;
+}
+
+void sr_ring_destroy(struct sr_ring* ring)
+{
+    free(ring->slots);
+    ring->slots = 0;
+}
+
+void* sr_ring_reserve(struct sr_ring* ring, uint64_t* pos)
+{
+    uint64_t p = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    for (;;) {
+        struct sr_ring_slot* slot = slot_at(ring, p);
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t) (seq - p);
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &p, p + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos = p;
+                return (uint8_t*) slot + SLOT_HDR_SIZE;
+            }
+            /* otro productor gano la posicion, p ya tiene el valor nuevo */
+        }
+        else if (dif < 0) {
+            /* el consumidor no libero todavia este slot: cola llena */
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        else {
+            p = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void sr_ring_commit(struct sr_ring* ring, uint64_t pos, uint32_t len)
+{
+    struct sr_ring_slot* slot = slot_at(ring, pos);
+
+    slot->len = len;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void* sr_ring_peek(struct sr_ring* ring, uint32_t* len)
+{
+    struct sr_ring_slot* slot = slot_at(ring, ring->tail);
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring->tail + 1) {
+        return 0;
+    }
+    if (len != 0) {
+        *len = slot->len;
+    }
+    return (uint8_t*) slot + SLOT_HDR_SIZE;
+}
+
+void sr_ring_release(struct sr_ring* ring)
+{
+    struct sr_ring_slot* slot = slot_at(ring, ring->tail);
+
+    __atomic_store_n(&slot->seq, ring->tail + ring->mask + 1, __ATOMIC_RELEASE);
+    ring->tail++;
+}
+
+uint64_t sr_ring_dropped(struct sr_ring* ring)
+{
+    return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.h
+ *
+ * Descripción:
+ *
+ * Cola circular acotada, sin locks, con varios productores y un unico
+ * consumidor (esquema de D. Vyukov). Cada slot tiene tamaño fijo y un
+ * numero de secuencia que indica si esta libre, reservado o listo para
+ * consumir, de modo que los productores solo compiten por un contador.
+ *
+ * Si la cola esta llena el productor no espera: el elemento se descarta y
+ * se cuenta en dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RING_H
+#define SR_RING_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_RING_CACHELINE 64
+
+struct sr_ring
+{
+    uint8_t* slots;          /* nslots * stride bytes */
+    uint32_t mask;           /* nslots - 1 (nslots es potencia de 2) */
+    uint32_t stride;         /* cabezal del slot + slot_size, alineado */
+    uint32_t slot_size;      /* bytes de datos por slot */
+
+    /* Contadores en lineas de cache distintas para que productores y
+       consumidor no se invaliden mutuamente */
+    uint64_t head __attribute__((aligned(SR_RING_CACHELINE)));  /* productores */
+    uint64_t dropped;
+    uint64_t tail __attribute__((aligned(SR_RING_CACHELINE)));  /* consumidor */
+};
+
+/* nslots se redondea a la potencia de 2 siguiente. Retorna 0 o -1. */
+int sr_ring_init(struct sr_ring* ring, unsigned int nslots, unsigned int slot_size);
+void sr_ring_destroy(struct sr_ring* ring);
+
+/* Productor: reserva un slot y retorna su area de datos (slot_size bytes),
+   o 0 si la cola esta llena. El slot queda invisible para el consumidor
+   hasta sr_ring_commit. */
+void* sr_ring_reserve(struct sr_ring* ring, uint64_t* pos);
+void sr_ring_commit(struct sr_ring* ring, uint64_t pos, uint32_t len);
+
+/* Consumidor: retorna el siguiente slot listo (y su largo) o 0 si no hay.
+   El slot se devuelve a la cola con sr_ring_release. */
+void* sr_ring_peek(struct sr_ring* ring, uint32_t* len);
+void sr_ring_release(struct sr_ring* ring);
+
+/* Elementos descartados por cola llena */
+uint64_t sr_ring_dropped(struct sr_ring* ring);
+
+#endif /* -- SR_RING_H -- */
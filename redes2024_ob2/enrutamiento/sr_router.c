@@ -20,6 +20,9 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_parse.h"
+#include "sr_flightrec.h"
+#include "sr_fib.h"
 #include "pwospf_protocol.h"
 #include "sr_pwospf.h"
 
@@ -69,28 +72,13 @@ struct sr_rt *lpm(struct sr_instance *sr, uint32_t dest_ip)
 {
   pwospf_lock(sr->ospf_subsys);
 
-  /* Tomo el puntero a la tabla de enrutamiento de la instancia del router */
-  struct sr_rt *rt_iterator = sr->routing_table;
-  /* Inicializo Best Prefix Match (bpm), que sera el que vaya almacenando el prefijo mas largo encontrado hasta el momento */
-  struct sr_rt *bpm = NULL;
-  while (rt_iterator != NULL)
-  {
-    /* Si la IP destino al ser enmascarada coincide con la IP destino de la entrada de la tabla */
-    if ((dest_ip & rt_iterator->mask.s_addr) == rt_iterator->dest.s_addr)
-    {
-      /* Y la mascara de la entrada es mayor a la de la mejor entrada hasta el momento (por ende el prefijo es mas largo) */
-      if (bpm == NULL || rt_iterator->mask.s_addr > bpm->mask.s_addr)
-      {
-        /* Almaceno esa entrada en bpm */
-        bpm = rt_iterator;
-      }
-    }
-    /* Avanzo en el iterador */
-    rt_iterator = rt_iterator->next;
-  }
+  /* La FIB (sr_fib.c) la pone al dia quien cambia la tabla; si alguno
+     se olvido de sr_fib_update, la consulta no lo tapa */
+  assert(sr->fib_version == sr->rt_version);
+  struct sr_rt *rt = sr_fib_lookup(sr, dest_ip);
   pwospf_unlock(sr->ospf_subsys);
 
-  return bpm;
+  return rt;
 }
 
 /* Funciones para  paquetes ICMP */
@@ -229,11 +217,10 @@ void sr_send_icmp_echo_reply(struct sr_instance *sr,
                              uint8_t *ipPacket)
 {
   /* COLOQUE AQUÍ SU CÓDIGO*/
-  printf("****** -> Construct ICMP echo reply.\n");
+  sr_log_debug(sr_sub_fwd, "****** -> Construct ICMP echo reply.\n");
   /* Obtengo la interfaz a la que mandar el paquete a partir de la tabla de enrutamiento */
   char *target_interface_name = lpm(sr, ipDst)->interface;
-  printf("****** -> ICMP reply targets interface: ");
-  printf("%s\n", target_interface_name);
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP reply targets interface: %s\n", target_interface_name);
   struct sr_if *target_interface = sr_get_interface(sr, target_interface_name);
 
   /* Genero el paquete ICMP, calculo su tamanio y lo envio*/
@@ -241,13 +228,12 @@ void sr_send_icmp_echo_reply(struct sr_instance *sr,
   /* Tomo el largo del paquete creado, pues largo variable con el payload ICMP */
   unsigned int ip_len = ntohs(((sr_ip_hdr_t *)(icmp_packet + sizeof(sr_ethernet_hdr_t)))->ip_len);
   unsigned int icmp_len = sizeof(sr_ethernet_hdr_t) + ip_len;
-  printf("****** -> ICMP echo reply headers:\n");
-  print_hdrs(icmp_packet, icmp_len);
+  DebugHdrs(icmp_packet, icmp_len);
   sr_send_packet(sr, icmp_packet, icmp_len, target_interface_name);
-  printf("****** -> ICMP echo reply sent.\n");
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP echo reply sent.\n");
   /* Libero la memoria asociada REVISAR POR EL DATA */
   free(icmp_packet);
-  printf("****** -> ICMP reply end.\n");
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP reply end.\n");
 
 } /* -- sr_send_icmp_echo_reply -- */
 
@@ -260,21 +246,19 @@ void sr_send_icmp_error_packet(uint8_t type,
 {
 
   /* COLOQUE AQUÍ SU CÓDIGO*/
-  printf("***** -> Construct ICMP error response.\n");
+  sr_log_debug(sr_sub_fwd, "***** -> Construct ICMP error response.\n");
 
   /* Obtengo la interfaz a la que mandar el paquete a partir de la tabla de enrutamiento */
   char *target_interface_name = lpm(sr, ipDst)->interface;
-  printf("****** -> ICMP error response targets interface: ");
-  printf("%s\n", target_interface_name);
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP error response targets interface: %s\n", target_interface_name);
   struct sr_if *target_interface = sr_get_interface(sr, target_interface_name);
 
   /* Genero el paquete ICMP, calculo su tamanio y lo envio*/
   uint8_t *icmp_t3_packet = generate_icmp_t3_packet(type, code, ipPacket, sr, target_interface);
   unsigned int icmp_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t);
-  printf("****** -> ICMP error response headers:\n");
 
   /* Opcion Actual */
-  print_hdrs(icmp_t3_packet, icmp_len);
+  DebugHdrs(icmp_t3_packet, icmp_len);
   sr_send_packet(sr, icmp_t3_packet, icmp_len, target_interface_name);
 
   /* Otra Opcion */
@@ -300,65 +284,52 @@ void sr_send_icmp_error_packet(uint8_t type,
       sr_arpcache_queuereq(&(sr->cache), next_hop_ip, packet, len, target_interface);
   } */
 
-  printf("****** -> ICMP error response sent.\n");
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP error response sent.\n");
   /* Libero la memoria asociada REVISAR */
   free(icmp_t3_packet);
-  printf("****** -> ICMP error response end.\n");
+  sr_log_debug(sr_sub_fwd, "****** -> ICMP error response end.\n");
 
 } /* -- sr_send_icmp_error_packet -- */
 
 void sr_handle_ip_packet(struct sr_instance *sr,
                          uint8_t *packet /* lent */,
                          unsigned int len,
-                         uint8_t *srcAddr,
-                         uint8_t *destAddr,
-                         char *interface /* lent */,
-                         sr_ethernet_hdr_t *eHdr)
+                         struct sr_pkt_desc *desc /* lent */)
 {
 
   /*
    * COLOQUE ASÍ SU CÓDIGO
    */
-  print_hdrs(packet, len);
 
   /* Obtengo el cabezal IP */
-  /* packet es un puntero a la posicion inicial del paquete en el buffer, debo indicar la posicion inicial de la
-    cabecera IP. La cabecera IP comienza inmediatamente despues que termina la cabecera Ethernet. */
-  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
-
-  /* La validacion de la sanidad del paquete ya viene hecha desde la funcion handle_packet (Ethernet e IP) */
+  /* El parser ya valido la trama (Ethernet, IP y checksums) y dejo los offsets en el descriptor */
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + desc->l3_off);
 
   /* Imprimo el cabezal IP */
-  printf("*** -> It is an IP packet. Print IP header.\n");
-  print_hdr_ip(packet + sizeof(sr_ethernet_hdr_t));
+  sr_log_debug(sr_sub_fwd, "*** -> It is an IP packet.\n");
+  DebugHdrs(packet, len);
 
   /* Chequeo si mensaje corresponde a protocolo PWOSPF */
   /* Si es mensaje PWOSPF */
-  if (ip_hdr->ip_p == ip_protocol_ospfv2) {
-   /* Tomo la interfaz que recibio el mensaje PWOSPF y llamo al manejador */
-    struct sr_if *interface_if = sr_get_interface(sr, interface);
-    sr_handle_pwospf_packet(sr, packet, len, interface_if);
-    /*
-    free(interface_if) habría que ver si fue asignado dinámicamente, para ver si es correcto eliminarlo o no
-    */
+  if (desc->l4_proto == ip_protocol_ospfv2) {
+    /* El descriptor ya tiene la interfaz que recibio el mensaje PWOSPF */
+    desc->action = sr_pkt_act_ospf;
+    sr_handle_pwospf_packet(sr, packet, len, desc);
   }
   /* Si no es mensaje PWOSPF manejo reenvío de manera regular (parte 1) */
   else {
     /* Obtengo las direcciones IP */
-    uint32_t sender_IP = ip_hdr->ip_src;
-    uint32_t target_IP = ip_hdr->ip_dst;
+    uint32_t sender_IP = desc->src;
+    uint32_t target_IP = desc->dst;
 
-    /* Verifico si paquete para una de mis interfaces */
-    struct sr_if *target_interface = sr_get_interface_given_ip(sr, target_IP);
-    printf("*** -> IP request targets interface: ");
+    /* Verifico si paquete para una de mis interfaces (el parser ya la busco) */
+    struct sr_if *target_interface = desc->local_if;
 
-    /* Si no es para una de mis interfaces (sr_get_interface_given_ip retorna 0 porque no encontro la interfaz
+    /* Si no es para una de mis interfaces (local_if es 0 porque no se encontro la interfaz
       en la lista de interfaces del router) */
     if (target_interface == 0)
     {
-      printf("Not found\n");
-
-      printf("**** -> IP request is not for one of my interfaces.\n");
+      sr_log_debug(sr_sub_fwd, "**** -> IP request is not for one of my interfaces.\n");
 
       /* Decremento TTL y calculo checksum nuevamente */
       ip_hdr->ip_ttl--;
@@ -376,7 +347,8 @@ void sr_handle_ip_packet(struct sr_instance *sr,
         {
           /* No es para una de mis interfaces y no hay coincidencia en la tabla de enrutamiento */
           /* Responder con error: Tipo 3, Codigo 0 : Red no alcanzable */
-          printf("***** -> IP request is for unknown destiny.\n");
+          sr_log_debug(sr_sub_fwd, "***** -> IP request is for unknown destiny.\n");
+          desc->action = sr_pkt_act_drop_no_route;
           sr_send_icmp_error_packet(icmp_type_dest_unreachable, icmp_code_net_unreachable, sr, sender_IP, packet);
         }
         /* Si hay coincidencia */
@@ -397,7 +369,7 @@ void sr_handle_ip_packet(struct sr_instance *sr,
           /* Si la entrada no es nula y es valida, reenvio el paquete */
           if (arp_entry != NULL && arp_entry->valid)
           {
-            printf("***** -> Next hop IP is in ARP cache.\n");
+            sr_log_debug(sr_sub_fwd, "***** -> Next hop IP is in ARP cache.\n");
             /* Armo la cabecera Ethernet (la cabecera IP se mantiene igual) */
             sr_ethernet_hdr_t *eth_hdr = (sr_ethernet_hdr_t *)packet;
             /* Sobreescribimos el paquete recibido, cambiando las direcciones MAC */
@@ -406,18 +378,20 @@ void sr_handle_ip_packet(struct sr_instance *sr,
             struct sr_if* if_source = sr_get_interface(sr, best_rt->interface);
             memcpy(eth_hdr->ether_shost, if_source->addr, ETHER_ADDR_LEN);
             /* Envia el paquete Ethernet */
-            printf("***** -> Ethernet packet is ready to send.\n");
+            sr_log_debug(sr_sub_fwd, "***** -> Ethernet packet is ready to send.\n");
+            desc->action = sr_pkt_act_forwarded;
             sr_send_packet(sr, packet, len, if_source->name);
-            printf("***** -> Ethernet packet sent.\n");
+            sr_log_debug(sr_sub_fwd, "***** -> Ethernet packet sent.\n");
             /* Libera la memoria del paquete (Es el mismo que se recibio en un principio) */
             free(arp_entry);
           }
           /* Si no se encontro una entrada para la IP del proximo salto en la cache ARP */
           else
           {
-            printf("***** -> Next hop IP is not in ARP cache.\n");
+            sr_log_debug(sr_sub_fwd, "***** -> Next hop IP is not in ARP cache.\n");
+            desc->action = sr_pkt_act_arp_queued;
             struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip, packet, len, best_rt->interface);
-            printf("***** -> Handle ARP request.\n");
+            sr_log_debug(sr_sub_fwd, "***** -> Handle ARP request.\n");
             handle_arpreq(sr, req);
           }
         }
@@ -426,38 +400,37 @@ void sr_handle_ip_packet(struct sr_instance *sr,
       /* Si TTL = 0, tengo que responder con ICMP Time Exceeded: Tipo 11, Codigo 0 */
       else
       {
+        desc->action = sr_pkt_act_drop_ttl;
         sr_send_icmp_error_packet(icmp_type_time_exceeded, 0, sr, sender_IP, packet);
       }
     }
     /* Si es para una de mis interfaces */
     else
     {
-      printf("%s\n", target_interface->name);
-
-      printf("**** -> IP request is for one of my interfaces.\n");
+      sr_log_debug(sr_sub_fwd, "**** -> IP request is for one of my interfaces (%s).\n", target_interface->name);
       /* Verificar si es un paquete ICMP */
-      if (ip_hdr->ip_p == ip_protocol_icmp)
+      if (desc->l4_proto == ip_protocol_icmp)
       {
-        /* Tomo la cabecera ICMP como el puntero a la cabecera IP mas el lago de esta x4, pues el tamanio
-        en la cabecera IP se seniala en palabras de 32 bits (4 bytes)*/
-        sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *)((u_int8_t *)ip_hdr + (ip_hdr->ip_hl * 4));
+        /* Tomo la cabecera ICMP del offset calculado por el parser */
+        sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *)(packet + desc->l4_off);
 
-        printf("***** -> It is an ICMP packet. Print ICMP header.\n");
-        print_hdr_icmp((u_int8_t *)icmp_hdr);
+        sr_log_debug(sr_sub_fwd, "***** -> It is an ICMP packet.\n");
 
-        /* Verificar suma de comprobacion ICMP */
+        /* La suma de comprobacion ICMP ya la verifico el parser */
 
         /* Si es un echo request*/
         if (icmp_hdr->icmp_type == icmp_echo_request)
         {
-          printf("****** -> It is an ICMP echo request.\n");
+          sr_log_debug(sr_sub_fwd, "****** -> It is an ICMP echo request.\n");
           /* Responder con un echo reply : Tipo 0, Codigo 0*/
+          desc->action = sr_pkt_act_local;
           sr_send_icmp_echo_reply(sr, sender_IP, packet);
         }
         /* Si no es un echo request */
         else
         {
           /* Responder con error: Tipo 3, Codigo ?. QUE ERROR SE ENVIA EN ESTE CASO */
+          desc->action = sr_pkt_act_drop_unreach;
           sr_send_icmp_error_packet(icmp_type_dest_unreachable, -1, sr, sender_IP, packet);
         }
       }
@@ -465,6 +438,7 @@ void sr_handle_ip_packet(struct sr_instance *sr,
       else
       {
         /* Responder con error: Tipo 3, Codigo 3 : Puerto no alcanzable */
+        desc->action = sr_pkt_act_drop_unreach;
         sr_send_icmp_error_packet(icmp_type_dest_unreachable, icmp_code_host_unreachable, sr, sender_IP, packet);
       }
     }
@@ -494,7 +468,7 @@ void sr_arp_reply_send_pending_packets(struct sr_instance *sr,
      copyPacket = malloc(sizeof(uint8_t) * currPacket->len);
      memcpy(copyPacket, ethHdr, sizeof(uint8_t) * currPacket->len);
 
-     print_hdrs(copyPacket, currPacket->len);
+     DebugHdrs(copyPacket, currPacket->len);
      sr_send_packet(sr, copyPacket, currPacket->len, iface->name);
      currPacket = currPacket->next;
   }
@@ -504,17 +478,15 @@ void sr_arp_reply_send_pending_packets(struct sr_instance *sr,
 void sr_handle_arp_packet(struct sr_instance *sr,
         uint8_t *packet /* lent */,
         unsigned int len,
-        uint8_t *srcAddr,
-        uint8_t *destAddr,
-        char *interface /* lent */,
-        sr_ethernet_hdr_t *eHdr) {
+        struct sr_pkt_desc *desc /* lent */) {
 
   /* Imprimo el cabezal ARP */
-  printf("*** -> It is an ARP packet. Print ARP header.\n");
-  print_hdr_arp(packet + sizeof(sr_ethernet_hdr_t));
+  sr_log_debug(sr_sub_arp, "*** -> It is an ARP packet.\n");
+  DebugHdrs(packet, len);
 
-  /* Obtengo el cabezal ARP */
-  sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
+  /* Obtengo los cabezales */
+  sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *) packet;
+  sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *) (packet + desc->l3_off);
 
   /* Obtengo las direcciones MAC */
   unsigned char senderHardAddr[ETHER_ADDR_LEN], targetHardAddr[ETHER_ADDR_LEN];
@@ -522,26 +494,26 @@ void sr_handle_arp_packet(struct sr_instance *sr,
   memcpy(targetHardAddr, arpHdr->ar_tha, ETHER_ADDR_LEN);
 
   /* Obtengo las direcciones IP */
-  uint32_t senderIP = arpHdr->ar_sip;
-  uint32_t targetIP = arpHdr->ar_tip;
+  uint32_t senderIP = desc->src;
+  uint32_t targetIP = desc->dst;
   unsigned short op = ntohs(arpHdr->ar_op);
 
-  /* Verifico si el paquete ARP es para una de mis interfaces */
-  struct sr_if *myInterface = sr_get_interface_given_ip(sr, targetIP);
+  /* Verifico si el paquete ARP es para una de mis interfaces (el parser ya la busco) */
+  struct sr_if *myInterface = desc->local_if;
 
   if (op == arp_op_request) {  /* Si es un request ARP */
-    printf("**** -> It is an ARP request.\n");
+    sr_log_debug(sr_sub_arp, "**** -> It is an ARP request.\n");
 
     /* Si el ARP request es para una de mis interfaces */
     if (myInterface != 0) {
-      printf("***** -> ARP request is for one of my interfaces.\n");
+      sr_log_debug(sr_sub_arp, "***** -> ARP request is for one of my interfaces.\n");
 
       /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-      printf("****** -> Add MAC->IP mapping of sender to my ARP cache.\n");
+      sr_log_debug(sr_sub_arp, "****** -> Add MAC->IP mapping of sender to my ARP cache.\n");
       sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
 
       /* Construyo un ARP reply y lo envío de vuelta */
-      printf("****** -> Construct an ARP reply and send it back.\n");
+      sr_log_debug(sr_sub_arp, "****** -> Construct an ARP reply and send it back.\n");
       memcpy(eHdr->ether_shost, (uint8_t *) myInterface->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(eHdr->ether_dhost, (uint8_t *) senderHardAddr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(arpHdr->ar_sha, myInterface->addr, ETHER_ADDR_LEN);
@@ -551,29 +523,32 @@ void sr_handle_arp_packet(struct sr_instance *sr,
       arpHdr->ar_op = htons(arp_op_reply);
 
       /* Imprimo el cabezal del ARP reply creado */
-      print_hdrs(packet, len);
+      DebugHdrs(packet, len);
+
+      desc->action = sr_pkt_act_local;
 
       sr_send_packet(sr, packet, len, myInterface->name);
     }
 
-    printf("******* -> ARP request processing complete.\n");
+    sr_log_debug(sr_sub_arp, "******* -> ARP request processing complete.\n");
 
   } else if (op == arp_op_reply) {  /* Si es un reply ARP */
 
-    printf("**** -> It is an ARP reply.\n");
+    sr_log_debug(sr_sub_arp, "**** -> It is an ARP reply.\n");
 
     /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-    printf("***** -> Add MAC->IP mapping of sender to my ARP cache.\n");
+    sr_log_debug(sr_sub_arp, "***** -> Add MAC->IP mapping of sender to my ARP cache.\n");
     struct sr_arpreq *arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
-    
+    desc->action = sr_pkt_act_local;
+
     if (arpReq != NULL) { /* Si hay paquetes pendientes */
 
-    	printf("****** -> Send outstanding packets.\n");
+    	sr_log_debug(sr_sub_arp, "****** -> Send outstanding packets.\n");
     	sr_arp_reply_send_pending_packets(sr, arpReq, (uint8_t *) myInterface->addr, (uint8_t *) senderHardAddr, myInterface);
     	sr_arpreq_destroy(&(sr->cache), arpReq);
 
     }
-    printf("******* -> ARP reply processing complete.\n");
+    sr_log_debug(sr_sub_arp, "******* -> ARP reply processing complete.\n");
   }
 }
 
@@ -598,26 +573,55 @@ void sr_handlepacket(struct sr_instance* sr,
         unsigned int len,
         char* interface/* lent */)
 {
+  struct sr_pkt_desc desc;
+
   assert(sr);
   assert(packet);
   assert(interface);
 
-  printf("*** -> Received packet of length %d \n",len);
+  sr_parse_packet(sr, packet, len, interface, &desc);
+  sr_handle_parsed_packet(sr, packet, len, &desc);
 
-  /* Obtengo direcciones MAC origen y destino */
-  sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *) packet;
-  uint8_t *destAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-  uint8_t *srcAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-  memcpy(destAddr, eHdr->ether_dhost, sizeof(uint8_t) * ETHER_ADDR_LEN);
-  memcpy(srcAddr, eHdr->ether_shost, sizeof(uint8_t) * ETHER_ADDR_LEN);
-  uint16_t pktType = ntohs(eHdr->ether_type);
-
-  if (is_packet_valid(packet, len)) {
-    if (pktType == ethertype_arp) {
-      sr_handle_arp_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
-    } else if (pktType == ethertype_ip) {
-      sr_handle_ip_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
-    }
+}/* end sr_ForwardPacket */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_parsed_packet(..)
+ * Scope:  Global
+ *
+ * Igual que sr_handlepacket, pero para una trama que ya paso por
+ * sr_parse_packet. sr_vns_comm.c la usa para no parsear dos veces.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handle_parsed_packet(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        struct sr_pkt_desc* desc/* lent */)
+{
+  uint64_t fr_pos = 0;
+
+  assert(sr);
+  assert(packet);
+  assert(desc);
+
+  sr_log_trace(sr_sub_fwd, "*** -> Received packet of length %d \n",len);
+
+  /* Se graba antes de manejarla: el reenvio modifica la trama */
+  if (sr->flightrec) {
+    fr_pos = sr_flightrec_rx(sr->flightrec, packet, len, desc);
+  }
+
+  if (desc->verdict != sr_pkt_ok) {
+    sr_log_debug(sr_sub_fwd, "*** -> Packet is INVALID: %s.\n", sr_pkt_verdict_str(desc->verdict));
+    desc->action = sr_pkt_act_drop_invalid;
+  } else if (desc->ethertype == ethertype_arp) {
+    sr_handle_arp_packet(sr, packet, len, desc);
+  } else if (desc->ethertype == ethertype_ip) {
+    sr_handle_ip_packet(sr, packet, len, desc);
+  }
+
+  if (sr->flightrec) {
+    sr_flightrec_set_action(sr->flightrec, fr_pos, desc->action);
   }
 
-}/* end sr_ForwardPacket */
\ No newline at end of file
+}/* -- sr_handle_parsed_packet -- */
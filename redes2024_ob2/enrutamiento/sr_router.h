@@ -15,16 +15,25 @@
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_parse.h"
 
-/* we dont like this debug , but what to do for varargs ? */
-#ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
+#include "sr_log.h"
+
+/* Debug y DebugMAC quedan como alias del log, con el subsistema del archivo
+   (SR_LOG_SUBSYS). Sin _DEBUG_ no se compilan, igual que antes. */
+#define Debug(x, args...) sr_log_debug(SR_LOG_SUBSYS, x, ## args)
 #define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
-  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
+  sr_log_debug(SR_LOG_SUBSYS, "%02x:%02x:%02x:%02x:%02x:%02x", \
+  (unsigned char)(x)[0], (unsigned char)(x)[1], (unsigned char)(x)[2], \
+  (unsigned char)(x)[3], (unsigned char)(x)[4], (unsigned char)(x)[5])
+
+/* Volcado de todos los cabezales de una trama. Es muy costoso y escribe
+   directo en stderr, por eso solo corre con el subsistema fwd en trace */
+#if SR_LOG_COMPILE_LEVEL >= SR_LOG_TRACE
+#define DebugHdrs(buf, len) \
+  do { if (sr_log_enabled(sr_sub_fwd, SR_LOG_TRACE)) print_hdrs(buf, len); } while (0)
 #else
-#define Debug(x, args...) do{}while(0)
-#define DebugMAC(x) do{}while(0)
+#define DebugHdrs(buf, len) do{}while(0)
 #endif
 
 #define INIT_TTL 255
@@ -35,6 +44,11 @@ struct sr_if;
 struct sr_rt;
 
 struct pwospf_subsys;
+struct sr_pkt_desc;
+struct sr_capture;
+struct sr_flightrec;
+struct sr_fib;
+struct sr_rib;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -52,10 +66,27 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
-    struct sr_rt* routing_table; /* routing table */
+    struct sr_rt* routing_table; /* routing table: selected routes of the RIB */
+    struct sr_rib* rib;          /* candidates of every source (sr_rt.c), or 0 */
+    struct sr_fib* fib;          /* busqueda de lpm, rutas estaticas (sr_fib.c), o 0 */
+    struct sr_fib* fib_dyn;      /* y conectadas y dinamicas elegidas, o 0 */
+    unsigned long rt_version;    /* cambia con cada alta o baja de rutas */
+    unsigned long rt_static_version; /* solo con las de rutas estaticas */
+    unsigned long fib_version;   /* rt_version con la que se armaron las capas */
+    unsigned long fib_static_version; /* rt_static_version de la capa estatica */
+    char rt_path[256];           /* archivo de texto de la tabla */
+    int64_t rt_mtime;            /* y su mtime y tamano al cargarlo */
+    uint64_t rt_size;
     struct sr_arpcache cache;   /* ARP cache */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_capture* capture;     /* captura de tramas (-l), o 0 */
+    struct sr_flightrec* flightrec; /* ultimas tramas en memoria (-F), o 0 */
+    int stopping;                   /* sr_send_packet ya no envia */
+    int senders;                    /* hilos dentro de sr_send_packet */
+
+    /* -- validacion de tramas (sr_parse.c) -- */
+    int validation_tier;            /* enum sr_validation_tier */
+    struct sr_pkt_stats pkt_stats;
 
     /* -- pwospf subsystem -- */
     struct pwospf_subsys* ospf_subsys;
@@ -66,14 +97,16 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+void sr_stop_senders(struct sr_instance* );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-void sr_handle_arp_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
-void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
+void sr_handle_parsed_packet(struct sr_instance* , uint8_t * , unsigned int , struct sr_pkt_desc* );
+void sr_handle_arp_packet(struct sr_instance*, uint8_t *, unsigned int, struct sr_pkt_desc *);
+void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, struct sr_pkt_desc *);
 void sr_send_icmp_error_packet(uint8_t, uint8_t, struct sr_instance*, uint32_t, uint8_t*);
 
 /* -- sr_if.c -- */
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
 
 
 #include <sys/socket.h>
@@ -21,9 +23,180 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_pwospf.h"
+#include "sr_fib.h"
+
+/* malformed lines reported one by one, the rest are only counted */
+#define SR_RT_MAX_REPORTED 10
+
+#define SR_RIB_MIN_BUCKETS 64
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: sr_rt_parse_ip
+ *
+ * Parse a dotted quad starting at *p and leave *p after it. Anything
+ * else inet_aton accepts (hex, fewer parts) goes through inet_aton.
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt_parse_ip(char** p, struct in_addr* out)
+{
+    char* s = *p;
+    uint32_t ip = 0;
+    int part;
+
+    for (part = 0; part < 4; part++)
+    {
+        unsigned int octet = 0;
+        int digits = 0;
+
+        while (*s >= '0' && *s <= '9' && digits < 4)
+        {
+            octet = octet * 10 + (*s++ - '0');
+            digits++;
+        }
+        if (digits == 0 || octet > 255 || (part < 3 && *s++ != '.'))
+        {
+            break;
+        }
+        ip = (ip << 8) | octet;
+    }
+
+    if (part == 4 && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n' || *s == 0))
+    {
+        out->s_addr = htonl(ip);
+        *p = s;
+        return 0;
+    }
+
+    /* -- not a plain dotted quad, let inet_aton decide -- */
+    s = *p;
+    while (*s != ' ' && *s != '\t' && *s != '\r' && *s != '\n' && *s != 0)
+    {
+        s++;
+    }
+    {
+        char tmp[32];
+        size_t len = s - *p;
+
+        if (len == 0 || len >= sizeof(tmp))
+        {
+            return -1;
+        }
+        memcpy(tmp, *p, len);
+        tmp[len] = 0;
+        if (inet_aton(tmp, out) == 0)
+        {
+            return -1;
+        }
+    }
+    *p = s;
+    return 0;
+} /* -- sr_rt_parse_ip -- */
+
+static char* sr_rt_skip_blanks(char* s)
+{
+    while (*s == ' ' || *s == '\t')
+    {
+        s++;
+    }
+    return s;
+}
+
+/*---------------------------------------------------------------------
+ * struct sr_rt_stage
+ *
+ * Routes read by sr_load_rt, in file order, before they reach the
+ * RIB. The open-addressing table over (dest, mask) finds duplicates in
+ * O(1) without touching the live table.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt_stage
+{
+    struct sr_rt* head;
+    struct sr_rt** tail;
+    struct sr_rt** slot;
+    unsigned long nslots;   /* power of two */
+    unsigned long n;
+};
+
+static struct sr_rt** sr_rt_stage_slot(struct sr_rt_stage* stage, struct in_addr dest,
+                                       struct in_addr mask)
+{
+    uint32_t h = dest.s_addr * 2654435761U ^ mask.s_addr * 0x85ebca6bU;
+    unsigned long i;
+
+    h ^= h >> 16;
+    for (i = h & (stage->nslots - 1); stage->slot[i] != 0; i = (i + 1) & (stage->nslots - 1))
+    {
+        if (stage->slot[i]->dest.s_addr == dest.s_addr &&
+            stage->slot[i]->mask.s_addr == mask.s_addr)
+        { break; }
+    }
+    return &stage->slot[i];
+} /* -- sr_rt_stage_slot -- */
+
+/* -- stage a route, returns -1 if its prefix is already staged -- */
+static int sr_rt_stage_add(struct sr_rt_stage* stage, struct in_addr dest, struct in_addr gw,
+                           struct in_addr mask, const char* iface)
+{
+    struct sr_rt** slot;
+    struct sr_rt* rt;
+
+    if (2 * (stage->n + 1) > stage->nslots)
+    {
+        struct sr_rt* it;
+
+        free(stage->slot);
+        stage->nslots = stage->nslots ? 2 * stage->nslots : SR_RIB_MIN_BUCKETS;
+        stage->slot = (struct sr_rt**) calloc(stage->nslots, sizeof(struct sr_rt*));
+        assert(stage->slot);
+        for (it = stage->head; it != 0; it = it->next)
+        { *sr_rt_stage_slot(stage, it->dest, it->mask) = it; }
+    }
+
+    slot = sr_rt_stage_slot(stage, dest, mask);
+    if (*slot != 0)
+    { return -1; }
+
+    rt = (struct sr_rt*) calloc(1, sizeof(struct sr_rt));
+    assert(rt);
+    rt->dest = dest;
+    rt->gw = gw;
+    rt->mask = mask;
+    strncpy(rt->interface, iface, sr_IFACE_NAMELEN - 1);
+    *slot = rt;
+    *stage->tail = rt;
+    stage->tail = &rt->next;
+    stage->n++;
+    return 0;
+} /* -- sr_rt_stage_add -- */
+
+static void sr_rt_stage_free(struct sr_rt_stage* stage)
+{
+    while (stage->head != 0)
+    {
+        struct sr_rt* rt = stage->head;
+
+        stage->head = rt->next;
+        free(rt);
+    }
+    free(stage->slot);
+} /* -- sr_rt_stage_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_load_rt
+ *
+ * Load the routing table in one pass: each line is
+ * "dest gateway mask iface", blank lines and lines starting with '#'
+ * are skipped. Malformed and duplicate lines are reported and skipped.
+ * The routes are staged first and replace the table only once the
+ * whole file has been read, each one costs O(1), so loading is linear.
+ *
+ * Returns -1, leaving the current table as it was, if the file can't
+ * be read or none of its route lines is valid.
  *
  *---------------------------------------------------------------------*/
 
@@ -31,14 +204,11 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
 {
     FILE* fp;
     char  line[BUFSIZ];
-    char  dest[32];
-    char  gw[32];
-    char  mask[32];
-    char  iface[32];
-    struct in_addr dest_addr;
-    struct in_addr gw_addr;
-    struct in_addr mask_addr;
-    int clear_routing_table = 0;
+    struct timespec t0, t1;
+    struct stat st;
+    struct sr_rt_stage stage;
+    struct sr_rt_diff diff;
+    unsigned long lineno = 0, routes = 0, bad = 0, dup = 0;
 
     /* -- REQUIRES -- */
     assert(filename);
@@ -48,89 +218,364 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         return -1;
     }
 
-    fp = fopen(filename,"r");
+    if ((fp = fopen(filename,"r")) == 0)
+    {
+        perror(filename);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (fstat(fileno(fp), &st) != 0)
+    {
+        st.st_mtime = 0;
+        st.st_size = 0;
+    }
+    memset(&stage, 0, sizeof(stage));
+    stage.tail = &stage.head;
 
     while( fgets(line,BUFSIZ,fp) != 0)
     {
-        sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
-        if(inet_aton(dest,&dest_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    dest);
-            return -1; 
+        struct in_addr dest_addr, gw_addr, mask_addr;
+        const char* error = 0;
+        char* p;
+        char* iface;
+        size_t len = strlen(line);
+
+        lineno++;
+        if (len == BUFSIZ - 1 && line[len - 1] != '\n')
+        {
+            int c;
+
+            /* -- skip the rest of an overlong line -- */
+            while ((c = getc(fp)) != EOF && c != '\n')
+                ;
+            error = "line too long";
         }
-        if(inet_aton(gw,&gw_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    gw);
-            return -1; 
+
+        p = sr_rt_skip_blanks(line);
+        if (error == 0 && (*p == '\n' || *p == '\r' || *p == '#' || *p == 0))
+        {
+            continue;
         }
-        if(inet_aton(mask,&mask_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    mask);
-            return -1; 
+
+        if (error == 0 && sr_rt_parse_ip(&p, &dest_addr) != 0)
+        { error = "invalid destination"; }
+
+        if (error == 0)
+        {
+            p = sr_rt_skip_blanks(p);
+            if (sr_rt_parse_ip(&p, &gw_addr) != 0)
+            { error = "invalid gateway"; }
         }
-        if( clear_routing_table == 0 ){
-            printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
-            clear_routing_table = 1;
+
+        if (error == 0)
+        {
+            p = sr_rt_skip_blanks(p);
+            if (sr_rt_parse_ip(&p, &mask_addr) != 0)
+            { error = "invalid mask"; }
+        }
+
+        if (error == 0)
+        {
+            iface = sr_rt_skip_blanks(p);
+            for (p = iface; *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != 0; p++)
+                ;
+            *p = 0;
+            if (*iface == 0)
+            { error = "missing interface"; }
+            else if (p - iface >= sr_IFACE_NAMELEN)
+            { error = "interface name too long"; }
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface, 0);
+
+        if (error != 0)
+        {
+            if (bad++ < SR_RT_MAX_REPORTED)
+            {
+                fprintf(stderr, "%s:%lu: %s, line skipped\n", filename, lineno, error);
+            }
+            continue;
+        }
+
+        /* -- one static route per prefix, the first one wins as before -- */
+        if (sr_rt_stage_add(&stage, dest_addr, gw_addr, mask_addr, iface) != 0)
+        {
+            if (dup++ < SR_RT_MAX_REPORTED)
+            {
+                fprintf(stderr, "%s:%lu: duplicate route, line skipped\n", filename, lineno);
+            }
+            continue;
+        }
+        routes++;
     } /* -- while -- */
 
+    if (ferror(fp) || (routes == 0 && bad > 0))
+    {
+        fprintf(stderr, "%s: %s, routing table left as it was\n", filename,
+                ferror(fp) ? "read error" : "no valid routes");
+        fclose(fp);
+        sr_rt_stage_free(&stage);
+        return -1;
+    }
+    fclose(fp);
+
+    /* -- the file is good, now it replaces the table -- */
+    sr->rt_mtime = st.st_mtime;
+    sr->rt_size = st.st_size;
+    snprintf(sr->rt_path, sizeof(sr->rt_path), "%s", filename);
+    if (sr->routing_table != 0)
+    {
+        printf("Loading routing table from server, clear local routing table.\n");
+    }
+    sr_clear_rt_source(sr, SR_RT_CONNECTED);
+    sr_clear_rt_source(sr, SR_RT_DYNAMIC);
+    sr_reserve_rt(sr, routes);
+    sr_rt_apply_routes(sr, stage.head, 0, &diff);
+    stage.head = 0;
+    sr_rt_stage_free(&stage);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (bad > SR_RT_MAX_REPORTED)
+    {
+        fprintf(stderr, "%s: %lu more malformed lines\n", filename, bad - SR_RT_MAX_REPORTED);
+    }
+    if (dup > SR_RT_MAX_REPORTED)
+    {
+        fprintf(stderr, "%s: %lu more duplicate routes\n", filename, dup - SR_RT_MAX_REPORTED);
+    }
+    printf("Loaded %lu routes from %s in %.1f ms (%lu lines, %lu malformed, %lu duplicate, %.1f KiB)\n",
+           routes, filename,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+           lineno, bad, dup, routes * sizeof(struct sr_rt) / 1024.0);
+
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
 /*---------------------------------------------------------------------
- * Method:
+ * RIB internals
+ *
+ * sr->rib is created on the first route. routing_table is kept as a
+ * doubly linked list (next/pprev) of the selected routes, so changing
+ * the best candidate of a prefix swaps one node in place.
  *
  *---------------------------------------------------------------------*/
 
-void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
+static struct sr_rib* sr_rib_get(struct sr_instance* sr)
+{
+    if (sr->rib == 0)
+    {
+        sr->rib = (struct sr_rib*) calloc(1, sizeof(struct sr_rib));
+        assert(sr->rib);
+        sr->rib->nbuckets = SR_RIB_MIN_BUCKETS;
+        sr->rib->bucket = (struct sr_rib_prefix**)
+            calloc(SR_RIB_MIN_BUCKETS, sizeof(struct sr_rib_prefix*));
+        assert(sr->rib->bucket);
+        sr->rib->tail = &sr->routing_table;
+    }
+    return sr->rib;
+} /* -- sr_rib_get -- */
+
+static unsigned long sr_rib_hash(const struct sr_rib* rib, struct in_addr dest, struct in_addr mask)
+{
+    uint32_t h = dest.s_addr * 2654435761U ^ mask.s_addr * 0x85ebca6bU;
+
+    h ^= h >> 16;
+    return h & (rib->nbuckets - 1);
+} /* -- sr_rib_hash -- */
+
+static struct sr_rib_prefix* sr_rib_find(const struct sr_rib* rib, struct in_addr dest, struct in_addr mask)
+{
+    struct sr_rib_prefix* p;
+
+    for (p = rib->bucket[sr_rib_hash(rib, dest, mask)]; p != 0; p = p->hnext)
+    {
+        if (p->dest.s_addr == dest.s_addr && p->mask.s_addr == mask.s_addr)
+        { return p; }
+    }
+    return 0;
+} /* -- sr_rib_find -- */
+
+/* -- rehash into nbuckets buckets (a power of two) -- */
+static void sr_rib_resize(struct sr_rib* rib, unsigned long nbuckets)
+{
+    struct sr_rib_prefix** old = rib->bucket;
+    unsigned long n = rib->nbuckets, i;
+
+    rib->nbuckets = nbuckets;
+    rib->bucket = (struct sr_rib_prefix**) calloc(rib->nbuckets, sizeof(struct sr_rib_prefix*));
+    assert(rib->bucket);
+    for (i = 0; i < n; i++)
+    {
+        while (old[i] != 0)
+        {
+            struct sr_rib_prefix* p = old[i];
+            unsigned long h = sr_rib_hash(rib, p->dest, p->mask);
+
+            old[i] = p->hnext;
+            p->hnext = rib->bucket[h];
+            rib->bucket[h] = p;
+        }
+    }
+    free(old);
+} /* -- sr_rib_resize -- */
+
+/* -- append rt to routing_table -- */
+static void sr_rt_select(struct sr_rib* rib, struct sr_rt* rt)
+{
+    rt->next = 0;
+    rt->pprev = rib->tail;
+    *rib->tail = rt;
+    rib->tail = &rt->next;
+    rib->nselected++;
+    if (rt->admin_dst <= 1)
+    { rib->nlocal++; }
+} /* -- sr_rt_select -- */
+
+/* -- take rt out of routing_table -- */
+static void sr_rt_unselect(struct sr_rib* rib, struct sr_rt* rt)
+{
+    *rt->pprev = rt->next;
+    if (rt->next != 0)
+    { rt->next->pprev = rt->pprev; }
+    else
+    { rib->tail = rt->pprev; }
+    rt->next = 0;
+    rt->pprev = 0;
+    rib->nselected--;
+    if (rt->admin_dst <= 1)
+    { rib->nlocal--; }
+} /* -- sr_rt_unselect -- */
+
+/* -- put rt in the place old had in routing_table -- */
+static void sr_rt_reselect(struct sr_rib* rib, struct sr_rt* old, struct sr_rt* rt)
+{
+    rt->next = old->next;
+    rt->pprev = old->pprev;
+    *rt->pprev = rt;
+    if (rt->next != 0)
+    { rt->next->pprev = &rt->next; }
+    else
+    { rib->tail = &rt->next; }
+    old->next = 0;
+    old->pprev = 0;
+    if (old->admin_dst <= 1)
+    { rib->nlocal--; }
+    if (rt->admin_dst <= 1)
+    { rib->nlocal++; }
+} /* -- sr_rt_reselect -- */
+
+static void sr_rt_source_link(struct sr_rib* rib, struct sr_rt** head, struct sr_rt* rt)
+{
+    rt->snext = *head;
+    if (rt->snext != 0)
+    { rt->snext->spprev = &rt->snext; }
+    rt->spprev = head;
+    *head = rt;
+    rib->ncand[SR_RT_SOURCE(rt->admin_dst)]++;
+} /* -- sr_rt_source_link -- */
+
+static void sr_rt_source_unlink(struct sr_rib* rib, struct sr_rt* rt)
+{
+    *rt->spprev = rt->snext;
+    if (rt->snext != 0)
+    { rt->snext->spprev = rt->spprev; }
+    rt->snext = 0;
+    rt->spprev = 0;
+    rib->ncand[SR_RT_SOURCE(rt->admin_dst)]--;
+} /* -- sr_rt_source_unlink -- */
+
+/* -- candidate of the same source as admin_dst, or 0 -- */
+static struct sr_rt* sr_rib_candidate(const struct sr_rib_prefix* p, uint8_t admin_dst)
+{
+    struct sr_rt* rt;
+
+    for (rt = p->cand; rt != 0; rt = rt->alt)
+    {
+        if (SR_RT_SOURCE(rt->admin_dst) == SR_RT_SOURCE(admin_dst))
+        { return rt; }
+    }
+    return 0;
+} /* -- sr_rib_candidate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_add_rt_entry
+ *
+ * Add a candidate route. A prefix keeps one candidate per source: if
+ * there is already one from the same source it is updated. The
+ * candidate with the lowest admin_dst is the one in routing_table.
+ * O(1) on average. Returns the route.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
 struct in_addr gw, struct in_addr mask, char* if_name, uint8_t admin_dst)
 {
-    struct sr_rt* rt_walker = 0;
+    struct sr_rib* rib;
+    struct sr_rib_prefix* p;
+    struct sr_rt* rt;
+    struct sr_rt** link;
 
     /* -- REQUIRES -- */
     assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
+    rib = sr_rib_get(sr);
+    p = sr_rib_find(rib, dest, mask);
+    if (p != 0 && (rt = sr_rib_candidate(p, admin_dst)) != 0)
     {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
-        sr->routing_table->admin_dst = admin_dst;
-
-        return;
+        if (rt->admin_dst == admin_dst)
+        {
+            rt->gw = gw;
+            strncpy(rt->interface, if_name, sr_IFACE_NAMELEN - 1);
+            sr->rt_version++;
+            return rt;
+        }
+        /* -- same source, new distance: it may move among the candidates -- */
+        sr_del_rt_entry(sr, rt);
+        p = sr_rib_find(rib, dest, mask);
     }
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+    if (p == 0)
+    {
+        unsigned long h;
+
+        p = (struct sr_rib_prefix*) calloc(1, sizeof(struct sr_rib_prefix));
+        assert(p);
+        p->dest = dest;
+        p->mask = mask;
+        h = sr_rib_hash(rib, dest, mask);
+        p->hnext = rib->bucket[h];
+        rib->bucket[h] = p;
+        /* -- double the buckets once there is more than one prefix per bucket -- */
+        if (++rib->nprefixes > rib->nbuckets)
+        { sr_rib_resize(rib, rib->nbuckets * 2); }
     }
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
-
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
-    rt_walker->admin_dst = admin_dst;
+    rt = (struct sr_rt*) calloc(1, sizeof(struct sr_rt));
+    assert(rt);
+    rt->dest = dest;
+    rt->gw   = gw;
+    rt->mask = mask;
+    strncpy(rt->interface, if_name, sr_IFACE_NAMELEN - 1);
+    rt->admin_dst = admin_dst;
+    rt->prefix = p;
+
+    /* -- keep the candidates ordered, the first one is selected -- */
+    for (link = &p->cand; *link != 0 && (*link)->admin_dst <= admin_dst; link = &(*link)->alt)
+        ;
+    rt->alt = *link;
+    *link = rt;
+    if (link == &p->cand)
+    {
+        if (rt->alt != 0)
+        { sr_rt_reselect(rib, rt->alt, rt); }
+        else
+        { sr_rt_select(rib, rt); }
+    }
+    sr_rt_source_link(rib, &rib->source[SR_RT_SOURCE(admin_dst)], rt);
+    sr->rt_version++;
+    if (SR_RT_SOURCE(admin_dst) == SR_RT_STATIC)
+    { sr->rt_static_version++; }
 
+    return rt;
 } /* -- sr_add_entry -- */
 
 /*---------------------------------------------------------------------
@@ -182,6 +627,25 @@ void sr_print_routing_entry(struct sr_rt* entry)
 
 } /* -- sr_print_routing_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_reserve_rt
+ *
+ * Size the RIB hash for n prefixes before a bulk load, so that it is
+ * not rehashed along the way
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_reserve_rt(struct sr_instance* sr, unsigned long n)
+{
+    struct sr_rib* rib = sr_rib_get(sr);
+    unsigned long nbuckets = rib->nbuckets;
+
+    while (nbuckets < n)
+    { nbuckets *= 2; }
+    if (nbuckets != rib->nbuckets)
+    { sr_rib_resize(rib, nbuckets); }
+} /* -- sr_reserve_rt -- */
+
 /*---------------------------------------------------------------------
  * Method: count_routes
  *
@@ -191,17 +655,7 @@ void sr_print_routing_entry(struct sr_rt* entry)
 
 int count_routes(struct sr_instance* sr)
 {
-    int count = 0;
-    struct sr_rt* entry = sr->routing_table;
-    while(entry != NULL)
-    {
-        if (entry->admin_dst <= 1)
-        {
-            count++;
-        }
-        entry = entry->next;
-    }
-    return count;
+    return sr->rib != 0 ? sr->rib->nlocal : 0;
 } /* -- count_routes -- */
 
 /*---------------------------------------------------------------------
@@ -213,68 +667,284 @@ int count_routes(struct sr_instance* sr)
 
 void clear_routes(struct sr_instance* sr)
 {
-    struct sr_rt* entry = sr->routing_table;
-    while(entry/*->next*/ != NULL)
+    sr_clear_rt_source(sr, SR_RT_DYNAMIC);
+} /* -- clean_routes -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_clear_rt_source
+ *
+ * Delete every route of one source (SR_RT_STATIC, ...), in time
+ * proportional to the routes of that source
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_clear_rt_source(struct sr_instance* sr, int source)
+{
+    if (sr->rib == 0)
+    { return; }
+    while (sr->rib->source[source] != 0)
     {
-/*printf("entry: %s\t", inet_ntoa(entry->dest));*/
-        if (entry->next == NULL)
-        {
-            break;
-        }
-/*printf("entry->next: %s\n", inet_ntoa(entry->next->dest));*/
-        if (entry->next->admin_dst > 1)
+        sr_del_rt_entry(sr, sr->rib->source[source]);
+    }
+} /* -- sr_clear_rt_source -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_del_rt_entry
+ *
+ * Delete route. If it was selected, the next candidate for the prefix
+ * takes its place in routing_table.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_del_rt_entry(struct sr_instance* sr, struct sr_rt* rt)
+{
+    struct sr_rib* rib = sr->rib;
+    struct sr_rib_prefix* p = rt->prefix;
+    struct sr_rt** link;
+
+    for (link = &p->cand; *link != rt; link = &(*link)->alt)
+        ;
+    *link = rt->alt;
+
+    if (rt->pprev != 0)
+    {
+        if (p->cand != 0)
+        { sr_rt_reselect(rib, rt, p->cand); }
+        else
+        { sr_rt_unselect(rib, rt); }
+    }
+
+    if (p->cand == 0)
+    {
+        struct sr_rib_prefix** pl;
+
+        for (pl = &rib->bucket[sr_rib_hash(rib, p->dest, p->mask)]; *pl != p; pl = &(*pl)->hnext)
+            ;
+        *pl = p->hnext;
+        rib->nprefixes--;
+        free(p);
+    }
+
+    if (SR_RT_SOURCE(rt->admin_dst) == SR_RT_STATIC)
+    { sr->rt_static_version++; }
+    sr_rt_source_unlink(rib, rt);
+    free(rt);
+    sr->rt_version++;
+} /* -- sr_del_rt_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: check_route
+ *
+ * Check route existance, from any source
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t check_route(struct sr_instance* sr, struct in_addr dest, struct in_addr mask)
+{
+    return sr->rib != 0 && sr_rib_find(sr->rib, dest, mask) != 0;
+} /* -- check_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_find_rt_entry
+ *
+ * Candidate for dest/mask from the source of admin_dst, or 0
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_find_rt_entry(struct sr_instance* sr, struct in_addr dest,
+                               struct in_addr mask, uint8_t admin_dst)
+{
+    struct sr_rib_prefix* p;
+
+    if (sr->rib == 0 || (p = sr_rib_find(sr->rib, dest, mask)) == 0)
+    { return 0; }
+    return sr_rib_candidate(p, admin_dst);
+} /* -- sr_find_rt_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_apply_one
+ *
+ * Install rt as the candidate of the source of admin_dst for its
+ * prefix and leave it at the front of that source list (head). An
+ * existing candidate is updated in place. Counts the result in diff.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_apply_one(struct sr_instance* sr, struct sr_rib* rib, struct sr_rt** head,
+                            struct sr_rt* rt, uint8_t admin_dst, struct sr_rt_diff* diff)
+{
+    struct sr_rt* cur = sr_find_rt_entry(sr, rt->dest, rt->mask, admin_dst);
+
+    if (cur == 0 || cur->admin_dst != admin_dst)
+    {
+        if (cur != 0)
         {
-            sr_del_rt_entry(entry);
+            sr_del_rt_entry(sr, cur);
+            diff->changed++;
         }
         else
+        { diff->added++; }
+        sr_add_rt_entry(sr, rt->dest, rt->gw, rt->mask, rt->interface, admin_dst);
+    }
+    else
+    {
+        sr_rt_source_unlink(rib, cur);
+        sr_rt_source_link(rib, head, cur);
+        if (cur->gw.s_addr != rt->gw.s_addr ||
+            strncmp(cur->interface, rt->interface, sr_IFACE_NAMELEN) != 0)
         {
-            entry = entry->next;
+            cur->gw = rt->gw;
+            memcpy(cur->interface, rt->interface, sr_IFACE_NAMELEN);
+            sr->rt_version++;
+            diff->changed++;
         }
+        else
+        { diff->unchanged++; }
     }
-} /* -- clean_routes -- */
+} /* -- sr_rt_apply_one -- */
 
 /*---------------------------------------------------------------------
- * Method: sr_del_rt_entry
+ * Method: sr_rt_apply_routes
+ *
+ * Make the routes of the source of admin_dst equal to the list
+ * "routes", touching only what differs: routes missing from the list
+ * are withdrawn, routes with a new gateway or interface are updated in
+ * place and new prefixes are added. Each route costs one lookup in the
+ * RIB hash, so a run is O(n + withdrawn).
  *
- * Delete route
+ * The whole batch is applied under the pwospf lock, lpm() sees either
+ * the old or the new set, and the FIB layers are brought up to date
+ * before the lock is released. The nodes of "routes" are consumed.
+ * Returns the number of routes added, changed or withdrawn; if it is 0
+ * the table (and the FIB built from it) is left untouched.
  *
  *---------------------------------------------------------------------*/
 
-void sr_del_rt_entry(struct sr_rt* previous_entry)
+int sr_rt_apply_routes(struct sr_instance* sr, struct sr_rt* routes,
+                       uint8_t admin_dst, struct sr_rt_diff* diff)
 {
-    struct sr_rt* temp = previous_entry->next;
+    struct sr_rib* rib;
+    struct sr_rt* stale;
+    struct sr_rt** head;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(diff);
+
+    memset(diff, 0, sizeof(*diff));
+    rib = sr_rib_get(sr);
+    head = &rib->source[SR_RT_SOURCE(admin_dst)];
+
+    if (sr->ospf_subsys != 0)
+    { pwospf_lock(sr->ospf_subsys); }
+
+    /* -- whatever is still in "stale" at the end was not computed again -- */
+    stale = *head;
+    *head = 0;
+    if (stale != 0)
+    { stale->spprev = &stale; }
 
-    if (previous_entry->next->next != NULL)
+    while (routes != 0)
     {
-        previous_entry->next = previous_entry->next->next;
+        struct sr_rt* rt = routes;
+
+        routes = rt->next;
+        sr_rt_apply_one(sr, rib, head, rt, admin_dst, diff);
+        free(rt);
     }
-    else
+
+    while (stale != 0)
     {
-        previous_entry->next = NULL;
+        sr_del_rt_entry(sr, stale);
+        diff->withdrawn++;
     }
+    sr_fib_update(sr);
 
-    free(temp);
-} /* -- sr_del_rt_entry -- */
+    if (sr->ospf_subsys != 0)
+    { pwospf_unlock(sr->ospf_subsys); }
+
+    return diff->added + diff->changed + diff->withdrawn;
+} /* -- sr_rt_apply_routes -- */
 
 /*---------------------------------------------------------------------
- * Method: check_route
+ * Method: sr_rt_update_routes
  *
- * Check route existance
+ * Partial version of sr_rt_apply_routes: the routes in "routes" are
+ * added or updated and the prefixes in "withdrawn" (dest and mask)
+ * removed from the source of admin_dst, every other route of the
+ * source stays as it is. Costs one RIB lookup per listed route. Same
+ * locking and return value as sr_rt_apply_routes; both lists are
+ * consumed.
  *
  *---------------------------------------------------------------------*/
 
-uint8_t check_route(struct sr_instance* sr, struct in_addr route)
+int sr_rt_update_routes(struct sr_instance* sr, struct sr_rt* routes, struct sr_rt* withdrawn,
+                        uint8_t admin_dst, struct sr_rt_diff* diff)
 {
-    struct sr_rt* entry = sr->routing_table;
-    while(entry != NULL)
+    struct sr_rib* rib;
+    struct sr_rt** head;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(diff);
+
+    memset(diff, 0, sizeof(*diff));
+    rib = sr_rib_get(sr);
+    head = &rib->source[SR_RT_SOURCE(admin_dst)];
+
+    if (sr->ospf_subsys != 0)
+    { pwospf_lock(sr->ospf_subsys); }
+
+    while (routes != 0)
+    {
+        struct sr_rt* rt = routes;
+
+        routes = rt->next;
+        sr_rt_apply_one(sr, rib, head, rt, admin_dst, diff);
+        free(rt);
+    }
+
+    while (withdrawn != 0)
     {
-        if (entry->dest.s_addr == route.s_addr)
+        struct sr_rt* rt = withdrawn;
+        struct sr_rt* cur = sr_find_rt_entry(sr, rt->dest, rt->mask, admin_dst);
+
+        withdrawn = rt->next;
+        if (cur != 0 && cur->admin_dst == admin_dst)
         {
-            return 1;
+            sr_del_rt_entry(sr, cur);
+            diff->withdrawn++;
         }
-
-        entry = entry->next;
+        free(rt);
     }
+    sr_fib_update(sr);
 
-    return 0;
-} /* -- check_route -- */
+    if (sr->ospf_subsys != 0)
+    { pwospf_unlock(sr->ospf_subsys); }
+
+    return diff->added + diff->changed + diff->withdrawn;
+} /* -- sr_rt_update_routes -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_print_rib_stats
+ *
+ * Prefixes and candidates per source
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_print_rib_stats(struct sr_instance* sr, FILE* out)
+{
+    struct sr_rib* rib = sr->rib;
+
+    if (rib == 0)
+    {
+        fprintf(out, "rib: empty\n");
+        return;
+    }
+    fprintf(out, "rib: %lu prefixes in %lu buckets, candidates %lu static, "
+            "%lu connected, %lu dynamic\n",
+            rib->nprefixes, rib->nbuckets, rib->ncand[SR_RT_STATIC],
+            rib->ncand[SR_RT_CONNECTED], rib->ncand[SR_RT_DYNAMIC]);
+    fprintf(out, "selected: %lu routes, %lu static or connected\n",
+            rib->nselected, rib->nlocal);
+} /* -- sr_print_rib_stats -- */
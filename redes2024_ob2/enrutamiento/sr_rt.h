@@ -16,15 +16,22 @@
 #include <sys/types.h>
 #endif
 
+#include <stdio.h>
 #include <netinet/in.h>
 
 #include "sr_if.h"
 
+struct sr_rib_prefix;
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
  * Node in the routing table 
  *
+ * Every route is a candidate in the RIB. Only the best candidate of each
+ * prefix (lowest admin_dst) is linked through "next" into
+ * sr->routing_table, the list the forwarding code walks.
+ *
  * -------------------------------------------------------------------------- */
 
 struct sr_rt
@@ -38,11 +45,73 @@ struct sr_rt
     /* New Field */
     uint8_t admin_dst;
     /*************/
+
+    /* -- RIB links, owned by sr_rt.c -- */
+    struct sr_rib_prefix* prefix;   /* prefix this route is a candidate for */
+    struct sr_rt* alt;              /* next candidate, higher admin_dst */
+    struct sr_rt** pprev;           /* link pointing here in routing_table, 0 if not selected */
+    struct sr_rt* snext;            /* routes of the same source */
+    struct sr_rt** spprev;
 };
 
+/* ----------------------------------------------------------------------------
+ * Route sources. A prefix holds at most one candidate per source.
+ * -------------------------------------------------------------------------- */
+
+#define SR_RT_STATIC    0   /* admin_dst 0, rtable file */
+#define SR_RT_CONNECTED 1   /* admin_dst 1 */
+#define SR_RT_DYNAMIC   2   /* anything else, PWOSPF uses 110 */
+#define SR_RT_NSOURCES  3
+
+#define SR_RT_SOURCE(admin_dst) ((admin_dst) <= 1 ? (admin_dst) : SR_RT_DYNAMIC)
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rib_prefix / struct sr_rib
+ *
+ * Candidates keyed by (dest, mask) in a chained hash, plus one list of
+ * routes per source so that a whole source can be dropped in time
+ * proportional to its size.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rib_prefix
+{
+    struct in_addr dest;
+    struct in_addr mask;
+    struct sr_rt* cand;             /* candidates, by increasing admin_dst */
+    struct sr_rib_prefix* hnext;
+};
+
+struct sr_rib
+{
+    struct sr_rib_prefix** bucket;
+    unsigned long nbuckets;         /* power of two */
+    unsigned long nprefixes;
+    struct sr_rt* source[SR_RT_NSOURCES];
+    unsigned long ncand[SR_RT_NSOURCES];
+    struct sr_rt** tail;            /* last link of routing_table */
+    unsigned long nselected;
+    unsigned long nlocal;           /* selected with admin_dst <= 1 */
+};
+
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_diff
+ *
+ * What sr_rt_apply_routes or sr_rt_update_routes changed in the table
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_diff
+{
+    unsigned long added;
+    unsigned long changed;      /* same prefix, new gateway or interface */
+    unsigned long withdrawn;
+    unsigned long unchanged;
+};
 
 int sr_load_rt(struct sr_instance*,const char*);
-void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
+struct sr_rt* sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*, uint8_t);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
@@ -50,7 +119,14 @@ void sr_print_routing_entry(struct sr_rt* entry);
 
 int count_routes(struct sr_instance*);
 void clear_routes(struct sr_instance*);
-void sr_del_rt_entry(struct sr_rt*);
-uint8_t check_route(struct sr_instance*, struct in_addr);
+void sr_del_rt_entry(struct sr_instance*, struct sr_rt*);
+uint8_t check_route(struct sr_instance*, struct in_addr, struct in_addr);
+struct sr_rt* sr_find_rt_entry(struct sr_instance*, struct in_addr, struct in_addr, uint8_t);
+void sr_clear_rt_source(struct sr_instance*, int);
+void sr_reserve_rt(struct sr_instance*, unsigned long);
+void sr_print_rib_stats(struct sr_instance*, FILE*);
+int sr_rt_apply_routes(struct sr_instance*, struct sr_rt*, uint8_t, struct sr_rt_diff*);
+int sr_rt_update_routes(struct sr_instance*, struct sr_rt*, struct sr_rt*, uint8_t,
+                        struct sr_rt_diff*);
 
 #endif  /* --  sr_RT_H -- */
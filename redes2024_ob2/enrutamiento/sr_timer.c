@@ -0,0 +1,235 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Descripción:
+ *
+ * Min-heap binario de punteros a timer, ordenado por vencimiento; cada
+ * timer guarda su posicion para que rearmarlo o cancelarlo no tenga que
+ * buscarlo. El hilo espera en una variable de condicion sobre
+ * CLOCK_MONOTONIC hasta el vencimiento de la raiz, asi que un timer vence
+ * en su momento y no en el siguiente tick. Se lo despierta solo cuando
+ * cambia la raiz.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_LOG_SUBSYS sr_sub_ospf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "sr_timer.h"
+#include "sr_router.h"
+#include "sr_log.h"
+
+static pthread_mutex_t g_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_timer_cond;
+static int g_timer_started;
+static struct sr_timer** g_heap;
+static uint32_t g_heap_n;
+static uint32_t g_heap_cap;
+
+uint64_t sr_timer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * SR_TIMER_SEC + ts.tv_nsec;
+}
+
+static void heap_set(uint32_t i, struct sr_timer* t)
+{
+    g_heap[i] = t;
+    t->slot = i;
+}
+
+static void heap_up(uint32_t i)
+{
+    struct sr_timer* t = g_heap[i];
+
+    while (i > 0 && g_heap[(i - 1) / 2]->deadline > t->deadline)
+    {
+        heap_set(i, g_heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(i, t);
+}
+
+static void heap_down(uint32_t i)
+{
+    struct sr_timer* t = g_heap[i];
+
+    for (;;)
+    {
+        uint32_t c = 2 * i + 1;
+
+        if (c >= g_heap_n)
+        {
+            break;
+        }
+        if (c + 1 < g_heap_n && g_heap[c + 1]->deadline < g_heap[c]->deadline)
+        {
+            c++;
+        }
+        if (g_heap[c]->deadline >= t->deadline)
+        {
+            break;
+        }
+        heap_set(i, g_heap[c]);
+        i = c;
+    }
+    heap_set(i, t);
+}
+
+/* Saca el timer de la posicion i; el ultimo ocupa su lugar */
+static void heap_remove(uint32_t i)
+{
+    struct sr_timer* t = g_heap[i];
+
+    g_heap_n--;
+    if (i < g_heap_n)
+    {
+        struct sr_timer* last = g_heap[g_heap_n];
+
+        heap_set(i, last);
+        heap_up(i);
+        heap_down(last->slot);
+    }
+    t->slot = SR_TIMER_IDLE;
+}
+
+/*---------------------------------------------------------------------
+ * Method: timer_thread
+ *
+ * Duerme hasta el vencimiento de la raiz y llama a las funciones de los
+ * timers vencidos, de a una y sin el lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* timer_thread(void* arg)
+{
+    pthread_mutex_lock(&g_timer_lock);
+    for (;;)
+    {
+        struct sr_timer* t;
+
+        if (g_heap_n == 0)
+        {
+            pthread_cond_wait(&g_timer_cond, &g_timer_lock);
+            continue;
+        }
+        t = g_heap[0];
+        if (t->deadline > sr_timer_now())
+        {
+            struct timespec ts;
+            ts.tv_sec = t->deadline / SR_TIMER_SEC;
+            ts.tv_nsec = t->deadline % SR_TIMER_SEC;
+            pthread_cond_timedwait(&g_timer_cond, &g_timer_lock, &ts);
+            continue;
+        }
+        heap_remove(0);
+        pthread_mutex_unlock(&g_timer_lock);
+
+        t->fn(t);
+
+        pthread_mutex_lock(&g_timer_lock);
+    }
+    return NULL;
+} /* -- timer_thread -- */
+
+static int timer_start(void)
+{
+    pthread_condattr_t attr;
+    pthread_attr_t tattr;
+    pthread_t tid;
+    int err;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_attr_init(&tattr);
+    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&tid, &tattr, timer_thread, 0);
+    pthread_attr_destroy(&tattr);
+    if (err != 0)
+    {
+        sr_log_error(SR_LOG_SUBSYS, "timers: pthread_create failed (%d)\n", err);
+        pthread_cond_destroy(&g_timer_cond);
+        return -1;
+    }
+    g_timer_started = 1;
+    return 0;
+}
+
+void sr_timer_init(struct sr_timer* t, sr_timer_fn fn, void* arg)
+{
+    t->deadline = 0;
+    t->slot = SR_TIMER_IDLE;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+void sr_timer_arm(struct sr_timer* t, uint64_t deadline)
+{
+    pthread_mutex_lock(&g_timer_lock);
+    if (!g_timer_started && timer_start() != 0)
+    {
+        pthread_mutex_unlock(&g_timer_lock);
+        return;
+    }
+
+    t->deadline = deadline;
+    if (t->slot == SR_TIMER_IDLE)
+    {
+        if (g_heap_n == g_heap_cap)
+        {
+            uint32_t cap = g_heap_cap ? g_heap_cap * 2 : 64;
+            struct sr_timer** heap = realloc(g_heap, cap * sizeof(struct sr_timer*));
+
+            if (heap == NULL)
+            {
+                pthread_mutex_unlock(&g_timer_lock);
+                return;
+            }
+            g_heap = heap;
+            g_heap_cap = cap;
+        }
+        heap_set(g_heap_n++, t);
+        heap_up(t->slot);
+    }
+    else
+    {
+        heap_up(t->slot);
+        heap_down(t->slot);
+    }
+
+    /* Si quedo primero el hilo tiene que esperar menos */
+    if (t->slot == 0)
+    {
+        pthread_cond_signal(&g_timer_cond);
+    }
+    pthread_mutex_unlock(&g_timer_lock);
+}
+
+void sr_timer_cancel(struct sr_timer* t)
+{
+    pthread_mutex_lock(&g_timer_lock);
+    if (t->slot != SR_TIMER_IDLE)
+    {
+        heap_remove(t->slot);
+    }
+    pthread_mutex_unlock(&g_timer_lock);
+}
+
+int sr_timer_armed(struct sr_timer* t)
+{
+    int armed;
+
+    pthread_mutex_lock(&g_timer_lock);
+    armed = t->slot != SR_TIMER_IDLE;
+    pthread_mutex_unlock(&g_timer_lock);
+
+    return armed;
+}
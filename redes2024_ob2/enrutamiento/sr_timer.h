@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Descripción:
+ *
+ * Timers por vencimiento absoluto (ns de CLOCK_MONOTONIC) en un min-heap,
+ * atendidos por un solo hilo que duerme hasta el vencimiento mas cercano.
+ * Armar, rearmar o cancelar cuesta O(log n) y solo los timers que vencen
+ * cuestan trabajo; no hay un barrido por segundo.
+ *
+ * El struct sr_timer va dentro del objeto al que pertenece. La funcion
+ * corre en el hilo de los timers sin el lock del heap: si el dueño puede
+ * rearmar el timer (o liberar el objeto) desde otro hilo, la funcion toma
+ * el lock del dueño y con sr_timer_armed se fija si el timer se rearmo
+ * mientras tanto.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_IDLE 0xffffffff
+
+#define SR_TIMER_SEC 1000000000ULL
+
+struct sr_timer;
+typedef void (*sr_timer_fn)(struct sr_timer*);
+
+struct sr_timer
+{
+    uint64_t deadline;    /* ns de CLOCK_MONOTONIC */
+    uint32_t slot;        /* posicion en el heap, SR_TIMER_IDLE si no esta armado */
+    sr_timer_fn fn;
+    void* arg;
+};
+
+/* Reloj de los timers */
+uint64_t sr_timer_now(void);
+
+/* Deja el timer desarmado, con la funcion a llamar cuando venza */
+void sr_timer_init(struct sr_timer* t, sr_timer_fn fn, void* arg);
+
+/* Arma el timer para deadline, o lo mueve si ya estaba armado. El hilo de
+   los timers arranca con el primer timer que se arma. */
+void sr_timer_arm(struct sr_timer* t, uint64_t deadline);
+
+/* Desarma el timer; no espera a una funcion que ya este corriendo */
+void sr_timer_cancel(struct sr_timer* t);
+
+/* 1 si el timer esta armado */
+int sr_timer_armed(struct sr_timer* t);
+
+#endif /* SR_TIMER_H */
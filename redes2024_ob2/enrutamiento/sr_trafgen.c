@@ -0,0 +1,1268 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trafgen.c
+ *
+ * Descripción:
+ *
+ * Generador y sumidero de trafico para pruebas de carga del router. Se
+ * conecta como el host de un enlace (client, server1, ...) a un servidor
+ * VNS, normalmente sr_vnsd, con el mismo protocolo que ./sr: autenticacion
+ * con sha1.c y auth_key, VNSOPEN y VNSHWINFO con su unica interfaz.
+ *
+ * Como generador emite, a tasa fija o en lazo abierto (llegadas de
+ * Poisson), una mezcla configurable de:
+ *
+ *   icmp  echo request hacia el destino
+ *   udp   datagrama UDP hacia el destino (puerto 9, discard)
+ *   ttl   datagrama UDP con TTL 1, que el router tiene que descartar
+ *         contestando time exceeded
+ *
+ * Los destinos son direcciones o nombres de ../IP_CONFIG (-c). Cada
+ * paquete lleva en su carga un numero de secuencia por destino y tipo y
+ * el instante de envio (CLOCK_MONOTONIC: la latencia en un sentido solo
+ * tiene sentido con todos los procesos en la misma maquina).
+ *
+ * Como sumidero contesta ARP y echo request a su IP y mide, por origen y
+ * tipo, tramas recibidas, tasa, perdidas y desorden (segun la secuencia)
+ * y la latencia en un sentido. Las echo reply que vuelven al generador se
+ * miden igual, con la latencia de ida y vuelta. Un mismo proceso puede
+ * generar y medir a la vez.
+ *
+ * Uso: ./sr_trafgen -v host [-s server] [-p port] [-k auth_key] [-c IP_CONFIG]
+ *                   [-g gateway] [-d dst,...|all] [-M icmp=N,udp=N,ttl=N]
+ *                   [-r pps] [-P] [-l bytes] [-n count] [-t seconds] [-i seconds]
+ *
+ * Sin -d (o con -r 0) solo mide. Por ejemplo, con sr_vnsd y los tres
+ * routers corriendo:
+ *
+ *   ./sr_trafgen -v server1 -c ../IP_CONFIG -i 1 &
+ *   ./sr_trafgen -v client -c ../IP_CONFIG -g 100.0.0.50 -d server1 \
+ *                -M icmp=1,udp=8,ttl=1 -r 50000 -P -t 10
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <poll.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sha1.h"
+#include "vnscommand.h"
+
+#define TG_DEFAULT_SERVER "127.0.0.1"
+#define TG_DEFAULT_PORT   8888
+#define TG_MAX_DSTS       32
+#define TG_MAX_FLOWS      256
+#define TG_HIST_BUCKETS   40          /* hasta 2^40 ns */
+#define TG_MAX_MSG        10000
+#define TG_IN_BUF         65536
+#define TG_OUT_BUF        65536
+#define TG_MAX_BURST      256         /* tramas por vuelta antes de mirar el socket */
+#define TG_MAGIC          0x53524547  /* "SREG" */
+#define TG_UDP_SPORT      40000
+#define TG_UDP_DPORT      9
+#define TG_TTL_DPORT      33434
+#define TG_AUTH_KEY_LEN   64
+#define TG_SHA1_LEN       20
+
+/* Tipos de trafico; tg_echo_reply solo se mide */
+enum tg_kind
+{
+    tg_icmp,
+    tg_udp,
+    tg_ttl,
+    tg_echo_reply,
+    tg_kind_max
+};
+
+static const char* tg_kind_str[tg_kind_max] = { "icmp", "udp", "ttl", "echo-reply" };
+
+struct tg_udp_hdr
+{
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t len;
+    uint16_t sum;
+} __attribute__ ((packed));
+
+/* Carga de cada paquete generado (orden de red) */
+struct tg_payload
+{
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t seq;
+    uint32_t tx_hi;
+    uint32_t tx_lo;
+} __attribute__ ((packed));
+
+/* Un destino del generador */
+struct tg_dst
+{
+    uint32_t ip;                      /* orden de red */
+    uint32_t next_hop;
+    uint8_t mac[ETHER_ADDR_LEN];
+    int resolved;
+    uint32_t seq[tg_kind_max];
+    uint64_t sent[tg_kind_max];
+};
+
+/* Lo que mide el sumidero por origen y tipo */
+struct tg_flow
+{
+    uint32_t src;
+    int kind;
+    uint64_t rx;
+    uint64_t rx_bytes;
+    uint64_t rx_last;                 /* rx al ultimo reporte periodico */
+    uint32_t first_seq;
+    uint32_t max_seq;
+    uint64_t reordered;
+    uint64_t lat_sum;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t hist[TG_HIST_BUCKETS];
+};
+
+/* Interfaz del host, segun VNSHWINFO */
+static char g_ifname[16];
+static uint8_t g_mac[ETHER_ADDR_LEN];
+static uint32_t g_ip;
+static uint32_t g_mask;
+
+static int g_fd = -1;
+static uint8_t g_in[TG_IN_BUF];
+static unsigned int g_in_len;
+static uint8_t g_out[TG_OUT_BUF];
+static unsigned int g_out_len;
+
+static struct tg_dst g_dsts[TG_MAX_DSTS];
+static int g_ndsts;
+static struct tg_flow g_flows[TG_MAX_FLOWS];
+static int g_nflows;
+
+static uint64_t g_arp_replies;        /* contestadas a otros */
+static uint64_t g_echo_replies;       /* contestadas a otros */
+static uint64_t g_time_exceeded;
+static uint64_t g_unreachable;
+static uint64_t g_other_rx;
+static uint16_t g_ip_id;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    g_stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Format: %s -v host [-s server] [-p port] [-k auth_key] [-c IP_CONFIG]\n"
+                    "          [-g gateway] [-d dst,...|all] [-M icmp=N,udp=N,ttl=N]\n"
+                    "          [-r pps] [-P] [-l frame bytes] [-n count] [-t seconds]\n"
+                    "          [-i report seconds]\n", argv0);
+}
+
+/*-----------------------------------------------------------------------------
+ * Conexion con el servidor VNS
+ *---------------------------------------------------------------------------*/
+
+static int vns_connect(const char* server, unsigned short port)
+{
+    int fd, one = 1;
+
+    if (strchr(server, '/') != 0)
+    {
+        struct sockaddr_un sun;
+
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strncpy(sun.sun_path, server, sizeof(sun.sun_path) - 1);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+            connect(fd, (struct sockaddr*) &sun, sizeof(sun)) < 0)
+        {
+            perror(server);
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_in sin;
+        struct hostent* hp;
+
+        if ((hp = gethostbyname(server)) == 0)
+        {
+            fprintf(stderr, "unknown host %s\n", server);
+            return -1;
+        }
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(port);
+        memcpy(&sin.sin_addr, hp->h_addr, hp->h_length);
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+            connect(fd, (struct sockaddr*) &sin, sizeof(sin)) < 0)
+        {
+            perror(server);
+            return -1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int write_all(const void* buf, unsigned int len)
+{
+    const uint8_t* p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = send(g_fd, p, len, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("send");
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Lee un mensaje completo (bloqueante); solo durante el arranque */
+static int read_msg(uint8_t* buf, unsigned int size)
+{
+    uint32_t len = 0;
+    unsigned int got = 0;
+
+    while (got < size)
+    {
+        ssize_t n = recv(g_fd, buf + got, got < 4 ? 4 - got : len - got, 0);
+
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "server closed the connection\n");
+            return -1;
+        }
+        got += n;
+        if (got == 4)
+        {
+            memcpy(&len, buf, 4);
+            len = ntohl(len);
+            if (len < sizeof(c_base) || len > size)
+            {
+                fprintf(stderr, "bad message length %u\n", len);
+                return -1;
+            }
+        }
+        if (got >= 4 && got == len)
+        {
+            return ntohl(((c_base*) buf)->mType);
+        }
+    }
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: vns_open
+ *
+ * Autentica (como sr_handle_auth_request), abre el host y toma su
+ * interfaz de VNSHWINFO.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vns_open(const char* host, const char* key_path)
+{
+    static uint8_t buf[TG_MAX_MSG];
+    char key[TG_AUTH_KEY_LEN + 1];
+    const char* user = getenv("USER") ? getenv("USER") : "trafgen";
+    SHA1Context sha1;
+    c_open op;
+    FILE* fp;
+    int type, i, n;
+
+    memset(key, 0, sizeof(key));
+    if ((fp = fopen(key_path, "r")) != 0)
+    {
+        if (fgets(key, sizeof(key), fp) == 0)
+        {
+            key[0] = 0;
+        }
+        fclose(fp);
+    }
+
+    while ((type = read_msg(buf, sizeof(buf))) > 0)
+    {
+        if (type == VNS_AUTH_REQUEST)
+        {
+            c_auth_request* req = (c_auth_request*) buf;
+            uint8_t reply[sizeof(c_auth_reply) + 64 + TG_SHA1_LEN];
+            c_auth_reply* ar = (c_auth_reply*) reply;
+            unsigned int ulen = strlen(user) < 64 ? strlen(user) : 64;
+            unsigned int len = sizeof(*ar) + ulen + TG_SHA1_LEN;
+
+            SHA1Reset(&sha1);
+            SHA1Input(&sha1, req->salt, ntohl(req->mLen) - sizeof(*req));
+            SHA1Input(&sha1, (unsigned char*) key, TG_AUTH_KEY_LEN);
+            SHA1Result(&sha1);
+            for (i = 0; i < 5; i++)
+            {
+                sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]);
+            }
+            ar->mLen = htonl(len);
+            ar->mType = htonl(VNS_AUTH_REPLY);
+            ar->usernameLen = htonl(ulen);
+            memcpy(ar->username, user, ulen);
+            memcpy(ar->username + ulen, sha1.Message_Digest, TG_SHA1_LEN);
+            if (write_all(reply, len) != 0)
+            {
+                return -1;
+            }
+        }
+        else if (type == VNS_AUTH_STATUS)
+        {
+            if (!((c_auth_status*) buf)->auth_ok)
+            {
+                fprintf(stderr, "authentication failed: %s\n", ((c_auth_status*) buf)->msg);
+                return -1;
+            }
+            memset(&op, 0, sizeof(op));
+            op.mLen = htonl(sizeof(op));
+            op.mType = htonl(VNSOPEN);
+            strncpy(op.mVirtualHostID, host, IDSIZE - 1);
+            strncpy(op.mUID, user, IDSIZE - 1);
+            if (write_all(&op, sizeof(op)) != 0)
+            {
+                return -1;
+            }
+        }
+        else if (type == VNSHWINFO)
+        {
+            c_hwinfo* hw = (c_hwinfo*) buf;
+
+            n = (ntohl(hw->mLen) - 2 * sizeof(uint32_t)) / sizeof(c_hw_entry);
+            for (i = 0; i < n; i++)
+            {
+                /* un host tiene una sola interfaz: nos quedamos con la primera */
+                if (ntohl(hw->mHWInfo[i].mKey) == HWINTERFACE && g_ifname[0] != 0)
+                {
+                    break;
+                }
+                switch (ntohl(hw->mHWInfo[i].mKey))
+                {
+                    case HWINTERFACE:
+                        memcpy(g_ifname, hw->mHWInfo[i].value, sizeof(g_ifname) - 1);
+                        break;
+                    case HWETHER:
+                        memcpy(g_mac, hw->mHWInfo[i].value, ETHER_ADDR_LEN);
+                        break;
+                    case HWETHIP:
+                        memcpy(&g_ip, hw->mHWInfo[i].value, 4);
+                        break;
+                    case HWMASK:
+                        memcpy(&g_mask, hw->mHWInfo[i].value, 4);
+                        break;
+                }
+            }
+            return g_ifname[0] != 0 ? 0 : -1;
+        }
+        else if (type == VNSCLOSE)
+        {
+            fprintf(stderr, "server closed session: %s\n", ((c_close*) buf)->mErrorMessage);
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/* Encola una trama como VNSPACKET; se envian juntas con out_flush */
+static int out_flush(void)
+{
+    int ret = g_out_len ? write_all(g_out, g_out_len) : 0;
+
+    g_out_len = 0;
+    return ret;
+}
+
+static int out_frame(const uint8_t* frame, unsigned int len)
+{
+    c_packet_header hdr;
+
+    if (g_out_len + sizeof(hdr) + len > TG_OUT_BUF && out_flush() != 0)
+    {
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.mLen = htonl(sizeof(hdr) + len);
+    hdr.mType = htonl(VNSPACKET);
+    memcpy(hdr.mInterfaceName, g_ifname, sizeof(hdr.mInterfaceName));
+    memcpy(g_out + g_out_len, &hdr, sizeof(hdr));
+    memcpy(g_out + g_out_len + sizeof(hdr), frame, len);
+    g_out_len += sizeof(hdr) + len;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Armado de tramas
+ *---------------------------------------------------------------------------*/
+
+static void send_arp(uint16_t op, const uint8_t* tha, uint32_t tip)
+{
+    uint8_t frame[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*) frame;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*) (frame + sizeof(*eth));
+
+    memset(eth->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    if (op == arp_op_reply)
+    {
+        memcpy(eth->ether_dhost, tha, ETHER_ADDR_LEN);
+    }
+    memcpy(eth->ether_shost, g_mac, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(op);
+    memcpy(arp->ar_sha, g_mac, ETHER_ADDR_LEN);
+    arp->ar_sip = g_ip;
+    memset(arp->ar_tha, 0, ETHER_ADDR_LEN);
+    if (op == arp_op_reply)
+    {
+        memcpy(arp->ar_tha, tha, ETHER_ADDR_LEN);
+    }
+    arp->ar_tip = tip;
+    out_frame(frame, sizeof(frame));
+}
+
+static void fill_ip(sr_ip_hdr_t* ip, uint32_t dst, uint8_t proto, uint8_t ttl, unsigned int len)
+{
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_tos = 0;
+    ip->ip_len = htons(len);
+    ip->ip_id = htons(g_ip_id++);
+    ip->ip_off = htons(IP_DF);
+    ip->ip_ttl = ttl;
+    ip->ip_p = proto;
+    ip->ip_src = g_ip;
+    ip->ip_dst = dst;
+    ip->ip_sum = 0;
+    ip->ip_sum = cksum(ip, sizeof(*ip));
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: send_probe
+ *
+ * Arma y encola un paquete de tipo kind hacia dst. frame_len es el largo
+ * de la trama Ethernet completa.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void send_probe(struct tg_dst* dst, int kind, unsigned int frame_len)
+{
+    static uint8_t frame[1514];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*) frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*) (frame + sizeof(*eth));
+    uint8_t* l4 = (uint8_t*) (ip + 1);
+    struct tg_payload* pl = (struct tg_payload*) (l4 + 8);
+    unsigned int l4_len = frame_len - sizeof(*eth) - sizeof(*ip);
+    uint64_t t;
+
+    memset(frame, 0, frame_len);
+    memcpy(eth->ether_dhost, dst->mac, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, g_mac, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_ip);
+
+    t = now_ns();
+    pl->magic = htonl(TG_MAGIC);
+    pl->kind = htonl(kind);
+    pl->seq = htonl(dst->seq[kind]++);
+    pl->tx_hi = htonl((uint32_t) (t >> 32));
+    pl->tx_lo = htonl((uint32_t) t);
+
+    if (kind == tg_icmp)
+    {
+        sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*) l4;
+
+        icmp->icmp_type = 8;
+        icmp->icmp_id = htons(getpid() & 0xffff);
+        icmp->icmp_seq = htons(dst->seq[kind] & 0xffff);
+        icmp->icmp_sum = cksum(icmp, l4_len);
+        fill_ip(ip, dst->ip, ip_protocol_icmp, 64, frame_len - sizeof(*eth));
+    }
+    else
+    {
+        struct tg_udp_hdr* udp = (struct tg_udp_hdr*) l4;
+
+        udp->sport = htons(TG_UDP_SPORT);
+        udp->dport = htons(kind == tg_ttl ? TG_TTL_DPORT : TG_UDP_DPORT);
+        udp->len = htons(l4_len);
+        udp->sum = 0;                 /* opcional en IPv4 */
+        fill_ip(ip, dst->ip, ip_protocol_udp, kind == tg_ttl ? 1 : 64, frame_len - sizeof(*eth));
+    }
+
+    dst->sent[kind]++;
+    out_frame(frame, frame_len);
+}
+
+/*-----------------------------------------------------------------------------
+ * Sumidero
+ *---------------------------------------------------------------------------*/
+
+static struct tg_flow* find_flow(uint32_t src, int kind)
+{
+    struct tg_flow* f;
+    int i;
+
+    for (i = 0; i < g_nflows; i++)
+    {
+        if (g_flows[i].src == src && g_flows[i].kind == kind)
+        {
+            return &g_flows[i];
+        }
+    }
+    if (g_nflows == TG_MAX_FLOWS)
+    {
+        return 0;
+    }
+    f = &g_flows[g_nflows++];
+    memset(f, 0, sizeof(*f));
+    f->src = src;
+    f->kind = kind;
+    f->lat_min = ~0ULL;
+    return f;
+}
+
+static void account(uint32_t src, int kind, const struct tg_payload* pl, unsigned int len,
+                    uint64_t now)
+{
+    struct tg_flow* f = find_flow(src, kind);
+    uint32_t seq = ntohl(pl->seq);
+    uint64_t tx = ((uint64_t) ntohl(pl->tx_hi) << 32) | ntohl(pl->tx_lo);
+    uint64_t lat = now > tx ? now - tx : 0;
+    int b = 0;
+
+    if (f == 0)
+    {
+        return;
+    }
+    if (f->rx == 0)
+    {
+        f->first_seq = f->max_seq = seq;
+    }
+    else if (seq < f->max_seq)
+    {
+        f->reordered++;
+    }
+    else
+    {
+        f->max_seq = seq;
+    }
+    if (seq < f->first_seq)
+    {
+        f->first_seq = seq;
+    }
+    f->rx++;
+    f->rx_bytes += len;
+    f->lat_sum += lat;
+    if (lat < f->lat_min)
+    {
+        f->lat_min = lat;
+    }
+    if (lat > f->lat_max)
+    {
+        f->lat_max = lat;
+    }
+    while (b < TG_HIST_BUCKETS - 1 && (lat >> (b + 1)) != 0)
+    {
+        b++;
+    }
+    f->hist[b]++;
+}
+
+static const struct tg_payload* find_payload(const uint8_t* p, unsigned int len)
+{
+    const struct tg_payload* pl = (const struct tg_payload*) p;
+
+    return len >= sizeof(*pl) && ntohl(pl->magic) == TG_MAGIC ? pl : 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: handle_frame
+ *
+ * Atiende una trama recibida: ARP, echo request a nuestra IP, paquetes
+ * generados (medidos) y errores ICMP del router.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void handle_frame(uint8_t* frame, unsigned int len, uint64_t now)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*) frame;
+    sr_ip_hdr_t* ip;
+    unsigned int ip_len, hl;
+    uint8_t* l4;
+    int i;
+
+    if (len < sizeof(*eth))
+    {
+        return;
+    }
+
+    if (ntohs(eth->ether_type) == ethertype_arp && len >= sizeof(*eth) + sizeof(sr_arp_hdr_t))
+    {
+        sr_arp_hdr_t* arp = (sr_arp_hdr_t*) (frame + sizeof(*eth));
+
+        if (ntohs(arp->ar_op) == arp_op_request && arp->ar_tip == g_ip)
+        {
+            send_arp(arp_op_reply, arp->ar_sha, arp->ar_sip);
+            g_arp_replies++;
+        }
+        else if (ntohs(arp->ar_op) == arp_op_reply)
+        {
+            for (i = 0; i < g_ndsts; i++)
+            {
+                if (g_dsts[i].next_hop == arp->ar_sip)
+                {
+                    memcpy(g_dsts[i].mac, arp->ar_sha, ETHER_ADDR_LEN);
+                    g_dsts[i].resolved = 1;
+                }
+            }
+        }
+        return;
+    }
+
+    if (ntohs(eth->ether_type) != ethertype_ip || len < sizeof(*eth) + sizeof(*ip))
+    {
+        g_other_rx++;
+        return;
+    }
+    ip = (sr_ip_hdr_t*) (frame + sizeof(*eth));
+    hl = ip->ip_hl * 4;
+    ip_len = ntohs(ip->ip_len);
+    if (ip->ip_dst != g_ip || hl < sizeof(*ip) || ip_len < hl + 8 || sizeof(*eth) + ip_len > len)
+    {
+        g_other_rx++;
+        return;
+    }
+    l4 = (uint8_t*) ip + hl;
+
+    if (ip->ip_p == ip_protocol_icmp)
+    {
+        sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*) l4;
+        const struct tg_payload* pl = find_payload(l4 + 8, ip_len - hl - 8);
+
+        switch (icmp->icmp_type)
+        {
+            case 8:
+                if (pl != 0)
+                {
+                    account(ip->ip_src, tg_icmp, pl, len, now);
+                }
+                /* contestar en el lugar, a la MAC de la que vino */
+                memcpy(eth->ether_dhost, eth->ether_shost, ETHER_ADDR_LEN);
+                memcpy(eth->ether_shost, g_mac, ETHER_ADDR_LEN);
+                icmp->icmp_type = 0;
+                icmp->icmp_sum = 0;
+                icmp->icmp_sum = cksum(icmp, ip_len - hl);
+                ip->ip_dst = ip->ip_src;
+                ip->ip_src = g_ip;
+                ip->ip_ttl = 64;
+                ip->ip_sum = 0;
+                ip->ip_sum = cksum(ip, hl);
+                out_frame(frame, sizeof(*eth) + ip_len);
+                g_echo_replies++;
+                return;
+            case 0:
+                if (pl != 0)
+                {
+                    account(ip->ip_src, tg_echo_reply, pl, len, now);
+                    return;
+                }
+                break;
+            case 11:
+                g_time_exceeded++;
+                return;
+            case 3:
+                g_unreachable++;
+                return;
+        }
+    }
+    else if (ip->ip_p == ip_protocol_udp)
+    {
+        const struct tg_payload* pl = find_payload(l4 + 8, ip_len - hl - 8);
+
+        if (pl != 0)
+        {
+            account(ip->ip_src, tg_udp, pl, len, now);
+            return;
+        }
+    }
+    g_other_rx++;
+}
+
+/* Lee lo disponible del servidor y atiende las tramas. -1 si se cerro. */
+static int read_frames(void)
+{
+    unsigned int off = 0;
+    uint64_t now;
+    ssize_t n;
+
+    n = recv(g_fd, g_in + g_in_len, sizeof(g_in) - g_in_len, MSG_DONTWAIT);
+    if (n < 0)
+    {
+        return (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    if (n == 0)
+    {
+        fprintf(stderr, "server closed the connection\n");
+        return -1;
+    }
+    g_in_len += n;
+    now = now_ns();
+
+    while (g_in_len - off >= sizeof(c_base))
+    {
+        uint32_t len, type;
+
+        memcpy(&len, g_in + off, 4);
+        memcpy(&type, g_in + off + 4, 4);
+        len = ntohl(len);
+        if (len < sizeof(c_base) || len > TG_MAX_MSG)
+        {
+            fprintf(stderr, "bad message length %u\n", len);
+            return -1;
+        }
+        if (g_in_len - off < len)
+        {
+            break;
+        }
+        if (ntohl(type) == VNSPACKET && len > sizeof(c_packet_header))
+        {
+            handle_frame(g_in + off + sizeof(c_packet_header), len - sizeof(c_packet_header), now);
+        }
+        else if (ntohl(type) == VNSCLOSE)
+        {
+            fprintf(stderr, "server closed session\n");
+            return -1;
+        }
+        off += len;
+    }
+    memmove(g_in, g_in + off, g_in_len - off);
+    g_in_len -= off;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Reportes
+ *---------------------------------------------------------------------------*/
+
+static uint64_t hist_percentile(const uint64_t* hist, uint64_t total, double p)
+{
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < TG_HIST_BUCKETS; i++)
+    {
+        seen += hist[i];
+        if (seen >= total * p)
+        {
+            return 1ULL << (i + 1);
+        }
+    }
+    return 1ULL << TG_HIST_BUCKETS;
+}
+
+static void print_flows(double secs, double interval)
+{
+    char src[INET_ADDRSTRLEN];
+    int i;
+
+    printf("%-15s %-10s %10s %10s %9s %7s %9s %9s %9s %9s %9s\n", "source", "kind",
+           "received", interval > 0 ? "pps (last)" : "pps", "lost", "loss%", "reordered",
+           "min us", "avg us", "<p99 us", "max us");
+    for (i = 0; i < g_nflows; i++)
+    {
+        struct tg_flow* f = &g_flows[i];
+        uint64_t expected = (uint64_t) f->max_seq - f->first_seq + 1;
+        uint64_t lost = expected > f->rx ? expected - f->rx : 0;
+        double pps = interval > 0 ? (f->rx - f->rx_last) / interval : (secs > 0 ? f->rx / secs : 0);
+
+        inet_ntop(AF_INET, &f->src, src, sizeof(src));
+        printf("%-15s %-10s %10llu %10.0f %9llu %6.2f%% %9llu %9.1f %9.1f %9.1f %9.1f\n", src,
+               tg_kind_str[f->kind], (unsigned long long) f->rx, pps, (unsigned long long) lost,
+               expected ? 100.0 * lost / expected : 0.0, (unsigned long long) f->reordered,
+               f->lat_min / 1e3, f->rx ? f->lat_sum / 1e3 / f->rx : 0.0,
+               hist_percentile(f->hist, f->rx, 0.99) / 1e3, f->lat_max / 1e3);
+        f->rx_last = f->rx;
+    }
+    fflush(stdout);
+}
+
+static void print_summary(double secs)
+{
+    char ip[INET_ADDRSTRLEN];
+    uint64_t total = 0;
+    int i, k;
+
+    printf("\n%s %s: %.2f s\n", g_ifname, inet_ntop(AF_INET, &g_ip, ip, sizeof(ip)), secs);
+    if (g_ndsts > 0)
+    {
+        printf("%-15s %10s %10s %10s\n", "sent to", "icmp", "udp", "ttl");
+        for (i = 0; i < g_ndsts; i++)
+        {
+            inet_ntop(AF_INET, &g_dsts[i].ip, ip, sizeof(ip));
+            printf("%-15s %10llu %10llu %10llu\n", ip, (unsigned long long) g_dsts[i].sent[tg_icmp],
+                   (unsigned long long) g_dsts[i].sent[tg_udp],
+                   (unsigned long long) g_dsts[i].sent[tg_ttl]);
+            for (k = 0; k < tg_kind_max; k++)
+            {
+                total += g_dsts[i].sent[k];
+            }
+        }
+        printf("sent %llu packets, %.0f pps\n", (unsigned long long) total, secs > 0 ? total / secs : 0);
+    }
+    if (g_nflows > 0)
+    {
+        print_flows(secs, 0);
+    }
+    printf("time exceeded %llu, unreachable %llu, echo replies sent %llu, ARP replies sent %llu, "
+           "other %llu\n", (unsigned long long) g_time_exceeded, (unsigned long long) g_unreachable,
+           (unsigned long long) g_echo_replies, (unsigned long long) g_arp_replies,
+           (unsigned long long) g_other_rx);
+}
+
+/*-----------------------------------------------------------------------------
+ * Opciones
+ *---------------------------------------------------------------------------*/
+
+/* Busca name en IP_CONFIG ("nombre ip" por linea) */
+static int ip_config_lookup(const char* path, const char* name, uint32_t* ip)
+{
+    FILE* fp;
+    char line[256], n[64], a[64];
+    struct in_addr in;
+    int found = 0;
+
+    if (path == 0 || (fp = fopen(path, "r")) == 0)
+    {
+        return -1;
+    }
+    while (!found && fgets(line, sizeof(line), fp) != 0)
+    {
+        if (sscanf(line, "%63s %63s", n, a) == 2 && strcmp(n, name) == 0 && inet_aton(a, &in))
+        {
+            *ip = in.s_addr;
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found ? 0 : -1;
+}
+
+static int add_dst(uint32_t ip)
+{
+    int i;
+
+    if (ip == g_ip)
+    {
+        return 0;
+    }
+    for (i = 0; i < g_ndsts; i++)
+    {
+        if (g_dsts[i].ip == ip)
+        {
+            return 0;
+        }
+    }
+    if (g_ndsts == TG_MAX_DSTS)
+    {
+        fprintf(stderr, "too many destinations\n");
+        return -1;
+    }
+    g_dsts[g_ndsts++].ip = ip;
+    return 0;
+}
+
+/* "10.0.1.1,server1" o "all" (todas las de IP_CONFIG) */
+static int parse_dsts(char* spec, const char* ip_config)
+{
+    char* save = 0;
+    char* tok;
+
+    if (strcmp(spec, "all") == 0)
+    {
+        FILE* fp;
+        char line[256], n[64], a[64];
+        struct in_addr in;
+
+        if (ip_config == 0 || (fp = fopen(ip_config, "r")) == 0)
+        {
+            fprintf(stderr, "-d all needs -c IP_CONFIG\n");
+            return -1;
+        }
+        while (fgets(line, sizeof(line), fp) != 0)
+        {
+            if (sscanf(line, "%63s %63s", n, a) == 2 && inet_aton(a, &in) && add_dst(in.s_addr) != 0)
+            {
+                break;
+            }
+        }
+        fclose(fp);
+        return 0;
+    }
+
+    for (tok = strtok_r(spec, ",", &save); tok != 0; tok = strtok_r(0, ",", &save))
+    {
+        struct in_addr in;
+        uint32_t ip;
+
+        if (inet_aton(tok, &in))
+        {
+            ip = in.s_addr;
+        }
+        else if (ip_config_lookup(ip_config, tok, &ip) != 0)
+        {
+            fprintf(stderr, "unknown destination %s (give -c IP_CONFIG for names)\n", tok);
+            return -1;
+        }
+        if (add_dst(ip) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* "icmp=1,udp=8,ttl=1" */
+static int parse_mix(char* spec, unsigned int* weight)
+{
+    char* save = 0;
+    char* tok;
+    int k;
+
+    memset(weight, 0, sizeof(unsigned int) * tg_echo_reply);
+    for (tok = strtok_r(spec, ",", &save); tok != 0; tok = strtok_r(0, ",", &save))
+    {
+        char* eq = strchr(tok, '=');
+
+        for (k = 0; k < tg_echo_reply; k++)
+        {
+            if (strncmp(tok, tg_kind_str[k], eq ? (size_t) (eq - tok) : strlen(tok)) == 0 &&
+                strlen(tg_kind_str[k]) == (eq ? (size_t) (eq - tok) : strlen(tok)))
+            {
+                break;
+            }
+        }
+        if (k == tg_echo_reply)
+        {
+            fprintf(stderr, "unknown traffic kind %s\n", tok);
+            return -1;
+        }
+        weight[k] = eq ? strtoul(eq + 1, 0, 10) : 1;
+    }
+    return 0;
+}
+
+static int pick_kind(const unsigned int* weight, unsigned int total)
+{
+    unsigned int r = lrand48() % total;
+    int k;
+
+    for (k = 0; k < tg_echo_reply - 1; k++)
+    {
+        if (r < weight[k])
+        {
+            break;
+        }
+        r -= weight[k];
+    }
+    return k;
+}
+
+int main(int argc, char** argv)
+{
+    const char* server = TG_DEFAULT_SERVER;
+    const char* host = 0;
+    const char* key_path = "auth_key";
+    const char* ip_config = 0;
+    char* dst_spec = 0;
+    unsigned int port = TG_DEFAULT_PORT;
+    unsigned int weight[tg_echo_reply] = { 1, 0, 0 };
+    unsigned int total_weight = 0;
+    unsigned int frame_len = 98;      /* lo que manda ping por defecto */
+    double rate = 1000, duration = 0, interval = 0;
+    uint64_t count = 0, sent = 0;
+    uint64_t start, next_send, next_arp, next_report, end = 0;
+    struct in_addr gw;
+    struct sigaction sa;
+    int poisson = 0, resolved = 0;
+    int c, i, k;
+
+    gw.s_addr = 0;
+    while ((c = getopt(argc, argv, "hs:p:v:k:c:g:d:M:r:Pl:n:t:i:")) != EOF)
+    {
+        switch (c)
+        {
+            case 's':
+                server = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'v':
+                host = optarg;
+                break;
+            case 'k':
+                key_path = optarg;
+                break;
+            case 'c':
+                ip_config = optarg;
+                break;
+            case 'g':
+                if (inet_aton(optarg, &gw) == 0)
+                {
+                    fprintf(stderr, "invalid gateway %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'd':
+                dst_spec = optarg;
+                break;
+            case 'M':
+                if (parse_mix(optarg, weight) != 0)
+                {
+                    exit(1);
+                }
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'P':
+                poisson = 1;
+                break;
+            case 'l':
+                frame_len = atoi(optarg);
+                break;
+            case 'n':
+                count = strtoull(optarg, 0, 10);
+                break;
+            case 't':
+                duration = atof(optarg);
+                break;
+            case 'i':
+                interval = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (host == 0 || optind != argc)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    for (k = 0; k < tg_echo_reply; k++)
+    {
+        total_weight += weight[k];
+    }
+    if (total_weight == 0)
+    {
+        fprintf(stderr, "empty traffic mix\n");
+        exit(1);
+    }
+    if (frame_len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8 + sizeof(struct tg_payload) ||
+        frame_len > 1514)
+    {
+        fprintf(stderr, "frame length must be between %u and 1514\n",
+                (unsigned int) (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8 +
+                                sizeof(struct tg_payload)));
+        exit(1);
+    }
+
+    if ((g_fd = vns_connect(server, port)) < 0 || vns_open(host, key_path) != 0)
+    {
+        exit(1);
+    }
+
+    if (dst_spec != 0 && rate > 0)
+    {
+        if (parse_dsts(dst_spec, ip_config) != 0)
+        {
+            exit(1);
+        }
+        for (i = 0; i < g_ndsts; i++)
+        {
+            if ((g_dsts[i].ip & g_mask) == (g_ip & g_mask))
+            {
+                g_dsts[i].next_hop = g_dsts[i].ip;
+            }
+            else if (gw.s_addr != 0)
+            {
+                g_dsts[i].next_hop = gw.s_addr;
+            }
+            else
+            {
+                fprintf(stderr, "%s is not on-link: give the gateway with -g\n",
+                        inet_ntoa(*(struct in_addr*) &g_dsts[i].ip));
+                exit(1);
+            }
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    srand48(getpid() ^ now_ns());
+
+    start = now_ns();
+    next_send = start;
+    next_arp = start;
+    next_report = interval > 0 ? start + (uint64_t) (interval * 1e9) : ~0ULL;
+    if (duration > 0)
+    {
+        end = start + (uint64_t) (duration * 1e9);
+    }
+
+    while (!g_stop)
+    {
+        struct pollfd pfd;
+        struct timespec ts;
+        uint64_t now = now_ns(), wake = next_report;
+        int burst = 0;
+
+        if (end != 0 && now >= end)
+        {
+            break;
+        }
+        if (count != 0 && sent >= count && end == 0)
+        {
+            /* con -n y sin -t, esperar un segundo las respuestas y salir */
+            end = now + 1000000000ULL;
+        }
+
+        /* primero resolver los next hop, reintentando cada segundo */
+        if (g_ndsts > 0 && !resolved)
+        {
+            resolved = 1;
+            for (i = 0; i < g_ndsts; i++)
+            {
+                resolved &= g_dsts[i].resolved;
+            }
+            if (!resolved && now >= next_arp)
+            {
+                for (i = 0; i < g_ndsts; i++)
+                {
+                    if (!g_dsts[i].resolved)
+                    {
+                        send_arp(arp_op_request, 0, g_dsts[i].next_hop);
+                    }
+                }
+                next_arp = now + 1000000000ULL;
+            }
+            if (resolved)
+            {
+                /* la medicion arranca cuando se puede enviar */
+                next_send = now;
+            }
+        }
+
+        /* lazo abierto: se envia todo lo que ya tendria que haber salido,
+           aunque la vuelta anterior se haya atrasado */
+        while (resolved && (count == 0 || sent < count) && next_send <= now &&
+               burst < TG_MAX_BURST)
+        {
+            struct tg_dst* dst = &g_dsts[lrand48() % g_ndsts];
+
+            send_probe(dst, pick_kind(weight, total_weight), frame_len);
+            sent++;
+            burst++;
+            next_send += (uint64_t) (1e9 * (poisson ? -log(1.0 - drand48()) : 1.0) / rate);
+        }
+        if (out_flush() != 0)
+        {
+            break;
+        }
+
+        if (now >= next_report)
+        {
+            print_flows(0, interval);
+            next_report += (uint64_t) (interval * 1e9);
+        }
+
+        if (resolved && (count == 0 || sent < count) && next_send < wake)
+        {
+            wake = next_send;
+        }
+        if (!resolved && g_ndsts > 0 && next_arp < wake)
+        {
+            wake = next_arp;
+        }
+        if (end != 0 && end < wake)
+        {
+            wake = end;
+        }
+        now = now_ns();
+        if (burst == TG_MAX_BURST || wake <= now)
+        {
+            ts.tv_sec = 0;
+            ts.tv_nsec = 0;
+        }
+        else
+        {
+            ts.tv_sec = (wake - now) / 1000000000ULL;
+            ts.tv_nsec = (wake - now) % 1000000000ULL;
+        }
+
+        pfd.fd = g_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (ppoll(&pfd, 1, wake == ~0ULL ? 0 : &ts, 0) < 0 && errno != EINTR)
+        {
+            perror("ppoll");
+            break;
+        }
+        if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && read_frames() != 0)
+        {
+            break;
+        }
+        if (out_flush() != 0)
+        {
+            break;
+        }
+    }
+
+    print_summary((now_ns() - start) / 1e9);
+    close(g_fd);
+    return 0;
+}
@@ -5,8 +5,29 @@
 #include "pwospf_protocol.h"
 #include "sr_utils.h"
 
-
-uint16_t cksum (const void *_data, int len) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SR_CKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+
+/*---------------------------------------------------------------------
+ * Checksum de Internet (RFC 1071)
+ *
+ * cksum_ref es la implementacion original, que suma de a un par de bytes
+ * en orden de red. Se mantiene como referencia para verificar y medir las
+ * versiones optimizadas.
+ *
+ * cksum_wide suma de a palabras de 32 bits en orden nativo sobre un
+ * acumulador de 64 bits y recien pliega los acarreos al final. La suma en
+ * complemento a uno no depende del orden de los bytes (RFC 1071, 2.(B)),
+ * por lo que el resultado plegado ya queda en network byte order.
+ *
+ * cksum_avx2 hace lo mismo con registros de 256 bits. cksum() elige la
+ * version a usar en tiempo de ejecucion segun el largo y la CPU.
+ *---------------------------------------------------------------------*/
+
+uint16_t cksum_ref (const void *_data, int len) {
   const uint8_t *data = _data;
   uint32_t sum;
 
@@ -20,6 +41,136 @@ uint16_t cksum (const void *_data, int len) {
   return sum ? sum : 0xffff;
 }
 
+/* Suma los ultimos bytes (menos de 4) y pliega el acumulador a 16 bits */
+static uint16_t cksum_finish (uint64_t sum, const uint8_t *data, int len) {
+  uint16_t word;
+  uint8_t tail[2];
+
+  if (len >= 2) {
+    memcpy(&word, data, 2);
+    sum += word;
+    data += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    /* El byte impar se completa con un cero a su derecha */
+    tail[0] = data[0];
+    tail[1] = 0;
+    memcpy(&word, tail, 2);
+    sum += word;
+  }
+
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+
+  word = ~sum;
+  return word ? word : 0xffff;
+}
+
+uint16_t cksum_wide (const void *_data, int len) {
+  const uint8_t *data = _data;
+  uint64_t sum = 0;
+  uint32_t w[8];
+
+  /* Bloques de 32 bytes: memcpy evita problemas de alineacion y el
+     compilador lo transforma en cargas directas */
+  while (len >= 32) {
+    memcpy(w, data, 32);
+    sum += (uint64_t) w[0] + w[1] + w[2] + w[3];
+    sum += (uint64_t) w[4] + w[5] + w[6] + w[7];
+    data += 32;
+    len -= 32;
+  }
+  while (len >= 4) {
+    memcpy(w, data, 4);
+    sum += w[0];
+    data += 4;
+    len -= 4;
+  }
+
+  return cksum_finish(sum, data, len);
+}
+
+#ifdef SR_CKSUM_X86
+
+__attribute__ ((target ("avx2")))
+uint16_t cksum_avx2 (const void *_data, int len) {
+  const uint8_t *data = _data;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  uint64_t lanes[4];
+  uint64_t sum;
+
+  /* Cada palabra de 32 bits se extiende a 64 bits antes de sumar, asi los
+     acarreos se acumulan en la parte alta de cada carril */
+  while (len >= 64) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *) data);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *) (data + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    data += 64;
+    len -= 64;
+  }
+  if (len >= 32) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *) data);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    data += 32;
+    len -= 32;
+  }
+
+  _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  while (len >= 4) {
+    uint32_t w;
+    memcpy(&w, data, 4);
+    sum += w;
+    data += 4;
+    len -= 4;
+  }
+
+  return cksum_finish(sum, data, len);
+}
+
+int cksum_avx2_supported (void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+
+#else
+
+uint16_t cksum_avx2 (const void *_data, int len) {
+  return cksum_wide(_data, len);
+}
+
+int cksum_avx2_supported (void) {
+  return 0;
+}
+
+#endif /* SR_CKSUM_X86 */
+
+/* Version elegida para paquetes largos. Se resuelve en la primera llamada;
+   si dos hilos la resuelven a la vez ambos escriben el mismo valor. */
+static uint16_t (*cksum_long_impl)(const void *, int) = NULL;
+
+uint16_t cksum (const void *_data, int len) {
+  /* Para cabezales IP, ICMP y OSPF cortos no vale la pena usar AVX2 */
+  if (len < CKSUM_AVX2_MIN_LEN)
+    return cksum_wide(_data, len);
+
+  if (cksum_long_impl == NULL)
+    cksum_long_impl = cksum_avx2_supported() ? cksum_avx2 : cksum_wide;
+
+  return cksum_long_impl(_data, len);
+}
+
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len) {
     uint16_t currChksum, calcChksum;
 
@@ -64,68 +215,6 @@ uint32_t ospfv2_cksum (ospfv2_hdr_t *ospfv2Hdr, int len) {
     return calcChksum;
 }
 
-int is_packet_valid(uint8_t *packet /* lent */,
-    unsigned int len) {
-
-  int cumulative_sz = sizeof(sr_ethernet_hdr_t);
-  sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *) packet;
-    
-  printf("*** -> Perform validation on the packet.\n");
-
-  if (eHdr->ether_type == htons(ethertype_arp)) {
-    printf("**** -> Validate ARP packet.\n");
-    cumulative_sz += sizeof(sr_arp_hdr_t);
-    if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
-      return 1;
-    }
-  } else if (eHdr->ether_type == htons(ethertype_ip)) {
-    printf("**** -> Validate IP packet.\n");
-    sr_ip_hdr_t *ipHdr = (sr_ip_hdr_t *) (packet + cumulative_sz);
-    cumulative_sz += sizeof(sr_ip_hdr_t);
-
-    if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
-      if (ip_cksum(ipHdr, sizeof(sr_ip_hdr_t)) == ipHdr->ip_sum) {
-        printf("***** -> IP packet checksum is correct.\n");
-        if (ipHdr->ip_p == ip_protocol_icmp) {
-          printf("***** -> IP packet is ICMP packet. Validate ICMP packet.\n");
-          int icmpOffset = cumulative_sz;
-          sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *) (packet + cumulative_sz);
-          cumulative_sz += sizeof(sr_icmp_hdr_t);
-
-          if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
-            if (icmp_cksum(icmpHdr, len - icmpOffset) == icmpHdr->icmp_sum) {
-              printf("****** -> ICMP packet checksum is correct.\n");
-              return 1;
-            }
-          }
-        } else if (ipHdr->ip_p == ip_protocol_ospfv2) {
-          printf("***** -> IP packet is OSPF packet. Validate OSPF packet.\n");
-          int ospfOffset = cumulative_sz;
-          ospfv2_hdr_t *ospfHdr = (ospfv2_hdr_t *) (packet + cumulative_sz);
-          cumulative_sz += sizeof(ospfv2_hdr_t);
-
-          if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
-            if (ospfv2_cksum(ospfHdr, len - ospfOffset) == ospfHdr->csum) {
-              printf("****** -> OSPF packet checksum is correct.\n");
-              return 1;
-            }
-          }
-        } else {
-          /* TODO */
-          printf("***** -> IP packet is of unknown protocol. No further validation is required.\n");
-	        return 1;
-        }
-      }
-    }
-  }
-  printf("*** -> Packet validation complete. Packet is INVALID.\n");
-  return 0;
-}
-
 /* Helper function for sr_arp_request_send to generate
    broadcast MAC address. */ 
 uint8_t *generate_ethernet_addr(uint8_t x) {
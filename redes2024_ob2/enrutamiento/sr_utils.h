@@ -30,12 +30,19 @@
 
 #include "pwospf_protocol.h"
 
+/* A partir de este largo (en bytes) cksum() usa la version AVX2 si la CPU
+   la soporta */
+#define CKSUM_AVX2_MIN_LEN 128
+
 uint16_t cksum(const void *_data, int len);
+uint16_t cksum_ref(const void *_data, int len);
+uint16_t cksum_wide(const void *_data, int len);
+uint16_t cksum_avx2(const void *_data, int len);
+int cksum_avx2_supported(void);
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len);
 uint32_t icmp_cksum (sr_icmp_hdr_t *icmpHdr, int len);
 uint32_t icmp3_cksum(sr_icmp_t3_hdr_t *icmp3_hdr, int len);
 uint32_t ospfv2_cksum(ospfv2_hdr_t *ospfv2_hdr, int len);
-int is_packet_valid(uint8_t *, unsigned int);
 uint8_t *generate_ethernet_addr(uint8_t);
 
 uint16_t ethertype(uint8_t *buf);
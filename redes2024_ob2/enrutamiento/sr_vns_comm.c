@@ -23,6 +23,8 @@
  *
  *---------------------------------------------------------------------------*/
 
+#define SR_LOG_SUBSYS sr_sub_vns
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -32,24 +34,27 @@
 #include <errno.h>
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sched.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_parse.h"
+#include "sr_capture.h"
+#include "sr_flightrec.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
-static int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                                  uint8_t * packet /* lent */,
-                                  unsigned int len,
-                                  char* interface  /* lent */);
+static void sr_log_packet(struct sr_instance* , uint8_t* , int , const char* , int );
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
+static int sr_connect_to_unix_server(struct sr_instance* sr, const char* path);
+static int sr_open_session(struct sr_instance* sr);
 
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
@@ -77,17 +82,16 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
                          char* server)
 {
     struct hostent *hp;
-    c_open command;
-    c_open_template ot;
-    char* buf;
-    uint32_t buf_len;
 
     /* REQUIRES */
     assert(sr);
     assert(server);
 
-    /* purify UMR be gone ! */
-    memset((void*)&command,0,sizeof(c_open));
+    /* a path (e.g. ./vns.sock from sr_vnsd -u) is a local unix socket */
+    if (strchr(server, '/') != 0)
+    {
+        return sr_connect_to_unix_server(sr, server);
+    }
 
     /* zero out server address struct */
     memset(&(sr->sr_addr),0,sizeof(struct sockaddr_in));
@@ -121,6 +125,62 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         return -1;
     }
 
+    return sr_open_session(sr);
+} /* -- sr_connect_to_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_connect_to_unix_server()
+ * Scope: Local
+ *
+ * Connect to a local server (sr_vnsd) through a unix socket
+ *
+ *---------------------------------------------------------------------------*/
+static int sr_connect_to_unix_server(struct sr_instance* sr, const char* path)
+{
+    struct sockaddr_un sun;
+
+    if (strlen(path) >= sizeof(sun.sun_path))
+    {
+        fprintf(stderr, "unix socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+
+    if ((sr->sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_client.c::sr_connect_to_unix_server(..)");
+        return -1;
+    }
+
+    if (connect(sr->sockfd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+    {
+        perror("connect(..):sr_client.c::sr_connect_to_unix_server(..)");
+        close(sr->sockfd);
+        return -1;
+    }
+
+    return sr_open_session(sr);
+} /* -- sr_connect_to_unix_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_open_session()
+ * Scope: Local
+ *
+ * Authenticate and open the virtual host once connected
+ *
+ *---------------------------------------------------------------------------*/
+static int sr_open_session(struct sr_instance* sr)
+{
+    c_open command;
+    c_open_template ot;
+    char* buf;
+    uint32_t buf_len;
+
+    /* purify UMR be gone ! */
+    memset((void*)&command,0,sizeof(c_open));
+
     /* wait for authentication to be completed (server sends the first message) */
     if(sr_read_from_server_expect(sr, VNS_AUTH_REQUEST)!= 1 ||
        sr_read_from_server_expect(sr, VNS_AUTH_STATUS) != 1)
@@ -160,7 +220,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
             return -1; /* needed to get the rtable */
 
     return 0;
-} /* -- sr_connect_to_server -- */
+} /* -- sr_open_session -- */
 
 
 
@@ -337,6 +397,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     int command, len;
     unsigned char *buf = 0;
     c_packet_ethernet_header* sr_pkt = 0;
+    struct sr_pkt_desc desc;
     int ret = 0, bytes_read = 0;
 
     /* REQUIRES */
@@ -427,24 +488,29 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
 
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
+            /* -- parse and validate the frame once, handlers use the descriptor -- */
+            sr_parse_packet(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
+                    (char*)(buf + sizeof(c_base)), &desc);
 
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
+            /* -- log packet, unless it is an ARP to another router -- */
+            if ( desc.verdict != sr_pkt_arp_not_for_us )
+            {
+                sr_log_packet(sr, buf + sizeof(c_packet_header),
+                        ntohl(sr_pkt->mLen) - sizeof(c_packet_header),
+                        (char*)(buf + sizeof(c_base)), sr_capture_in);
+            }
 
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
+            /* -- pass to router, student's code should take over here
+                  (invalid frames are dropped there, after the flight
+                  recorder saw them) -- */
+            sr_handle_parsed_packet(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+                    &desc);
 
             break;
 
@@ -470,6 +536,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
         case VNSHWINFO:
             sr_handle_hwinfo(sr,(c_hwinfo*)buf);
+            if(sr->capture)
+            { sr_capture_set_interfaces(sr->capture, sr->if_list); }
             if(sr_verify_routing_table(sr) != 0)
             {
                 /*fprintf(stderr,"Routing table not consistent with hardware\n");
@@ -552,15 +620,15 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 } /* -- sr_ether_addrs_match_interface -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_send_packet(..)
- * Scope: Global
+ * Method: send_packet(..)
+ * Scope: Local
  *
  * Send a packet (ethernet header included!) of length 'len' to the server
  * to be injected onto the wire.
  *
  *---------------------------------------------------------------------------*/
 
-int sr_send_packet(struct sr_instance* sr /* borrowed */,
+static int send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
                          const char* iface /* borrowed */)
@@ -585,12 +653,21 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     assert(sr_pkt);
     sr_pkt->mLen  = htonl(total_len);
     sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
+    strncpy(sr_pkt->mInterfaceName,iface,sizeof(sr_pkt->mInterfaceName) - 1);
+    sr_pkt->mInterfaceName[sizeof(sr_pkt->mInterfaceName) - 1] = '\0';
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
     /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
+    sr_log_packet(sr,buf,len,iface,sr_capture_out);
+
+    /* -- flight recorder (received frames are recorded by the router) -- */
+    if(sr->flightrec)
+    {
+        struct sr_if* if_rec = sr_get_interface(sr, iface);
+        sr_flightrec_tx(sr->flightrec, buf, len,
+                if_rec ? if_rec->index : SR_CAPTURE_IF_UNKNOWN);
+    }
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
@@ -607,62 +684,72 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     free(sr_pkt);
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- send_packet -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_log_packet()
- * Scope: Local
+ * Method: sr_send_packet(..)
+ * Scope: Global
+ *
+ * Any thread may send. Each sender counts itself in sr->senders before
+ * checking sr->stopping, and sr_stop_senders does the reverse, so either
+ * the sender sees stopping or sr_stop_senders waits for it.
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+int sr_send_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed */)
 {
-    struct pcap_pkthdr h;
-    int size;
+    int ret = -1;
 
-    /* REQUIRES */
-    assert(sr);
-
-    if(!sr->logfile)
-    {return; }
+    __atomic_add_fetch(&sr->senders, 1, __ATOMIC_SEQ_CST);
+    if(!__atomic_load_n(&sr->stopping, __ATOMIC_SEQ_CST))
+    { ret = send_packet(sr, buf, len, iface); }
+    __atomic_sub_fetch(&sr->senders, 1, __ATOMIC_RELEASE);
 
-    size = min(PACKET_DUMP_SIZE, len);
+    return ret;
+} /* -- sr_send_packet -- */
 
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
+/*-----------------------------------------------------------------------------
+ * Method: sr_stop_senders(..)
+ * Scope: Global
+ *
+ * Makes every later sr_send_packet a no-op and waits for the ones in
+ * progress, so the capture and the flight recorder can be closed.
+ *
+ *---------------------------------------------------------------------------*/
 
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
-} /* -- sr_log_packet -- */
+void sr_stop_senders(struct sr_instance* sr)
+{
+    __atomic_store_n(&sr->stopping, 1, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&sr->senders, __ATOMIC_SEQ_CST) != 0)
+    { sched_yield(); }
+} /* -- sr_stop_senders -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_arp_req_not_for_us()
+ * Method: sr_log_packet()
  * Scope: Local
  *
  *---------------------------------------------------------------------------*/
 
-int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                           uint8_t * packet /* lent */,
-                           unsigned int len,
-                           char* interface  /* lent */)
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   const char* iface, int dir)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
-    struct sr_ethernet_hdr* e_hdr = 0;
-    struct sr_arp_hdr*       a_hdr = 0;
+    struct sr_if* if_rec;
 
-    if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr) )
-    { return 0; }
-
-    assert(iface);
+    /* REQUIRES */
+    assert(sr);
 
-    e_hdr = (struct sr_ethernet_hdr*)packet;
-    a_hdr = (struct sr_arp_hdr*)(packet + sizeof(struct sr_ethernet_hdr));
+    if(!sr->capture)
+    {return; }
 
-    if ( (e_hdr->ether_type == htons(ethertype_arp)) &&
-            (a_hdr->ar_op      == htons(arp_op_request))   &&
-            (a_hdr->ar_tip     != iface->ip ) )
-    { return 1; }
+    /* -- el filtro se evalua antes de buscar la interfaz y copiar -- */
+    if(!sr_capture_match(sr->capture, buf, len, iface, dir))
+    {return; }
 
-    return 0;
-} /* -- sr_arp_req_not_for_us -- */
+    /* -- solo encola una copia, el disco lo maneja el hilo de sr_capture.c -- */
+    if_rec = sr_get_interface(sr, iface);
+    sr_capture_packet(sr->capture, buf, len,
+            if_rec ? if_rec->index : SR_CAPTURE_IF_UNKNOWN, dir);
+} /* -- sr_log_packet -- */
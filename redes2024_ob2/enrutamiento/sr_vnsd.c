@@ -0,0 +1,1080 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vnsd.c
+ *
+ * Descripción:
+ *
+ * Servidor VNS local, en reemplazo de POX (pox_module/pwospf/srhandler.py)
+ * y Mininet para pruebas de integracion y de carga. Habla el protocolo de
+ * vnscommand.h con varios procesos ./sr a la vez, por TCP (loopback por
+ * defecto) o por un socket Unix:
+ *
+ *   - al conectarse cada cliente recibe VNS_AUTH_REQUEST con una sal al
+ *     azar y responde con el SHA1 de sal + auth_key (sha1.c). Con -k se
+ *     verifica contra ese archivo; sin -k se acepta a cualquiera, como POX.
+ *   - con VNSOPEN el cliente elige un host de la topologia (opcion -v de
+ *     ./sr) y recibe VNSHWINFO con sus interfaces.
+ *   - cada VNSPACKET que envia un cliente por una interfaz se entrega como
+ *     VNSPACKET, con el nombre de la interfaz de destino, a los demas
+ *     extremos del mismo enlace. Si el otro extremo no esta conectado la
+ *     trama se descarta (un cable sin nadie del otro lado).
+ *
+ * Todo corre en un solo hilo con poll(); las colas de salida son por
+ * cliente y si una supera VNSD_MAX_QUEUE las tramas hacia ese cliente se
+ * descartan en vez de frenar a los demas.
+ *
+ * Uso: ./sr_vnsd [-p puerto] [-b direccion] [-u socket] [-k auth_key]
+ *                [-i segundos] [-d] topologia
+ *
+ * Topologia, una directiva por linea ('#' comenta):
+ *
+ *   host  NOMBRE                     host virtual (router o no)
+ *   iface HOST IFACE MAC IP MASCARA  interfaz de un host
+ *   link  HOST:IFACE HOST:IFACE ...  enlace; con mas de dos extremos es
+ *                                    un segmento compartido (hub)
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sha1.h"
+#include "vnscommand.h"
+
+#define VNSD_DEFAULT_PORT  8888
+#define VNSD_MAX_HOSTS     64
+#define VNSD_MAX_IFACES    16
+#define VNSD_MAX_LINKS     256
+#define VNSD_MAX_LINK_ENDS 16
+#define VNSD_MAX_CONNS     128
+#define VNSD_IFNAMELEN     16        /* c_packet_header.mInterfaceName */
+#define VNSD_MAX_MSG       10000     /* el cliente rechaza mensajes mayores */
+#define VNSD_IN_BUF        65536
+#define VNSD_MAX_QUEUE     (1 << 20) /* bytes pendientes por cliente */
+#define VNSD_SALT_LEN      20
+#define VNSD_AUTH_KEY_LEN  64        /* como AUTH_KEY_LEN en sr_vns_comm.c */
+#define VNSD_SHA1_LEN      20
+#define VNSD_SPEED         100
+
+struct vnsd_host;
+struct vnsd_link;
+
+struct vnsd_if
+{
+    char name[VNSD_IFNAMELEN];
+    uint8_t mac[6];
+    uint32_t ip;                     /* orden de red */
+    uint32_t mask;                   /* orden de red */
+    struct vnsd_host* host;
+    struct vnsd_link* link;
+
+    uint64_t out_frames;             /* enviadas por el cliente por esta interfaz */
+    uint64_t out_bytes;
+    uint64_t in_frames;              /* entregadas al cliente por esta interfaz */
+    uint64_t in_bytes;
+    uint64_t drop_down;              /* el otro extremo no esta conectado */
+    uint64_t drop_queue;             /* la cola del otro extremo estaba llena */
+};
+
+struct vnsd_link
+{
+    struct vnsd_if* ends[VNSD_MAX_LINK_ENDS];
+    int nends;
+};
+
+struct vnsd_conn;
+
+struct vnsd_host
+{
+    char name[IDSIZE];
+    struct vnsd_if ifs[VNSD_MAX_IFACES];
+    int nifs;
+    struct vnsd_conn* conn;          /* 0 si ningun cliente lo abrio */
+};
+
+enum vnsd_state
+{
+    vnsd_st_auth,                    /* se envio la sal, falta la respuesta */
+    vnsd_st_authed,                  /* falta VNSOPEN */
+    vnsd_st_open,                    /* intercambiando tramas */
+    vnsd_st_closing                  /* cerrar cuando se vacie la cola */
+};
+
+struct vnsd_conn
+{
+    int fd;
+    enum vnsd_state state;
+    char peer[64];
+    struct vnsd_host* host;
+    uint8_t salt[VNSD_SALT_LEN];
+
+    uint8_t* in;                     /* mensajes a medio leer */
+    unsigned int in_len;
+
+    uint8_t* out;                    /* cola de salida */
+    unsigned int out_off;
+    unsigned int out_len;
+    unsigned int out_cap;
+};
+
+static struct vnsd_host g_hosts[VNSD_MAX_HOSTS];
+static int g_nhosts;
+static struct vnsd_link g_links[VNSD_MAX_LINKS];
+static int g_nlinks;
+
+static struct vnsd_conn* g_conns[VNSD_MAX_CONNS];
+static int g_nconns;
+
+static char g_auth_key[VNSD_AUTH_KEY_LEN + 1];
+static int g_check_auth;
+static int g_debug;
+static uint64_t g_unknown_iface;     /* VNSPACKET por una interfaz que no existe */
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    g_stop = 1;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Format: %s [-p port] [-b address] [-u unix socket] [-k auth_key]\n"
+                    "          [-i stats interval] [-d] topology\n", argv0);
+}
+
+static int parse_mac(const char* s, uint8_t* mac)
+{
+    unsigned int b[6];
+    int i;
+
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+    {
+        return -1;
+    }
+    for (i = 0; i < 6; i++)
+    {
+        mac[i] = b[i];
+    }
+    return 0;
+}
+
+static struct vnsd_host* find_host(const char* name)
+{
+    int i;
+
+    for (i = 0; i < g_nhosts; i++)
+    {
+        if (strcmp(g_hosts[i].name, name) == 0)
+        {
+            return &g_hosts[i];
+        }
+    }
+    return 0;
+}
+
+static struct vnsd_if* find_if(struct vnsd_host* host, const char* name)
+{
+    int i;
+
+    for (i = 0; i < host->nifs; i++)
+    {
+        if (strncmp(host->ifs[i].name, name, VNSD_IFNAMELEN) == 0)
+        {
+            return &host->ifs[i];
+        }
+    }
+    return 0;
+}
+
+/* "HOST:IFACE" */
+static struct vnsd_if* find_end(char* spec)
+{
+    char* colon = strchr(spec, ':');
+    struct vnsd_host* host;
+
+    if (colon == 0)
+    {
+        return 0;
+    }
+    *colon = 0;
+    host = find_host(spec);
+    *colon = ':';
+    return host ? find_if(host, colon + 1) : 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: load_topology
+ *
+ * Lee las directivas del archivo de topologia. Retorna 0 si todas son
+ * validas.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int load_topology(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    char line[1024];
+    int lineno = 0;
+
+    if (fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != 0)
+    {
+        char* w[2 + VNSD_MAX_LINK_ENDS];
+        char* save = 0;
+        char* tok;
+        char* hash = strchr(line, '#');
+        int n = 0;
+
+        lineno++;
+        if (hash != 0)
+        {
+            *hash = 0;
+        }
+        for (tok = strtok_r(line, " \t\r\n", &save); tok != 0 && n < 2 + VNSD_MAX_LINK_ENDS;
+             tok = strtok_r(0, " \t\r\n", &save))
+        {
+            w[n++] = tok;
+        }
+        if (n == 0)
+        {
+            continue;
+        }
+
+        if (strcmp(w[0], "host") == 0 && n == 2)
+        {
+            struct vnsd_host* host;
+
+            if (g_nhosts == VNSD_MAX_HOSTS || strlen(w[1]) >= IDSIZE || find_host(w[1]) != 0)
+            {
+                goto bad;
+            }
+            host = &g_hosts[g_nhosts++];
+            strcpy(host->name, w[1]);
+        }
+        else if (strcmp(w[0], "iface") == 0 && n == 6)
+        {
+            struct vnsd_host* host = find_host(w[1]);
+            struct vnsd_if* iface;
+            struct in_addr ip, mask;
+
+            if (host == 0 || host->nifs == VNSD_MAX_IFACES || strlen(w[2]) >= VNSD_IFNAMELEN ||
+                find_if(host, w[2]) != 0)
+            {
+                goto bad;
+            }
+            iface = &host->ifs[host->nifs];
+            if (parse_mac(w[3], iface->mac) != 0 || inet_aton(w[4], &ip) == 0 ||
+                inet_aton(w[5], &mask) == 0)
+            {
+                goto bad;
+            }
+            strcpy(iface->name, w[2]);
+            iface->ip = ip.s_addr;
+            iface->mask = mask.s_addr;
+            iface->host = host;
+            host->nifs++;
+        }
+        else if (strcmp(w[0], "link") == 0 && n >= 3 && n - 1 <= VNSD_MAX_LINK_ENDS)
+        {
+            struct vnsd_link* link;
+            int i;
+
+            if (g_nlinks == VNSD_MAX_LINKS)
+            {
+                goto bad;
+            }
+            link = &g_links[g_nlinks];
+            for (i = 1; i < n; i++)
+            {
+                struct vnsd_if* end = find_end(w[i]);
+
+                if (end == 0 || end->link != 0)
+                {
+                    fprintf(stderr, "%s:%d: %s does not exist or is already linked\n",
+                            path, lineno, w[i]);
+                    goto fail;
+                }
+                end->link = link;
+                link->ends[link->nends++] = end;
+            }
+            g_nlinks++;
+        }
+        else
+        {
+            goto bad;
+        }
+    }
+    fclose(fp);
+
+    if (g_nhosts == 0)
+    {
+        fprintf(stderr, "%s: no hosts\n", path);
+        return -1;
+    }
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: invalid directive\n", path, lineno);
+fail:
+    fclose(fp);
+    return -1;
+}
+
+static int load_auth_key(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+
+    if (fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fgets(g_auth_key, sizeof(g_auth_key), fp) != g_auth_key ||
+        strlen(g_auth_key) < VNSD_AUTH_KEY_LEN)
+    {
+        fprintf(stderr, "%s: the key must be %d characters long\n", path, VNSD_AUTH_KEY_LEN);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    g_check_auth = 1;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Cola de salida
+ *---------------------------------------------------------------------------*/
+
+/* Agrega un mensaje a la cola del cliente. Retorna -1 si no entra. */
+static int conn_queue(struct vnsd_conn* c, const void* buf, unsigned int len)
+{
+    if (c->out_len - c->out_off + len > VNSD_MAX_QUEUE)
+    {
+        return -1;
+    }
+    if (c->out_len + len > c->out_cap)
+    {
+        /* primero compactar, y si no alcanza agrandar */
+        memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+        if (c->out_len + len > c->out_cap)
+        {
+            unsigned int cap = c->out_cap ? c->out_cap : 4096;
+            uint8_t* out;
+
+            while (cap < c->out_len + len)
+            {
+                cap *= 2;
+            }
+            if ((out = realloc(c->out, cap)) == 0)
+            {
+                return -1;
+            }
+            c->out = out;
+            c->out_cap = cap;
+        }
+    }
+    memcpy(c->out + c->out_len, buf, len);
+    c->out_len += len;
+    return 0;
+}
+
+/* Escribe lo que se pueda sin bloquear. Retorna -1 si el cliente se fue. */
+static int conn_flush(struct vnsd_conn* c)
+{
+    while (c->out_off < c->out_len)
+    {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->out_off += n;
+    }
+    c->out_off = c->out_len = 0;
+    return 0;
+}
+
+static void conn_send_close(struct vnsd_conn* c, const char* reason)
+{
+    c_close msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.mLen = htonl(sizeof(msg));
+    msg.mType = htonl(VNSCLOSE);
+    strncpy(msg.mErrorMessage, reason, sizeof(msg.mErrorMessage) - 1);
+    conn_queue(c, &msg, sizeof(msg));
+    c->state = vnsd_st_closing;
+    fprintf(stderr, "%s: closing: %s\n", c->peer, reason);
+}
+
+static void conn_send_auth_status(struct vnsd_conn* c, int ok, const char* text)
+{
+    uint8_t buf[sizeof(c_auth_status) + 128];
+    c_auth_status* st = (c_auth_status*) buf;
+    unsigned int len = sizeof(c_auth_status) + strlen(text) + 1;
+
+    st->mLen = htonl(len);
+    st->mType = htonl(VNS_AUTH_STATUS);
+    st->auth_ok = ok;
+    strcpy(st->msg, text);
+    conn_queue(c, buf, len);
+}
+
+static void conn_send_hwinfo(struct vnsd_conn* c)
+{
+    c_hwinfo msg;
+    struct vnsd_host* host = c->host;
+    int n = 0;
+    int i;
+
+    memset(&msg, 0, sizeof(msg));
+    /* mismo orden que POX: las claves que siguen a HWINTERFACE se aplican
+       a la ultima interfaz agregada (sr_handle_hwinfo) */
+    for (i = 0; i < host->nifs; i++)
+    {
+        struct vnsd_if* iface = &host->ifs[i];
+        uint32_t v;
+
+        msg.mHWInfo[n].mKey = htonl(HWINTERFACE);
+        memcpy(msg.mHWInfo[n++].value, iface->name, VNSD_IFNAMELEN);
+        msg.mHWInfo[n].mKey = htonl(HWSPEED);
+        v = htonl(VNSD_SPEED);
+        memcpy(msg.mHWInfo[n++].value, &v, 4);
+        msg.mHWInfo[n].mKey = htonl(HWSUBNET);
+        v = iface->ip & iface->mask;
+        memcpy(msg.mHWInfo[n++].value, &v, 4);
+        msg.mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(msg.mHWInfo[n++].value, iface->mac, 6);
+        msg.mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(msg.mHWInfo[n++].value, &iface->ip, 4);
+        msg.mHWInfo[n].mKey = htonl(HWMASK);
+        memcpy(msg.mHWInfo[n++].value, &iface->mask, 4);
+    }
+    msg.mLen = htonl(2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+    msg.mType = htonl(VNSHWINFO);
+    conn_queue(c, &msg, ntohl(msg.mLen));
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: relay_packet
+ *
+ * Entrega la trama que el cliente envio por iface a los demas extremos
+ * del enlace, reescribiendo el nombre de la interfaz en el cabezal.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void relay_packet(struct vnsd_if* iface, const uint8_t* frame, unsigned int len)
+{
+    struct vnsd_link* link = iface->link;
+    c_packet_header hdr;
+    int i;
+
+    iface->out_frames++;
+    iface->out_bytes += len;
+    if (link == 0)
+    {
+        iface->drop_down++;
+        return;
+    }
+
+    for (i = 0; i < link->nends; i++)
+    {
+        struct vnsd_if* end = link->ends[i];
+        struct vnsd_conn* c = end->host->conn;
+
+        if (end == iface)
+        {
+            continue;
+        }
+        if (c == 0 || c->state != vnsd_st_open)
+        {
+            iface->drop_down++;
+            continue;
+        }
+        if (c->out_len - c->out_off + sizeof(hdr) + len > VNSD_MAX_QUEUE)
+        {
+            iface->drop_queue++;
+            continue;
+        }
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.mLen = htonl(sizeof(hdr) + len);
+        hdr.mType = htonl(VNSPACKET);
+        memcpy(hdr.mInterfaceName, end->name, VNSD_IFNAMELEN);
+        if (conn_queue(c, &hdr, sizeof(hdr)) != 0 || conn_queue(c, frame, len) != 0)
+        {
+            iface->drop_queue++;
+            continue;
+        }
+        end->in_frames++;
+        end->in_bytes += len;
+
+        if (g_debug)
+        {
+            fprintf(stderr, "%s:%s -> %s:%s %u bytes\n", iface->host->name, iface->name,
+                    end->host->name, end->name, len);
+        }
+    }
+}
+
+static void handle_auth_reply(struct vnsd_conn* c, const uint8_t* buf, unsigned int len)
+{
+    const c_auth_reply* ar = (const c_auth_reply*) buf;
+    uint32_t ulen;
+    SHA1Context sha1;
+    int i;
+
+    /* el largo se chequea antes de restar, que es sin signo */
+    if (len < sizeof(*ar) + VNSD_SHA1_LEN ||
+        (ulen = ntohl(ar->usernameLen)) != len - sizeof(*ar) - VNSD_SHA1_LEN)
+    {
+        conn_send_close(c, "malformed authentication reply");
+        return;
+    }
+
+    if (g_check_auth)
+    {
+        /* lo mismo que calcula sr_handle_auth_request */
+        SHA1Reset(&sha1);
+        SHA1Input(&sha1, c->salt, VNSD_SALT_LEN);
+        SHA1Input(&sha1, (unsigned char*) g_auth_key, VNSD_AUTH_KEY_LEN);
+        if (!SHA1Result(&sha1))
+        {
+            conn_send_close(c, "SHA1 result could not be computed");
+            return;
+        }
+        for (i = 0; i < 5; i++)
+        {
+            sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]);
+        }
+        if (memcmp(ar->username + ulen, sha1.Message_Digest, VNSD_SHA1_LEN) != 0)
+        {
+            conn_send_auth_status(c, 0, "bad key");
+            c->state = vnsd_st_closing;
+            fprintf(stderr, "%s: authentication failed\n", c->peer);
+            return;
+        }
+    }
+
+    conn_send_auth_status(c, 1, "authenticated");
+    c->state = vnsd_st_authed;
+}
+
+static void handle_open(struct vnsd_conn* c, const uint8_t* buf, unsigned int len)
+{
+    const c_open* op = (const c_open*) buf;
+    char name[IDSIZE + 1];
+    struct vnsd_host* host;
+
+    if (len < sizeof(*op))
+    {
+        conn_send_close(c, "malformed open");
+        return;
+    }
+    memcpy(name, op->mVirtualHostID, IDSIZE);
+    name[IDSIZE] = 0;
+
+    if ((host = find_host(name)) == 0)
+    {
+        conn_send_close(c, "no such virtual host in the topology");
+        return;
+    }
+    if (host->conn != 0)
+    {
+        conn_send_close(c, "virtual host already in use");
+        return;
+    }
+
+    host->conn = c;
+    c->host = host;
+    c->state = vnsd_st_open;
+    conn_send_hwinfo(c);
+    fprintf(stderr, "%s: opened %s (%d interfaces)\n", c->peer, host->name, host->nifs);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: handle_message
+ *
+ * Atiende un mensaje completo del cliente. buf tiene el cabezal en orden
+ * de red.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void handle_message(struct vnsd_conn* c, const uint8_t* buf, unsigned int len)
+{
+    uint32_t type = ntohl(((const c_base*) buf)->mType);
+
+    if (c->state == vnsd_st_closing)
+    {
+        return;
+    }
+
+    switch (type)
+    {
+        case VNS_AUTH_REPLY:
+            if (c->state != vnsd_st_auth)
+            {
+                conn_send_close(c, "unexpected authentication reply");
+                break;
+            }
+            handle_auth_reply(c, buf, len);
+            break;
+
+        case VNSOPEN:
+            if (c->state != vnsd_st_authed)
+            {
+                conn_send_close(c, "open before authentication");
+                break;
+            }
+            handle_open(c, buf, len);
+            break;
+
+        case VNS_OPEN_TEMPLATE:
+            conn_send_close(c, "templates are not supported");
+            break;
+
+        case VNSPACKET:
+        {
+            const c_packet_header* ph = (const c_packet_header*) buf;
+            struct vnsd_if* iface;
+
+            if (c->state != vnsd_st_open || len < sizeof(*ph))
+            {
+                break;
+            }
+            if ((iface = find_if(c->host, ph->mInterfaceName)) == 0)
+            {
+                g_unknown_iface++;
+                break;
+            }
+            relay_packet(iface, buf + sizeof(*ph), len - sizeof(*ph));
+            break;
+        }
+
+        case VNSCLOSE:
+            c->state = vnsd_st_closing;
+            break;
+
+        default:
+            if (g_debug)
+            {
+                fprintf(stderr, "%s: unknown command %u\n", c->peer, type);
+            }
+            break;
+    }
+}
+
+/* Lee lo disponible y atiende los mensajes completos. Retorna -1 si hay
+   que cerrar la conexion. */
+static int conn_read(struct vnsd_conn* c)
+{
+    unsigned int off = 0;
+    ssize_t n;
+
+    n = recv(c->fd, c->in + c->in_len, VNSD_IN_BUF - c->in_len, 0);
+    if (n < 0)
+    {
+        return (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    if (n == 0)
+    {
+        return -1;
+    }
+    c->in_len += n;
+
+    while (c->in_len - off >= sizeof(c_base))
+    {
+        uint32_t len;
+
+        memcpy(&len, c->in + off, sizeof(len));
+        len = ntohl(len);
+        if (len < sizeof(c_base) || len > VNSD_MAX_MSG)
+        {
+            fprintf(stderr, "%s: bad message length %u\n", c->peer, len);
+            return -1;
+        }
+        if (c->in_len - off < len)
+        {
+            break;
+        }
+        handle_message(c, c->in + off, len);
+        off += len;
+    }
+    memmove(c->in, c->in + off, c->in_len - off);
+    c->in_len -= off;
+    return 0;
+}
+
+static void random_salt(uint8_t* salt)
+{
+    int fd = open("/dev/urandom", O_RDONLY);
+    int i;
+
+    if (fd < 0 || read(fd, salt, VNSD_SALT_LEN) != VNSD_SALT_LEN)
+    {
+        for (i = 0; i < VNSD_SALT_LEN; i++)
+        {
+            salt[i] = rand();
+        }
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+static void conn_accept(int lfd, int is_unix)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    struct vnsd_conn* c;
+    uint8_t buf[sizeof(c_auth_request) + VNSD_SALT_LEN];
+    c_auth_request* req = (c_auth_request*) buf;
+    int fd, one = 1;
+
+    if ((fd = accept(lfd, (struct sockaddr*) &addr, &alen)) < 0)
+    {
+        perror("accept");
+        return;
+    }
+    if (g_nconns == VNSD_MAX_CONNS)
+    {
+        fprintf(stderr, "too many clients\n");
+        close(fd);
+        return;
+    }
+    if ((c = calloc(1, sizeof(*c))) == 0 || (c->in = malloc(VNSD_IN_BUF)) == 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        free(c);
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (is_unix)
+    {
+        snprintf(c->peer, sizeof(c->peer), "unix:%d", fd);
+    }
+    else
+    {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        snprintf(c->peer, sizeof(c->peer), "%s:%u", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    }
+    c->fd = fd;
+    c->state = vnsd_st_auth;
+    g_conns[g_nconns++] = c;
+
+    /* el cliente espera que el servidor hable primero */
+    random_salt(c->salt);
+    req->mLen = htonl(sizeof(buf));
+    req->mType = htonl(VNS_AUTH_REQUEST);
+    memcpy(req->salt, c->salt, VNSD_SALT_LEN);
+    conn_queue(c, buf, sizeof(buf));
+}
+
+static void conn_free(int i)
+{
+    struct vnsd_conn* c = g_conns[i];
+
+    if (c->host != 0)
+    {
+        fprintf(stderr, "%s: %s disconnected\n", c->peer, c->host->name);
+        c->host->conn = 0;
+    }
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+    g_conns[i] = g_conns[--g_nconns];
+}
+
+static void print_stats(FILE* out)
+{
+    int h, i;
+
+    fprintf(out, "%-8s %-6s %-9s %12s %14s %12s %14s %10s %10s\n", "host", "iface", "state",
+            "sent", "sent bytes", "received", "recv bytes", "drop down", "drop queue");
+    for (h = 0; h < g_nhosts; h++)
+    {
+        struct vnsd_host* host = &g_hosts[h];
+
+        for (i = 0; i < host->nifs; i++)
+        {
+            struct vnsd_if* iface = &host->ifs[i];
+
+            fprintf(out, "%-8s %-6s %-9s %12llu %14llu %12llu %14llu %10llu %10llu\n", host->name,
+                    iface->name, host->conn ? "connected" : "-",
+                    (unsigned long long) iface->out_frames, (unsigned long long) iface->out_bytes,
+                    (unsigned long long) iface->in_frames, (unsigned long long) iface->in_bytes,
+                    (unsigned long long) iface->drop_down, (unsigned long long) iface->drop_queue);
+        }
+    }
+    if (g_unknown_iface)
+    {
+        fprintf(out, "frames sent on unknown interfaces: %llu\n", (unsigned long long) g_unknown_iface);
+    }
+    fflush(out);
+}
+
+static int listen_tcp(const char* addr, unsigned short port)
+{
+    struct sockaddr_in sin;
+    int fd, one = 1;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    if (inet_aton(addr, &sin.sin_addr) == 0)
+    {
+        fprintf(stderr, "invalid address %s\n", addr);
+        return -1;
+    }
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*) &sin, sizeof(sin)) < 0 || listen(fd, 16) < 0)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_unix(const char* path)
+{
+    struct sockaddr_un sun;
+    int fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path))
+    {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &sun, sizeof(sun)) < 0 || listen(fd, 16) < 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv)
+{
+    const char* bind_addr = "127.0.0.1";
+    const char* unix_path = 0;
+    unsigned int port = VNSD_DEFAULT_PORT;
+    unsigned int interval = 0;
+    int tcp_fd = -1, unix_fd = -1;
+    time_t next_stats = 0;
+    struct sigaction sa;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "hp:b:u:k:i:d")) != EOF)
+    {
+        switch (c)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'b':
+                bind_addr = optarg;
+                break;
+            case 'u':
+                unix_path = optarg;
+                break;
+            case 'k':
+                if (load_auth_key(optarg) != 0)
+                {
+                    exit(1);
+                }
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 'd':
+                g_debug = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (load_topology(argv[optind]) != 0)
+    {
+        exit(1);
+    }
+
+    /* -p 0 deja solo el socket Unix */
+    if (port != 0 && (tcp_fd = listen_tcp(bind_addr, port)) < 0)
+    {
+        exit(1);
+    }
+    if (unix_path != 0 && (unix_fd = listen_unix(unix_path)) < 0)
+    {
+        exit(1);
+    }
+    if (tcp_fd < 0 && unix_fd < 0)
+    {
+        fprintf(stderr, "nothing to listen on\n");
+        exit(1);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (tcp_fd >= 0)
+    {
+        fprintf(stderr, "listening on %s:%u\n", bind_addr, port);
+    }
+    if (unix_fd >= 0)
+    {
+        fprintf(stderr, "listening on %s\n", unix_path);
+    }
+    if (interval)
+    {
+        next_stats = time(0) + interval;
+    }
+
+    while (!g_stop)
+    {
+        struct pollfd pfd[VNSD_MAX_CONNS + 2];
+        int nconns = g_nconns;
+        int npfd = 0;
+
+        for (i = 0; i < nconns; i++)
+        {
+            pfd[npfd].fd = g_conns[i]->fd;
+            pfd[npfd].events = POLLIN;
+            if (g_conns[i]->out_off < g_conns[i]->out_len)
+            {
+                pfd[npfd].events |= POLLOUT;
+            }
+            pfd[npfd++].revents = 0;
+        }
+        pfd[npfd].fd = tcp_fd;
+        pfd[npfd].events = POLLIN;
+        pfd[npfd++].revents = 0;
+        pfd[npfd].fd = unix_fd;
+        pfd[npfd].events = POLLIN;
+        pfd[npfd++].revents = 0;
+
+        if (poll(pfd, npfd, interval ? 1000 : -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        for (i = 0; i < nconns; i++)
+        {
+            if ((pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) && conn_read(g_conns[i]) != 0)
+            {
+                g_conns[i]->state = vnsd_st_closing;
+                g_conns[i]->out_off = g_conns[i]->out_len = 0;
+            }
+        }
+
+        /* vaciar las colas (las tramas recien encoladas salen en esta vuelta)
+           y cerrar las conexiones terminadas; se recorre de atras para
+           adelante porque conn_free mueve la ultima a la posicion i */
+        for (i = g_nconns - 1; i >= 0; i--)
+        {
+            struct vnsd_conn* cn = g_conns[i];
+
+            if (conn_flush(cn) != 0 || (cn->state == vnsd_st_closing && cn->out_off == cn->out_len))
+            {
+                conn_free(i);
+            }
+        }
+
+        if (pfd[nconns].revents & POLLIN)
+        {
+            conn_accept(tcp_fd, 0);
+        }
+        if (pfd[nconns + 1].revents & POLLIN)
+        {
+            conn_accept(unix_fd, 1);
+        }
+
+        if (interval && time(0) >= next_stats)
+        {
+            print_stats(stderr);
+            next_stats = time(0) + interval;
+        }
+    }
+
+    print_stats(stdout);
+
+    while (g_nconns > 0)
+    {
+        conn_free(g_nconns - 1);
+    }
+    if (tcp_fd >= 0)
+    {
+        close(tcp_fd);
+    }
+    if (unix_fd >= 0)
+    {
+        close(unix_fd);
+        unlink(unix_path);
+    }
+    return 0;
+}